@@ -0,0 +1,497 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "transport.h"
+#include <windows.h>
+#include <cstring>
+
+/// <summary>
+/// The header of a capture file.
+/// The header is followed by the records, each one a CaptureRecord followed by its data padded to a multiple of 8 bytes.
+/// </summary>
+struct CaptureHeader
+{
+    enum : uint32_t
+    {
+        Magic = 0x43545356, // 'VSTC'
+        Version = 1,
+    };
+
+    uint32_t magic;
+    uint32_t version;
+
+    /// <summary>
+    /// The bytes used by the header and the records
+    /// </summary>
+    uint64_t size;
+
+    /// <summary>
+    /// The performance counter frequency and value at the start of the capture, the records are stamped relative to it
+    /// </summary>
+    int64_t frequency;
+    int64_t startTime;
+
+    /// <summary>
+    /// The number of records which did not fit into the capture file any more
+    /// </summary>
+    uint32_t dropped;
+
+    /// <summary>
+    /// The platform of the VST host, 32 or 64
+    /// </summary>
+    uint32_t platform;
+
+    /// <summary>
+    /// The VSTi the session was captured with
+    /// </summary>
+    wchar_t pluginPath[MAX_PATH];
+};
+
+struct CaptureRecord
+{
+    enum : uint32_t
+    {
+        /// <summary>
+        /// Sent by the VST driver to the VST host
+        /// </summary>
+        Sent = 0,
+        /// <summary>
+        /// Received by the VST driver from the VST host
+        /// </summary>
+        Received = 1,
+    };
+
+    uint32_t direction;
+    uint32_t size;
+
+    /// <summary>
+    /// The performance counter ticks since the start of the capture
+    /// </summary>
+    int64_t time;
+};
+
+/// <summary>
+/// A capture of the traffic between the VST driver and the VST host in a preallocated, memory-mapped file.
+/// Appending a record is a copy into the mapping, nothing is written to the disk until the capture is closed.
+/// </summary>
+class CaptureLog
+{
+private:
+    HANDLE hFile = NULL;
+    HANDLE hMapping = NULL;
+    CaptureHeader* header = NULL;
+    uint64_t capacity = 0;
+
+    /// <summary>
+    /// true for a created capture file, false for a replayed one
+    /// </summary>
+    bool writable = false;
+
+    /// <summary>
+    /// The position of the next record to read
+    /// </summary>
+    uint64_t readPosition = 0;
+
+    static uint32_t GetPaddedSize(uint32_t size)
+    {
+        return (size + 7) & ~7u;
+    }
+
+    static int64_t GetTicks()
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return counter.QuadPart;
+    }
+
+    bool Map(DWORD protect, DWORD access)
+    {
+        ULARGE_INTEGER mappingSize;
+        mappingSize.QuadPart = capacity;
+
+        hMapping = CreateFileMapping(hFile, NULL, protect, mappingSize.HighPart, mappingSize.LowPart, NULL);
+        if (!hMapping)
+        {
+            Close();
+            return false;
+        }
+
+        header = (CaptureHeader*)MapViewOfFile(hMapping, access, 0, 0, (SIZE_T)capacity);
+        if (!header)
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+public:
+    ~CaptureLog()
+    {
+        Close();
+    }
+
+    /// <summary>
+    /// Create the capture file and allocate all of it up front
+    /// </summary>
+    /// <param name="path">The path of the capture file</param>
+    /// <param name="bytes">The size of the capture file</param>
+    /// <param name="pluginPath">The VSTi which is captured</param>
+    /// <param name="platform">The platform of the VST host, 32 or 64</param>
+    /// <returns>true on success</returns>
+    bool Create(const wchar_t* path, uint64_t bytes, const wchar_t* pluginPath, uint32_t platform)
+    {
+        Close();
+
+        if (bytes < sizeof(CaptureHeader))
+        {
+            return false;
+        }
+
+        hFile = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            hFile = NULL;
+            return false;
+        }
+
+        capacity = bytes;
+        writable = true;
+        if (!Map(PAGE_READWRITE, FILE_MAP_WRITE))
+        {
+            return false;
+        }
+
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+
+        header->magic = CaptureHeader::Magic;
+        header->version = CaptureHeader::Version;
+        header->size = sizeof(CaptureHeader);
+        header->frequency = frequency.QuadPart;
+        header->startTime = GetTicks();
+        header->dropped = 0;
+        header->platform = platform;
+        wcsncpy_s(header->pluginPath, pluginPath, _TRUNCATE);
+
+        return true;
+    }
+
+    /// <summary>
+    /// Open a capture file for replay
+    /// </summary>
+    /// <param name="path">The path of the capture file</param>
+    /// <returns>true on success</returns>
+    bool Open(const wchar_t* path)
+    {
+        Close();
+
+        hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            hFile = NULL;
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize) || (uint64_t)fileSize.QuadPart < sizeof(CaptureHeader))
+        {
+            Close();
+            return false;
+        }
+
+        capacity = fileSize.QuadPart;
+        if (!Map(PAGE_READONLY, FILE_MAP_READ))
+        {
+            return false;
+        }
+
+        if (header->magic != CaptureHeader::Magic || header->version != CaptureHeader::Version || header->size > capacity)
+        {
+            Close();
+            return false;
+        }
+
+        readPosition = sizeof(CaptureHeader);
+
+        return true;
+    }
+
+    /// <summary>
+    /// Close the capture, a created capture file is cut to the used size
+    /// </summary>
+    void Close()
+    {
+        bool truncate = false;
+        LARGE_INTEGER used = {};
+
+        if (header)
+        {
+            truncate = writable && header->size < capacity;
+            used.QuadPart = header->size;
+
+            UnmapViewOfFile(header);
+            header = NULL;
+        }
+        if (hMapping)
+        {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+        }
+        if (hFile)
+        {
+            if (truncate && SetFilePointerEx(hFile, used, NULL, FILE_BEGIN))
+            {
+                SetEndOfFile(hFile);
+            }
+            CloseHandle(hFile);
+            hFile = NULL;
+        }
+        capacity = 0;
+        readPosition = 0;
+        writable = false;
+    }
+
+    bool IsOpen() const
+    {
+        return header != NULL;
+    }
+
+    const CaptureHeader* GetHeader() const
+    {
+        return header;
+    }
+
+    /// <summary>
+    /// Append a record, it is dropped when the capture file is full
+    /// </summary>
+    /// <param name="direction">CaptureRecord::Sent or CaptureRecord::Received</param>
+    /// <param name="data">The data</param>
+    /// <param name="size">The size of the data</param>
+    void Append(uint32_t direction, const void* data, uint32_t size)
+    {
+        if (!header)
+        {
+            return;
+        }
+
+        uint64_t recordSize = sizeof(CaptureRecord) + GetPaddedSize(size);
+        if (header->size + recordSize > capacity)
+        {
+            ++header->dropped;
+            return;
+        }
+
+        uint8_t* position = (uint8_t*)header + header->size;
+
+        CaptureRecord record;
+        record.direction = direction;
+        record.size = size;
+        record.time = GetTicks() - header->startTime;
+
+        memcpy(position, &record, sizeof(record));
+        memcpy(position + sizeof(record), data, size);
+
+        header->size += recordSize;
+    }
+
+    /// <summary>
+    /// Get the next record of an opened capture file
+    /// </summary>
+    /// <param name="record">The record</param>
+    /// <param name="data">Points to the data of the record in the mapping</param>
+    /// <returns>false at the end of the capture</returns>
+    bool Next(CaptureRecord& record, const uint8_t*& data)
+    {
+        if (!header || readPosition + sizeof(CaptureRecord) > header->size)
+        {
+            return false;
+        }
+
+        const uint8_t* position = (const uint8_t*)header + readPosition;
+        memcpy(&record, position, sizeof(record));
+
+        uint64_t recordSize = sizeof(CaptureRecord) + GetPaddedSize(record.size);
+        if (readPosition + recordSize > header->size)
+        {
+            readPosition = header->size;
+            return false;
+        }
+
+        data = position + sizeof(record);
+        readPosition += recordSize;
+
+        return true;
+    }
+};
+
+/// <summary>
+/// Records the traffic of another transport in a CaptureLog
+/// </summary>
+class CaptureTransport : public Transport
+{
+private:
+    Transport* transport = NULL;
+    CaptureLog* log = NULL;
+
+public:
+    void Attach(Transport* transport, CaptureLog* log)
+    {
+        this->transport = transport;
+        this->log = log;
+    }
+
+    bool Connect(uint32_t timeout) override
+    {
+        return transport->Connect(timeout);
+    }
+
+    bool Send(const void* data, uint32_t size) override
+    {
+        if (!transport->Send(data, size))
+        {
+            return false;
+        }
+
+        log->Append(CaptureRecord::Sent, data, size);
+        return true;
+    }
+
+    uint32_t Receive(void* data, uint32_t size) override
+    {
+        uint32_t received = transport->Receive(data, size);
+        if (received)
+        {
+            log->Append(CaptureRecord::Received, data, received);
+        }
+        return received;
+    }
+
+    bool Wait(uint32_t timeout) override
+    {
+        return transport->Wait(timeout);
+    }
+
+    void Close() override
+    {
+        transport->Close();
+    }
+};
+
+/// <summary>
+/// Plays the traffic the VST driver sent in a captured session to the VST host, the replies of the VST host are discarded.
+/// At the original speed every record is delivered at the time it was captured, otherwise as fast as it is read.
+/// </summary>
+class ReplayTransport : public Transport
+{
+private:
+    CaptureLog* log = NULL;
+    bool originalSpeed = true;
+
+    int64_t frequency = 1;
+    int64_t startTime = 0;
+
+    const uint8_t* pending = NULL;
+    uint32_t pendingSize = 0;
+
+    /// <summary>
+    /// Find the next record sent by the VST driver and wait for its time
+    /// </summary>
+    bool NextSent()
+    {
+        CaptureRecord record;
+        const uint8_t* data;
+
+        do
+        {
+            if (!log->Next(record, data))
+            {
+                return false;
+            }
+        } while (record.direction != CaptureRecord::Sent || !record.size);
+
+        if (originalSpeed)
+        {
+            int64_t due = startTime + record.time * frequency / log->GetHeader()->frequency;
+            for (;;)
+            {
+                LARGE_INTEGER now;
+                QueryPerformanceCounter(&now);
+
+                int64_t remaining = (due - now.QuadPart) * 1000 / frequency;
+                if (remaining <= 0)
+                {
+                    break;
+                }
+
+                Sleep(remaining > 1 ? (DWORD)(remaining - 1) : 0);
+            }
+        }
+
+        pending = data;
+        pendingSize = record.size;
+
+        return true;
+    }
+
+public:
+    /// <summary>
+    /// Start the replay
+    /// </summary>
+    /// <param name="log">The opened capture</param>
+    /// <param name="originalSpeed">Deliver the records at the time they were captured</param>
+    void Open(CaptureLog* log, bool originalSpeed)
+    {
+        this->log = log;
+        this->originalSpeed = originalSpeed;
+
+        LARGE_INTEGER counter;
+        QueryPerformanceFrequency(&counter);
+        frequency = counter.QuadPart;
+        QueryPerformanceCounter(&counter);
+        startTime = counter.QuadPart;
+
+        pending = NULL;
+        pendingSize = 0;
+    }
+
+    bool Connect(uint32_t timeout) override
+    {
+        return log && log->IsOpen();
+    }
+
+    bool Send(const void* data, uint32_t size) override
+    {
+        return true;
+    }
+
+    uint32_t Receive(void* data, uint32_t size) override
+    {
+        if (!pendingSize && !NextSent())
+        {
+            return 0;
+        }
+
+        uint32_t count = size < pendingSize ? size : pendingSize;
+        memcpy(data, pending, count);
+        pending += count;
+        pendingSize -= count;
+
+        return count;
+    }
+
+    bool Wait(uint32_t timeout) override
+    {
+        return pendingSize || NextSent();
+    }
+
+    void Close() override
+    {
+        log = NULL;
+        pending = NULL;
+        pendingSize = 0;
+    }
+};
+
+#endif
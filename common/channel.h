@@ -0,0 +1,260 @@
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+#include "transport.h"
+#include <cstring>
+#include <vector>
+
+/// <summary>
+/// The I/O counters of a BufferedChannel
+/// </summary>
+struct ChannelStatistics
+{
+    /// <summary>
+    /// The number of Transport::Send calls
+    /// </summary>
+    uint64_t sendCalls;
+    /// <summary>
+    /// The number of Transport::Receive calls
+    /// </summary>
+    uint64_t receiveCalls;
+    uint64_t bytesSent;
+    uint64_t bytesReceived;
+    /// <summary>
+    /// The number of flushed messages, bytesSent / messagesSent is the average message size
+    /// </summary>
+    uint64_t messagesSent;
+};
+
+/// <summary>
+/// Buffers both directions of a Transport.
+/// Writes are staged and sent with one call per message when Flush is called,
+/// reads pull as much as is available and are served from memory.
+/// Pending writes are flushed before a read has to wait for the other side.
+/// </summary>
+class BufferedChannel
+{
+private:
+    enum : uint32_t
+    {
+        /// <summary>
+        /// Writes of at least this size bypass the staging buffer
+        /// </summary>
+        DirectWriteSize = 16384,
+        ReadBufferSize = 65536,
+    };
+
+    Transport* transport = NULL;
+
+    std::vector<uint8_t> writeBuffer;
+    std::vector<uint8_t> readBuffer;
+    uint32_t readPosition = 0;
+    uint32_t readEnd = 0;
+
+    bool failed = false;
+
+    /// <summary>
+    /// Flush the staged writes before a read waits, off when another thread writes to the channel
+    /// </summary>
+    bool flushBeforeRead = true;
+
+    ChannelStatistics statistics = {};
+
+    bool SendNow(const void* data, uint32_t size)
+    {
+        ++statistics.sendCalls;
+        if (!transport->Send(data, size))
+        {
+            failed = true;
+            return false;
+        }
+        statistics.bytesSent += size;
+        return true;
+    }
+
+    uint32_t ReceiveNow(void* data, uint32_t size)
+    {
+        ++statistics.receiveCalls;
+        uint32_t received = transport->Receive(data, size);
+        if (!received)
+        {
+            failed = true;
+        }
+        statistics.bytesReceived += received;
+        return received;
+    }
+
+public:
+    /// <summary>
+    /// Attach the channel to a transport and discard any buffered data
+    /// </summary>
+    /// <param name="transport">The transport</param>
+    /// <param name="flushBeforeRead">false if reads and writes happen on different threads, the writer has to Flush</param>
+    void Attach(Transport* transport, bool flushBeforeRead = true)
+    {
+        this->transport = transport;
+        this->flushBeforeRead = flushBeforeRead;
+        writeBuffer.clear();
+        readBuffer.resize(ReadBufferSize);
+        readPosition = 0;
+        readEnd = 0;
+        failed = false;
+    }
+
+    /// <summary>
+    /// false once a send or receive failed
+    /// </summary>
+    bool IsGood() const
+    {
+        return transport && !failed;
+    }
+
+    /// <summary>
+    /// Stage data, it is sent on the next Flush
+    /// </summary>
+    /// <param name="data">The data to send</param>
+    /// <param name="size">The size of the data</param>
+    /// <returns>false when the connection is broken</returns>
+    bool Write(const void* data, uint32_t size)
+    {
+        if (!IsGood())
+        {
+            return false;
+        }
+
+        if (size >= DirectWriteSize)
+        {
+            return Flush(false) && SendNow(data, size);
+        }
+
+        size_t position = writeBuffer.size();
+        writeBuffer.resize(position + size);
+        memcpy(&writeBuffer[position], data, size);
+        return true;
+    }
+
+    /// <summary>
+    /// Send the staged data with a single call
+    /// </summary>
+    /// <param name="endOfMessage">Count the flush as the end of a message</param>
+    /// <returns>false when the connection is broken</returns>
+    bool Flush(bool endOfMessage = true)
+    {
+        if (!IsGood())
+        {
+            return false;
+        }
+
+        if (endOfMessage)
+        {
+            ++statistics.messagesSent;
+        }
+
+        if (writeBuffer.empty())
+        {
+            return true;
+        }
+
+        bool sent = SendNow(writeBuffer.data(), (uint32_t)writeBuffer.size());
+        writeBuffer.clear();
+        return sent;
+    }
+
+    /// <summary>
+    /// Read exactly size bytes
+    /// </summary>
+    /// <param name="data">The received data</param>
+    /// <param name="size">The size of the data</param>
+    /// <returns>false when the connection is broken</returns>
+    bool Read(void* data, uint32_t size)
+    {
+        uint8_t* out = (uint8_t*)data;
+
+        while (size)
+        {
+            if (readPosition == readEnd)
+            {
+                /// The other side can only answer what it has received
+                if (flushBeforeRead && !writeBuffer.empty() && !Flush())
+                {
+                    return false;
+                }
+
+                if (!IsGood())
+                {
+                    return false;
+                }
+
+                readPosition = 0;
+                readEnd = 0;
+
+                /// Large payloads go straight to their destination
+                if (size >= ReadBufferSize)
+                {
+                    uint32_t received = ReceiveNow(out, size);
+                    if (!received)
+                    {
+                        return false;
+                    }
+                    out += received;
+                    size -= received;
+                    continue;
+                }
+
+                readEnd = ReceiveNow(readBuffer.data(), ReadBufferSize);
+                if (!readEnd)
+                {
+                    return false;
+                }
+            }
+
+            uint32_t count = readEnd - readPosition;
+            if (count > size)
+            {
+                count = size;
+            }
+
+            memcpy(out, &readBuffer[readPosition], count);
+            readPosition += count;
+            out += count;
+            size -= count;
+        }
+
+        return true;
+    }
+
+    /// <summary>
+    /// Wait until data can be read, the staged writes are flushed first
+    /// </summary>
+    /// <param name="timeout">The timeout in milliseconds</param>
+    /// <returns>true when data is available, false on timeout or when the connection is broken</returns>
+    bool Wait(uint32_t timeout)
+    {
+        if (readPosition != readEnd)
+        {
+            return true;
+        }
+
+        if (flushBeforeRead && !writeBuffer.empty() && !Flush())
+        {
+            return false;
+        }
+
+        return IsGood() && transport->Wait(timeout);
+    }
+
+    /// <summary>
+    /// Get the number of received bytes which are not read yet
+    /// </summary>
+    uint32_t GetBuffered() const
+    {
+        return readEnd - readPosition;
+    }
+
+    void GetStatistics(ChannelStatistics& out) const
+    {
+        out = statistics;
+    }
+};
+
+#endif
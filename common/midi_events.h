@@ -0,0 +1,426 @@
+#ifndef __MIDI_EVENTS_H__
+#define __MIDI_EVENTS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/// <summary>
+/// Called once a referenced System Exclusive message has been consumed by the VST host or discarded, its data may be reused then
+/// </summary>
+typedef void (*SysExRelease)(void* context);
+
+/// <summary>
+/// The MIDI events which are sent to the VST host along with a render request.
+/// Every event starts with a header word:
+///     bit 31      set for a System Exclusive message
+///     bits 24-30  the port
+///     bits 0-23   the short MIDI message, or the length of the System Exclusive message
+/// followed by the frame offset of the event within the render block (VstEvent::deltaFrames).
+/// A System Exclusive message is followed by its data, padded to a multiple of 4 bytes.
+/// The data of a referenced System Exclusive message stays in the buffer of the caller until the batch is written,
+/// only its header and offset are kept in the batch.
+/// </summary>
+class MidiEventBatch
+{
+private:
+    struct Reference
+    {
+        /// <summary>
+        /// The position of the header of the event in the buffer
+        /// </summary>
+        size_t position;
+        const uint8_t* data;
+        uint32_t length;
+        SysExRelease release;
+        void* context;
+    };
+
+    /// <summary>
+    /// An event which is taken by TakeBlock
+    /// </summary>
+    struct DueEvent
+    {
+        uint32_t offset;
+        size_t position;
+        size_t length;
+        size_t reference;
+    };
+
+    static const size_t NoReference = ~(size_t)0;
+
+    std::vector<uint8_t> buffer;
+    std::vector<Reference> references;
+    std::vector<DueEvent> due;
+
+    /// <summary>
+    /// The padded length of the referenced data
+    /// </summary>
+    uint32_t referencedSize = 0;
+
+    void AppendWord(uint32_t word)
+    {
+        size_t size = buffer.size();
+        buffer.resize(size + sizeof(word));
+        memcpy(&buffer[size], &word, sizeof(word));
+    }
+
+public:
+    enum : uint32_t
+    {
+        SysExFlag = 0x80000000,
+        PortMask = 0x7F000000,
+        PortShift = 24,
+        DataMask = 0x00FFFFFF,
+    };
+
+    static uint32_t GetPaddedLength(uint32_t length)
+    {
+        return (length + 3) & ~3u;
+    }
+
+    /// <summary>
+    /// Append a short MIDI message
+    /// </summary>
+    /// <param name="port">The port</param>
+    /// <param name="message">The MIDI message</param>
+    /// <param name="offset">The frame offset of the message</param>
+    void AppendMessage(uint32_t port, uint32_t message, uint32_t offset = 0)
+    {
+        AppendWord((message & DataMask) | ((port << PortShift) & PortMask));
+        AppendWord(offset);
+    }
+
+    /// <summary>
+    /// Append a MIDI System Exclusive message
+    /// </summary>
+    /// <param name="port">The port</param>
+    /// <param name="sysEx">The MIDI System Exclusive message</param>
+    /// <param name="length">The length of the MIDI System Exclusive message</param>
+    /// <param name="offset">The frame offset of the message</param>
+    void AppendSysEx(uint32_t port, const uint8_t* sysEx, uint32_t length, uint32_t offset = 0)
+    {
+        length &= DataMask;
+        AppendWord(SysExFlag | ((port << PortShift) & PortMask) | length);
+        AppendWord(offset);
+
+        size_t size = buffer.size();
+        buffer.resize(size + GetPaddedLength(length), 0);
+        memcpy(&buffer[size], sysEx, length);
+    }
+
+    /// <summary>
+    /// Append a MIDI System Exclusive message without copying it.
+    /// The data must stay valid until release is called, which happens when the batch is cleared.
+    /// </summary>
+    /// <param name="port">The port</param>
+    /// <param name="sysEx">The MIDI System Exclusive message</param>
+    /// <param name="length">The length of the MIDI System Exclusive message</param>
+    /// <param name="offset">The frame offset of the message</param>
+    /// <param name="release">Called with context once the message is not referenced anymore</param>
+    /// <param name="context">Passed to release</param>
+    void AppendSysExReference(uint32_t port, const uint8_t* sysEx, uint32_t length, uint32_t offset, SysExRelease release, void* context)
+    {
+        length &= DataMask;
+
+        Reference reference = { buffer.size(), sysEx, length, release, context };
+        references.push_back(reference);
+        referencedSize += GetPaddedLength(length);
+
+        AppendWord(SysExFlag | ((port << PortShift) & PortMask) | length);
+        AppendWord(offset);
+    }
+
+    /// <summary>
+    /// Move the events which are due within the next frames to block, in the order of their offsets.
+    /// The offsets of the remaining events are made relative to the end of the block.
+    /// </summary>
+    /// <param name="frames">The length of the block</param>
+    /// <param name="block">Receives the events of the block</param>
+    void TakeBlock(uint32_t frames, MidiEventBatch& block)
+    {
+        due.clear();
+
+        size_t reference = 0;
+        for (size_t position = 0; position + 2 * sizeof(uint32_t) <= buffer.size(); )
+        {
+            uint32_t header;
+            uint32_t offset;
+            memcpy(&header, &buffer[position], sizeof(header));
+            memcpy(&offset, &buffer[position + sizeof(header)], sizeof(offset));
+
+            bool referenced = reference < references.size() && references[reference].position == position;
+
+            size_t length = 2 * sizeof(uint32_t);
+            if ((header & SysExFlag) && !referenced)
+            {
+                length += GetPaddedLength(header & DataMask);
+            }
+
+            if (offset < frames)
+            {
+                DueEvent event = { offset, position, length, referenced ? reference : NoReference };
+
+                /// Events appended from different sources may be out of order, the VSTi expects them sorted.
+                /// Mostly they are in order already, the insertion does not move anything then.
+                size_t index = due.size();
+                due.push_back(event);
+                while (index && due[index - 1].offset > offset)
+                {
+                    due[index] = due[index - 1];
+                    --index;
+                }
+                due[index] = event;
+            }
+
+            if (referenced)
+            {
+                ++reference;
+            }
+
+            position += length;
+        }
+
+        for (const DueEvent& event : due)
+        {
+            if (event.reference != NoReference)
+            {
+                Reference moved = references[event.reference];
+                moved.position = block.buffer.size();
+                block.references.push_back(moved);
+
+                uint32_t padded = GetPaddedLength(moved.length);
+                block.referencedSize += padded;
+                referencedSize -= padded;
+            }
+
+            block.buffer.insert(block.buffer.end(), buffer.begin() + event.position, buffer.begin() + event.position + event.length);
+        }
+
+        if (due.empty())
+        {
+            Postpone(frames);
+            return;
+        }
+
+        size_t kept = 0;
+        size_t keptReferences = 0;
+        reference = 0;
+
+        for (size_t position = 0; position + 2 * sizeof(uint32_t) <= buffer.size(); )
+        {
+            uint32_t header;
+            uint32_t offset;
+            memcpy(&header, &buffer[position], sizeof(header));
+            memcpy(&offset, &buffer[position + sizeof(header)], sizeof(offset));
+
+            bool referenced = reference < references.size() && references[reference].position == position;
+
+            size_t length = 2 * sizeof(uint32_t);
+            if ((header & SysExFlag) && !referenced)
+            {
+                length += GetPaddedLength(header & DataMask);
+            }
+
+            if (offset >= frames)
+            {
+                if (referenced)
+                {
+                    references[keptReferences] = references[reference];
+                    references[keptReferences].position = kept;
+                    ++keptReferences;
+                }
+
+                offset -= frames;
+                memmove(&buffer[kept], &buffer[position], length);
+                memcpy(&buffer[kept + sizeof(header)], &offset, sizeof(offset));
+                kept += length;
+            }
+
+            if (referenced)
+            {
+                ++reference;
+            }
+
+            position += length;
+        }
+
+        buffer.resize(kept);
+        references.resize(keptReferences);
+    }
+
+    /// <summary>
+    /// Move the events by frames towards the start, the events which are due within the next frames become due at once.
+    /// Used when a block is not rendered, so its events go along with the next one.
+    /// </summary>
+    /// <param name="frames">The length of the block</param>
+    void Postpone(uint32_t frames)
+    {
+        size_t reference = 0;
+
+        for (size_t position = 0; position + 2 * sizeof(uint32_t) <= buffer.size(); )
+        {
+            uint32_t header;
+            uint32_t offset;
+            memcpy(&header, &buffer[position], sizeof(header));
+            memcpy(&offset, &buffer[position + sizeof(header)], sizeof(offset));
+
+            offset = offset > frames ? offset - frames : 0;
+            memcpy(&buffer[position + sizeof(header)], &offset, sizeof(offset));
+
+            bool referenced = reference < references.size() && references[reference].position == position;
+            if (referenced)
+            {
+                ++reference;
+            }
+
+            position += 2 * sizeof(uint32_t);
+            if ((header & SysExFlag) && !referenced)
+            {
+                position += GetPaddedLength(header & DataMask);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Remove the events, the referenced System Exclusive messages are released
+    /// </summary>
+    void Clear()
+    {
+        for (const Reference& reference : references)
+        {
+            reference.release(reference.context);
+        }
+
+        buffer.clear();
+        references.clear();
+        referencedSize = 0;
+    }
+
+    bool IsEmpty() const
+    {
+        return buffer.empty();
+    }
+
+    /// <summary>
+    /// Get the events in the wire format, only valid without referenced System Exclusive messages, see Write
+    /// </summary>
+    const uint8_t* GetData() const
+    {
+        return buffer.data();
+    }
+
+    /// <summary>
+    /// Get the size of the events in the wire format, including the referenced data
+    /// </summary>
+    uint32_t GetSize() const
+    {
+        return (uint32_t)buffer.size() + referencedSize;
+    }
+
+    /// <summary>
+    /// Write the events in the wire format as a sequence of pieces, the referenced data is passed on from the buffer of the caller
+    /// </summary>
+    /// <param name="write">Called as write(const void* data, uint32_t size) for every piece, returns false to stop</param>
+    /// <returns>false when write failed</returns>
+    template <class Write> bool WriteTo(Write write) const
+    {
+        static const uint8_t padding[4] = {};
+
+        size_t written = 0;
+
+        for (const Reference& reference : references)
+        {
+            size_t end = reference.position + 2 * sizeof(uint32_t);
+            if (!write(&buffer[written], (uint32_t)(end - written)))
+            {
+                return false;
+            }
+            written = end;
+
+            if (reference.length && !write(reference.data, reference.length))
+            {
+                return false;
+            }
+
+            uint32_t paddingLength = GetPaddedLength(reference.length) - reference.length;
+            if (paddingLength && !write(padding, paddingLength))
+            {
+                return false;
+            }
+        }
+
+        if (written < buffer.size())
+        {
+            return write(&buffer[written], (uint32_t)(buffer.size() - written));
+        }
+
+        return true;
+    }
+};
+
+/// <summary>
+/// Walks through the events of a received MidiEventBatch
+/// </summary>
+class MidiEventReader
+{
+private:
+    const uint8_t* position;
+    const uint8_t* end;
+
+public:
+    MidiEventReader(const uint8_t* data, uint32_t size)
+        : position(data), end(data + size)
+    {
+    }
+
+    /// <summary>
+    /// Get the next event
+    /// </summary>
+    /// <param name="port">The port</param>
+    /// <param name="message">The short MIDI message, 0 for a System Exclusive message</param>
+    /// <param name="sysEx">The MIDI System Exclusive message, NULL for a short MIDI message</param>
+    /// <param name="length">The length of the MIDI System Exclusive message</param>
+    /// <param name="offset">The frame offset of the event within the render block</param>
+    /// <returns>false when there are no more (complete) events</returns>
+    bool Next(uint32_t& port, uint32_t& message, const uint8_t*& sysEx, uint32_t& length, uint32_t& offset)
+    {
+        uint32_t header;
+        if (end - position < (ptrdiff_t)(sizeof(header) + sizeof(offset)))
+        {
+            return false;
+        }
+
+        memcpy(&header, position, sizeof(header));
+        position += sizeof(header);
+        memcpy(&offset, position, sizeof(offset));
+        position += sizeof(offset);
+
+        port = (header & MidiEventBatch::PortMask) >> MidiEventBatch::PortShift;
+
+        if (header & MidiEventBatch::SysExFlag)
+        {
+            length = header & MidiEventBatch::DataMask;
+            if ((uint32_t)(end - position) < MidiEventBatch::GetPaddedLength(length))
+            {
+                position = end;
+                return false;
+            }
+
+            message = 0;
+            sysEx = position;
+            position += MidiEventBatch::GetPaddedLength(length);
+        }
+        else
+        {
+            message = header & MidiEventBatch::DataMask;
+            sysEx = NULL;
+            length = 0;
+        }
+
+        return true;
+    }
+};
+
+#endif
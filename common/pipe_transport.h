@@ -0,0 +1,409 @@
+#ifndef __PIPE_TRANSPORT_H__
+#define __PIPE_TRANSPORT_H__
+
+#include "transport.h"
+#include <windows.h>
+#include <string>
+
+/// <summary>
+/// Transport over a pair of pipes.
+/// The VST driver creates the pipes and passes the child ends as stdin / stdout to the VST host,
+/// the VST host attaches to its stdin / stdout.
+/// </summary>
+class PipeTransport : public Transport
+{
+private:
+    HANDLE hInput = NULL;
+    HANDLE hOutput = NULL;
+    HANDLE hReadEvent = NULL;
+    HANDLE hWriteEvent = NULL;
+
+    /// <summary>
+    /// true on the VST driver side, the pipes are opened for overlapped I/O
+    /// </summary>
+    bool overlapped = false;
+
+    /// <summary>
+    /// The handles are closed by Close, unless they were attached
+    /// </summary>
+    bool ownsHandles = false;
+
+    /// <summary>
+    /// Dispatch window messages while waiting for the VST host, so the calling thread stays responsive
+    /// </summary>
+    bool pumpMessages = false;
+
+    static void ProcessPendingMessages()
+    {
+        MSG msg = {};
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+        {
+            DispatchMessage(&msg);
+        }
+    }
+
+    /// <summary>
+    /// Wait for an overlapped operation to complete
+    /// </summary>
+    bool WaitOverlapped(HANDLE hFile, OVERLAPPED& ol, DWORD& transferred)
+    {
+        DWORD state;
+        for (;;)
+        {
+            if (pumpMessages)
+            {
+                state = MsgWaitForMultipleObjects(1, &ol.hEvent, FALSE, INFINITE, QS_ALLEVENTS);
+                if (state == WAIT_OBJECT_0 + 1)
+                {
+                    ProcessPendingMessages();
+                    continue;
+                }
+            }
+            else
+            {
+                state = WaitForSingleObject(ol.hEvent, INFINITE);
+            }
+            break;
+        }
+
+        if (state == WAIT_OBJECT_0 && GetOverlappedResult(hFile, &ol, &transferred, TRUE))
+        {
+            return true;
+        }
+
+        CancelIo(hFile);
+        return false;
+    }
+
+    static bool CreateServerPipe(const std::wstring& name, DWORD openMode, DWORD access, SECURITY_ATTRIBUTES* saAttr, HANDLE& hServer, HANDLE& hClient)
+    {
+        HANDLE hPipe = CreateNamedPipe(name.c_str(), openMode | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, saAttr);
+        if (hPipe == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        hClient = CreateFile(name.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, saAttr, OPEN_EXISTING, 0, NULL);
+        if (hClient == INVALID_HANDLE_VALUE)
+        {
+            hClient = NULL;
+            CloseHandle(hPipe);
+            return false;
+        }
+
+        /// The server end must not be inherited by the VST host, otherwise the pipe does not break when it terminates
+        DuplicateHandle(GetCurrentProcess(), hPipe, GetCurrentProcess(), &hServer, 0, FALSE, DUPLICATE_SAME_ACCESS);
+        CloseHandle(hPipe);
+
+        return true;
+    }
+
+public:
+    ~PipeTransport()
+    {
+        Close();
+    }
+
+    /// <summary>
+    /// Create the pipes (VST driver side)
+    /// </summary>
+    /// <param name="inputName">The name of the pipe the VST host writes to</param>
+    /// <param name="outputName">The name of the pipe the VST host reads from</param>
+    /// <param name="hChildInput">Receives the inheritable stdin of the VST host</param>
+    /// <param name="hChildOutput">Receives the inheritable stdout of the VST host</param>
+    /// <returns>true on success</returns>
+    bool Create(const std::wstring& inputName, const std::wstring& outputName, HANDLE& hChildInput, HANDLE& hChildOutput)
+    {
+        Close();
+
+        hChildInput = NULL;
+        hChildOutput = NULL;
+
+        SECURITY_ATTRIBUTES saAttr{};
+        saAttr.nLength = sizeof(saAttr);
+        saAttr.bInheritHandle = TRUE;
+        saAttr.lpSecurityDescriptor = NULL;
+
+        overlapped = true;
+        ownsHandles = true;
+        pumpMessages = false;
+
+        hReadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        hWriteEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+        if (!hReadEvent || !hWriteEvent
+            || !CreateServerPipe(outputName, PIPE_ACCESS_OUTBOUND, GENERIC_READ, &saAttr, hOutput, hChildInput)
+            || !CreateServerPipe(inputName, PIPE_ACCESS_INBOUND, GENERIC_WRITE, &saAttr, hInput, hChildOutput))
+        {
+            if (hChildInput)
+            {
+                CloseHandle(hChildInput);
+                hChildInput = NULL;
+            }
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    /// <summary>
+    /// Create the pipes and let the VST host open them by name (VST driver side).
+    /// Nothing waits for window messages, the pipes are meant to be used by a worker thread.
+    /// </summary>
+    /// <param name="inputName">The name of the pipe the VST host writes to</param>
+    /// <param name="outputName">The name of the pipe the VST host reads from</param>
+    /// <returns>true on success</returns>
+    bool Listen(const std::wstring& inputName, const std::wstring& outputName)
+    {
+        Close();
+
+        overlapped = true;
+        ownsHandles = true;
+        pumpMessages = false;
+
+        hReadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        hWriteEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+        hOutput = CreateNamedPipe(outputName.c_str(), PIPE_ACCESS_OUTBOUND | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, NULL);
+        hInput = CreateNamedPipe(inputName.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, NULL);
+
+        if (hOutput == INVALID_HANDLE_VALUE)
+        {
+            hOutput = NULL;
+        }
+        if (hInput == INVALID_HANDLE_VALUE)
+        {
+            hInput = NULL;
+        }
+
+        if (!hReadEvent || !hWriteEvent || !hInput || !hOutput)
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    /// <summary>
+    /// Open the pipes created by Listen (VST host side)
+    /// </summary>
+    /// <param name="inputName">The name of the pipe to read from</param>
+    /// <param name="outputName">The name of the pipe to write to</param>
+    /// <returns>true on success</returns>
+    bool Open(const std::wstring& inputName, const std::wstring& outputName)
+    {
+        Close();
+
+        overlapped = false;
+        ownsHandles = true;
+        pumpMessages = false;
+
+        hInput = CreateFile(inputName.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+        hOutput = CreateFile(outputName.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+
+        if (hInput == INVALID_HANDLE_VALUE)
+        {
+            hInput = NULL;
+        }
+        if (hOutput == INVALID_HANDLE_VALUE)
+        {
+            hOutput = NULL;
+        }
+
+        if (!hInput || !hOutput)
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    /// <summary>
+    /// Attach to existing pipe handles (VST host side)
+    /// </summary>
+    /// <param name="hInput">The pipe to read from</param>
+    /// <param name="hOutput">The pipe to write to</param>
+    void Attach(HANDLE hInput, HANDLE hOutput)
+    {
+        Close();
+
+        this->hInput = hInput;
+        this->hOutput = hOutput;
+        overlapped = false;
+        ownsHandles = false;
+        pumpMessages = false;
+    }
+
+    /// <summary>
+    /// Dispatch window messages while waiting, for the requests of a thread which owns windows.
+    /// The audio thread must not pump, a window message handler could keep it from the next block.
+    /// </summary>
+    void SetPumpMessages(bool pumpMessages) noexcept
+    {
+        this->pumpMessages = pumpMessages;
+    }
+
+    bool Connect(uint32_t timeout) override
+    {
+        if (!overlapped)
+        {
+            return hInput && hOutput;
+        }
+
+        HANDLE handles[2] = { hInput, hOutput };
+        for (HANDLE hPipe : handles)
+        {
+            OVERLAPPED ol = {};
+            ol.hEvent = hReadEvent;
+            ResetEvent(hReadEvent);
+            if (!ConnectNamedPipe(hPipe, &ol))
+            {
+                DWORD error = GetLastError();
+                if (error == ERROR_PIPE_CONNECTED)
+                {
+                    continue;
+                }
+
+                if (error != ERROR_IO_PENDING || WaitForSingleObject(hReadEvent, timeout) != WAIT_OBJECT_0)
+                {
+                    CancelIo(hPipe);
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool Send(const void* data, uint32_t size) override
+    {
+        DWORD written;
+
+        if (!overlapped)
+        {
+            return WriteFile(hOutput, data, size, &written, NULL) && written == size;
+        }
+
+        OVERLAPPED ol = {};
+        ol.hEvent = hWriteEvent;
+        ResetEvent(hWriteEvent);
+        if (WriteFile(hOutput, data, size, &written, &ol))
+        {
+            return written == size;
+        }
+
+        return GetLastError() == ERROR_IO_PENDING && WaitOverlapped(hOutput, ol, written) && written == size;
+    }
+
+    uint32_t Receive(void* data, uint32_t size) override
+    {
+        DWORD received = 0;
+
+        if (!overlapped)
+        {
+            return ReadFile(hInput, data, size, &received, NULL) ? received : 0;
+        }
+
+        OVERLAPPED ol = {};
+        ol.hEvent = hReadEvent;
+        ResetEvent(hReadEvent);
+        if (ReadFile(hInput, data, size, &received, &ol))
+        {
+            return received;
+        }
+
+        if (GetLastError() != ERROR_IO_PENDING || !WaitOverlapped(hInput, ol, received))
+        {
+            return 0;
+        }
+
+        return received;
+    }
+
+    bool Wait(uint32_t timeout) override
+    {
+        DWORD start = GetTickCount();
+
+        if (overlapped && timeout)
+        {
+            /// A zero byte read completes when data arrives, without consuming it and without pumping messages
+            OVERLAPPED ol = {};
+            ol.hEvent = hReadEvent;
+            ResetEvent(hReadEvent);
+
+            DWORD received;
+            if (!ReadFile(hInput, NULL, 0, &received, &ol))
+            {
+                if (GetLastError() != ERROR_IO_PENDING)
+                {
+                    return false;
+                }
+
+                if (WaitForSingleObject(hReadEvent, timeout) != WAIT_OBJECT_0)
+                {
+                    CancelIo(hInput);
+                    GetOverlappedResult(hInput, &ol, &received, TRUE);
+                    return false;
+                }
+
+                if (!GetOverlappedResult(hInput, &ol, &received, FALSE))
+                {
+                    return false;
+                }
+            }
+        }
+
+        for (;;)
+        {
+            DWORD available = 0;
+            if (!PeekNamedPipe(hInput, NULL, 0, NULL, &available, NULL))
+            {
+                return false;
+            }
+
+            if (available)
+            {
+                return true;
+            }
+
+            if (GetTickCount() - start >= timeout)
+            {
+                return false;
+            }
+
+            Sleep(1);
+        }
+    }
+
+    void Close() override
+    {
+        if (ownsHandles)
+        {
+            if (hInput)
+            {
+                CloseHandle(hInput);
+            }
+            if (hOutput)
+            {
+                CloseHandle(hOutput);
+            }
+        }
+        if (hReadEvent)
+        {
+            CloseHandle(hReadEvent);
+            hReadEvent = NULL;
+        }
+        if (hWriteEvent)
+        {
+            CloseHandle(hWriteEvent);
+            hWriteEvent = NULL;
+        }
+        hInput = NULL;
+        hOutput = NULL;
+    }
+};
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef __SHARED_AUDIO_H__
+#define __SHARED_AUDIO_H__
+
+#include "shared_memory.h"
+#include <cstdint>
+
+/// <summary>
+/// The header of the shared audio ring.
+/// The header is followed by capacity interleaved frames of channels floats.
+/// Both positions are running frame counters, the ring index is position & (capacity - 1).
+/// </summary>
+struct SharedAudioHeader
+{
+    enum : uint32_t
+    {
+        Magic = 0x41545356, // 'VSTA'
+    };
+
+    uint32_t magic;
+    uint32_t capacity;
+    uint32_t channels;
+
+    /// <summary>
+    /// How long the VST host spins for the next render request, in microseconds
+    /// </summary>
+    uint32_t hostSpinMicroseconds;
+
+    /// <summary>
+    /// The number of frames written by the VST host
+    /// </summary>
+    alignas(64) volatile SharedCounter writePos;
+
+    /// <summary>
+    /// The number of frames consumed by the driver
+    /// </summary>
+    alignas(64) volatile SharedCounter readPos;
+
+    /// <summary>
+    /// The number of render requests sent by the driver
+    /// </summary>
+    alignas(64) volatile SharedCounter requestCount;
+
+    /// <summary>
+    /// The number of render replies sent by the VST host
+    /// </summary>
+    alignas(64) volatile SharedCounter replyCount;
+};
+
+/// <summary>
+/// Single producer / single consumer ring of rendered audio frames in shared memory.
+/// The VST host writes interleaved frames straight into the mapping, the driver reads them in place.
+/// </summary>
+class SharedAudioRing
+{
+private:
+    SharedMemory memory;
+    SharedAudioHeader* header = NULL;
+    float* frames = NULL;
+
+    static size_t GetMappingSize(uint32_t capacity, uint32_t channels)
+    {
+        return sizeof(SharedAudioHeader) + sizeof(float) * capacity * channels;
+    }
+
+    void Attach()
+    {
+        header = (SharedAudioHeader*)memory.Data();
+        frames = (float*)(header + 1);
+    }
+
+public:
+    /// <summary>
+    /// Create the ring (driver side)
+    /// </summary>
+    /// <param name="name">The name of the mapping</param>
+    /// <param name="capacity">The capacity in frames, must be a power of two</param>
+    /// <param name="channels">The number of interleaved channels</param>
+    /// <returns>true on success</returns>
+    bool Create(const wchar_t* name, uint32_t capacity, uint32_t channels)
+    {
+        if (!capacity || (capacity & (capacity - 1)) || !channels)
+        {
+            return false;
+        }
+
+        if (!memory.Create(name, GetMappingSize(capacity, channels)))
+        {
+            return false;
+        }
+
+        Attach();
+
+        header->capacity = capacity;
+        header->channels = channels;
+        header->hostSpinMicroseconds = 0;
+        header->writePos = 0;
+        header->readPos = 0;
+        header->requestCount = 0;
+        header->replyCount = 0;
+        SharedMemoryBarrier();
+        header->magic = SharedAudioHeader::Magic;
+
+        return true;
+    }
+
+    /// <summary>
+    /// Open the ring created by the driver (VST host side)
+    /// </summary>
+    /// <param name="name">The name of the mapping</param>
+    /// <returns>true on success</returns>
+    bool Open(const wchar_t* name)
+    {
+        if (!memory.Open(name, sizeof(SharedAudioHeader)))
+        {
+            return false;
+        }
+
+        SharedAudioHeader probe = *(SharedAudioHeader*)memory.Data();
+
+        if (probe.magic != SharedAudioHeader::Magic || !probe.capacity || (probe.capacity & (probe.capacity - 1)) || !probe.channels)
+        {
+            memory.Close();
+            return false;
+        }
+
+        if (!memory.Open(name, GetMappingSize(probe.capacity, probe.channels)))
+        {
+            return false;
+        }
+
+        Attach();
+
+        return true;
+    }
+
+    void Close()
+    {
+        memory.Close();
+        header = NULL;
+        frames = NULL;
+    }
+
+    bool IsOpen() const
+    {
+        return header != NULL;
+    }
+
+    uint32_t GetCapacity() const
+    {
+        return header ? header->capacity : 0;
+    }
+
+    uint32_t GetChannels() const
+    {
+        return header ? header->channels : 0;
+    }
+
+    uint32_t GetHostSpinMicroseconds() const
+    {
+        return header ? header->hostSpinMicroseconds : 0;
+    }
+
+    void SetHostSpinMicroseconds(uint32_t microseconds)
+    {
+        header->hostSpinMicroseconds = microseconds;
+    }
+
+    /// <summary>
+    /// Count a render request once it has been sent (driver side)
+    /// </summary>
+    /// <returns>The number of render requests sent</returns>
+    SharedCounter PublishRequest()
+    {
+        return SharedCounterIncrement(&header->requestCount);
+    }
+
+    /// <summary>
+    /// Count a render reply once it has been sent (VST host side)
+    /// </summary>
+    /// <returns>The number of render replies sent</returns>
+    SharedCounter PublishReply()
+    {
+        return SharedCounterIncrement(&header->replyCount);
+    }
+
+    const volatile SharedCounter* GetRequestCount() const
+    {
+        return &header->requestCount;
+    }
+
+    const volatile SharedCounter* GetReplyCount() const
+    {
+        return &header->replyCount;
+    }
+
+    /// <summary>
+    /// Get the number of frames which are written but not consumed yet
+    /// </summary>
+    uint32_t GetAvailable() const
+    {
+        return (uint32_t)header->writePos - (uint32_t)header->readPos;
+    }
+
+    /// <summary>
+    /// Write planar output buffers as interleaved frames (VST host side)
+    /// </summary>
+    /// <param name="planar">One buffer per channel</param>
+    /// <param name="count">The number of frames to write</param>
+    /// <returns>The number of frames written</returns>
+    uint32_t Write(float* const* planar, uint32_t count)
+    {
+        uint32_t space = header->capacity - GetAvailable();
+        if (count > space)
+        {
+            count = space;
+        }
+
+        const uint32_t mask = header->capacity - 1;
+        const uint32_t channels = header->channels;
+        uint32_t position = (uint32_t)header->writePos;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            float* out = frames + ((position + i) & mask) * channels;
+            for (uint32_t channel = 0; channel < channels; ++channel)
+            {
+                out[channel] = planar[channel][i];
+            }
+        }
+
+        /// Publish the frames only after they are written
+        SharedCounterStore(&header->writePos, (SharedCounter)(position + count));
+
+        return count;
+    }
+
+    /// <summary>
+    /// Read interleaved frames and scale them by the volume (driver side)
+    /// </summary>
+    /// <param name="out">The interleaved output buffer</param>
+    /// <param name="count">The number of frames to read</param>
+    /// <param name="volume">The volume to apply</param>
+    /// <returns>The number of frames read</returns>
+    uint32_t Read(float* out, uint32_t count, float volume)
+    {
+        SharedCounter written = SharedCounterLoad(&header->writePos);
+        uint32_t available = (uint32_t)written - (uint32_t)header->readPos;
+        if (count > available)
+        {
+            count = available;
+        }
+
+        const uint32_t mask = header->capacity - 1;
+        const uint32_t channels = header->channels;
+        uint32_t position = (uint32_t)header->readPos;
+
+        for (uint32_t i = 0; i < count; )
+        {
+            uint32_t index = (position + i) & mask;
+            uint32_t run = header->capacity - index;
+            if (run > count - i)
+            {
+                run = count - i;
+            }
+
+            const float* in = frames + index * channels;
+            for (uint32_t j = 0; j < run * channels; ++j)
+            {
+                *out++ = in[j] * volume;
+            }
+
+            i += run;
+        }
+
+        SharedCounterStore(&header->readPos, (SharedCounter)(position + count));
+
+        return count;
+    }
+
+    /// <summary>
+    /// Discard frames without reading them (driver side)
+    /// </summary>
+    /// <param name="count">The number of frames to discard</param>
+    /// <returns>The number of frames discarded</returns>
+    uint32_t Skip(uint32_t count)
+    {
+        uint32_t available = GetAvailable();
+        if (count > available)
+        {
+            count = available;
+        }
+
+        SharedCounterStore(&header->readPos, (SharedCounter)((uint32_t)header->readPos + count));
+
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef __SHARED_MEMORY_H__
+#define __SHARED_MEMORY_H__
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// A sequence counter shared between processes, it is only changed through the SharedCounter functions
+/// </summary>
+#ifdef _WIN32
+typedef LONG SharedCounter;
+#else
+typedef int32_t SharedCounter;
+#endif
+
+/// <summary>
+/// Increment a shared counter, the writes before it are visible to the process which sees the new value
+/// </summary>
+/// <returns>The incremented value</returns>
+inline SharedCounter SharedCounterIncrement(volatile SharedCounter* counter)
+{
+#ifdef _WIN32
+    return InterlockedIncrement(counter);
+#else
+    return __atomic_add_fetch(counter, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/// <summary>
+/// Read a shared counter, the writes published with the value are visible afterwards
+/// </summary>
+inline SharedCounter SharedCounterLoad(const volatile SharedCounter* counter)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchange((volatile SharedCounter*)counter, 0, 0);
+#else
+    return __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/// <summary>
+/// Publish a new value of a shared counter after the writes before it
+/// </summary>
+inline void SharedCounterStore(volatile SharedCounter* counter, SharedCounter value)
+{
+#ifdef _WIN32
+    InterlockedExchange(counter, value);
+#else
+    __atomic_store_n(counter, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/// <summary>
+/// Order the writes to shared memory before the following ones
+/// </summary>
+inline void SharedMemoryBarrier()
+{
+#ifdef _WIN32
+    MemoryBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+#ifdef _WIN32
+
+/// <summary>
+/// A named shared memory mapping backed by the paging file.
+/// The driver creates the mapping and the VST host opens it by name.
+/// </summary>
+class SharedMemory
+{
+private:
+    HANDLE hMapping = NULL;
+    void* view = NULL;
+    size_t size = 0;
+
+public:
+    ~SharedMemory()
+    {
+        Close();
+    }
+
+    /// <summary>
+    /// Create a new mapping
+    /// </summary>
+    /// <param name="name">The name of the mapping</param>
+    /// <param name="bytes">The size of the mapping in bytes</param>
+    /// <returns>true on success</returns>
+    bool Create(const wchar_t* name, size_t bytes)
+    {
+        Close();
+
+        ULARGE_INTEGER mappingSize;
+        mappingSize.QuadPart = bytes;
+
+        hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, mappingSize.HighPart, mappingSize.LowPart, name);
+        if (!hMapping || GetLastError() == ERROR_ALREADY_EXISTS)
+        {
+            Close();
+            return false;
+        }
+
+        return Map(bytes);
+    }
+
+    /// <summary>
+    /// Open an existing mapping
+    /// </summary>
+    /// <param name="name">The name of the mapping</param>
+    /// <param name="bytes">The size of the mapping in bytes</param>
+    /// <returns>true on success</returns>
+    bool Open(const wchar_t* name, size_t bytes)
+    {
+        Close();
+
+        hMapping = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, name);
+        if (!hMapping)
+        {
+            return false;
+        }
+
+        return Map(bytes);
+    }
+
+    void Close()
+    {
+        if (view)
+        {
+            UnmapViewOfFile(view);
+            view = NULL;
+        }
+        if (hMapping)
+        {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+        }
+        size = 0;
+    }
+
+    void* Data() const
+    {
+        return view;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+private:
+    bool Map(size_t bytes)
+    {
+        view = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+        if (!view)
+        {
+            Close();
+            return false;
+        }
+
+        size = bytes;
+        return true;
+    }
+};
+
+#else
+
+/// <summary>
+/// A named POSIX shared memory object.
+/// The driver creates the object and the VST host opens it by name, the creator removes the name again on Close.
+/// </summary>
+class SharedMemory
+{
+private:
+    int fd = -1;
+    void* view = NULL;
+    size_t size = 0;
+    std::string createdName;
+
+    /// <summary>
+    /// Turn a mapping name into a shared memory object name, which is a single path component
+    /// </summary>
+    static std::string GetObjectName(const wchar_t* name)
+    {
+        std::string objectName = "/";
+        for (; *name; ++name)
+        {
+            objectName += (*name == L'/' || *name == L'\\' || *name > 0x7F) ? '_' : (char)*name;
+        }
+        return objectName;
+    }
+
+public:
+    ~SharedMemory()
+    {
+        Close();
+    }
+
+    /// <summary>
+    /// Create a new shared memory object
+    /// </summary>
+    /// <param name="name">The name of the mapping</param>
+    /// <param name="bytes">The size of the mapping in bytes</param>
+    /// <returns>true on success</returns>
+    bool Create(const wchar_t* name, size_t bytes)
+    {
+        Close();
+
+        std::string objectName = GetObjectName(name);
+        fd = shm_open(objectName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+        {
+            return false;
+        }
+        createdName = objectName;
+
+        if (ftruncate(fd, (off_t)bytes))
+        {
+            Close();
+            return false;
+        }
+
+        return Map(bytes);
+    }
+
+    /// <summary>
+    /// Open an existing shared memory object
+    /// </summary>
+    /// <param name="name">The name of the mapping</param>
+    /// <param name="bytes">The size of the mapping in bytes</param>
+    /// <returns>true on success</returns>
+    bool Open(const wchar_t* name, size_t bytes)
+    {
+        Close();
+
+        fd = shm_open(GetObjectName(name).c_str(), O_RDWR, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat status;
+        if (fstat(fd, &status) || (size_t)status.st_size < bytes)
+        {
+            Close();
+            return false;
+        }
+
+        return Map(bytes);
+    }
+
+    void Close()
+    {
+        if (view)
+        {
+            munmap(view, size);
+            view = NULL;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        if (!createdName.empty())
+        {
+            shm_unlink(createdName.c_str());
+            createdName.clear();
+        }
+        size = 0;
+    }
+
+    void* Data() const
+    {
+        return view;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+private:
+    bool Map(size_t bytes)
+    {
+        void* mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+
+        view = mapped;
+        size = bytes;
+        return true;
+    }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef __SOCKET_TRANSPORT_H__
+#define __SOCKET_TRANSPORT_H__
+
+#include "transport.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/// <summary>
+/// Transport over a connected pair of sockets, the POSIX counterpart of PipeTransport.
+/// The VST driver creates the pair and passes the child end as stdin / stdout to the VST host,
+/// the VST host attaches to its stdin / stdout.
+/// </summary>
+class SocketTransport : public Transport
+{
+private:
+    int input = -1;
+    int output = -1;
+
+    /// <summary>
+    /// The sockets are closed by Close, unless they were attached
+    /// </summary>
+    bool ownsSockets = false;
+
+    /// <summary>
+    /// A broken connection fails the send instead of raising SIGPIPE
+    /// </summary>
+#ifdef MSG_NOSIGNAL
+    static const int SendFlags = MSG_NOSIGNAL;
+#else
+    static const int SendFlags = 0;
+#endif
+
+public:
+    ~SocketTransport()
+    {
+        Close();
+    }
+
+    /// <summary>
+    /// Create the socket pair (VST driver side)
+    /// </summary>
+    /// <param name="childSocket">Receives the inheritable end of the VST host, the caller closes it once the VST host is started</param>
+    /// <returns>true on success</returns>
+    bool Create(int& childSocket)
+    {
+        Close();
+
+        childSocket = -1;
+
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets))
+        {
+            return false;
+        }
+
+        /// The own end must not be inherited by the VST host, otherwise the connection does not break when it terminates
+        fcntl(sockets[0], F_SETFD, FD_CLOEXEC);
+
+        input = sockets[0];
+        output = sockets[0];
+        ownsSockets = true;
+        childSocket = sockets[1];
+
+        return true;
+    }
+
+    /// <summary>
+    /// Attach to existing sockets (VST host side)
+    /// </summary>
+    /// <param name="input">The socket to read from</param>
+    /// <param name="output">The socket to write to</param>
+    void Attach(int input, int output)
+    {
+        Close();
+
+        this->input = input;
+        this->output = output;
+        ownsSockets = false;
+    }
+
+    bool Connect(uint32_t /*timeout*/) override
+    {
+        return input >= 0 && output >= 0;
+    }
+
+    bool Send(const void* data, uint32_t size) override
+    {
+        const char* position = (const char*)data;
+
+        while (size)
+        {
+            ssize_t written = send(output, position, size, SendFlags);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+
+            position += written;
+            size -= (uint32_t)written;
+        }
+
+        return true;
+    }
+
+    uint32_t Receive(void* data, uint32_t size) override
+    {
+        for (;;)
+        {
+            ssize_t received = recv(input, data, size, 0);
+            if (received < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return received > 0 ? (uint32_t)received : 0;
+        }
+    }
+
+    bool Wait(uint32_t timeout) override
+    {
+        pollfd descriptor = {};
+        descriptor.fd = input;
+        descriptor.events = POLLIN;
+
+        for (;;)
+        {
+            /// 0xFFFFFFFF is INFINITE on Windows
+            int ready = poll(&descriptor, 1, timeout == 0xFFFFFFFF ? -1 : (int)timeout);
+            if (ready < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            /// A broken connection is readable as well, the following Receive reports it
+            return ready > 0 && (descriptor.revents & POLLIN);
+        }
+    }
+
+    void Close() override
+    {
+        if (ownsSockets)
+        {
+            if (input >= 0)
+            {
+                close(input);
+            }
+            if (output >= 0 && output != input)
+            {
+                close(output);
+            }
+        }
+        input = -1;
+        output = -1;
+        ownsSockets = false;
+    }
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#include <cstdint>
+
+/// <summary>
+/// The version of the protocol between the VST driver and the VST host.
+/// Both sides exchange it in the handshake which follows the name, vendor and product exchange.
+/// </summary>
+enum : uint32_t
+{
+    ProtocolVersion = 1
+};
+
+/// <summary>
+/// The optional parts of the protocol.
+/// A capability is only used when both sides announce it in the handshake.
+/// </summary>
+enum Capability : uint32_t
+{
+    /// <summary>
+    /// The rendered audio is returned through a SharedAudioRing instead of the pipe
+    /// </summary>
+    SharedAudio = 1 << 0,
+    /// <summary>
+    /// The queued MIDI events are sent as a MidiEventBatch along with the render request
+    /// </summary>
+    EventBatch = 1 << 1,
+    /// <summary>
+    /// Chunk, editor and reset requests go through a second pair of pipes and complete asynchronously
+    /// </summary>
+    ControlLane = 1 << 2,
+    /// <summary>
+    /// Render requests and replies are counted in the shared audio ring, so both sides can spin on them before blocking on the pipe
+    /// </summary>
+    SpinWait = 1 << 3,
+    /// <summary>
+    /// The VST host can split the rendering of a block at the frame offsets of its events, for a VSTi which ignores deltaFrames
+    /// </summary>
+    SubBlockSplit = 1 << 4,
+    /// <summary>
+    /// The VST host warms up and idles the VSTi on a low priority thread instead of the render path
+    /// </summary>
+    BackgroundIdle = 1 << 5,
+    /// <summary>
+    /// The VST host renders in blocks of the size set by the VST driver, the period of the audio device, instead of 4096 frames
+    /// </summary>
+    BlockSize = 1 << 6,
+};
+
+/// <summary>
+/// The capabilities implemented by this build
+/// </summary>
+const uint32_t SupportedCapabilities = Capability::SharedAudio | Capability::EventBatch | Capability::ControlLane | Capability::SpinWait | Capability::SubBlockSplit | Capability::BackgroundIdle | Capability::BlockSize;
+
+/// <summary>
+/// A bidirectional byte stream between the VST driver and the VST host.
+/// The interface is platform independent, PipeTransport implements it on Windows and SocketTransport on POSIX systems.
+/// </summary>
+class Transport
+{
+public:
+    virtual ~Transport()
+    {
+    }
+
+    /// <summary>
+    /// Wait until the other side is connected
+    /// </summary>
+    /// <param name="timeout">The timeout in milliseconds</param>
+    /// <returns>true when connected</returns>
+    virtual bool Connect(uint32_t timeout) = 0;
+
+    /// <summary>
+    /// Send all the data
+    /// </summary>
+    /// <param name="data">The data to send</param>
+    /// <param name="size">The size of the data</param>
+    /// <returns>false when the connection is broken</returns>
+    virtual bool Send(const void* data, uint32_t size) = 0;
+
+    /// <summary>
+    /// Receive at most size bytes, blocks until at least one byte is available
+    /// </summary>
+    /// <param name="data">The received data</param>
+    /// <param name="size">The size of the buffer</param>
+    /// <returns>The number of bytes received, 0 when the connection is broken</returns>
+    virtual uint32_t Receive(void* data, uint32_t size) = 0;
+
+    /// <summary>
+    /// Wait until data can be received
+    /// </summary>
+    /// <param name="timeout">The timeout in milliseconds</param>
+    /// <returns>true when data is available, false on timeout or when the connection is broken</returns>
+    virtual bool Wait(uint32_t timeout) = 0;
+
+    virtual void Close() = 0;
+};
+
+#endif
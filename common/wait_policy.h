@@ -0,0 +1,129 @@
+#ifndef __WAIT_POLICY_H__
+#define __WAIT_POLICY_H__
+
+#include <windows.h>
+#include <cstdint>
+
+/// <summary>
+/// The durations of the waits of a SpinWaitPolicy.
+/// Bucket i counts the waits shorter than 2^i microseconds, the last bucket also counts the longer ones.
+/// </summary>
+struct WaitHistogram
+{
+    enum : uint32_t
+    {
+        Buckets = 20,
+    };
+
+    /// <summary>
+    /// The waits which ended while spinning
+    /// </summary>
+    uint64_t spun[Buckets];
+    /// <summary>
+    /// The waits which fell back to the blocking wait
+    /// </summary>
+    uint64_t blocked[Buckets];
+};
+
+/// <summary>
+/// Spins on a sequence counter in shared memory for a bounded time, before the caller falls back to its blocking wait.
+/// A wait starts with Spin and ends with Finish, which adds its duration to the histogram.
+/// </summary>
+class SpinWaitPolicy
+{
+private:
+    LONGLONG frequency = 1;
+    LONGLONG spinTicks = 0;
+    uint32_t spinMicroseconds = 0;
+
+    LONGLONG waitStart = 0;
+    bool waitSpun = false;
+
+    WaitHistogram histogram = {};
+
+    static LONGLONG GetTicks()
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return counter.QuadPart;
+    }
+
+public:
+    /// <summary>
+    /// Set the spin budget and clear the histogram
+    /// </summary>
+    /// <param name="spinMicroseconds">The longest time to spin, 0 always blocks</param>
+    void Init(uint32_t spinMicroseconds)
+    {
+        LARGE_INTEGER counterFrequency;
+        QueryPerformanceFrequency(&counterFrequency);
+
+        frequency = counterFrequency.QuadPart;
+        this->spinMicroseconds = spinMicroseconds;
+        spinTicks = (LONGLONG)spinMicroseconds * frequency / 1000000;
+        histogram = {};
+    }
+
+    uint32_t GetSpinMicroseconds() const
+    {
+        return spinMicroseconds;
+    }
+
+    /// <summary>
+    /// Start a wait and spin until the counter reaches the target or the spin budget is used up
+    /// </summary>
+    /// <param name="counter">The sequence counter, NULL to skip spinning</param>
+    /// <param name="target">The value to wait for</param>
+    /// <returns>true when the counter reached the target while spinning</returns>
+    bool Spin(const volatile LONG* counter, LONG target)
+    {
+        waitStart = GetTicks();
+        waitSpun = false;
+
+        if (!counter || !spinTicks)
+        {
+            return false;
+        }
+
+        for (;;)
+        {
+            /// The counters wrap around, compare the distance
+            if ((LONG)((ULONG)*counter - (ULONG)target) >= 0)
+            {
+                MemoryBarrier();
+                waitSpun = true;
+                return true;
+            }
+
+            if (GetTicks() - waitStart >= spinTicks)
+            {
+                return false;
+            }
+
+            YieldProcessor();
+        }
+    }
+
+    /// <summary>
+    /// End the wait started by Spin and count its duration
+    /// </summary>
+    void Finish()
+    {
+        LONGLONG microseconds = (GetTicks() - waitStart) * 1000000 / frequency;
+
+        uint32_t bucket = 0;
+        while (bucket < WaitHistogram::Buckets - 1 && microseconds >= (1LL << bucket))
+        {
+            ++bucket;
+        }
+
+        ++(waitSpun ? histogram.spun : histogram.blocked)[bucket];
+    }
+
+    void GetHistogram(WaitHistogram& out) const
+    {
+        out = histogram;
+    }
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef __DRIVERSETTINGS_H__
+#define __DRIVERSETTINGS_H__
+
+#include <windows.h>
+
+/// <summary>
+/// Read a DWORD value from HKEY_CURRENT_USER\Software\VSTi Driver
+/// </summary>
+/// <param name="valueName">The name of the value</param>
+/// <param name="defaultValue">Returned when the value does not exist or is not a DWORD</param>
+/// <returns>The value</returns>
+inline DWORD GetDriverSetting(const TCHAR* valueName, DWORD defaultValue)
+{
+    HKEY hKey;
+    LSTATUS result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver", 0, KEY_READ | KEY_WOW64_32KEY, &hKey);
+
+    if (result != NO_ERROR)
+    {
+        return defaultValue;
+    }
+
+    DWORD value;
+    DWORD size = sizeof(value);
+    DWORD registryType = REG_NONE;
+
+    result = RegQueryValueEx(hKey, valueName, NULL, &registryType, (LPBYTE)&value, &size);
+
+    RegCloseKey(hKey);
+
+    if (result != NO_ERROR || registryType != REG_DWORD)
+    {
+        return defaultValue;
+    }
+
+    return value;
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef __MESSAGEPLACEMENT_H__
+#define __MESSAGEPLACEMENT_H__
+
+#include <cstdint>
+
+/// <summary>
+/// Maps frame positions of the rendered audio to performance counter values.
+/// The observed times at which frames are played jitter by up to a device buffer, the clock follows them slowly,
+/// so the frame at which a timestamped message is played does not jitter along.
+/// </summary>
+class PlaybackClock
+{
+private:
+    int64_t frequency = 1;
+    int64_t sampleRate = 1;
+
+    /// <summary>
+    /// The performance counter value at which frame 0 is played
+    /// </summary>
+    int64_t origin = 0;
+    bool running = false;
+
+    /// <summary>
+    /// The observations are followed with 1/smoothing of their error
+    /// </summary>
+    static const int64_t smoothing = 16;
+
+public:
+    void Init(int64_t frequency, int64_t sampleRate) noexcept
+    {
+        this->frequency = frequency;
+        this->sampleRate = sampleRate;
+        running = false;
+    }
+
+    /// <summary>
+    /// Start over with the next observation, after the audio was interrupted
+    /// </summary>
+    void Reset() noexcept
+    {
+        running = false;
+    }
+
+    /// <summary>
+    /// Feed the time at which a frame was observed to be played and get the time the clock assigns to it
+    /// </summary>
+    /// <param name="time">The performance counter value of the observation</param>
+    /// <param name="frame">The frame which is played at time</param>
+    /// <returns>The smoothed performance counter value at which frame is played</returns>
+    int64_t Update(int64_t time, int64_t frame) noexcept
+    {
+        int64_t frameTime = frame * frequency / sampleRate;
+        int64_t error = time - (origin + frameTime);
+
+        // An error of 100 ms is a dropout or a stall rather than jitter, the clock jumps
+        if (!running || error > frequency / 10 || error < -frequency / 10)
+        {
+            origin = time - frameTime;
+            running = true;
+        }
+        else
+        {
+            origin += error / smoothing;
+        }
+
+        return origin + frameTime;
+    }
+};
+
+/// <summary>
+/// Places timestamped messages at frame offsets of the rendered blocks.
+/// A message is played at the frame of its arrival relative to a reference, late messages at the start of the block.
+/// Messages due after the block keep their offset up to the fixed latency ahead, the next block does not place its
+/// messages before them, so messages are never reordered.
+/// </summary>
+class MessagePlacement
+{
+private:
+    int64_t frequency = 1;
+    int64_t sampleRate = 1;
+    uint32_t latencyFrames = 0;
+
+    /// <summary>
+    /// The offset of the last message placed for a later block, relative to the start of the next block
+    /// </summary>
+    uint32_t carriedOffset = 0;
+
+    uint32_t totalFrames = 0;
+    uint32_t horizon = 0;
+    uint32_t lastOffset = 0;
+    int64_t referenceTime = 0;
+    int64_t referenceFrame = 0;
+
+public:
+    /// <summary>
+    /// Set up the placement
+    /// </summary>
+    /// <param name="frequency">The frequency of the performance counter</param>
+    /// <param name="sampleRate">The sample rate of the rendered audio</param>
+    /// <param name="latencyFrames">How far after the block a message may be placed</param>
+    void Init(int64_t frequency, int64_t sampleRate, uint32_t latencyFrames) noexcept
+    {
+        this->frequency = frequency;
+        this->sampleRate = sampleRate;
+        this->latencyFrames = latencyFrames;
+        Reset();
+    }
+
+    /// <summary>
+    /// Forget the messages placed after the previous block
+    /// </summary>
+    void Reset() noexcept
+    {
+        carriedOffset = 0;
+    }
+
+    /// <summary>
+    /// Start placing the messages of a block
+    /// </summary>
+    /// <param name="totalFrames">The number of frames which are about to be rendered</param>
+    /// <param name="referenceTime">The performance counter value at which referenceFrame is played, 0 if unknown</param>
+    /// <param name="referenceFrame">The frame relative to the start of the block which is played at referenceTime</param>
+    void BeginBlock(uint32_t totalFrames, int64_t referenceTime, int64_t referenceFrame) noexcept
+    {
+        this->totalFrames = totalFrames;
+        this->referenceTime = referenceTime;
+        this->referenceFrame = referenceFrame;
+        horizon = totalFrames + latencyFrames;
+        lastOffset = carriedOffset;
+    }
+
+    /// <summary>
+    /// Place the next message of the block, in the order of arrival
+    /// </summary>
+    /// <param name="timestamp">The performance counter value at the arrival of the message</param>
+    /// <returns>The frame offset of the message relative to the start of the block, below totalFrames + latencyFrames</returns>
+    uint32_t Place(int64_t timestamp) noexcept
+    {
+        // Late messages are played at the start of the block, early messages at its end.
+        uint32_t offset = lastOffset;
+        if (referenceTime)
+        {
+            int64_t frames = referenceFrame + (timestamp - referenceTime) * sampleRate / frequency;
+            offset = frames < 0 ? 0 : frames < horizon ? (uint32_t)frames : horizon - 1;
+        }
+
+        // Never reorder messages
+        if (offset < lastOffset)
+        {
+            offset = lastOffset;
+        }
+
+        lastOffset = offset;
+        return offset;
+    }
+
+    /// <summary>
+    /// Finish the block, the next block must not place its messages before the ones placed for it already
+    /// </summary>
+    void EndBlock() noexcept
+    {
+        carriedOffset = lastOffset > totalFrames ? lastOffset - totalFrames : 0;
+    }
+};
+
+#endif
@@ -0,0 +1,628 @@
+/* Copyright (C) 2011, 2012 Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSTMIDIDRV_MIDISTREAM_H
+#define VSTMIDIDRV_MIDISTREAM_H
+
+#include <windows.h>
+#include <mmsystem.h>
+#include "../common/midi_events.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace VSTMIDIDRV {
+
+    /// <summary>
+    /// The counters of the MIDI queue of a port
+    /// </summary>
+    struct MidiQueueStatistics
+    {
+        /// <summary>
+        /// The number of messages the queue holds for all ports
+        /// </summary>
+        DWORD capacity;
+        DWORD pending;
+        /// <summary>
+        /// The most messages of the port which were queued at once
+        /// </summary>
+        DWORD highWater;
+        /// <summary>
+        /// The messages which were not queued, MIDIERR_NOTREADY was returned to the client
+        /// </summary>
+        DWORD rejected;
+        /// <summary>
+        /// The queued messages which were dropped to make room for newer ones
+        /// </summary>
+        DWORD dropped;
+    };
+
+    /// <summary>
+    /// Fixed-capacity storage for the MIDI System Exclusive messages of one port.
+    /// Clients take blocks from their own threads and the consumer returns them, without a lock and without the heap.
+    /// Messages which do not fit into a block, or arrive while all blocks are in use, go to the heap.
+    /// </summary>
+    class SysExSlab
+    {
+    private:
+        static const unsigned int blockSize = 512;
+        static const unsigned int blockCount = 256;
+
+        unsigned char blocks[blockCount][blockSize];
+        volatile LONG used[blockCount] = {};
+
+        /// <summary>
+        /// Where the next search for a free block starts, the blocks are returned roughly in the order they were taken
+        /// </summary>
+        volatile LONG cursor = 0;
+
+    public:
+        /// <summary>
+        /// Get storage for a MIDI System Exclusive message
+        /// </summary>
+        /// <param name="size">The length of the message</param>
+        /// <returns>The storage, NULL if the heap is exhausted</returns>
+        unsigned char* Allocate(DWORD size) noexcept
+        {
+            if (size <= blockSize)
+            {
+                ULONG start = (ULONG)InterlockedIncrement(&cursor) - 1;
+                for (unsigned int i = 0; i < blockCount; ++i)
+                {
+                    unsigned int index = (start + i) & (blockCount - 1);
+                    if (!used[index] && InterlockedCompareExchange(&used[index], 1, 0) == 0)
+                    {
+                        return blocks[index];
+                    }
+                }
+            }
+
+            return (unsigned char*)malloc(size);
+        }
+
+        /// <summary>
+        /// Return the storage of a MIDI System Exclusive message
+        /// </summary>
+        /// <param name="sysEx">The storage returned by Allocate</param>
+        void Free(unsigned char* sysEx) noexcept
+        {
+            if (sysEx >= blocks[0] && sysEx < blocks[0] + sizeof(blocks))
+            {
+                InterlockedExchange(&used[(sysEx - blocks[0]) / blockSize], 0);
+            }
+            else
+            {
+                free(sysEx);
+            }
+        }
+    };
+
+    /// <summary>
+    /// Get the System Exclusive storage of a port, defined by the user of the MidiStream
+    /// </summary>
+    SysExSlab& GetSysExSlab(DWORD port) noexcept;
+
+    /// <summary>
+    /// Collects midi messages from the midi source.
+    /// Bounded multi-producer / single consumer queue: any number of clients put messages from their own threads,
+    /// the consumer takes them in batches without a lock. Every slot carries a sequence number which tells whether it is
+    /// free for the producer at that position, published for the consumer, or dropped by the overflow policy.
+    /// The queue has twice as many slots as its capacity, so dropped messages do not take room from new ones.
+    /// </summary>
+    class MidiStream
+    {
+    public:
+        struct Message
+        {
+            DWORD port;
+            DWORD message;
+            unsigned char* sysEx;
+            DWORD sysExLength;
+            /// <summary>
+            /// Set when sysEx is referenced rather than copied, called with releaseContext once the message is consumed
+            /// </summary>
+            SysExRelease release;
+            void* releaseContext;
+            /// <summary>
+            /// The performance counter value at the arrival of the message
+            /// </summary>
+            LONGLONG timestamp;
+        };
+
+        /// <summary>
+        /// What happens to a message which arrives while the queue holds capacity messages
+        /// </summary>
+        enum OverflowPolicy : DWORD
+        {
+            /// <summary>
+            /// The message is rejected with MIDIERR_NOTREADY
+            /// </summary>
+            Reject = 0,
+            /// <summary>
+            /// The oldest queued channel message other than a note on / off, a sustain pedal or an all sounds / notes off
+            /// is dropped to make room, System Exclusive messages are kept
+            /// </summary>
+            DropOldest = 1,
+            /// <summary>
+            /// The client waits up to blockTime milliseconds for room, then the message is rejected
+            /// </summary>
+            Block = 2,
+        };
+
+        static const DWORD defaultCapacity = 1024;
+        static const DWORD maxPorts = 2;
+
+    private:
+        struct Slot
+        {
+            volatile LONG sequence;
+            Message message;
+        };
+
+        struct PortCounters
+        {
+            volatile LONG pending;
+            volatile LONG highWater;
+            volatile LONG rejected;
+            volatile LONG dropped;
+        };
+
+        Slot* stream = NULL;
+        DWORD slotCount = 0;
+        DWORD capacity = 0;
+        OverflowPolicy policy = Reject;
+        DWORD blockTime = 0;
+
+        PortCounters counters[maxPorts] = {};
+
+        /// <summary>
+        /// The number of queued messages, a producer reserves room here before it claims a slot
+        /// </summary>
+        alignas(64) volatile LONG pending = 0;
+
+        /// <summary>
+        /// The next position claimed by a producer, on its own cache line
+        /// </summary>
+        alignas(64) volatile LONG endpos = 0;
+
+        /// <summary>
+        /// The next position taken by the consumer, on its own cache line
+        /// </summary>
+        alignas(64) volatile LONG startpos = 0;
+
+        static LONG Distance(LONG a, LONG b) noexcept
+        {
+            return (LONG)((ULONG)a - (ULONG)b);
+        }
+
+        static LONG Advance(LONG position, DWORD count) noexcept
+        {
+            return (LONG)((ULONG)position + count);
+        }
+
+        PortCounters& GetCounters(DWORD port) noexcept
+        {
+            return counters[port < maxPorts ? port : 0];
+        }
+
+        /// <summary>
+        /// Reserve room for a message according to the overflow policy
+        /// </summary>
+        /// <returns>false when the message has to be rejected</returns>
+        bool Reserve() noexcept
+        {
+            DWORD start = GetTickCount();
+            for (;;)
+            {
+                if ((DWORD)InterlockedIncrement(&pending) <= capacity)
+                {
+                    return true;
+                }
+
+                if (policy == DropOldest && DropOldestMessage())
+                {
+                    // The room of the dropped message is taken over, DropOldestMessage gave back its count
+                    return true;
+                }
+
+                InterlockedDecrement(&pending);
+
+                if (policy != Block || GetTickCount() - start >= blockTime)
+                {
+                    return false;
+                }
+
+                Sleep(1);
+            }
+        }
+
+        /// <summary>
+        /// Check for the controllers which end notes: sustain pedal (64), all sounds off (120) and all notes off (123).
+        /// Dropping one of them leaves notes hanging, and the pedal is kept in both directions so it stays in step.
+        /// </summary>
+        static bool IsNoteRelease(DWORD message) noexcept
+        {
+            DWORD controller = (message >> 8) & 0x7F;
+            return (message & 0xF0) == 0xB0 && (controller == 64 || controller == 120 || controller == 123);
+        }
+
+        /// <summary>
+        /// Drop the oldest queued channel message which is not a note on / off, a sustain pedal or an all sounds / notes off.
+        /// The slot stays taken until the consumer passes it, its room in the queue is handed to the caller.
+        /// </summary>
+        /// <returns>true if a message was dropped</returns>
+        bool DropOldestMessage() noexcept
+        {
+            LONG end = endpos;
+            for (LONG position = startpos; Distance(end, position) > 0; position = Advance(position, 1))
+            {
+                Slot* slot = &stream[position & (slotCount - 1)];
+                if (slot->sequence != Advance(position, 1))
+                {
+                    continue;
+                }
+
+                Message message = slot->message;
+                BYTE status = (BYTE)message.message & 0xF0;
+                if (message.sysEx || status < 0x80 || status == 0x80 || status == 0x90 || status == 0xF0 || IsNoteRelease(message.message))
+                {
+                    continue;
+                }
+
+                // Dropped is position + 2, which is never a valid sequence of this slot
+                if (InterlockedCompareExchange(&slot->sequence, Advance(position, 2), Advance(position, 1)) == Advance(position, 1))
+                {
+                    // The consumer skips the slot without counting it, so the dropped message leaves the count here
+                    InterlockedDecrement(&pending);
+
+                    PortCounters& portCounters = GetCounters(message.port);
+                    InterlockedDecrement(&portCounters.pending);
+                    InterlockedIncrement(&portCounters.dropped);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /// <summary>
+        /// Claim a slot, publish it with Publish
+        /// </summary>
+        /// <returns>The slot, NULL when all slots are in use</returns>
+        Slot* Claim(LONG& position) noexcept
+        {
+            position = endpos;
+            for (;;)
+            {
+                Slot* slot = &stream[position & (slotCount - 1)];
+                LONG distance = Distance(slot->sequence, position);
+
+                if (distance == 0)
+                {
+                    LONG claimed = InterlockedCompareExchange(&endpos, Advance(position, 1), position);
+                    if (claimed == position)
+                    {
+                        return slot;
+                    }
+                    position = claimed;
+                }
+                else if (distance < 0)
+                {
+                    // The consumer has not passed the message of the previous round yet
+                    return NULL;
+                }
+                else
+                {
+                    // Another producer claimed the slot
+                    position = endpos;
+                }
+            }
+        }
+
+        void Publish(Slot* slot, LONG position) noexcept
+        {
+            PortCounters& portCounters = GetCounters(slot->message.port);
+            LONG portPending = InterlockedIncrement(&portCounters.pending);
+
+            LONG highWater = portCounters.highWater;
+            while (portPending > highWater)
+            {
+                LONG previous = InterlockedCompareExchange(&portCounters.highWater, portPending, highWater);
+                if (previous == highWater)
+                {
+                    break;
+                }
+                highWater = previous;
+            }
+
+            InterlockedExchange(&slot->sequence, Advance(position, 1));
+        }
+
+        /// <summary>
+        /// Reserve room and claim a slot
+        /// </summary>
+        /// <returns>The slot, NULL if the message is rejected</returns>
+        Slot* Put(DWORD port, LONG& position) noexcept
+        {
+            Slot* slot = NULL;
+            if (stream && Reserve())
+            {
+                slot = Claim(position);
+                if (!slot)
+                {
+                    InterlockedDecrement(&pending);
+                }
+            }
+
+            if (!slot)
+            {
+                InterlockedIncrement(&GetCounters(port).rejected);
+            }
+
+            return slot;
+        }
+
+    public:
+        ~MidiStream()
+        {
+            delete[] stream;
+        }
+
+        /// <summary>
+        /// Set up the queue, must not run concurrently with the clients or the consumer
+        /// </summary>
+        /// <param name="capacity">The number of messages the queue holds, rounded up to a power of two</param>
+        /// <param name="policy">What happens to the messages which arrive while the queue is full</param>
+        /// <param name="blockTime">How long the Block policy waits for room, in milliseconds</param>
+        void Init(DWORD capacity, OverflowPolicy policy, DWORD blockTime) noexcept
+        {
+            Reset();
+
+            DWORD slots = 2;
+            while (slots < capacity * 2)
+            {
+                slots <<= 1;
+            }
+
+            if (slots != slotCount)
+            {
+                Slot* newStream = new (std::nothrow) Slot[slots];
+                if (newStream)
+                {
+                    delete[] stream;
+                    stream = newStream;
+                    slotCount = slots;
+                }
+            }
+
+            for (DWORD i = 0; i < slotCount; ++i)
+            {
+                stream[i].sequence = i;
+            }
+
+            this->capacity = slotCount / 2;
+            this->policy = policy <= Block ? policy : Reject;
+            this->blockTime = blockTime;
+            pending = 0;
+            startpos = 0;
+            endpos = 0;
+
+            for (PortCounters& portCounters : counters)
+            {
+                portCounters = {};
+            }
+        }
+
+        /// <summary>
+        /// Discard the pending messages, must not run concurrently with GetMessages
+        /// </summary>
+        void Reset() noexcept
+        {
+            Message messages[64];
+            DWORD count;
+            while ((count = GetMessages(messages, _countof(messages))))
+            {
+                for (DWORD i = 0; i < count; ++i)
+                {
+                    if (messages[i].release)
+                    {
+                        messages[i].release(messages[i].releaseContext);
+                    }
+                    else if (messages[i].sysEx)
+                    {
+                        GetSysExSlab(messages[i].port).Free(messages[i].sysEx);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Get the current value of the performance counter, the messages are stamped with it on arrival.
+        /// </summary>
+        static LONGLONG GetTimestamp() noexcept
+        {
+            LARGE_INTEGER counter;
+            QueryPerformanceCounter(&counter);
+            return counter.QuadPart;
+        }
+
+        /// <summary>
+        /// Put MIDI message to the midi stream.
+        /// </summary>
+        /// <param name="uDeviceID">The port type.</param>
+        /// <param name="dwParam1">The MIDI message to put.</param>
+        /// <returns>MMSYSERR_NOERROR on sucess, MIDIERR_NOTREADY otherwise</returns>
+        DWORD PutMessage(DWORD uDeviceID, DWORD dwParam1) noexcept
+        {
+            LONG position;
+            Slot* slot = Put(uDeviceID, position);
+            if (!slot)
+            {
+                return MIDIERR_NOTREADY;
+            }
+
+            slot->message.port = uDeviceID;
+            slot->message.message = dwParam1;
+            slot->message.sysEx = NULL;
+            slot->message.sysExLength = 0;
+            slot->message.release = NULL;
+            slot->message.releaseContext = NULL;
+            slot->message.timestamp = GetTimestamp();
+            Publish(slot, position);
+
+            return MMSYSERR_NOERROR;
+        }
+
+        /// <summary>
+        /// Put MIDI System Exclusive message to the midi stream.
+        /// </summary>
+        /// <param name="port">The port type.</param>
+        /// <param name="sysEx">The MIDI System Exclusive message to put.</param>
+        /// <param name="sysExLength">The length of the MIDI System Exclusive message.</param>
+        /// <returns></returns>
+        DWORD PutSysEx(DWORD port, const unsigned char* sysEx, DWORD sysExLength) noexcept
+        {
+            unsigned char* sysExCopy = GetSysExSlab(port).Allocate(sysExLength);
+            if (!sysExCopy)
+            {
+                InterlockedIncrement(&GetCounters(port).rejected);
+                return MIDIERR_NOTREADY;
+            }
+
+            memcpy(sysExCopy, sysEx, sysExLength);
+
+            LONG position;
+            Slot* slot = Put(port, position);
+            if (!slot)
+            {
+                GetSysExSlab(port).Free(sysExCopy);
+                return MIDIERR_NOTREADY;
+            }
+
+            slot->message.port = port;
+            slot->message.message = 0;
+            slot->message.sysEx = sysExCopy;
+            slot->message.sysExLength = sysExLength;
+            slot->message.release = NULL;
+            slot->message.releaseContext = NULL;
+            slot->message.timestamp = GetTimestamp();
+            Publish(slot, position);
+
+            return MMSYSERR_NOERROR;
+        }
+
+        /// <summary>
+        /// Put MIDI System Exclusive message to the midi stream without copying it.
+        /// </summary>
+        /// <param name="port">The port type.</param>
+        /// <param name="sysEx">The MIDI System Exclusive message to put, it must stay valid until release is called.</param>
+        /// <param name="sysExLength">The length of the MIDI System Exclusive message.</param>
+        /// <param name="release">Called with releaseContext once the message is consumed by the VST host or discarded.</param>
+        /// <param name="releaseContext">Passed to release.</param>
+        /// <returns>MMSYSERR_NOERROR on sucess, MIDIERR_NOTREADY otherwise, release is not called then</returns>
+        DWORD PutSysExReference(DWORD port, unsigned char* sysEx, DWORD sysExLength, SysExRelease release, void* releaseContext) noexcept
+        {
+            LONG position;
+            Slot* slot = Put(port, position);
+            if (!slot)
+            {
+                return MIDIERR_NOTREADY;
+            }
+
+            slot->message.port = port;
+            slot->message.message = 0;
+            slot->message.sysEx = sysEx;
+            slot->message.sysExLength = sysExLength;
+            slot->message.release = release;
+            slot->message.releaseContext = releaseContext;
+            slot->message.timestamp = GetTimestamp();
+            Publish(slot, position);
+
+            return MMSYSERR_NOERROR;
+        }
+
+        /// <summary>
+        /// Take the published messages from the midi stream in one pass, in the order in which they were put (single consumer).
+        /// </summary>
+        /// <param name="messages">Receives the messages, the consumer returns their sysEx to GetSysExSlab(port).</param>
+        /// <param name="maxCount">The size of messages.</param>
+        /// <returns>The number of messages taken.</returns>
+        DWORD GetMessages(Message* messages, DWORD maxCount) noexcept
+        {
+            DWORD count = 0;
+
+            while (stream && count < maxCount)
+            {
+                LONG position = startpos;
+                Slot* slot = &stream[position & (slotCount - 1)];
+
+                LONG sequence = slot->sequence;
+                if (sequence == Advance(position, 1))
+                {
+                    messages[count] = slot->message;
+
+                    // A producer may drop the message while it is copied
+                    if (InterlockedCompareExchange(&slot->sequence, Advance(position, slotCount), sequence) == sequence)
+                    {
+                        InterlockedDecrement(&GetCounters(messages[count].port).pending);
+                        InterlockedDecrement(&pending);
+                        ++count;
+                    }
+                    else
+                    {
+                        InterlockedExchange(&slot->sequence, Advance(position, slotCount));
+                    }
+                }
+                else if (sequence == Advance(position, 2))
+                {
+                    // Dropped, its room was handed over when it was dropped
+                    InterlockedExchange(&slot->sequence, Advance(position, slotCount));
+                }
+                else
+                {
+                    // Claimed but not published yet
+                    break;
+                }
+
+                startpos = Advance(position, 1);
+            }
+
+            return count;
+        }
+
+        /// <summary>
+        /// Get the counters of a port
+        /// </summary>
+        /// <param name="port">The port</param>
+        /// <param name="statistics">The counters</param>
+        void GetStatistics(DWORD port, MidiQueueStatistics& statistics) noexcept
+        {
+            PortCounters& portCounters = GetCounters(port);
+            statistics.capacity = capacity;
+            statistics.pending = portCounters.pending;
+            statistics.highWater = portCounters.highWater;
+            statistics.rejected = portCounters.rejected;
+            statistics.dropped = portCounters.dropped;
+        }
+
+        DWORD GetCapacity() const noexcept
+        {
+            return capacity;
+        }
+    };
+}
+
+#endif
@@ -1,961 +1,2336 @@
-/* Copyright (C) 2011, 2012 Sergey V. Mikayev
- *
- *  This program is free software: you can redistribute it and/or modify
- *  it under the terms of the GNU Lesser General Public License as published by
- *  the Free Software Foundation, either version 2.1 of the License, or
- *  (at your option) any later version.
- *
- *  This program is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- *  GNU Lesser General Public License for more details.
- *
- *  You should have received a copy of the GNU Lesser General Public License
- *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-#include "stdafx.h"
-#include "winreg.h"
-#include <map>
-
-#undef GetMessage
-
-// Define BASSASIO functions as pointers
-#define BASSASIODEF(f) (WINAPI *f)
-#define LOADBASSASIOFUNCTION(f) *((void**)&f)=GetProcAddress(bassAsio,#f)
-
-// Define BASS functions as pointers
-#define BASSDEF(f) (WINAPI *f)
-#define LOADBASSFUNCTION(f) *((void**)&f)=GetProcAddress(bass,#f)
-
-// Define BASSWASAPI functions as pointers
-#define BASSWASAPIDEF(f) (WINAPI *f)
-#define LOADBASSWASAPIFUNCTION(f) *((void**)&f)=GetProcAddress(bassWasapi,#f)
-
-#include <bass.h>
-#include <bassasio.h>
-#include <basswasapi.h>
-
-#include "VSTDriver.h"
-#include <string>
-#include <codecvt>
-
-using std::string;
-using std::wstring;
-using std::map;
-using std::wstring_convert;
-using std::codecvt_utf8;
-
-
-extern "C" { extern HINSTANCE hinst_vst_driver; }
-
-namespace VSTMIDIDRV
-{
-    static MidiSynth& midiSynth = MidiSynth::GetInstance();
-
-    /// <summary>
-    /// Collects midi messages from the midi source
-    /// </summary>
-    static class MidiStream
-    {
-    private:
-        static const unsigned int maxPos = 1024;
-        unsigned int startpos;
-        unsigned int endpos;
-
-        struct message
-        {
-            void* sysex;
-            DWORD msg;
-            DWORD port_type;
-        };
-
-        message stream[maxPos];
-
-    public:
-        MidiStream() noexcept
-        {
-            Reset();
-        }
-
-        void Reset() noexcept
-        {
-            startpos = 0;
-            endpos = 0;
-        }
-
-        /// <summary>
-        /// Put MIDI message to the midi stream.
-        /// </summary>
-        /// <param name="uDeviceID">The port type.</param>
-        /// <param name="dwParam1">The MIDI message to put.</param>
-        /// <returns>MMSYSERR_NOERROR on sucess, MIDIERR_NOTREADY otherwise</returns>
-        DWORD PutMessage(DWORD uDeviceID, DWORD dwParam1) noexcept
-        {
-            unsigned int newEndpos = endpos;
-
-            ++newEndpos;
-
-            // Check for buffer rolloff
-            if (newEndpos == maxPos)
-            {
-                newEndpos = 0;
-            }
-
-            // Check for buffer full
-            if (startpos == newEndpos)
-            {
-                return MIDIERR_NOTREADY;
-            }
-
-            // Put data and update endpos
-            stream[endpos].sysex = 0;
-            stream[endpos].msg = dwParam1;
-            stream[endpos].port_type = uDeviceID;
-            endpos = newEndpos;
-
-            return MMSYSERR_NOERROR;
-        }
-
-        /// <summary>
-        /// Put MIDI System Exclusive message to the midi stream.
-        /// </summary>
-        /// <param name="port">The port type.</param>
-        /// <param name="sysEx">The MIDI System Exclusive message to put.</param>
-        /// <param name="sysExLength">The length of the MIDI System Exclusive message.</param>
-        /// <returns></returns>
-        DWORD PutSysEx(DWORD port, const unsigned char* sysEx, DWORD sysExLength) noexcept
-        {
-            unsigned int newEndpos = endpos;
-
-            ++newEndpos;
-
-            // Check for buffer rolloff
-            if (newEndpos == maxPos)
-            {
-                newEndpos = 0;
-            }
-
-            // Check for buffer full
-            if (startpos == newEndpos)
-            {
-                return MIDIERR_NOTREADY;
-            }
-
-            void* sysExCopy = malloc(sysExLength);
-            if (!sysExCopy)
-            {
-                return MIDIERR_NOTREADY;
-            }
-
-            memcpy(sysExCopy, sysEx, sysExLength);
-
-            stream[endpos].sysex = sysExCopy;
-            stream[endpos].msg = sysExLength;
-            stream[endpos].port_type = port | 0x80000000;
-            endpos = newEndpos;
-
-            return MMSYSERR_NOERROR;
-        }
-
-        /// <summary>
-        /// Get MIDI message or MIDI System Exclusive message from the midi stream and advance the .
-        /// </summary>
-        /// <param name="port">The port type.</param>
-        /// <param name="message">The next MIDI message from the midi stream.</param>
-        /// <param name="sysEx">The MIDI System Exclusive message.</param>
-        /// <param name="sysExLength">The length of the MIDI System Exclusive message.</param>
-        /// <returns></returns>
-        void GetMessage(DWORD& port, DWORD& message, unsigned char*& sysEx, DWORD& sysExLength) noexcept
-        {
-            port = 0;
-            message = 0;
-            sysEx = 0;
-            sysExLength = 0;
-
-            // Check for buffer empty
-            if (startpos == endpos)
-            {
-                return;
-            }
-
-            port = stream[startpos].port_type & 0x7fffffff;
-
-            if (stream[startpos].port_type & 0x80000000)
-            {
-                sysEx = (unsigned char*)stream[startpos].sysex;
-                sysExLength = stream[startpos].msg;
-            }
-            else
-            {
-                message = stream[startpos].msg;
-            }
-
-            ++startpos;
-
-            // Check for buffer rolloff
-            if (startpos == maxPos)
-            {
-                startpos = 0;
-            }
-        }
-
-        DWORD PeekMessageCount() noexcept
-        {
-            if (endpos < startpos)
-            {
-                return endpos + maxPos - startpos;
-            }
-            else
-            {
-                return endpos - startpos;
-            }
-        }
-    } midiStream;
-
-    static class SynthMutexWin32
-    {
-    private:
-        CRITICAL_SECTION cCritSec;
-
-    public:
-        int Init() noexcept
-        {
-            InitializeCriticalSection(&cCritSec);
-            return 0;
-        }
-
-        void Close() noexcept
-        {
-            DeleteCriticalSection(&cCritSec);
-        }
-
-        void Enter() noexcept
-        {
-            EnterCriticalSection(&cCritSec);
-        }
-
-        void Leave() noexcept
-        {
-            LeaveCriticalSection(&cCritSec);
-        }
-    } synthMutex;
-
-    static class WaveOutWin32
-    {
-    private:
-        HINSTANCE bass = NULL;          // bass handle
-        HINSTANCE bassAsio = NULL;      // bassasio handle
-        HINSTANCE bassWasapi = NULL;    // basswasapi handle
-
-        HSTREAM hStOutput = NULL;
-
-        TCHAR* modeValueName = L"Mode";
-        TCHAR* asioValueName = L"ASIO";
-        TCHAR* wasapiValueName = L"WASAPI";
-
-        bool soundOutFloat = false;
-        DWORD wasapiBits = 16;
-        DWORD buflen = 0;
-
-        TCHAR installPath[MAX_PATH] = { 0 };
-        TCHAR bassPath[MAX_PATH] = { 0 };
-        TCHAR bassAsioPath[MAX_PATH] = { 0 };
-        TCHAR bassWasapiPath[MAX_PATH] = { 0 };
-
-        map<wstring, wstring> outputDriver;
-
-        void InitializePaths() noexcept
-        {
-            GetModuleFileName(hinst_vst_driver, installPath, MAX_PATH);
-            PathRemoveFileSpec(installPath);
-            lstrcat(installPath, _T("\\vstmididrv\\"));
-
-            lstrcat(bassPath, installPath);
-            lstrcat(bassPath, _T("bass.dll"));
-
-            lstrcat(bassAsioPath, installPath);
-            lstrcat(bassAsioPath, _T("bassasio.dll"));
-
-            lstrcat(bassWasapiPath, installPath);
-            lstrcat(bassWasapiPath, _T("basswasapi.dll"));
-        }
-
-        bool LoadBass(wstring mode) noexcept
-        {
-            if (mode.empty() || mode.compare(asioValueName) == 0)
-            {
-                // Load Bass Asio
-                bassAsio = LoadLibrary(bassAsioPath);
-
-                LOADBASSASIOFUNCTION(BASS_ASIO_Init);
-
-                /// Check if there is at least one ASIO capable device
-                if (BASS_ASIO_Init(-1, BASS_ASIO_THREAD))
-                {
-                    LOADBASSASIOFUNCTION(BASS_ASIO_Free);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_Stop);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_Start);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_GetInfo);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_GetRate);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_SetRate);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_SetNotify);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_ErrorGetCode);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_GetDeviceInfo);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelGetInfo);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelJoin);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelReset);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelEnable);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelIsActive);
-                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelSetFormat);
-
-                    BASS_ASIO_Free();
-                }
-                else
-                {
-                    FreeLibrary(bassAsio);
-                    bassAsio = NULL;
-                }
-            }
-
-            if (bassAsio)
-            {
-                return true;
-            }
-
-            // Load Bass
-            bass = LoadLibrary(bassPath);
-
-            if (!bass)
-            {
-                return false;
-            }
-
-            // Load Bass Wasapi
-            bassWasapi = LoadLibrary(bassWasapiPath);
-            
-            if (bass)
-            {
-                LOADBASSFUNCTION(BASS_Init);
-                LOADBASSFUNCTION(BASS_Free);
-                LOADBASSFUNCTION(BASS_SetConfig);
-                LOADBASSFUNCTION(BASS_ErrorGetCode);
-                LOADBASSFUNCTION(BASS_GetDeviceInfo);
-                LOADBASSFUNCTION(BASS_StreamCreate);
-                LOADBASSFUNCTION(BASS_StreamFree);
-                LOADBASSFUNCTION(BASS_ChannelPlay);
-                LOADBASSFUNCTION(BASS_ChannelStop);
-                LOADBASSFUNCTION(BASS_ChannelPause);
-                LOADBASSFUNCTION(BASS_ChannelPause);
-                LOADBASSFUNCTION(BASS_ChannelGetData);
-            }
-
-            if (bassWasapi)
-            {
-                LOADBASSWASAPIFUNCTION(BASS_WASAPI_Init);
-                LOADBASSWASAPIFUNCTION(BASS_WASAPI_Free);
-                LOADBASSWASAPIFUNCTION(BASS_WASAPI_Start);
-                LOADBASSWASAPIFUNCTION(BASS_WASAPI_Stop);
-                LOADBASSWASAPIFUNCTION(BASS_WASAPI_GetInfo);
-                LOADBASSWASAPIFUNCTION(BASS_WASAPI_GetDeviceInfo);
-            }
-
-            return true;
-        }
-
-        void LoadOutputDriverSettings()
-        {
-            HKEY hKey;
-
-            LSTATUS result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver\\Output Driver", 0, KEY_READ | KEY_WOW64_32KEY, &hKey);
-
-            if (result != NO_ERROR)
-            {
-                return;
-            }
-
-            DWORD values;
-            DWORD valueNameMaxSize;
-            DWORD valueMaxSize;
-
-            result = RegQueryInfoKey(hKey, NULL, NULL, NULL, NULL, NULL, NULL, &values, &valueNameMaxSize, &valueMaxSize, NULL, NULL);
-
-            if (result != NO_ERROR || values == 0)
-            {
-                return;
-            }
-
-            TCHAR* valueName = NULL;
-            DWORD valueNameSize = 0;
-            TCHAR* value = NULL;
-            DWORD valueSize = 0;
-
-            DWORD valueType = REG_NONE;
-
-            valueName = (TCHAR*)calloc(valueNameMaxSize + 1, sizeof(TCHAR));
-            value = (TCHAR*)calloc(valueMaxSize + 1, sizeof(TCHAR));
-
-            for (int i = 0; i < values; ++i)
-            {
-                valueNameSize = valueNameMaxSize + 1;
-                valueSize = valueMaxSize + 1;
-
-                result = RegEnumValue(hKey, i, valueName, &valueNameSize, NULL, &valueType, (LPBYTE)value, &valueSize);
-
-                if (result == NO_ERROR && valueType == REG_SZ)
-                {
-                    wstring tempName = valueName;
-                    wstring tempValue = value;
-
-                    outputDriver[tempName] = tempValue;
-                }
-            }
-
-            free(valueName);
-            free(value);
-        }
-
-        /// <summary>
-        /// Get the selected ASIO driver
-        /// </summary>
-        /// <param name="selectedDeviceId">The device id of the selected ASIO driver</param>
-        /// <param name="selectedChannelId">The channeld id of the selected ASIO driver</param>
-        void GetSelectedAsioDriver(int& selectedDeviceId, int& selectedChannelId)
-        {
-            selectedDeviceId = -1;
-            selectedChannelId = 0;
-
-            wstring selectedOutputDriver = outputDriver[asioValueName];
-
-            BASS_ASIO_DEVICEINFO asioDeviceInfo{};
-
-            for (size_t deviceId = 0; BASS_ASIO_Init(deviceId, BASS_ASIO_THREAD); ++deviceId)
-            {
-                BASS_ASIO_GetDeviceInfo(deviceId, &asioDeviceInfo);
-
-                wstring deviceName = wstring_convert<codecvt_utf8<wchar_t>>().from_bytes(asioDeviceInfo.name);
-
-                if (selectedOutputDriver.find(deviceName) == string::npos)
-                {
-                    continue;
-                }
-
-                selectedDeviceId = deviceId;
-
-                BASS_ASIO_CHANNELINFO channelInfo{};
-
-                size_t pos = strlen(asioDeviceInfo.name);
-
-                for (size_t channel = 0; BASS_ASIO_ChannelGetInfo(FALSE, channel, &channelInfo); ++channel)
-                {
-                    wstring channelName = wstring_convert<codecvt_utf8<wchar_t>>().from_bytes(channelInfo.name);
-                    if (selectedOutputDriver.find(channelName, pos) == string::npos)
-                    {
-                        continue;
-                    }
-
-                    selectedChannelId = channel;
-                    break;
-                }
-
-                BASS_ASIO_Free();
-            }
-        }
-
-        /// <summary>
-        /// Get the selected WASAPI driver
-        /// </summary>
-        void GetSelectedWasapiDriver(int& selectedDeviceId)
-        {
-            // -1 = default output device
-            selectedDeviceId = -1;
-
-            wstring selectedOutputDriver = outputDriver[wasapiValueName];
-
-            BASS_WASAPI_DEVICEINFO  deviceInfo{};
-
-            for (size_t deviceId = 0; BASS_WASAPI_GetDeviceInfo(deviceId, &deviceInfo); ++deviceId)
-            {
-                wstring deviceName = wstring_convert<codecvt_utf8<wchar_t>>().from_bytes(deviceInfo.name);
-                if (!(deviceInfo.flags & BASS_DEVICE_INPUT) && (deviceInfo.flags & BASS_DEVICE_ENABLED) && selectedOutputDriver.compare(deviceName) == 0)
-                {
-                    selectedDeviceId = deviceId;
-                    break;
-                }
-            }
-        }
-
-    public:
-        WaveOutWin32() noexcept
-        {
-        }
-
-        int Init(unsigned int bufferSize, unsigned int chunkSize, unsigned int sampleRate)
-        {
-            if (bassPath[0] == NULL)
-            {
-                InitializePaths();
-            }
-
-            LoadOutputDriverSettings();
-
-            wstring selectedMode = outputDriver[modeValueName];
-
-            if (!LoadBass(selectedMode))
-            {
-                return -1;
-            }
-
-            int deviceId;
-
-            if (bassAsio)
-            {
-                int channelId;
-
-                GetSelectedAsioDriver(deviceId, channelId);
-
-                if (!BASS_ASIO_Init(deviceId, BASS_ASIO_THREAD))
-                {
-                    return -2;
-                }
-
-                BASS_ASIO_SetRate(sampleRate);
-
-                sampleRate = BASS_ASIO_GetRate();
-
-                // Enable 1st output channel
-                BASS_ASIO_ChannelEnable(FALSE, channelId, AsioProc, this);
-
-                soundOutFloat = true;
-
-                // Join the next channel to it (stereo)
-                BASS_ASIO_ChannelJoin(FALSE, channelId + 1, channelId);
-
-                // Set the source format to FLOAT
-                // TODO: autodetect format or add format option in config
-                BASS_ASIO_ChannelSetFormat(FALSE, channelId, BASS_ASIO_FORMAT_FLOAT);
-
-                //BASS_ASIO_SetNotify((ASIONOTIFYPROC*)AsioNotifyProc, this);
-            }
-            else if (bassWasapi)
-            {
-                GetSelectedWasapiDriver(deviceId);
-
-                DWORD wasapiFlags = BASS_WASAPI_AUTOFORMAT;
-                wasapiFlags &= selectedMode.compare(L"WASAPI Shared") == 0 ? BASS_WASAPI_EVENT : BASS_WASAPI_EXCLUSIVE;
-                
-                if (!BASS_WASAPI_Init(deviceId, sampleRate, 2, wasapiFlags, 0, 0, WasapiProc, this))
-                {
-                    int error = BASS_ErrorGetCode();
-                    return -3;
-                }
-
-                BASS_WASAPI_INFO winfo{};
-
-                if (!BASS_WASAPI_GetInfo(&winfo))
-                {
-                    int error = BASS_ErrorGetCode();
-                    BASS_WASAPI_Free();
-                    return -4;
-                }
-
-                sampleRate = winfo.freq;
-
-                switch (winfo.format)
-                {
-                    case BASS_WASAPI_FORMAT_8BIT:
-                        wasapiBits = 8;
-                        break;
-
-                    default:
-                    case BASS_WASAPI_FORMAT_16BIT:
-                        wasapiBits = 16;
-                        break;
-
-                    case BASS_WASAPI_FORMAT_24BIT:
-                        wasapiBits = 24;
-                        break;
-
-                    case BASS_WASAPI_FORMAT_32BIT:
-                        wasapiBits = 32;
-                        break;
-
-                    case BASS_WASAPI_FORMAT_FLOAT:
-                        soundOutFloat = TRUE;
-                        break;
-                }
-            }
-            else if (bass)
-            {
-                if (!BASS_Init(deviceId, sampleRate, 0, NULL, NULL))
-                {
-                    int error = BASS_ErrorGetCode();
-                    return -5;
-                }
-
-                BASS_SetConfig(BASS_CONFIG_UPDATEPERIOD, 0);
-                BASS_SetConfig(BASS_CONFIG_VISTA_TRUEPOS, 0);
-                BASS_SetConfig(BASS_CONFIG_BUFFER, 0);
-
-                hStOutput = BASS_StreamCreate(sampleRate, 2, (soundOutFloat ? BASS_SAMPLE_FLOAT : 0), StreamProc, this);
-                if (!hStOutput)
-                {
-                    int error = BASS_ErrorGetCode();
-                    BASS_Free();
-                    return -6;
-                }
-            }
-
-            return sampleRate;
-        }
-
-        int Close() noexcept
-        {
-            if (bassAsio)
-            {
-                // Stop ASIO device in case it was playing
-                if (BASS_ASIO_IsStarted)
-                {
-                    BASS_ASIO_Stop();
-                }
-                BASS_ASIO_Free();
-
-                FreeLibrary(bassAsio);
-                bassAsio = NULL;
-            }
-
-            if (bassWasapi)
-            {
-                BASS_WASAPI_Stop(TRUE);
-                BASS_WASAPI_Free();
-                FreeLibrary(bassWasapi);
-                bassWasapi = NULL;
-            }
-            else if (hStOutput)
-            {
-                BASS_ChannelStop(hStOutput);
-                BASS_StreamFree(hStOutput);
-                hStOutput = NULL;
-            }
-
-            if (bass)
-            {
-                BASS_Free();
-                FreeLibrary(bass);
-                bass = NULL;
-            }
-
-            return 0;
-        }
-
-        int Start() noexcept
-        {
-            if (bassAsio)
-            {
-                BASS_ASIO_Start(buflen, 0);
-            }
-            else if (bassWasapi)
-            {
-                BASS_WASAPI_Start();
-            }
-            else if (hStOutput)
-            {
-                BASS_ChannelPlay(hStOutput, FALSE);
-            }
-
-            return 0;
-        }
-
-        int Pause() noexcept
-        {
-            if (bassAsio)
-            {
-                //BASS_ASIO_ChannelPause(FALSE, -1);
-            }
-            else if (bassWasapi)
-            {
-                BASS_WASAPI_Stop(FALSE);
-            }
-            else if (hStOutput)
-            {
-                BASS_ChannelPause(hStOutput);
-            }
-
-            return 0;
-        }
-
-        int Resume() noexcept
-        {
-            if (bassAsio)
-            {
-                //BASS_ASIO_ChannelReset(FALSE, -1, BASS_ASIO_RESET_PAUSE);
-            }
-            else if (bassWasapi)
-            {
-                BASS_WASAPI_Start();
-            }
-            else if (hStOutput)
-            {
-                BASS_ChannelPlay(hStOutput, FALSE);
-            }
-
-            return 0;
-        }
-
-        static DWORD CALLBACK AsioProc(BOOL input, DWORD channel, void* buffer, DWORD length, void* user) noexcept
-        {
-            WaveOutWin32* _this = (WaveOutWin32*)user;
-            if (_this->soundOutFloat)
-            {
-                midiSynth.RenderFloat((float*)buffer, length / 8);
-            }
-            else
-            {
-                midiSynth.Render((short*)buffer, length / 4);
-            }
-            return length;
-        }
-
-        static DWORD CALLBACK WasapiProc(void* buffer, DWORD length, void* user)
-        {
-            WaveOutWin32* _this = (WaveOutWin32*)user;
-            if (_this->soundOutFloat || _this->wasapiBits == 16)
-            {
-                return StreamProc(NULL, buffer, length, user);
-            }
-            else
-            {
-                int bytes_per_sample = _this->wasapiBits / 8;
-                int bytes_done = 0;
-                while (length)
-                {
-                    unsigned short sample_buffer[1024];
-                    int length_todo = (length / bytes_per_sample);
-                    if (length_todo > 512) length_todo = 512;
-                    int bytes_done_this = StreamProc(NULL, sample_buffer, length_todo * 4, 0);
-                    if (bytes_done_this <= 0) return bytes_done;
-                    if (bytes_per_sample == 4)
-                    {
-                        unsigned int* out = (unsigned int*)buffer;
-                        for (int i = 0; i < bytes_done_this; i += 2)
-                        {
-                            *out++ = sample_buffer[i / 2] << 16;
-                        }
-                        buffer = out;
-                    }
-                    else if (bytes_per_sample == 3)
-                    {
-                        unsigned char* out = (unsigned char*)buffer;
-                        for (int i = 0; i < bytes_done_this; i += 2)
-                        {
-                            int sample = sample_buffer[i / 2];
-                            *out++ = 0;
-                            *out++ = sample & 0xFF;
-                            *out++ = (sample >> 8) & 0xFF;
-                        }
-                        buffer = out;
-                    }
-                    else if (bytes_per_sample == 1)
-                    {
-                        unsigned char* out = (unsigned char*)buffer;
-                        for (int i = 0; i < bytes_done_this; i += 2)
-                        {
-                            *out++ = (sample_buffer[i / 2] >> 8) & 0xFF;
-                        }
-                        buffer = out;
-                    }
-                    bytes_done += (bytes_done_this / 2) * bytes_per_sample;
-                    length -= (bytes_done_this / 2) * bytes_per_sample;
-                }
-                return bytes_done;
-            }
-        }
-
-        static DWORD CALLBACK StreamProc(HSTREAM handle, void* buffer, DWORD length, void* user)
-        {
-            WaveOutWin32* _this = (WaveOutWin32*)user;
-            if (_this->soundOutFloat)
-            {
-                midiSynth.RenderFloat((float*)buffer, length / 8);
-            }
-            else
-            {
-                midiSynth.Render((short*)buffer, length / 4);
-            }
-            return length;
-        }
-
-        static void CALLBACK AsioNotifyProc(DWORD notify, void* user)
-        {
-            switch (notify)
-            {
-                case BASS_ASIO_NOTIFY_RATE:
-                    // The device's sample rate has changed. The new rate is available from BASS_ASIO_GetRate.
-                    break;
-
-                case BASS_ASIO_NOTIFY_RESET:
-                    // The driver has requested a reset/reinitialization; for example, following a change of the default buffer size.
-                    // This request can be ignored, but if a reinitialization is performed, it should not be done within the callback.
-                    break;
-            }
-        }
-    } waveOut;
-
-    MidiSynth::MidiSynth() noexcept {}
-
-    MidiSynth& MidiSynth::GetInstance()
-    {
-        static MidiSynth instance;
-        return instance;
-    }
-
-    // Renders totalFrames frames starting from bufpos
-    // The number of frames rendered is added to the global counter framesRendered
-    void MidiSynth::Render(short* bufpos, DWORD totalFrames)
-    {
-        DWORD count;
-        // Incoming MIDI messages timestamped with the current audio playback position + midiLatency
-        while ((count = midiStream.PeekMessageCount()))
-        {
-            DWORD msg;
-            DWORD sysex_len;
-            DWORD port;
-            unsigned char* sysex;
-            synthMutex.Enter();
-            midiStream.GetMessage(port, msg, sysex, sysex_len);
-            if (msg && !sysex)
-            {
-                vstDriver->ProcessMIDIMessage(port, msg);
-            }
-            else if (!msg && sysex && sysex_len)
-            {
-                vstDriver->ProcessSysEx(port, sysex, sysex_len);
-                free(sysex);
-            }
-            synthMutex.Leave();
-        }
-
-        synthMutex.Enter();
-        vstDriver->Render(bufpos, totalFrames);
-        synthMutex.Leave();
-    }
-
-    void MidiSynth::RenderFloat(float* bufpos, DWORD totalFrames)
-    {
-        DWORD count;
-        // Incoming MIDI messages timestamped with the current audio playback position + midiLatency
-        while ((count = midiStream.PeekMessageCount()))
-        {
-            DWORD msg;
-            DWORD sysex_len;
-            DWORD port;
-            unsigned char* sysex;
-            synthMutex.Enter();
-            midiStream.GetMessage(port, msg, sysex, sysex_len);
-            if (msg && !sysex)
-            {
-                vstDriver->ProcessMIDIMessage(port, msg);
-            }
-            else if (!msg && sysex && sysex_len)
-            {
-                vstDriver->ProcessSysEx(port, sysex, sysex_len);
-                free(sysex);
-            }
-            synthMutex.Leave();
-        }
-
-        synthMutex.Enter();
-        vstDriver->RenderFloat(bufpos, totalFrames);
-        synthMutex.Leave();
-    }
-
-    BOOL IsVistaOrNewer() noexcept
-    {
-        OSVERSIONINFOEX osvi;
-        BOOL bOsVersionInfoEx;
-        ZeroMemory(&osvi, sizeof(OSVERSIONINFOEX));
-        osvi.dwOSVersionInfoSize = sizeof(OSVERSIONINFOEX);
-        bOsVersionInfoEx = GetVersionEx((OSVERSIONINFO*)&osvi);
-
-        return bOsVersionInfoEx && osvi.dwPlatformId == VER_PLATFORM_WIN32_NT && osvi.dwMajorVersion > 5;
-    }
-
-    int MidiSynth::Init(unsigned uDeviceID)
-    {
-        // Init synth
-        if (synthMutex.Init())
-        {
-            return 1;
-        }
-
-        unsigned int sampleRate = 44100;
-        int wResult = waveOut.Init(bufferSize, chunkSize, sampleRate);
-        if (wResult < 0)
-        {
-            return -wResult;
-        }
-
-        sampleRate = wResult;
-
-        vstDriver = new VSTDriver;
-        if (!vstDriver->OpenVSTDriver(NULL, NULL, sampleRate))
-        {
-            delete vstDriver;
-            vstDriver = NULL;
-            return 1;
-        }
-
-        return waveOut.Start();
-    }
-
-    int MidiSynth::Reset(unsigned uDeviceID) noexcept
-    {
-        UINT wResult = waveOut.Pause();
-        if (wResult)
-        {
-            return wResult;
-        }
-
-        synthMutex.Enter();
-        vstDriver->ResetDriver();
-        midiStream.Reset();
-        synthMutex.Leave();
-
-        return waveOut.Resume();
-    }
-
-    /// <summary>
-    /// Put MIDI message to the midi stream.
-    /// </summary>
-    /// <param name="uDeviceID">The port type.</param>
-    /// <param name="dwParam1">The MIDI message to put.</param>
-    /// <returns></returns>
-    DWORD MidiSynth::PutMidiMessage(unsigned uDeviceID, DWORD dwParam1)
-    {
-        return midiStream.PutMessage(uDeviceID, dwParam1);
-    }
-
-    /// <summary>
-    /// Put MIDI SysEx message to the midi stream.
-    /// </summary>
-    /// <param name="uDeviceID">The port type.</param>
-    /// <param name="bufpos">The MIDI SysEx message to put.</param>
-    /// <param name="len">The length of the MIDI SysEx message.</param>
-    /// <returns></returns>
-    DWORD MidiSynth::PutSysEx(unsigned uDeviceID, unsigned char* bufpos, DWORD len)
-    {
-        return midiStream.PutSysEx(uDeviceID, bufpos, len);
-    }
-
-    void MidiSynth::Close() noexcept
-    {
-        waveOut.Close();
-
-        synthMutex.Enter();
-        vstDriver->CloseVSTDriver();
-        delete vstDriver;
-        vstDriver = NULL;
-        synthMutex.Leave();
-        synthMutex.Close();
-    }
+/* Copyright (C) 2011, 2012 Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+#include "winreg.h"
+#include <map>
+
+#undef GetMessage
+
+// Define BASSASIO functions as pointers
+#define BASSASIODEF(f) (WINAPI *f)
+#define LOADBASSASIOFUNCTION(f) *((void**)&f)=GetProcAddress(bassAsio,#f)
+
+// Define BASS functions as pointers
+#define BASSDEF(f) (WINAPI *f)
+#define LOADBASSFUNCTION(f) *((void**)&f)=GetProcAddress(bass,#f)
+
+// Define BASSWASAPI functions as pointers
+#define BASSWASAPIDEF(f) (WINAPI *f)
+#define LOADBASSWASAPIFUNCTION(f) *((void**)&f)=GetProcAddress(bassWasapi,#f)
+
+#include <bass.h>
+#include <bassasio.h>
+#include <basswasapi.h>
+
+#include "VSTDriver.h"
+#include "DriverSettings.h"
+#include "MessagePlacement.h"
+#include "MidiStream.h"
+#include "PriorityLanes.h"
+#include "StreamScheduler.h"
+#include <string>
+#include <codecvt>
+
+using std::string;
+using std::wstring;
+using std::map;
+using std::wstring_convert;
+using std::codecvt_utf8;
+
+
+extern "C" { extern HINSTANCE hinst_vst_driver; }
+
+namespace VSTMIDIDRV
+{
+    static MidiSynth& midiSynth = MidiSynth::GetInstance();
+
+    static SysExSlab sysExSlabs[2];
+
+    SysExSlab& GetSysExSlab(DWORD port) noexcept
+    {
+        return sysExSlabs[port < _countof(sysExSlabs) ? port : 0];
+    }
+
+    static MidiStream midiStream;
+
+    /// <summary>
+    /// The messages of the block which is queued, used by the render path only
+    /// </summary>
+    static std::vector<ScheduledMessage> blockMessages;
+
+    /// <summary>
+    /// Removes the continuous controller, pitch bend and pressure messages of a block which are superseded by a later value,
+    /// and repeated identical System Exclusive resets. Used when the render path falls behind and the backlog is long.
+    /// A note or any other message of a channel ends the run of a value, so the notes are neither dropped nor reordered
+    /// and every note still hears the values which were sent before it.
+    /// </summary>
+    static class Coalescer
+    {
+    private:
+        static const DWORD ports = 2;
+
+        /// <summary>
+        /// The slots of a channel: the controllers, the poly pressure of the keys, the pitch bend and the channel pressure
+        /// </summary>
+        enum : DWORD
+        {
+            PolyPressureSlot = 128,
+            PitchBendSlot = 256,
+            ChannelPressureSlot = 257,
+            SlotCount = 258,
+        };
+
+        /// <summary>
+        /// The run of a channel, increased when a message ends the runs of the channel
+        /// </summary>
+        DWORD channelRun[ports][16];
+
+        /// <summary>
+        /// The run in which a later message of the slot was seen, a message whose slot is seen in its run is superseded
+        /// </summary>
+        DWORD seen[ports][16][SlotCount];
+
+        DWORD run = 0;
+
+        MidiCoalesceStatistics statistics = {};
+
+        /// <summary>
+        /// The controllers which carry a continuous value. Switches, bank select, data entry, (N)RPN and channel mode
+        /// messages depend on their order and are never removed.
+        /// </summary>
+        static bool IsContinuousController(DWORD controller) noexcept
+        {
+            if (controller == 0 || controller == 6 || controller == 32 || controller == 38)
+            {
+                return false;
+            }
+            return controller < 64 || (controller >= 70 && controller < 96) || (controller >= 102 && controller < 120);
+        }
+
+        static bool IsReset(const unsigned char* sysEx, DWORD length) noexcept
+        {
+            static const unsigned char gmOn[] = { 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7 };
+            static const unsigned char gm2On[] = { 0xF0, 0x7E, 0x7F, 0x09, 0x03, 0xF7 };
+            static const unsigned char gsReset[] = { 0xF0, 0x41, 0x10, 0x42, 0x12, 0x40, 0x00, 0x7F, 0x00, 0x41, 0xF7 };
+            static const unsigned char xgOn[] = { 0xF0, 0x43, 0x10, 0x4C, 0x00, 0x00, 0x7E, 0x00, 0xF7 };
+
+            return (length == sizeof(gmOn) && !memcmp(sysEx, gmOn, length))
+                || (length == sizeof(gm2On) && !memcmp(sysEx, gm2On, length))
+                || (length == sizeof(gsReset) && !memcmp(sysEx, gsReset, length))
+                || (length == sizeof(xgOn) && !memcmp(sysEx, xgOn, length));
+        }
+
+        void EndRuns(DWORD port) noexcept
+        {
+            for (DWORD channel = 0; channel < 16; ++channel)
+            {
+                channelRun[port][channel] = ++run;
+            }
+        }
+
+        void EndAllRuns() noexcept
+        {
+            for (DWORD port = 0; port < ports; ++port)
+            {
+                EndRuns(port);
+            }
+        }
+
+    public:
+        void Init() noexcept
+        {
+            memset(channelRun, 0, sizeof(channelRun));
+            memset(seen, 0, sizeof(seen));
+            run = 0;
+            EndAllRuns();
+            statistics = {};
+        }
+
+        /// <summary>
+        /// Mark the superseded messages of a block
+        /// </summary>
+        /// <param name="messages">The messages of the block in their order</param>
+        /// <param name="subBlockFrames">The values are kept per sub-block of this many frames, 0 keeps one value per block</param>
+        void Run(std::vector<ScheduledMessage>& messages, DWORD subBlockFrames) noexcept
+        {
+            DWORD coalesced = 0;
+
+            // Backwards, so the later value of a slot is seen first
+            EndAllRuns();
+            DWORD subBlock = ~0u;
+
+            for (size_t i = messages.size(); i--; )
+            {
+                ScheduledMessage& scheduled = messages[i];
+                const MidiStream::Message& message = scheduled.message;
+                DWORD port = message.port < ports ? message.port : 0;
+
+                if (subBlockFrames && scheduled.offset / subBlockFrames != subBlock)
+                {
+                    subBlock = scheduled.offset / subBlockFrames;
+                    EndAllRuns();
+                }
+
+                if (message.sysEx)
+                {
+                    EndRuns(port);
+                    continue;
+                }
+
+                DWORD status = message.message & 0xFF;
+                DWORD channel = status & 0x0F;
+                DWORD data1 = (message.message >> 8) & 0x7F;
+
+                DWORD slot;
+                switch (status & 0xF0)
+                {
+                    case 0xA0:
+                        slot = PolyPressureSlot + data1;
+                        break;
+
+                    case 0xB0:
+                        slot = IsContinuousController(data1) ? data1 : SlotCount;
+                        break;
+
+                    case 0xD0:
+                        slot = ChannelPressureSlot;
+                        break;
+
+                    case 0xE0:
+                        slot = PitchBendSlot;
+                        break;
+
+                    default:
+                        // Notes and everything else keep the values before them, system messages and running status concern every channel
+                        if (status < 0x80 || status >= 0xF0)
+                        {
+                            EndRuns(port);
+                        }
+                        else
+                        {
+                            channelRun[port][channel] = ++run;
+                        }
+                        continue;
+                }
+
+                if (slot == SlotCount)
+                {
+                    channelRun[port][channel] = ++run;
+                    continue;
+                }
+
+                if (seen[port][channel][slot] == channelRun[port][channel])
+                {
+                    scheduled.superseded = true;
+                    ++coalesced;
+                }
+                else
+                {
+                    seen[port][channel][slot] = channelRun[port][channel];
+                }
+            }
+
+            // Forwards, a reset which repeats the previous message of its port does nothing
+            const ScheduledMessage* previous[ports] = {};
+            DWORD resets = 0;
+
+            for (ScheduledMessage& scheduled : messages)
+            {
+                if (scheduled.superseded)
+                {
+                    continue;
+                }
+
+                const MidiStream::Message& message = scheduled.message;
+                DWORD port = message.port < ports ? message.port : 0;
+
+                if (message.sysEx && previous[port] && previous[port]->message.sysEx
+                    && previous[port]->message.sysExLength == message.sysExLength
+                    && IsReset(message.sysEx, message.sysExLength)
+                    && !memcmp(previous[port]->message.sysEx, message.sysEx, message.sysExLength))
+                {
+                    scheduled.superseded = true;
+                    ++resets;
+                    continue;
+                }
+
+                previous[port] = &scheduled;
+            }
+
+            ++statistics.blocks;
+            statistics.coalesced += coalesced;
+            statistics.resets += resets;
+        }
+
+        void GetStatistics(MidiCoalesceStatistics& out) const noexcept
+        {
+            out = statistics;
+        }
+    } coalescer;
+
+    static PriorityLanes priorityLanes;
+
+    /// <summary>
+    /// Caps the number of notes which sound at once, so a note flood does not make the VSTi miss its render deadline.
+    /// The notes are tracked per port, channel and key from the messages which are sent to the VST driver.
+    /// Over the limit a new note either steals a sounding one, which gets a note off, or is dropped.
+    /// The limit is the VoiceLimit setting, lowered while the VSTi renders slower than real time and raised again one voice per block.
+    /// </summary>
+    static class VoiceGovernor
+    {
+    public:
+        enum StealPolicy
+        {
+            /// <summary>
+            /// The new note is dropped
+            /// </summary>
+            DropNew = 0,
+            /// <summary>
+            /// The note which started first is stolen
+            /// </summary>
+            Oldest = 1,
+            /// <summary>
+            /// The oldest of the notes with the lowest velocity is stolen
+            /// </summary>
+            Quietest = 2,
+            /// <summary>
+            /// The oldest note of the highest channel is stolen, channel 1 has the highest priority
+            /// </summary>
+            LowestPriorityChannel = 3,
+        };
+
+    private:
+        static const DWORD ports = 2;
+        static const int voiceCount = ports * 16 * 128;
+        static const int classCount = 128;
+        /// <summary>
+        /// The limit is not lowered below this many voices
+        /// </summary>
+        static const DWORD minimumLimit = 16;
+
+        DWORD voiceLimit = 0;
+        DWORD limit = 0;
+        StealPolicy policy = Oldest;
+        uint64_t slowBlocks = 0;
+
+        /// <summary>
+        /// The sounding voices, indexed by port, channel and key, in lists by steal class which are ordered by age
+        /// </summary>
+        bool active[voiceCount];
+        BYTE voiceClass[voiceCount];
+        int previous[voiceCount];
+        int next[voiceCount];
+        int head[classCount];
+        int tail[classCount];
+        DWORD activeCount = 0;
+
+        MidiVoiceStatistics statistics = {};
+
+        void Unlink(int voice) noexcept
+        {
+            int cls = voiceClass[voice];
+            (previous[voice] < 0 ? head[cls] : next[previous[voice]]) = next[voice];
+            (next[voice] < 0 ? tail[cls] : previous[next[voice]]) = previous[voice];
+            active[voice] = false;
+            --activeCount;
+        }
+
+        void Link(int voice, BYTE cls) noexcept
+        {
+            voiceClass[voice] = cls;
+            previous[voice] = tail[cls];
+            next[voice] = -1;
+            (tail[cls] < 0 ? head[cls] : next[tail[cls]]) = voice;
+            tail[cls] = voice;
+            active[voice] = true;
+            ++activeCount;
+        }
+
+        /// <summary>
+        /// The class of a voice, the classes are stolen from in ascending order
+        /// </summary>
+        BYTE GetClass(DWORD port, DWORD channel, DWORD velocity) const noexcept
+        {
+            switch (policy)
+            {
+                case Quietest:
+                    return (BYTE)velocity;
+
+                case LowestPriorityChannel:
+                    return (BYTE)((15 - channel) * ports + port);
+
+                default:
+                    return 0;
+            }
+        }
+
+        void ReleaseChannel(DWORD port, DWORD channel) noexcept
+        {
+            int first = (port * 16 + channel) * 128;
+            for (int voice = first; voice < first + 128; ++voice)
+            {
+                if (active[voice])
+                {
+                    Unlink(voice);
+                }
+            }
+        }
+
+    public:
+        void Init(DWORD voiceLimit, DWORD policy) noexcept
+        {
+            this->voiceLimit = voiceLimit;
+            this->policy = policy <= LowestPriorityChannel ? (StealPolicy)policy : Oldest;
+            limit = voiceLimit;
+            statistics = {};
+            Reset();
+        }
+
+        /// <summary>
+        /// Forget the sounding voices, after the VSTi was reset
+        /// </summary>
+        void Reset() noexcept
+        {
+            memset(active, 0, sizeof(active));
+            for (int cls = 0; cls < classCount; ++cls)
+            {
+                head[cls] = -1;
+                tail[cls] = -1;
+            }
+            activeCount = 0;
+        }
+
+        bool IsEnabled() const noexcept
+        {
+            return voiceLimit != 0;
+        }
+
+        /// <summary>
+        /// Adapt the limit to the render time before a block is queued
+        /// </summary>
+        /// <param name="renderStatistics">The counters of the render replies of the VST driver</param>
+        void BeginBlock(const RenderStatistics& renderStatistics) noexcept
+        {
+            if (!voiceLimit)
+            {
+                return;
+            }
+
+            if (renderStatistics.slowBlocks != slowBlocks)
+            {
+                // The VSTi took longer than the block plays, the voices which sound now are too many
+                slowBlocks = renderStatistics.slowBlocks;
+                DWORD lowered = activeCount * 3 / 4;
+                lowered = lowered > minimumLimit ? lowered : minimumLimit;
+                limit = lowered < voiceLimit ? lowered : voiceLimit;
+            }
+            else if (limit < voiceLimit)
+            {
+                ++limit;
+            }
+
+            statistics.limit = limit;
+        }
+
+        /// <summary>
+        /// Track a message which is about to be sent and make room for a new note
+        /// </summary>
+        /// <param name="port">The port</param>
+        /// <param name="message">The MIDI message</param>
+        /// <param name="offset">The frame offset of the message, the note off of a stolen voice is sent at the same offset</param>
+        /// <param name="vstDriver">Receives the note offs of the stolen voices</param>
+        /// <returns>false if the message is dropped</returns>
+        bool Admit(DWORD port, DWORD message, DWORD offset, VSTDriver* vstDriver) noexcept
+        {
+            if (!voiceLimit || port >= ports)
+            {
+                return true;
+            }
+
+            DWORD status = message & 0xF0;
+            DWORD channel = message & 0x0F;
+            DWORD key = (message >> 8) & 0x7F;
+            DWORD velocity = (message >> 16) & 0x7F;
+
+            if (status == 0xB0 && (key == 120 || key == 123))
+            {
+                // All Sound Off, All Notes Off
+                ReleaseChannel(port, channel);
+                return true;
+            }
+
+            if (status != 0x80 && status != 0x90)
+            {
+                return true;
+            }
+
+            int voice = (port * 16 + channel) * 128 + key;
+
+            if (status == 0x80 || !velocity)
+            {
+                if (active[voice])
+                {
+                    Unlink(voice);
+                }
+                return true;
+            }
+
+            // A repeated note on of a sounding key starts no new voice, it only gets younger
+            if (active[voice])
+            {
+                Unlink(voice);
+            }
+            else if (activeCount >= limit)
+            {
+                if (policy == DropNew)
+                {
+                    ++statistics.dropped;
+                    return false;
+                }
+
+                int cls = 0;
+                while (cls < classCount && head[cls] < 0)
+                {
+                    ++cls;
+                }
+
+                if (cls < classCount)
+                {
+                    int stolen = head[cls];
+                    Unlink(stolen);
+                    vstDriver->QueueMIDIMessage(stolen / (16 * 128), 0x80 | ((stolen / 128) % 16) | ((stolen % 128) << 8), offset);
+                    ++statistics.stolen;
+                }
+            }
+
+            Link(voice, GetClass(port, channel, velocity));
+
+            statistics.active = activeCount;
+            if (activeCount > statistics.peak)
+            {
+                statistics.peak = activeCount;
+            }
+
+            return true;
+        }
+
+        void GetStatistics(MidiVoiceStatistics& out) const noexcept
+        {
+            out = statistics;
+            out.active = activeCount;
+        }
+    } voiceGovernor;
+
+    /// <summary>
+    /// Drops the MIDI messages the VSTi does not need before they are queued, such as Active Sensing or Timing Clock.
+    /// The rules are the DWORD settings MidiFilter0 to MidiFilter15, read until the first missing one:
+    ///     bits 0-7    the status, 0x80 to 0xE0 for a channel message type, 0xF0 to 0xFF for a system message
+    ///     bits 8-15   the controller of a control change, 0xFF for all controllers
+    ///     bits 16-31  the channel mask of a channel message, bit 0 for channel 1, 0 for all channels
+    /// Without MidiFilter0 nothing is dropped. The rules are compiled to lookup tables, so a message costs two lookups at most.
+    /// </summary>
+    static class MidiFilter
+    {
+    private:
+        /// <summary>
+        /// The rule which drops a status byte, the rule number plus 1 or 0 if none does
+        /// </summary>
+        BYTE statusRule[256];
+        /// <summary>
+        /// The rule which drops a controller of a channel, looked up before statusRule
+        /// </summary>
+        BYTE controllerRule[16][128];
+
+        DWORD ruleCount = 0;
+        DWORD rules[MidiFilterStatistics::MaxRules];
+        volatile LONG filtered[MidiFilterStatistics::MaxRules];
+
+        void Compile(DWORD rule, DWORD number) noexcept
+        {
+            DWORD status = rule & 0xFF;
+            DWORD controller = (rule >> 8) & 0xFF;
+            DWORD channelMask = rule >> 16;
+            BYTE entry = (BYTE)(number + 1);
+
+            if (status < 0x80)
+            {
+                return;
+            }
+
+            if (status >= 0xF0)
+            {
+                if (!statusRule[status])
+                {
+                    statusRule[status] = entry;
+                }
+                return;
+            }
+
+            for (DWORD channel = 0; channel < 16; ++channel)
+            {
+                if (channelMask && !(channelMask & (1 << channel)))
+                {
+                    continue;
+                }
+
+                if ((status & 0xF0) == 0xB0 && controller < 128)
+                {
+                    if (!controllerRule[channel][controller])
+                    {
+                        controllerRule[channel][controller] = entry;
+                    }
+                }
+                else if (!statusRule[(status & 0xF0) | channel])
+                {
+                    statusRule[(status & 0xF0) | channel] = entry;
+                }
+            }
+        }
+
+        bool Count(BYTE entry) noexcept
+        {
+            if (!entry)
+            {
+                return false;
+            }
+
+            InterlockedIncrement(&filtered[entry - 1]);
+            return true;
+        }
+
+    public:
+        void Init() noexcept
+        {
+            memset(statusRule, 0, sizeof(statusRule));
+            memset(controllerRule, 0, sizeof(controllerRule));
+            ruleCount = 0;
+
+            for (DWORD number = 0; number < MidiFilterStatistics::MaxRules; ++number)
+            {
+                TCHAR valueName[32];
+                _stprintf_s(valueName, _T("MidiFilter%u"), number);
+
+                DWORD rule = GetDriverSetting(valueName, 0);
+                if (!rule)
+                {
+                    break;
+                }
+
+                rules[ruleCount] = rule;
+                filtered[ruleCount] = 0;
+                Compile(rule, ruleCount);
+                ++ruleCount;
+            }
+        }
+
+        /// <summary>
+        /// Tell whether a short MIDI message is dropped, and count it for the rule which drops it
+        /// </summary>
+        /// <param name="message">The MIDI message</param>
+        /// <returns>true if the message is dropped</returns>
+        bool Drop(DWORD message) noexcept
+        {
+            DWORD status = message & 0xFF;
+            if ((status & 0xF0) == 0xB0 && Count(controllerRule[status & 0x0F][(message >> 8) & 0x7F]))
+            {
+                return true;
+            }
+            return Count(statusRule[status]);
+        }
+
+        /// <summary>
+        /// Tell whether a MIDI System Exclusive message is dropped, by a rule for the status 0xF0
+        /// </summary>
+        /// <returns>true if the message is dropped</returns>
+        bool DropSysEx() noexcept
+        {
+            return Count(statusRule[0xF0]);
+        }
+
+        void GetStatistics(MidiFilterStatistics& out) const noexcept
+        {
+            out.rules = ruleCount;
+            for (DWORD number = 0; number < ruleCount; ++number)
+            {
+                out.rule[number] = rules[number];
+                out.filtered[number] = filtered[number];
+            }
+        }
+    } midiFilter;
+
+    static class SynthMutexWin32
+    {
+    private:
+        CRITICAL_SECTION cCritSec;
+
+    public:
+        int Init() noexcept
+        {
+            InitializeCriticalSection(&cCritSec);
+            return 0;
+        }
+
+        void Close() noexcept
+        {
+            DeleteCriticalSection(&cCritSec);
+        }
+
+        void Enter() noexcept
+        {
+            EnterCriticalSection(&cCritSec);
+        }
+
+        void Leave() noexcept
+        {
+            LeaveCriticalSection(&cCritSec);
+        }
+    } synthMutex;
+
+    /// <summary>
+    /// Single producer / single consumer FIFO of rendered stereo frames.
+    /// The render thread writes the frames ahead of time, the audio device callback only copies them out.
+    /// </summary>
+    static class RenderAheadFifo
+    {
+    private:
+        static const unsigned int channels = 2;
+
+        std::vector<float> frames;
+        unsigned int capacity = 0;
+
+        /// <summary>
+        /// Running frame counters, the index in the FIFO is position & (capacity - 1)
+        /// </summary>
+        volatile LONG writePos = 0;
+        volatile LONG readPos = 0;
+
+        /// <summary>
+        /// The time of the last read and the total number of frames read until then, guarded by clockLock
+        /// </summary>
+        CRITICAL_SECTION clockLock;
+        LONGLONG readTime = 0;
+        LONGLONG framesRead = 0;
+
+    public:
+        /// <summary>
+        /// Allocate the FIFO
+        /// </summary>
+        /// <param name="minimumFrames">The minimum capacity in frames, rounded up to a power of two</param>
+        void Init(unsigned int minimumFrames)
+        {
+            capacity = 1;
+            while (capacity < minimumFrames)
+            {
+                capacity <<= 1;
+            }
+
+            frames.assign(capacity * channels, 0.0f);
+            writePos = 0;
+            readPos = 0;
+            readTime = 0;
+            framesRead = 0;
+
+            InitializeCriticalSection(&clockLock);
+        }
+
+        void Close()
+        {
+            DeleteCriticalSection(&clockLock);
+            frames.clear();
+            capacity = 0;
+        }
+
+        /// <summary>
+        /// Get the number of frames which are written but not read yet
+        /// </summary>
+        unsigned int GetAvailable()
+        {
+            return (unsigned int)writePos - (unsigned int)InterlockedCompareExchange(&readPos, 0, 0);
+        }
+
+        /// <summary>
+        /// Write interleaved frames (render thread)
+        /// </summary>
+        /// <param name="in">The interleaved frames</param>
+        /// <param name="count">The number of frames, at most the capacity minus GetAvailable()</param>
+        void Write(const float* in, unsigned int count)
+        {
+            unsigned int position = (unsigned int)writePos;
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                float* out = &frames[((position + i) & (capacity - 1)) * channels];
+                out[0] = in[0];
+                out[1] = in[1];
+                in += channels;
+            }
+
+            /// Publish the frames only after they are written
+            InterlockedExchange(&writePos, (LONG)(position + count));
+        }
+
+        /// <summary>
+        /// Read interleaved frames, the frames which are not rendered yet are silent (audio device callback)
+        /// </summary>
+        /// <param name="out">The interleaved output buffer</param>
+        /// <param name="count">The number of frames to read</param>
+        /// <returns>The number of rendered frames read</returns>
+        unsigned int Read(float* out, unsigned int count)
+        {
+            unsigned int position = (unsigned int)readPos;
+            unsigned int available = (unsigned int)InterlockedCompareExchange(&writePos, 0, 0) - position;
+            unsigned int done = count < available ? count : available;
+
+            for (unsigned int i = 0; i < done; ++i)
+            {
+                const float* in = &frames[((position + i) & (capacity - 1)) * channels];
+                out[0] = in[0];
+                out[1] = in[1];
+                out += channels;
+            }
+
+            if (done < count)
+            {
+                memset(out, 0, sizeof(*out) * (count - done) * channels);
+            }
+
+            InterlockedExchange(&readPos, (LONG)(position + done));
+
+            LARGE_INTEGER now;
+            QueryPerformanceCounter(&now);
+
+            EnterCriticalSection(&clockLock);
+            readTime = now.QuadPart;
+            framesRead += count;
+            LeaveCriticalSection(&clockLock);
+
+            return done;
+        }
+
+        /// <summary>
+        /// Get the playback clock, the frame which is played at the performance counter value readTime
+        /// </summary>
+        /// <param name="time">The performance counter value of the last read, 0 before the first read</param>
+        /// <param name="frames">The total number of frames read until then</param>
+        void GetReadClock(LONGLONG& time, LONGLONG& frames)
+        {
+            EnterCriticalSection(&clockLock);
+            time = readTime;
+            frames = framesRead;
+            LeaveCriticalSection(&clockLock);
+        }
+    } renderFifo;
+
+    static PlaybackClock playbackClock;
+
+    static MessagePlacement messagePlacement;
+
+    /// <summary>
+    /// The MIDI stream (MIDI_IO_COOKED) of a port.
+    /// The client queues its buffers from its own thread, the render path plays them block by block.
+    /// </summary>
+    static class StreamPort
+    {
+    public:
+        /// <summary>
+        /// A MOM_DONE or MOM_POSITIONCB for the client, sent once no lock is held
+        /// </summary>
+        struct Notification
+        {
+            StreamNotify notify;
+            void* context;
+            UINT message;
+            DWORD offset;
+        };
+
+    private:
+        CRITICAL_SECTION lock;
+        bool open = false;
+        StreamScheduler scheduler;
+        StreamNotify notify = NULL;
+
+        /// <summary>
+        /// The events of the block which is rendered, they are queued to the VST driver by the render path
+        /// </summary>
+        DWORD port = 0;
+        VSTDriver* vstDriver = NULL;
+        std::vector<Notification>* notifications = NULL;
+
+    public:
+        void Init(DWORD port) noexcept
+        {
+            InitializeCriticalSection(&lock);
+            this->port = port;
+            open = false;
+        }
+
+        void Close() noexcept
+        {
+            DeleteCriticalSection(&lock);
+        }
+
+        /// <summary>
+        /// Open the stream, a port has one stream at most
+        /// </summary>
+        /// <param name="sampleRate">The sample rate of the rendered audio</param>
+        /// <param name="notify">Reports MOM_DONE and MOM_POSITIONCB for the queued buffers</param>
+        /// <returns>false if the stream is open already</returns>
+        bool Open(DWORD sampleRate, StreamNotify notify) noexcept
+        {
+            EnterCriticalSection(&lock);
+            bool opened = !open;
+            if (opened)
+            {
+                scheduler.Init(sampleRate);
+                this->notify = notify;
+                open = true;
+            }
+            LeaveCriticalSection(&lock);
+            return opened;
+        }
+
+        /// <summary>
+        /// Close the stream, the queued buffers are returned
+        /// </summary>
+        void Shut() noexcept
+        {
+            Stop();
+
+            EnterCriticalSection(&lock);
+            open = false;
+            LeaveCriticalSection(&lock);
+        }
+
+        bool IsOpen() const noexcept
+        {
+            return open;
+        }
+
+        DWORD Enqueue(const unsigned char* data, DWORD size, void* context) noexcept
+        {
+            EnterCriticalSection(&lock);
+            if (!open)
+            {
+                LeaveCriticalSection(&lock);
+                return MMSYSERR_NOTENABLED;
+            }
+            StreamScheduler::Buffer buffer = { data, size, context };
+            scheduler.Enqueue(buffer);
+            LeaveCriticalSection(&lock);
+            return MMSYSERR_NOERROR;
+        }
+
+        void Restart() noexcept
+        {
+            EnterCriticalSection(&lock);
+            scheduler.Restart();
+            LeaveCriticalSection(&lock);
+        }
+
+        void Pause() noexcept
+        {
+            EnterCriticalSection(&lock);
+            scheduler.Pause();
+            LeaveCriticalSection(&lock);
+        }
+
+        /// <summary>
+        /// Return the queued buffers and rewind the stream
+        /// </summary>
+        void Stop() noexcept
+        {
+            std::vector<Notification> done;
+
+            EnterCriticalSection(&lock);
+            notifications = &done;
+            scheduler.Stop(*this);
+            notifications = NULL;
+            LeaveCriticalSection(&lock);
+
+            Send(done);
+        }
+
+        /// <summary>
+        /// Get or set the tempo or the time division, as MODM_PROPERTIES
+        /// </summary>
+        /// <param name="property">A MIDIPROPTEMPO or MIDIPROPTIMEDIV</param>
+        /// <param name="flags">MIDIPROP_GET or MIDIPROP_SET, and MIDIPROP_TEMPO or MIDIPROP_TIMEDIV</param>
+        /// <returns>MMSYSERR_NOERROR on success</returns>
+        DWORD Property(LPBYTE property, DWORD flags) noexcept
+        {
+            bool get = (flags & MIDIPROP_GET) != 0;
+            if (get == ((flags & MIDIPROP_SET) != 0))
+            {
+                return MMSYSERR_INVALFLAG;
+            }
+
+            DWORD result = MMSYSERR_NOERROR;
+
+            EnterCriticalSection(&lock);
+            if (flags & MIDIPROP_TEMPO)
+            {
+                MIDIPROPTEMPO* tempo = (MIDIPROPTEMPO*)property;
+                if (tempo->cbStruct < sizeof(*tempo))
+                {
+                    result = MMSYSERR_INVALPARAM;
+                }
+                else if (get)
+                {
+                    tempo->dwTempo = scheduler.GetTempo();
+                }
+                else
+                {
+                    scheduler.SetTempo(tempo->dwTempo);
+                }
+            }
+            else if (flags & MIDIPROP_TIMEDIV)
+            {
+                MIDIPROPTIMEDIV* timeDivision = (MIDIPROPTIMEDIV*)property;
+                if (timeDivision->cbStruct < sizeof(*timeDivision))
+                {
+                    result = MMSYSERR_INVALPARAM;
+                }
+                else if (get)
+                {
+                    timeDivision->dwTimeDiv = scheduler.GetTimeDivision();
+                }
+                else
+                {
+                    scheduler.SetTimeDivision(timeDivision->dwTimeDiv);
+                }
+            }
+            else
+            {
+                result = MMSYSERR_INVALPARAM;
+            }
+            LeaveCriticalSection(&lock);
+
+            return result;
+        }
+
+        /// <summary>
+        /// Get the position of the stream, in ticks or in milliseconds
+        /// </summary>
+        /// <param name="time">The position, TIME_TICKS and TIME_MS are supported, other formats are answered in TIME_MS</param>
+        DWORD GetPosition(MMTIME* time) noexcept
+        {
+            uint64_t ticks;
+            uint64_t milliseconds;
+
+            EnterCriticalSection(&lock);
+            scheduler.GetPosition(ticks, milliseconds);
+            LeaveCriticalSection(&lock);
+
+            if (time->wType == TIME_TICKS)
+            {
+                time->u.ticks = (DWORD)ticks;
+            }
+            else
+            {
+                time->wType = TIME_MS;
+                time->u.ms = (DWORD)milliseconds;
+            }
+
+            return MMSYSERR_NOERROR;
+        }
+
+        /// <summary>
+        /// Queue the events which are due within the block to the VST driver, under the synth mutex
+        /// </summary>
+        /// <param name="frames">The length of the block</param>
+        /// <param name="vstDriver">The VST driver</param>
+        /// <param name="out">Receives the notifications for the client, to be sent with Send</param>
+        void Render(DWORD frames, VSTDriver* vstDriver, std::vector<Notification>& out) noexcept
+        {
+            if (!open || !frames)
+            {
+                return;
+            }
+
+            EnterCriticalSection(&lock);
+            this->vstDriver = vstDriver;
+            notifications = &out;
+            scheduler.Render(frames, *this);
+            notifications = NULL;
+            LeaveCriticalSection(&lock);
+        }
+
+        /// <summary>
+        /// Send the notifications, without holding a lock
+        /// </summary>
+        static void Send(const std::vector<Notification>& out) noexcept
+        {
+            for (const Notification& notification : out)
+            {
+                notification.notify(notification.context, notification.message, notification.offset);
+            }
+        }
+
+        // StreamScheduler sink
+        void ShortMessage(uint32_t offset, uint32_t message) noexcept
+        {
+            if (!midiFilter.Drop(message) && voiceGovernor.Admit(port, message, offset, vstDriver))
+            {
+                vstDriver->QueueMIDIMessage(port, message, offset);
+            }
+        }
+
+        void LongMessage(uint32_t offset, const uint8_t* data, uint32_t length) noexcept
+        {
+            if (!midiFilter.DropSysEx())
+            {
+                vstDriver->QueueSysEx(port, data, length, offset);
+            }
+        }
+
+        void Position(void* context, uint32_t bufferOffset) noexcept
+        {
+            Notification notification = { notify, context, MOM_POSITIONCB, bufferOffset };
+            notifications->push_back(notification);
+        }
+
+        void Done(void* context) noexcept
+        {
+            Notification notification = { notify, context, MOM_DONE, 0 };
+            notifications->push_back(notification);
+        }
+    } streamPorts[2];
+
+    static StreamPort& GetStreamPort(DWORD port) noexcept
+    {
+        return streamPorts[port < _countof(streamPorts) ? port : 0];
+    }
+
+    /// <summary>
+    /// The notifications of the streams for the block which is rendered, used by the render path only
+    /// </summary>
+    static std::vector<StreamPort::Notification> streamNotifications;
+
+    static class WaveOutWin32
+    {
+    private:
+        HINSTANCE bass = NULL;          // bass handle
+        HINSTANCE bassAsio = NULL;      // bassasio handle
+        HINSTANCE bassWasapi = NULL;    // basswasapi handle
+
+        HSTREAM hStOutput = NULL;
+
+        TCHAR* modeValueName = L"Mode";
+        TCHAR* asioValueName = L"ASIO";
+        TCHAR* wasapiValueName = L"WASAPI";
+
+        bool soundOutFloat = false;
+        DWORD wasapiBits = 16;
+        DWORD buflen = 0;
+
+        /// <summary>
+        /// The number of frames the audio device asks for at once, 0 if the output does not tell
+        /// </summary>
+        DWORD periodFrames = 0;
+
+        TCHAR installPath[MAX_PATH] = { 0 };
+        TCHAR bassPath[MAX_PATH] = { 0 };
+        TCHAR bassAsioPath[MAX_PATH] = { 0 };
+        TCHAR bassWasapiPath[MAX_PATH] = { 0 };
+
+        map<wstring, wstring> outputDriver;
+
+        void InitializePaths() noexcept
+        {
+            GetModuleFileName(hinst_vst_driver, installPath, MAX_PATH);
+            PathRemoveFileSpec(installPath);
+            lstrcat(installPath, _T("\\vstmididrv\\"));
+
+            lstrcat(bassPath, installPath);
+            lstrcat(bassPath, _T("bass.dll"));
+
+            lstrcat(bassAsioPath, installPath);
+            lstrcat(bassAsioPath, _T("bassasio.dll"));
+
+            lstrcat(bassWasapiPath, installPath);
+            lstrcat(bassWasapiPath, _T("basswasapi.dll"));
+        }
+
+        bool LoadBass(wstring mode) noexcept
+        {
+            if (mode.empty() || mode.compare(asioValueName) == 0)
+            {
+                // Load Bass Asio
+                bassAsio = LoadLibrary(bassAsioPath);
+
+                LOADBASSASIOFUNCTION(BASS_ASIO_Init);
+
+                /// Check if there is at least one ASIO capable device
+                if (BASS_ASIO_Init(-1, BASS_ASIO_THREAD))
+                {
+                    LOADBASSASIOFUNCTION(BASS_ASIO_Free);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_Stop);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_Start);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_GetInfo);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_GetRate);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_SetRate);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_SetNotify);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_ErrorGetCode);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_GetDeviceInfo);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelGetInfo);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelJoin);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelReset);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelEnable);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelIsActive);
+                    LOADBASSASIOFUNCTION(BASS_ASIO_ChannelSetFormat);
+
+                    BASS_ASIO_Free();
+                }
+                else
+                {
+                    FreeLibrary(bassAsio);
+                    bassAsio = NULL;
+                }
+            }
+
+            if (bassAsio)
+            {
+                return true;
+            }
+
+            // Load Bass
+            bass = LoadLibrary(bassPath);
+
+            if (!bass)
+            {
+                return false;
+            }
+
+            // Load Bass Wasapi
+            bassWasapi = LoadLibrary(bassWasapiPath);
+            
+            if (bass)
+            {
+                LOADBASSFUNCTION(BASS_Init);
+                LOADBASSFUNCTION(BASS_Free);
+                LOADBASSFUNCTION(BASS_SetConfig);
+                LOADBASSFUNCTION(BASS_ErrorGetCode);
+                LOADBASSFUNCTION(BASS_GetDeviceInfo);
+                LOADBASSFUNCTION(BASS_StreamCreate);
+                LOADBASSFUNCTION(BASS_StreamFree);
+                LOADBASSFUNCTION(BASS_ChannelPlay);
+                LOADBASSFUNCTION(BASS_ChannelStop);
+                LOADBASSFUNCTION(BASS_ChannelPause);
+                LOADBASSFUNCTION(BASS_ChannelPause);
+                LOADBASSFUNCTION(BASS_ChannelGetData);
+            }
+
+            if (bassWasapi)
+            {
+                LOADBASSWASAPIFUNCTION(BASS_WASAPI_Init);
+                LOADBASSWASAPIFUNCTION(BASS_WASAPI_Free);
+                LOADBASSWASAPIFUNCTION(BASS_WASAPI_Start);
+                LOADBASSWASAPIFUNCTION(BASS_WASAPI_Stop);
+                LOADBASSWASAPIFUNCTION(BASS_WASAPI_GetInfo);
+                LOADBASSWASAPIFUNCTION(BASS_WASAPI_GetDeviceInfo);
+                LOADBASSWASAPIFUNCTION(BASS_WASAPI_GetDevice);
+            }
+
+            return true;
+        }
+
+        void LoadOutputDriverSettings()
+        {
+            HKEY hKey;
+
+            LSTATUS result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver\\Output Driver", 0, KEY_READ | KEY_WOW64_32KEY, &hKey);
+
+            if (result != NO_ERROR)
+            {
+                return;
+            }
+
+            DWORD values;
+            DWORD valueNameMaxSize;
+            DWORD valueMaxSize;
+
+            result = RegQueryInfoKey(hKey, NULL, NULL, NULL, NULL, NULL, NULL, &values, &valueNameMaxSize, &valueMaxSize, NULL, NULL);
+
+            if (result != NO_ERROR || values == 0)
+            {
+                return;
+            }
+
+            TCHAR* valueName = NULL;
+            DWORD valueNameSize = 0;
+            TCHAR* value = NULL;
+            DWORD valueSize = 0;
+
+            DWORD valueType = REG_NONE;
+
+            valueName = (TCHAR*)calloc(valueNameMaxSize + 1, sizeof(TCHAR));
+            value = (TCHAR*)calloc(valueMaxSize + 1, sizeof(TCHAR));
+
+            for (int i = 0; i < values; ++i)
+            {
+                valueNameSize = valueNameMaxSize + 1;
+                valueSize = valueMaxSize + 1;
+
+                result = RegEnumValue(hKey, i, valueName, &valueNameSize, NULL, &valueType, (LPBYTE)value, &valueSize);
+
+                if (result == NO_ERROR && valueType == REG_SZ)
+                {
+                    wstring tempName = valueName;
+                    wstring tempValue = value;
+
+                    outputDriver[tempName] = tempValue;
+                }
+            }
+
+            free(valueName);
+            free(value);
+        }
+
+        /// <summary>
+        /// Get the selected ASIO driver
+        /// </summary>
+        /// <param name="selectedDeviceId">The device id of the selected ASIO driver</param>
+        /// <param name="selectedChannelId">The channeld id of the selected ASIO driver</param>
+        void GetSelectedAsioDriver(int& selectedDeviceId, int& selectedChannelId)
+        {
+            selectedDeviceId = -1;
+            selectedChannelId = 0;
+
+            wstring selectedOutputDriver = outputDriver[asioValueName];
+
+            BASS_ASIO_DEVICEINFO asioDeviceInfo{};
+
+            for (size_t deviceId = 0; BASS_ASIO_Init(deviceId, BASS_ASIO_THREAD); ++deviceId)
+            {
+                BASS_ASIO_GetDeviceInfo(deviceId, &asioDeviceInfo);
+
+                wstring deviceName = wstring_convert<codecvt_utf8<wchar_t>>().from_bytes(asioDeviceInfo.name);
+
+                if (selectedOutputDriver.find(deviceName) == string::npos)
+                {
+                    continue;
+                }
+
+                selectedDeviceId = deviceId;
+
+                BASS_ASIO_CHANNELINFO channelInfo{};
+
+                size_t pos = strlen(asioDeviceInfo.name);
+
+                for (size_t channel = 0; BASS_ASIO_ChannelGetInfo(FALSE, channel, &channelInfo); ++channel)
+                {
+                    wstring channelName = wstring_convert<codecvt_utf8<wchar_t>>().from_bytes(channelInfo.name);
+                    if (selectedOutputDriver.find(channelName, pos) == string::npos)
+                    {
+                        continue;
+                    }
+
+                    selectedChannelId = channel;
+                    break;
+                }
+
+                BASS_ASIO_Free();
+            }
+        }
+
+        /// <summary>
+        /// Get the selected WASAPI driver
+        /// </summary>
+        void GetSelectedWasapiDriver(int& selectedDeviceId)
+        {
+            // -1 = default output device
+            selectedDeviceId = -1;
+
+            wstring selectedOutputDriver = outputDriver[wasapiValueName];
+
+            BASS_WASAPI_DEVICEINFO  deviceInfo{};
+
+            for (size_t deviceId = 0; BASS_WASAPI_GetDeviceInfo(deviceId, &deviceInfo); ++deviceId)
+            {
+                wstring deviceName = wstring_convert<codecvt_utf8<wchar_t>>().from_bytes(deviceInfo.name);
+                if (!(deviceInfo.flags & BASS_DEVICE_INPUT) && (deviceInfo.flags & BASS_DEVICE_ENABLED) && selectedOutputDriver.compare(deviceName) == 0)
+                {
+                    selectedDeviceId = deviceId;
+                    break;
+                }
+            }
+        }
+
+    public:
+        WaveOutWin32() noexcept
+        {
+        }
+
+        int Init(unsigned int bufferSize, unsigned int chunkSize, unsigned int sampleRate)
+        {
+            if (bassPath[0] == NULL)
+            {
+                InitializePaths();
+            }
+
+            LoadOutputDriverSettings();
+
+            periodFrames = 0;
+
+            wstring selectedMode = outputDriver[modeValueName];
+
+            if (!LoadBass(selectedMode))
+            {
+                return -1;
+            }
+
+            int deviceId;
+
+            if (bassAsio)
+            {
+                int channelId;
+
+                GetSelectedAsioDriver(deviceId, channelId);
+
+                if (!BASS_ASIO_Init(deviceId, BASS_ASIO_THREAD))
+                {
+                    return -2;
+                }
+
+                BASS_ASIO_SetRate(sampleRate);
+
+                sampleRate = BASS_ASIO_GetRate();
+
+                // Enable 1st output channel
+                BASS_ASIO_ChannelEnable(FALSE, channelId, AsioProc, this);
+
+                soundOutFloat = true;
+
+                // Join the next channel to it (stereo)
+                BASS_ASIO_ChannelJoin(FALSE, channelId + 1, channelId);
+
+                // Set the source format to FLOAT
+                // TODO: autodetect format or add format option in config
+                BASS_ASIO_ChannelSetFormat(FALSE, channelId, BASS_ASIO_FORMAT_FLOAT);
+
+                // BASS_ASIO_Start uses the preferred buffer length when buflen is 0
+                BASS_ASIO_INFO asioInfo{};
+                periodFrames = buflen ? buflen : BASS_ASIO_GetInfo(&asioInfo) ? asioInfo.bufpref : 0;
+
+                //BASS_ASIO_SetNotify((ASIONOTIFYPROC*)AsioNotifyProc, this);
+            }
+            else if (bassWasapi)
+            {
+                GetSelectedWasapiDriver(deviceId);
+
+                DWORD wasapiFlags = BASS_WASAPI_AUTOFORMAT;
+                wasapiFlags &= selectedMode.compare(L"WASAPI Shared") == 0 ? BASS_WASAPI_EVENT : BASS_WASAPI_EXCLUSIVE;
+                
+                if (!BASS_WASAPI_Init(deviceId, sampleRate, 2, wasapiFlags, 0, 0, WasapiProc, this))
+                {
+                    int error = BASS_ErrorGetCode();
+                    return -3;
+                }
+
+                BASS_WASAPI_INFO winfo{};
+
+                if (!BASS_WASAPI_GetInfo(&winfo))
+                {
+                    int error = BASS_ErrorGetCode();
+                    BASS_WASAPI_Free();
+                    return -4;
+                }
+
+                sampleRate = winfo.freq;
+
+                switch (winfo.format)
+                {
+                    case BASS_WASAPI_FORMAT_8BIT:
+                        wasapiBits = 8;
+                        break;
+
+                    default:
+                    case BASS_WASAPI_FORMAT_16BIT:
+                        wasapiBits = 16;
+                        break;
+
+                    case BASS_WASAPI_FORMAT_24BIT:
+                        wasapiBits = 24;
+                        break;
+
+                    case BASS_WASAPI_FORMAT_32BIT:
+                        wasapiBits = 32;
+                        break;
+
+                    case BASS_WASAPI_FORMAT_FLOAT:
+                        soundOutFloat = TRUE;
+                        break;
+                }
+
+                // BASS_WASAPI_Init uses the default period of the device when period is 0, the buffer holds several periods
+                BASS_WASAPI_DEVICEINFO deviceInfo{};
+                if (BASS_WASAPI_GetDeviceInfo(BASS_WASAPI_GetDevice(), &deviceInfo) && deviceInfo.defperiod > 0)
+                {
+                    periodFrames = (DWORD)(deviceInfo.defperiod * winfo.freq + 0.5f);
+                }
+                else
+                {
+                    // Without a period the callback is never asked for more than the buffer holds
+                    DWORD frameBytes = winfo.chans * (soundOutFloat ? sizeof(float) : wasapiBits / 8);
+                    periodFrames = frameBytes ? winfo.buflen / frameBytes : 0;
+                }
+            }
+            else if (bass)
+            {
+                if (!BASS_Init(deviceId, sampleRate, 0, NULL, NULL))
+                {
+                    int error = BASS_ErrorGetCode();
+                    return -5;
+                }
+
+                BASS_SetConfig(BASS_CONFIG_UPDATEPERIOD, 0);
+                BASS_SetConfig(BASS_CONFIG_VISTA_TRUEPOS, 0);
+                BASS_SetConfig(BASS_CONFIG_BUFFER, 0);
+
+                hStOutput = BASS_StreamCreate(sampleRate, 2, (soundOutFloat ? BASS_SAMPLE_FLOAT : 0), StreamProc, this);
+                if (!hStOutput)
+                {
+                    int error = BASS_ErrorGetCode();
+                    BASS_Free();
+                    return -6;
+                }
+            }
+
+            return sampleRate;
+        }
+
+        DWORD GetPeriodFrames() const noexcept
+        {
+            return periodFrames;
+        }
+
+        int Close() noexcept
+        {
+            if (bassAsio)
+            {
+                // Stop ASIO device in case it was playing
+                if (BASS_ASIO_IsStarted)
+                {
+                    BASS_ASIO_Stop();
+                }
+                BASS_ASIO_Free();
+
+                FreeLibrary(bassAsio);
+                bassAsio = NULL;
+            }
+
+            if (bassWasapi)
+            {
+                BASS_WASAPI_Stop(TRUE);
+                BASS_WASAPI_Free();
+                FreeLibrary(bassWasapi);
+                bassWasapi = NULL;
+            }
+            else if (hStOutput)
+            {
+                BASS_ChannelStop(hStOutput);
+                BASS_StreamFree(hStOutput);
+                hStOutput = NULL;
+            }
+
+            if (bass)
+            {
+                BASS_Free();
+                FreeLibrary(bass);
+                bass = NULL;
+            }
+
+            return 0;
+        }
+
+        int Start() noexcept
+        {
+            if (bassAsio)
+            {
+                BASS_ASIO_Start(buflen, 0);
+            }
+            else if (bassWasapi)
+            {
+                BASS_WASAPI_Start();
+            }
+            else if (hStOutput)
+            {
+                BASS_ChannelPlay(hStOutput, FALSE);
+            }
+
+            return 0;
+        }
+
+        int Pause() noexcept
+        {
+            if (bassAsio)
+            {
+                //BASS_ASIO_ChannelPause(FALSE, -1);
+            }
+            else if (bassWasapi)
+            {
+                BASS_WASAPI_Stop(FALSE);
+            }
+            else if (hStOutput)
+            {
+                BASS_ChannelPause(hStOutput);
+            }
+
+            return 0;
+        }
+
+        int Resume() noexcept
+        {
+            if (bassAsio)
+            {
+                //BASS_ASIO_ChannelReset(FALSE, -1, BASS_ASIO_RESET_PAUSE);
+            }
+            else if (bassWasapi)
+            {
+                BASS_WASAPI_Start();
+            }
+            else if (hStOutput)
+            {
+                BASS_ChannelPlay(hStOutput, FALSE);
+            }
+
+            return 0;
+        }
+
+        static DWORD CALLBACK AsioProc(BOOL input, DWORD channel, void* buffer, DWORD length, void* user) noexcept
+        {
+            WaveOutWin32* _this = (WaveOutWin32*)user;
+            if (_this->soundOutFloat)
+            {
+                midiSynth.RenderFloat((float*)buffer, length / 8);
+            }
+            else
+            {
+                midiSynth.Render((short*)buffer, length / 4);
+            }
+            return length;
+        }
+
+        static DWORD CALLBACK WasapiProc(void* buffer, DWORD length, void* user)
+        {
+            WaveOutWin32* _this = (WaveOutWin32*)user;
+            if (_this->soundOutFloat || _this->wasapiBits == 16)
+            {
+                return StreamProc(NULL, buffer, length, user);
+            }
+            else
+            {
+                int bytes_per_sample = _this->wasapiBits / 8;
+                int bytes_done = 0;
+                while (length)
+                {
+                    unsigned short sample_buffer[1024];
+                    int length_todo = (length / bytes_per_sample);
+                    if (length_todo > 512) length_todo = 512;
+                    int bytes_done_this = StreamProc(NULL, sample_buffer, length_todo * 4, 0);
+                    if (bytes_done_this <= 0) return bytes_done;
+                    if (bytes_per_sample == 4)
+                    {
+                        unsigned int* out = (unsigned int*)buffer;
+                        for (int i = 0; i < bytes_done_this; i += 2)
+                        {
+                            *out++ = sample_buffer[i / 2] << 16;
+                        }
+                        buffer = out;
+                    }
+                    else if (bytes_per_sample == 3)
+                    {
+                        unsigned char* out = (unsigned char*)buffer;
+                        for (int i = 0; i < bytes_done_this; i += 2)
+                        {
+                            int sample = sample_buffer[i / 2];
+                            *out++ = 0;
+                            *out++ = sample & 0xFF;
+                            *out++ = (sample >> 8) & 0xFF;
+                        }
+                        buffer = out;
+                    }
+                    else if (bytes_per_sample == 1)
+                    {
+                        unsigned char* out = (unsigned char*)buffer;
+                        for (int i = 0; i < bytes_done_this; i += 2)
+                        {
+                            *out++ = (sample_buffer[i / 2] >> 8) & 0xFF;
+                        }
+                        buffer = out;
+                    }
+                    bytes_done += (bytes_done_this / 2) * bytes_per_sample;
+                    length -= (bytes_done_this / 2) * bytes_per_sample;
+                }
+                return bytes_done;
+            }
+        }
+
+        static DWORD CALLBACK StreamProc(HSTREAM handle, void* buffer, DWORD length, void* user)
+        {
+            WaveOutWin32* _this = (WaveOutWin32*)user;
+            if (_this->soundOutFloat)
+            {
+                midiSynth.RenderFloat((float*)buffer, length / 8);
+            }
+            else
+            {
+                midiSynth.Render((short*)buffer, length / 4);
+            }
+            return length;
+        }
+
+        static void CALLBACK AsioNotifyProc(DWORD notify, void* user)
+        {
+            switch (notify)
+            {
+                case BASS_ASIO_NOTIFY_RATE:
+                    // The device's sample rate has changed. The new rate is available from BASS_ASIO_GetRate.
+                    break;
+
+                case BASS_ASIO_NOTIFY_RESET:
+                    // The driver has requested a reset/reinitialization; for example, following a change of the default buffer size.
+                    // This request can be ignored, but if a reinitialization is performed, it should not be done within the callback.
+                    break;
+            }
+        }
+    } waveOut;
+
+    MidiSynth::MidiSynth() noexcept {}
+
+    MidiSynth& MidiSynth::GetInstance()
+    {
+        static MidiSynth instance;
+        return instance;
+    }
+
+    /// <summary>
+    /// Move the incoming MIDI messages to the VST driver.
+    /// The messages are spread over the block at the offsets at which they arrived,
+    /// so their relative timing is kept at the cost of the latency between the reference and the block.
+    /// </summary>
+    /// <param name="totalFrames">The number of frames which are about to be rendered</param>
+    /// <param name="referenceTime">The performance counter value at which referenceFrame is played, 0 if unknown</param>
+    /// <param name="referenceFrame">The frame relative to the start of the block which is played at referenceTime</param>
+    void MidiSynth::QueueMidiMessages(DWORD totalFrames, LONGLONG referenceTime, LONGLONG referenceFrame)
+    {
+        MidiStream::Message messages[64];
+        DWORD count;
+        DWORD total = 0;
+
+        synthMutex.Enter();
+
+        blockMessages.clear();
+        priorityLanes.BeginBlock(blockMessages, totalFrames);
+
+        // Messages due after this block are queued for the later blocks, up to the fixed latency ahead
+        messagePlacement.BeginBlock(totalFrames, referenceTime, referenceFrame);
+
+        if (voiceGovernor.IsEnabled())
+        {
+            RenderStatistics renderStatistics;
+            vstDriver->GetRenderStatistics(renderStatistics);
+            voiceGovernor.BeginBlock(renderStatistics);
+        }
+
+        // One pass over what is in the stream, messages put meanwhile wait for the next block
+        while (total < midiStream.GetCapacity() && (count = midiStream.GetMessages(messages, _countof(messages))))
+        {
+            total += count;
+
+            for (DWORD i = 0; i < count; ++i)
+            {
+                const MidiStream::Message& message = messages[i];
+
+                ScheduledMessage scheduled = { message, messagePlacement.Place(message.timestamp), false };
+                blockMessages.push_back(scheduled);
+            }
+        }
+
+        // A long backlog means the render path fell behind, the values which are overwritten within the block are not sent
+        if (coalesceThreshold && total > coalesceThreshold)
+        {
+            coalescer.Run(blockMessages, coalesceSubBlock);
+        }
+
+        for (const ScheduledMessage& scheduled : blockMessages)
+        {
+            // Bulk messages over the budget wait for the next block, and so do the messages which depend on them
+            if (!scheduled.superseded && !priorityLanes.Admit(scheduled))
+            {
+                continue;
+            }
+
+            const MidiStream::Message& message = scheduled.message;
+            DWORD offset = scheduled.offset;
+
+            if (message.message && !message.sysEx)
+            {
+                if (!scheduled.superseded && voiceGovernor.Admit(message.port, message.message, offset, vstDriver))
+                {
+                    vstDriver->QueueMIDIMessage(message.port, message.message, offset);
+                }
+            }
+            else if (message.release)
+            {
+                // The client buffer goes to the VST host as it is and is released once the VST host has consumed it
+                if (message.sysExLength && !scheduled.superseded)
+                {
+                    vstDriver->QueueSysEx(message.port, message.sysEx, message.sysExLength, offset, message.release, message.releaseContext);
+                }
+                else
+                {
+                    message.release(message.releaseContext);
+                }
+            }
+            else if (message.sysEx)
+            {
+                if (message.sysExLength && !scheduled.superseded)
+                {
+                    vstDriver->QueueSysEx(message.port, message.sysEx, message.sysExLength, offset);
+                }
+                GetSysExSlab(message.port).Free(message.sysEx);
+            }
+        }
+
+        messagePlacement.EndBlock();
+
+        // The MIDI streams place their events by their own clock, the VST driver sorts them into the block
+        for (StreamPort& streamPort : streamPorts)
+        {
+            streamPort.Render(totalFrames, vstDriver, streamNotifications);
+        }
+
+        synthMutex.Leave();
+
+        if (!streamNotifications.empty())
+        {
+            StreamPort::Send(streamNotifications);
+            streamNotifications.clear();
+        }
+    }
+
+    /// <summary>
+    /// Move the messages which arrived since the previous render call to the VST driver.
+    /// Without a fixed latency the frame 0 of the block is played at the time of the previous render call,
+    /// otherwise every message is played the fixed latency after its arrival on the playback clock of the render calls.
+    /// </summary>
+    /// <param name="totalFrames">The number of frames which are about to be rendered</param>
+    void MidiSynth::QueueMidiMessages(DWORD totalFrames)
+    {
+        LONGLONG renderTime = MidiStream::GetTimestamp();
+        LONGLONG previousRenderTime = lastRenderTime;
+        lastRenderTime = renderTime;
+
+        if (midiLatencyFrames)
+        {
+            LONGLONG blockTime = playbackClock.Update(renderTime, queuedFrames);
+            queuedFrames += totalFrames;
+
+            QueueMidiMessages(totalFrames, blockTime, midiLatencyFrames);
+            return;
+        }
+
+        QueueMidiMessages(totalFrames, previousRenderTime, 0);
+    }
+
+    // Renders totalFrames frames starting from bufpos
+    // The number of frames rendered is added to the global counter framesRendered
+    void MidiSynth::Render(short* bufpos, DWORD totalFrames)
+    {
+        if (hRenderThread)
+        {
+            float* float_out = (float*)_alloca(RenderAheadBlockSize * 2 * sizeof(*float_out));
+            while (totalFrames > 0)
+            {
+                DWORD len_todo = totalFrames > RenderAheadBlockSize ? RenderAheadBlockSize : totalFrames;
+                renderFifo.Read(float_out, len_todo);
+                for (unsigned i = 0; i < len_todo * 2; ++i)
+                {
+                    int sample = (float_out[i] * 32768.f);
+                    if ((sample + 0x8000) & 0xFFFF0000)
+                    {
+                        sample = 0x7FFF ^ (sample >> 31);
+                    }
+                    bufpos[0] = sample;
+                    ++bufpos;
+                }
+                totalFrames -= len_todo;
+            }
+            SetEvent(hRenderEvent);
+            return;
+        }
+
+        QueueMidiMessages(totalFrames);
+
+        synthMutex.Enter();
+        vstDriver->Render(bufpos, totalFrames);
+        synthMutex.Leave();
+    }
+
+    void MidiSynth::RenderFloat(float* bufpos, DWORD totalFrames)
+    {
+        if (hRenderThread)
+        {
+            renderFifo.Read(bufpos, totalFrames);
+            SetEvent(hRenderEvent);
+            return;
+        }
+
+        QueueMidiMessages(totalFrames);
+
+        synthMutex.Enter();
+        vstDriver->RenderFloat(bufpos, totalFrames);
+        synthMutex.Leave();
+    }
+
+    DWORD WINAPI MidiSynth::RenderThreadProc(LPVOID lpParameter)
+    {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+        ((MidiSynth*)lpParameter)->RenderAhead();
+        return 0;
+    }
+
+    /// <summary>
+    /// Keep renderAheadBlocks blocks rendered ahead of the audio device.
+    /// The messages are stamped with the frame at which they will be played, the arrival time plus the render-ahead latency and the fixed latency.
+    /// </summary>
+    void MidiSynth::RenderAhead()
+    {
+        const LONGLONG latencyFrames = (LONGLONG)renderAheadBlocks * RenderAheadBlockSize;
+        std::vector<float> block(RenderAheadBlockSize * 2);
+
+        while (renderThreadRunning)
+        {
+            if (renderFifo.GetAvailable() + RenderAheadBlockSize > latencyFrames)
+            {
+                WaitForSingleObject(hRenderEvent, 100);
+                continue;
+            }
+
+            LONGLONG readTime;
+            LONGLONG framesRead;
+            renderFifo.GetReadClock(readTime, framesRead);
+            if (readTime)
+            {
+                readTime = playbackClock.Update(readTime, framesRead);
+            }
+
+            QueueMidiMessages(RenderAheadBlockSize, readTime, framesRead + latencyFrames + midiLatencyFrames - renderedFrames);
+
+            synthMutex.Enter();
+            vstDriver->RenderFloat(block.data(), RenderAheadBlockSize);
+            synthMutex.Leave();
+
+            renderFifo.Write(block.data(), RenderAheadBlockSize);
+            renderedFrames += RenderAheadBlockSize;
+        }
+    }
+
+    /// <summary>
+    /// Start the render thread if render-ahead is enabled
+    /// </summary>
+    /// <returns>false if the render thread could not be started</returns>
+    bool MidiSynth::StartRenderThread()
+    {
+        renderAheadBlocks = GetDriverSetting(L"RenderAheadBlocks", 0);
+        if (!renderAheadBlocks)
+        {
+            return true;
+        }
+
+        if (renderAheadBlocks > MaxRenderAheadBlocks)
+        {
+            renderAheadBlocks = MaxRenderAheadBlocks;
+        }
+
+        renderFifo.Init(renderAheadBlocks * RenderAheadBlockSize);
+        renderedFrames = 0;
+
+        hRenderEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (!hRenderEvent)
+        {
+            renderFifo.Close();
+            return false;
+        }
+
+        renderThreadRunning = true;
+        hRenderThread = CreateThread(NULL, 0, RenderThreadProc, this, 0, NULL);
+        if (!hRenderThread)
+        {
+            renderThreadRunning = false;
+            CloseHandle(hRenderEvent);
+            hRenderEvent = NULL;
+            renderFifo.Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MidiSynth::StopRenderThread() noexcept
+    {
+        if (!hRenderThread)
+        {
+            return;
+        }
+
+        renderThreadRunning = false;
+        SetEvent(hRenderEvent);
+        WaitForSingleObject(hRenderThread, INFINITE);
+
+        CloseHandle(hRenderThread);
+        hRenderThread = NULL;
+        CloseHandle(hRenderEvent);
+        hRenderEvent = NULL;
+        renderFifo.Close();
+    }
+
+    BOOL IsVistaOrNewer() noexcept
+    {
+        OSVERSIONINFOEX osvi;
+        BOOL bOsVersionInfoEx;
+        ZeroMemory(&osvi, sizeof(OSVERSIONINFOEX));
+        osvi.dwOSVersionInfoSize = sizeof(OSVERSIONINFOEX);
+        bOsVersionInfoEx = GetVersionEx((OSVERSIONINFO*)&osvi);
+
+        return bOsVersionInfoEx && osvi.dwPlatformId == VER_PLATFORM_WIN32_NT && osvi.dwMajorVersion > 5;
+    }
+
+    int MidiSynth::Init(unsigned uDeviceID)
+    {
+        // Init synth
+        if (synthMutex.Init())
+        {
+            return 1;
+        }
+
+        for (DWORD port = 0; port < _countof(streamPorts); ++port)
+        {
+            streamPorts[port].Init(port);
+        }
+
+        DWORD queueSize = GetDriverSetting(L"MidiQueueSize", MidiStream::defaultCapacity);
+        queueSize = queueSize < 16 ? 16 : queueSize > 65536 ? 65536 : queueSize;
+        midiStream.Init(queueSize, (MidiStream::OverflowPolicy)GetDriverSetting(L"MidiQueueOverflow", MidiStream::Reject), GetDriverSetting(L"MidiQueueBlockTime", 10));
+        blockMessages.reserve(midiStream.GetCapacity());
+
+        coalesceThreshold = GetDriverSetting(L"CoalesceThreshold", DefaultCoalesceThreshold);
+        coalesceSubBlock = GetDriverSetting(L"CoalesceSubBlock", 0);
+        coalescer.Init();
+        midiFilter.Init();
+        priorityLanes.Init(GetDriverSetting(L"BulkBytesPerBlock", DefaultBulkBytesPerBlock));
+        voiceGovernor.Init(GetDriverSetting(L"VoiceLimit", 0), GetDriverSetting(L"VoiceStealing", VoiceGovernor::Oldest));
+
+        unsigned int sampleRate = 44100;
+        int wResult = waveOut.Init(bufferSize, chunkSize, sampleRate);
+        if (wResult < 0)
+        {
+            return -wResult;
+        }
+
+        sampleRate = wResult;
+
+        this->sampleRate = sampleRate;
+
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        clockFrequency = frequency.QuadPart;
+        lastRenderTime = 0;
+
+        DWORD midiLatency = GetDriverSetting(L"MidiLatency", 0);
+        midiLatencyFrames = (midiLatency > MaxMidiLatency ? MaxMidiLatency : midiLatency) * sampleRate / 1000;
+        playbackClock.Init(clockFrequency, sampleRate);
+        messagePlacement.Init(clockFrequency, sampleRate, midiLatencyFrames);
+        queuedFrames = 0;
+
+        /// The VSTi renders in blocks of the size the audio device asks for, or of the size of the blocks rendered ahead
+        DWORD blockSize = GetDriverSetting(L"RenderAheadBlocks", 0) ? RenderAheadBlockSize : waveOut.GetPeriodFrames();
+
+        vstDriver = new VSTDriver;
+        if (!vstDriver->OpenVSTDriver(NULL, NULL, sampleRate, blockSize))
+        {
+            delete vstDriver;
+            vstDriver = NULL;
+            return 1;
+        }
+
+        if (!StartRenderThread())
+        {
+            vstDriver->CloseVSTDriver();
+            delete vstDriver;
+            vstDriver = NULL;
+            return 1;
+        }
+
+        return waveOut.Start();
+    }
+
+    /// <summary>
+    /// Discard the queued messages, which returns the buffers they reference, and turn off the playing notes.
+    /// Must be called with the synth mutex held and the audio paused.
+    /// </summary>
+    void MidiSynth::DiscardMessages(unsigned uDeviceID) noexcept
+    {
+        midiStream.Reset();
+        priorityLanes.Discard();
+        vstDriver->DiscardQueuedEvents();
+
+        // All Sound Off and All Notes Off on every channel
+        for (DWORD channel = 0; channel < 16; ++channel)
+        {
+            vstDriver->QueueMIDIMessage(uDeviceID, 0x78B0 | channel);
+            vstDriver->QueueMIDIMessage(uDeviceID, 0x7BB0 | channel);
+        }
+
+        messagePlacement.Reset();
+    }
+
+    /// <summary>
+    /// Return the queued buffers and turn off the playing notes, for midiOutReset. The VSTi keeps its state.
+    /// </summary>
+    int MidiSynth::Silence(unsigned uDeviceID) noexcept
+    {
+        UINT wResult = waveOut.Pause();
+        if (wResult)
+        {
+            return wResult;
+        }
+
+        synthMutex.Enter();
+        DiscardMessages(uDeviceID);
+        synthMutex.Leave();
+
+        return waveOut.Resume();
+    }
+
+    /// <summary>
+    /// Save the settings of the VSTi and recreate it, after returning the queued buffers and turning off the playing notes
+    /// </summary>
+    int MidiSynth::Reset(unsigned uDeviceID) noexcept
+    {
+        UINT wResult = waveOut.Pause();
+        if (wResult)
+        {
+            return wResult;
+        }
+
+        synthMutex.Enter();
+        /// With the control lane the VST host recreates the VSTi between render requests and rendering does not wait for it
+        vstDriver->ResetDriverAsync();
+        voiceGovernor.Reset();
+
+        // The notes off are for the requests which reach the VST host before the reset
+        DiscardMessages(uDeviceID);
+
+        lastRenderTime = 0;
+        playbackClock.Reset();
+        synthMutex.Leave();
+
+        return waveOut.Resume();
+    }
+
+    /// <summary>
+    /// Put MIDI message to the midi stream.
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    /// <param name="dwParam1">The MIDI message to put.</param>
+    /// <returns></returns>
+    DWORD MidiSynth::PutMidiMessage(unsigned uDeviceID, DWORD dwParam1)
+    {
+        if (midiFilter.Drop(dwParam1))
+        {
+            return MMSYSERR_NOERROR;
+        }
+
+        return midiStream.PutMessage(uDeviceID, dwParam1);
+    }
+
+    /// <summary>
+    /// Put MIDI SysEx message to the midi stream.
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    /// <param name="bufpos">The MIDI SysEx message to put.</param>
+    /// <param name="len">The length of the MIDI SysEx message.</param>
+    /// <returns></returns>
+    DWORD MidiSynth::PutSysEx(unsigned uDeviceID, unsigned char* bufpos, DWORD len)
+    {
+        if (midiFilter.DropSysEx())
+        {
+            return MMSYSERR_NOERROR;
+        }
+
+        return midiStream.PutSysEx(uDeviceID, bufpos, len);
+    }
+
+    /// <summary>
+    /// Put MIDI SysEx message to the midi stream without copying it, the client buffer is written to the VST host directly.
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    /// <param name="bufpos">The MIDI SysEx message to put, it must stay valid until release is called.</param>
+    /// <param name="len">The length of the MIDI SysEx message.</param>
+    /// <param name="release">Called with context once the VST host has consumed the message or it is discarded.</param>
+    /// <param name="context">Passed to release.</param>
+    /// <returns>MMSYSERR_NOERROR on sucess, MIDIERR_NOTREADY otherwise, release is not called then</returns>
+    DWORD MidiSynth::PutSysExReference(unsigned uDeviceID, unsigned char* bufpos, DWORD len, SysExRelease release, void* context)
+    {
+        if (midiFilter.DropSysEx())
+        {
+            release(context);
+            return MMSYSERR_NOERROR;
+        }
+
+        return midiStream.PutSysExReference(uDeviceID, bufpos, len, release, context);
+    }
+
+    /// <summary>
+    /// Open the MIDI stream of a port (MIDI_IO_COOKED).
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    /// <param name="notify">Called with the MIDIHDR for MOM_DONE and MOM_POSITIONCB.</param>
+    /// <returns>MMSYSERR_NOERROR on sucess, MMSYSERR_ALLOCATED if the port has an open stream already</returns>
+    DWORD MidiSynth::OpenStream(unsigned uDeviceID, StreamNotify notify)
+    {
+        return GetStreamPort(uDeviceID).Open(sampleRate, notify) ? MMSYSERR_NOERROR : MMSYSERR_ALLOCATED;
+    }
+
+    /// <summary>
+    /// Close the MIDI stream of a port, the queued buffers are returned.
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    void MidiSynth::CloseStream(unsigned uDeviceID)
+    {
+        GetStreamPort(uDeviceID).Shut();
+    }
+
+    /// <summary>
+    /// Queue a buffer of MIDIEVENTs to the MIDI stream (MODM_STRMDATA), the stream plays it after the buffers queued before.
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    /// <param name="midiHdr">The buffer, dwBytesRecorded bytes of it are played, it is returned with MOM_DONE.</param>
+    /// <returns>MMSYSERR_NOERROR on sucess</returns>
+    DWORD MidiSynth::PutStreamBuffer(unsigned uDeviceID, MIDIHDR* midiHdr)
+    {
+        return GetStreamPort(uDeviceID).Enqueue((const unsigned char*)midiHdr->lpData, midiHdr->dwBytesRecorded, midiHdr);
+    }
+
+    /// <summary>
+    /// Get or set the tempo or the time division of the MIDI stream (MODM_PROPERTIES).
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    /// <param name="property">A MIDIPROPTEMPO or MIDIPROPTIMEDIV.</param>
+    /// <param name="flags">MIDIPROP_GET or MIDIPROP_SET, and MIDIPROP_TEMPO or MIDIPROP_TIMEDIV.</param>
+    /// <returns>MMSYSERR_NOERROR on sucess</returns>
+    DWORD MidiSynth::StreamProperty(unsigned uDeviceID, LPBYTE property, DWORD flags)
+    {
+        return GetStreamPort(uDeviceID).Property(property, flags);
+    }
+
+    void MidiSynth::RestartStream(unsigned uDeviceID)
+    {
+        GetStreamPort(uDeviceID).Restart();
+    }
+
+    void MidiSynth::PauseStream(unsigned uDeviceID)
+    {
+        GetStreamPort(uDeviceID).Pause();
+    }
+
+    /// <summary>
+    /// Stop the MIDI stream (MODM_STOP), the queued buffers are returned, the stream is rewound and the playing notes are turned off.
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    void MidiSynth::StopStream(unsigned uDeviceID)
+    {
+        GetStreamPort(uDeviceID).Stop();
+
+        // All Notes Off on every channel
+        for (DWORD channel = 0; channel < 16; ++channel)
+        {
+            midiStream.PutMessage(uDeviceID, 0x7BB0 | channel);
+        }
+    }
+
+    /// <summary>
+    /// Get the position of the MIDI stream (MODM_GETPOS).
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    /// <param name="time">The position, in ticks or in milliseconds.</param>
+    /// <returns>MMSYSERR_NOERROR on sucess</returns>
+    DWORD MidiSynth::GetStreamPosition(unsigned uDeviceID, MMTIME* time)
+    {
+        return GetStreamPort(uDeviceID).GetPosition(time);
+    }
+
+    /// <summary>
+    /// Get the filter rules and the number of messages each one dropped.
+    /// </summary>
+    /// <param name="out">The rules and their counters.</param>
+    void MidiSynth::GetFilterStatistics(MidiFilterStatistics& out) noexcept
+    {
+        midiFilter.GetStatistics(out);
+    }
+
+    /// <summary>
+    /// Get the counters of the voice governor.
+    /// </summary>
+    /// <param name="out">The counters.</param>
+    void MidiSynth::GetVoiceStatistics(MidiVoiceStatistics& out) noexcept
+    {
+        voiceGovernor.GetStatistics(out);
+    }
+
+    /// <summary>
+    /// Get the counters of the coalescing of the backlog.
+    /// </summary>
+    /// <param name="out">The counters.</param>
+    void MidiSynth::GetCoalesceStatistics(MidiCoalesceStatistics& out) noexcept
+    {
+        coalescer.GetStatistics(out);
+    }
+
+    /// <summary>
+    /// Get the counters of the MIDI queue of a port.
+    /// </summary>
+    /// <param name="uDeviceID">The port type.</param>
+    /// <param name="out">The counters.</param>
+    void MidiSynth::GetQueueStatistics(unsigned uDeviceID, MidiQueueStatistics& out) noexcept
+    {
+        midiStream.GetStatistics(uDeviceID, out);
+    }
+
+    void MidiSynth::Close() noexcept
+    {
+        waveOut.Close();
+
+        StopRenderThread();
+
+        synthMutex.Enter();
+        vstDriver->CloseVSTDriver();
+        delete vstDriver;
+        vstDriver = NULL;
+        // The client buffers which are still queued are returned
+        midiStream.Reset();
+        priorityLanes.Discard();
+        synthMutex.Leave();
+        synthMutex.Close();
+
+        for (StreamPort& streamPort : streamPorts)
+        {
+            streamPort.Close();
+        }
+    }
 }
\ No newline at end of file
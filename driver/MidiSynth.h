@@ -1,47 +1,192 @@
-/* Copyright (C) 2011, 2012 Sergey V. Mikayev
- *
- *  This program is free software: you can redistribute it and/or modify
- *  it under the terms of the GNU Lesser General Public License as published by
- *  the Free Software Foundation, either version 2.1 of the License, or
- *  (at your option) any later version.
- *
- *  This program is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- *  GNU Lesser General Public License for more details.
- *
- *  You should have received a copy of the GNU Lesser General Public License
- *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-#include "stdafx.h"
-
-#ifndef VSTMIDIDRV_MIDISYNTH_H
-#define VSTMIDIDRV_MIDISYNTH_H
-
-class VSTDriver;
-
-namespace VSTMIDIDRV {
-
-    class MidiSynth {
-    private:
-        unsigned int chunkSize = 0;
-        unsigned int bufferSize = 0;
-
-        VSTDriver* vstDriver = NULL;
-
-        MidiSynth() noexcept;
-
-    public:
-        void Close() noexcept;
-        static MidiSynth& GetInstance();
-        int Init(unsigned uDeviceID);
-        DWORD PutMidiMessage(unsigned uDeviceID, DWORD dwParam1);
-        DWORD PutSysEx(unsigned uDeviceID, unsigned char* bufpos, DWORD len);
-        void Render(short* bufpos, DWORD totalFrames);
-        void RenderFloat(float* bufpos, DWORD totalFrames);
-        int Reset(unsigned uDeviceID) noexcept;
-    };
-
-}
+/* Copyright (C) 2011, 2012 Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#ifndef VSTMIDIDRV_MIDISYNTH_H
+#define VSTMIDIDRV_MIDISYNTH_H
+
+#include "../common/midi_events.h"
+#include "MidiStream.h"
+
+class VSTDriver;
+
+namespace VSTMIDIDRV {
+
+    /// <summary>
+    /// Reports MOM_DONE or MOM_POSITIONCB for a buffer of a MIDI stream, offset is the position of the event for MOM_POSITIONCB
+    /// </summary>
+    typedef void (*StreamNotify)(void* midiHdr, UINT message, DWORD offset);
+
+    /// <summary>
+    /// The counters of the coalescing of the MIDI messages, when the render path falls behind
+    /// </summary>
+    struct MidiCoalesceStatistics
+    {
+        /// <summary>
+        /// The blocks whose backlog exceeded the threshold
+        /// </summary>
+        DWORD blocks;
+        /// <summary>
+        /// The controller, pitch bend and pressure messages which were superseded within their block and not sent
+        /// </summary>
+        DWORD coalesced;
+        /// <summary>
+        /// The System Exclusive resets which repeated the previous message and were not sent
+        /// </summary>
+        DWORD resets;
+    };
+
+    /// <summary>
+    /// The rules of the MIDI filter and the number of messages each one dropped
+    /// </summary>
+    struct MidiFilterStatistics
+    {
+        static const DWORD MaxRules = 16;
+
+        DWORD rules;
+        /// <summary>
+        /// The rules as configured in the MidiFilter settings
+        /// </summary>
+        DWORD rule[MaxRules];
+        DWORD filtered[MaxRules];
+    };
+
+    /// <summary>
+    /// The counters of the voice governor
+    /// </summary>
+    struct MidiVoiceStatistics
+    {
+        /// <summary>
+        /// The notes which sound now and the most which sounded at once
+        /// </summary>
+        DWORD active;
+        DWORD peak;
+        /// <summary>
+        /// The limit in effect, lower than the VoiceLimit setting while the render replies are late
+        /// </summary>
+        DWORD limit;
+        /// <summary>
+        /// The sounding notes which were ended by a note off to make room for a new one
+        /// </summary>
+        DWORD stolen;
+        /// <summary>
+        /// The new notes which were not played
+        /// </summary>
+        DWORD dropped;
+    };
+
+    class MidiSynth {
+    private:
+        unsigned int chunkSize = 0;
+        unsigned int bufferSize = 0;
+        unsigned int sampleRate = 0;
+
+        LONGLONG clockFrequency = 1;
+        LONGLONG lastRenderTime = 0;
+
+        /// <summary>
+        /// The limit of the MidiLatency setting in milliseconds
+        /// </summary>
+        static const DWORD MaxMidiLatency = 1000;
+
+        /// <summary>
+        /// The fixed latency between the arrival of a message and the frame at which it is played, 0 plays the messages of
+        /// a render call over the block relative to the previous render call
+        /// </summary>
+        DWORD midiLatencyFrames = 0;
+        /// <summary>
+        /// The total number of frames queued in the render calls, the position of the playback clock
+        /// </summary>
+        LONGLONG queuedFrames = 0;
+
+        /// <summary>
+        /// The default of the CoalesceThreshold setting
+        /// </summary>
+        static const DWORD DefaultCoalesceThreshold = 128;
+
+        /// <summary>
+        /// The backlog in messages from which on the superseded messages of a block are coalesced, 0 never coalesces
+        /// </summary>
+        DWORD coalesceThreshold = DefaultCoalesceThreshold;
+        /// <summary>
+        /// The values are kept per sub-block of this many frames, 0 keeps the last value of the block
+        /// </summary>
+        DWORD coalesceSubBlock = 0;
+
+        /// <summary>
+        /// The default of the BulkBytesPerBlock setting, the bytes of System Exclusive messages sent with a block, 0 (the default) sends everything at once.
+        /// A System Exclusive message is never split, one longer than the budget is sent as the only System Exclusive message of its block
+        /// </summary>
+        static const DWORD DefaultBulkBytesPerBlock = 0;
+
+        /// <summary>
+        /// The size of the blocks which are rendered ahead and the limit of the RenderAheadBlocks setting
+        /// </summary>
+        static const DWORD RenderAheadBlockSize = 512;
+        static const DWORD MaxRenderAheadBlocks = 64;
+
+        /// <summary>
+        /// The number of blocks which are rendered ahead of the audio device, 0 renders in the device callback
+        /// </summary>
+        DWORD renderAheadBlocks = 0;
+        HANDLE hRenderThread = NULL;
+        /// <summary>
+        /// Set by the audio device callback when it consumed rendered frames
+        /// </summary>
+        HANDLE hRenderEvent = NULL;
+        volatile bool renderThreadRunning = false;
+        LONGLONG renderedFrames = 0;
+
+        VSTDriver* vstDriver = NULL;
+
+        MidiSynth() noexcept;
+        void QueueMidiMessages(DWORD totalFrames);
+        void QueueMidiMessages(DWORD totalFrames, LONGLONG referenceTime, LONGLONG referenceFrame);
+
+        static DWORD WINAPI RenderThreadProc(LPVOID lpParameter);
+        void RenderAhead();
+        bool StartRenderThread();
+        void StopRenderThread() noexcept;
+        void DiscardMessages(unsigned uDeviceID) noexcept;
+
+    public:
+        void Close() noexcept;
+        static MidiSynth& GetInstance();
+        int Init(unsigned uDeviceID);
+        DWORD PutMidiMessage(unsigned uDeviceID, DWORD dwParam1);
+        DWORD PutSysEx(unsigned uDeviceID, unsigned char* bufpos, DWORD len);
+        DWORD PutSysExReference(unsigned uDeviceID, unsigned char* bufpos, DWORD len, SysExRelease release, void* context);
+        DWORD OpenStream(unsigned uDeviceID, StreamNotify notify);
+        void CloseStream(unsigned uDeviceID);
+        DWORD PutStreamBuffer(unsigned uDeviceID, MIDIHDR* midiHdr);
+        DWORD StreamProperty(unsigned uDeviceID, LPBYTE property, DWORD flags);
+        void RestartStream(unsigned uDeviceID);
+        void PauseStream(unsigned uDeviceID);
+        void StopStream(unsigned uDeviceID);
+        DWORD GetStreamPosition(unsigned uDeviceID, MMTIME* time);
+        void Render(short* bufpos, DWORD totalFrames);
+        void RenderFloat(float* bufpos, DWORD totalFrames);
+        int Silence(unsigned uDeviceID) noexcept;
+        int Reset(unsigned uDeviceID) noexcept;
+        void GetQueueStatistics(unsigned uDeviceID, MidiQueueStatistics& out) noexcept;
+        void GetCoalesceStatistics(MidiCoalesceStatistics& out) noexcept;
+        void GetFilterStatistics(MidiFilterStatistics& out) noexcept;
+        void GetVoiceStatistics(MidiVoiceStatistics& out) noexcept;
+    };
+
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,180 @@
+/* Copyright (C) 2011, 2012 Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VSTMIDIDRV_PRIORITYLANES_H
+#define VSTMIDIDRV_PRIORITYLANES_H
+
+#include "MidiStream.h"
+#include <cstring>
+#include <vector>
+
+namespace VSTMIDIDRV {
+
+    /// <summary>
+    /// A message taken from the midi stream, with the frame offset at which it is played
+    /// </summary>
+    struct ScheduledMessage
+    {
+        MidiStream::Message message;
+        DWORD offset;
+        /// <summary>
+        /// Set by the coalescer when a later message supersedes this one
+        /// </summary>
+        bool superseded;
+    };
+
+    /// <summary>
+    /// Splits the messages of a block into two lanes: the channel voice messages, which are sent at once,
+    /// and the bulk lane of the System Exclusive and system messages, which sends at most BulkBytesPerBlock bytes per block
+    /// and defers the rest to the next blocks, so a patch upload does not hold up the notes.
+    /// Ordering is kept where it matters: the messages of a port stay behind its deferred bulk messages if they are system messages,
+    /// program changes or bank selects, and the later messages of such a channel stay behind those.
+    /// Only whole messages are deferred, the VSTi expects a complete System Exclusive message per event, so the first message
+    /// of a block is always sent and a message longer than the budget exceeds it for the block it is sent with.
+    /// </summary>
+    class PriorityLanes
+    {
+    private:
+        static const DWORD ports = 2;
+
+        /// <summary>
+        /// The bytes of System Exclusive messages per block, 0 sends everything at once
+        /// </summary>
+        DWORD bulkBudget = 0;
+        DWORD bulkBytes = 0;
+
+        /// <summary>
+        /// The length of the block which deferred the messages, their offsets are relative to its start
+        /// </summary>
+        DWORD blockFrames = 0;
+
+        /// <summary>
+        /// Set for a port which has deferred bulk messages in this block
+        /// </summary>
+        bool portDeferred[ports];
+        /// <summary>
+        /// The channels of a port which have deferred messages in this block
+        /// </summary>
+        WORD channelsDeferred[ports];
+
+        std::vector<ScheduledMessage> deferred;
+
+        static bool IsProgramSelection(DWORD message) noexcept
+        {
+            DWORD status = message & 0xF0;
+            DWORD controller = (message >> 8) & 0x7F;
+            return status == 0xC0 || (status == 0xB0 && (controller == 0 || controller == 32));
+        }
+
+    public:
+        void Init(DWORD bulkBudget) noexcept
+        {
+            this->bulkBudget = bulkBudget;
+            Discard();
+        }
+
+        /// <summary>
+        /// Start a block with the messages deferred by the previous one.
+        /// They keep their position relative to the messages sent before them, which may be queued past the previous block
+        /// with a MIDI latency, so they are moved by the length of the previous block and the late ones are due at once.
+        /// </summary>
+        /// <param name="block">Receives the deferred messages</param>
+        /// <param name="totalFrames">The length of the block</param>
+        void BeginBlock(std::vector<ScheduledMessage>& block, DWORD totalFrames) noexcept
+        {
+            for (ScheduledMessage& scheduled : deferred)
+            {
+                scheduled.offset = scheduled.offset > blockFrames ? scheduled.offset - blockFrames : 0;
+                block.push_back(scheduled);
+            }
+            deferred.clear();
+            blockFrames = totalFrames;
+
+            bulkBytes = 0;
+            memset(portDeferred, 0, sizeof(portDeferred));
+            memset(channelsDeferred, 0, sizeof(channelsDeferred));
+        }
+
+        /// <summary>
+        /// Decide whether a message is sent in this block, otherwise it is kept for the next one
+        /// </summary>
+        /// <param name="scheduled">The message, in the order of the block</param>
+        /// <returns>true if the message is sent now</returns>
+        bool Admit(const ScheduledMessage& scheduled) noexcept
+        {
+            const MidiStream::Message& message = scheduled.message;
+            DWORD port = message.port < ports ? message.port : 0;
+
+            bool defer;
+            if (message.sysEx)
+            {
+                // The first message of a block is sent even if it exceeds the budget on its own
+                defer = portDeferred[port] || (bulkBudget && bulkBytes && bulkBytes + message.sysExLength > bulkBudget);
+                if (!defer)
+                {
+                    bulkBytes += message.sysExLength;
+                }
+                portDeferred[port] |= defer;
+            }
+            else
+            {
+                DWORD status = message.message & 0xFF;
+                if (status < 0x80 || status >= 0xF0)
+                {
+                    defer = portDeferred[port];
+                }
+                else
+                {
+                    WORD channel = 1 << (status & 0x0F);
+                    defer = (channelsDeferred[port] & channel) || (portDeferred[port] && IsProgramSelection(message.message));
+                    if (defer)
+                    {
+                        channelsDeferred[port] |= channel;
+                    }
+                }
+            }
+
+            if (defer)
+            {
+                deferred.push_back(scheduled);
+            }
+
+            return !defer;
+        }
+
+        /// <summary>
+        /// Drop the deferred messages, their System Exclusive data is returned
+        /// </summary>
+        void Discard() noexcept
+        {
+            for (const ScheduledMessage& scheduled : deferred)
+            {
+                const MidiStream::Message& message = scheduled.message;
+                if (message.release)
+                {
+                    message.release(message.releaseContext);
+                }
+                else if (message.sysEx)
+                {
+                    GetSysExSlab(message.port).Free(message.sysEx);
+                }
+            }
+            deferred.clear();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef __STREAMSCHEDULER_H__
+#define __STREAMSCHEDULER_H__
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+
+/// <summary>
+/// Plays the MIDIEVENT buffers of a MIDI stream (midiStreamOut) against the frame clock of the rendered audio.
+/// Every MIDIEVENT is a delta time in ticks, a stream id and an event word, followed by the parameters of a long event
+/// padded to a multiple of 4 bytes. The ticks are converted to frames with the tempo and the time division of the stream,
+/// so the events are placed at their frame within the rendered block instead of being sent when a timer fires.
+/// The scheduler does not lock and does not know about WINMM, the caller serializes it and reports to the client.
+/// </summary>
+class StreamScheduler
+{
+public:
+    enum : uint32_t
+    {
+        /// <summary>
+        /// The event types (MEVT_*) in the high byte of the event word
+        /// </summary>
+        ShortMessageEvent = 0x00,
+        TempoEvent = 0x01,
+        NopEvent = 0x02,
+        LongMessageEvent = 0x80,
+
+        /// <summary>
+        /// The flags in the event word (MEVT_F_*)
+        /// </summary>
+        LongFlag = 0x80000000,
+        CallbackFlag = 0x40000000,
+
+        ParameterMask = 0x00FFFFFF,
+
+        /// <summary>
+        /// The defaults of a new stream, 120 beats per minute and 96 ticks per quarter note
+        /// </summary>
+        DefaultTempo = 500000,
+        DefaultTimeDivision = 96,
+    };
+
+    /// <summary>
+    /// A queued buffer of MIDIEVENTs
+    /// </summary>
+    struct Buffer
+    {
+        const uint8_t* data;
+        uint32_t size;
+        /// <summary>
+        /// Passed back to the sink, the MIDIHDR of the buffer
+        /// </summary>
+        void* context;
+    };
+
+private:
+    double sampleRate = 44100;
+    uint32_t tempo = DefaultTempo;
+    uint32_t timeDivision = DefaultTimeDivision;
+    double framesPerTick = 0;
+
+    bool running = false;
+
+    /// <summary>
+    /// The frame at which the next block starts, counted while the stream runs
+    /// </summary>
+    double position = 0;
+
+    /// <summary>
+    /// The frame and the tick of the last played event
+    /// </summary>
+    double lastEventFrame = 0;
+    uint64_t lastEventTick = 0;
+
+    std::deque<Buffer> buffers;
+    /// <summary>
+    /// The position of the next event in the first buffer
+    /// </summary>
+    uint32_t cursor = 0;
+
+    void UpdateFramesPerTick()
+    {
+        if (timeDivision & 0x8000)
+        {
+            /// SMPTE: the high byte is the negative frame rate, -29 for 30 drop frame, the low byte the ticks per frame
+            int framesPerSecond = -(int)(int8_t)(timeDivision >> 8);
+            double rate = framesPerSecond == 29 ? 29.97 : framesPerSecond;
+            uint32_t ticksPerFrame = timeDivision & 0xFF;
+            framesPerTick = rate && ticksPerFrame ? sampleRate / (rate * ticksPerFrame) : 0;
+        }
+        else
+        {
+            /// Ticks per quarter note, the tempo is in microseconds per quarter note
+            uint32_t ticksPerQuarterNote = timeDivision & 0x7FFF;
+            framesPerTick = ticksPerQuarterNote ? sampleRate * tempo / (1000000.0 * ticksPerQuarterNote) : 0;
+        }
+    }
+
+    static uint32_t ReadWord(const uint8_t* data)
+    {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        return word;
+    }
+
+public:
+    /// <summary>
+    /// Set up a stopped stream with the default tempo and time division
+    /// </summary>
+    /// <param name="sampleRate">The sample rate of the rendered audio</param>
+    void Init(uint32_t sampleRate)
+    {
+        this->sampleRate = sampleRate;
+        tempo = DefaultTempo;
+        timeDivision = DefaultTimeDivision;
+        UpdateFramesPerTick();
+        running = false;
+        position = 0;
+        lastEventFrame = 0;
+        lastEventTick = 0;
+        buffers.clear();
+        cursor = 0;
+    }
+
+    uint32_t GetTempo() const
+    {
+        return tempo;
+    }
+
+    /// <summary>
+    /// Set the tempo, it applies from the next event on
+    /// </summary>
+    /// <param name="tempo">Microseconds per quarter note</param>
+    void SetTempo(uint32_t tempo)
+    {
+        this->tempo = tempo;
+        UpdateFramesPerTick();
+    }
+
+    uint32_t GetTimeDivision() const
+    {
+        return timeDivision;
+    }
+
+    /// <summary>
+    /// Set the time division as in a standard MIDI file header
+    /// </summary>
+    /// <param name="timeDivision">Ticks per quarter note, or SMPTE frames per second and ticks per frame when bit 15 is set</param>
+    void SetTimeDivision(uint32_t timeDivision)
+    {
+        this->timeDivision = timeDivision;
+        UpdateFramesPerTick();
+    }
+
+    bool IsRunning() const
+    {
+        return running;
+    }
+
+    void Restart()
+    {
+        running = true;
+    }
+
+    void Pause()
+    {
+        running = false;
+    }
+
+    bool IsEmpty() const
+    {
+        return buffers.empty();
+    }
+
+    /// <summary>
+    /// Queue a buffer, its events follow the ones of the previous buffer
+    /// </summary>
+    /// <param name="buffer">The buffer, it must stay valid until the sink is done with it</param>
+    void Enqueue(const Buffer& buffer)
+    {
+        buffers.push_back(buffer);
+    }
+
+    /// <summary>
+    /// Remove the queued buffers and rewind the stream to tick 0
+    /// </summary>
+    /// <param name="sink">sink.Done(context) is called for every removed buffer</param>
+    template <class Sink> void Stop(Sink& sink)
+    {
+        while (!buffers.empty())
+        {
+            void* context = buffers.front().context;
+            buffers.pop_front();
+            sink.Done(context);
+        }
+
+        cursor = 0;
+        position = 0;
+        lastEventFrame = 0;
+        lastEventTick = 0;
+    }
+
+    /// <summary>
+    /// Get the position of the stream at the start of the next block
+    /// </summary>
+    /// <param name="ticks">The position in ticks</param>
+    /// <param name="milliseconds">The position in milliseconds</param>
+    void GetPosition(uint64_t& ticks, uint64_t& milliseconds) const
+    {
+        ticks = lastEventTick;
+        if (framesPerTick > 0 && position > lastEventFrame)
+        {
+            ticks += (uint64_t)((position - lastEventFrame) / framesPerTick);
+        }
+
+        milliseconds = (uint64_t)(position * 1000 / sampleRate);
+    }
+
+    /// <summary>
+    /// Play the events which are due within the next block
+    /// </summary>
+    /// <param name="frames">The length of the block</param>
+    /// <param name="sink">
+    /// Receives the events as sink.ShortMessage(offset, message) and sink.LongMessage(offset, data, length),
+    /// sink.Position(context, bufferOffset) for the events with the callback flag and sink.Done(context) for every played buffer
+    /// </param>
+    template <class Sink> void Render(uint32_t frames, Sink& sink)
+    {
+        if (!running)
+        {
+            return;
+        }
+
+        double end = position + frames;
+
+        while (!buffers.empty())
+        {
+            const Buffer& buffer = buffers.front();
+
+            if (cursor + 3 * sizeof(uint32_t) > buffer.size)
+            {
+                void* context = buffer.context;
+                buffers.pop_front();
+                cursor = 0;
+                sink.Done(context);
+                continue;
+            }
+
+            const uint8_t* event = buffer.data + cursor;
+            uint32_t deltaTime = ReadWord(event);
+            uint32_t eventWord = ReadWord(event + 2 * sizeof(uint32_t));
+
+            double eventFrame = lastEventFrame + deltaTime * framesPerTick;
+            if (eventFrame >= end)
+            {
+                break;
+            }
+
+            /// An event which is late, because its buffer came late, moves the stream along with it
+            if (eventFrame < position)
+            {
+                eventFrame = position;
+            }
+
+            uint32_t offset = (uint32_t)(eventFrame - position);
+            if (offset >= frames)
+            {
+                offset = frames - 1;
+            }
+
+            uint32_t eventSize = 3 * sizeof(uint32_t);
+            uint32_t parameter = eventWord & ParameterMask;
+
+            if (eventWord & LongFlag)
+            {
+                uint32_t length = parameter;
+                if (length > buffer.size - cursor - eventSize)
+                {
+                    length = buffer.size - cursor - eventSize;
+                }
+                eventSize += (length + 3) & ~3u;
+
+                if (((eventWord >> 24) & ~(CallbackFlag >> 24)) == LongMessageEvent && length)
+                {
+                    sink.LongMessage(offset, event + 3 * sizeof(uint32_t), length);
+                }
+            }
+            else
+            {
+                switch ((eventWord >> 24) & ~(CallbackFlag >> 24))
+                {
+                    case ShortMessageEvent:
+                        sink.ShortMessage(offset, parameter);
+                        break;
+
+                    case TempoEvent:
+                        SetTempo(parameter);
+                        break;
+                }
+            }
+
+            if (eventWord & CallbackFlag)
+            {
+                sink.Position(buffer.context, cursor);
+            }
+
+            lastEventFrame = eventFrame;
+            lastEventTick += deltaTime;
+            cursor += eventSize;
+        }
+
+        position = end;
+    }
+};
+
+#endif
@@ -1,849 +1,1568 @@
-/* Copyright (C) 2011 Chris Moeller, Brad Miller
- *
- *  This program is free software: you can redistribute it and/or modify
- *  it under the terms of the GNU Lesser General Public License as published by
- *  the Free Software Foundation, either version 2.1 of the License, or
- *  (at your option) any later version.
- *
- *  This program is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- *  GNU Lesser General Public License for more details.
- *
- *  You should have received a copy of the GNU Lesser General Public License
- *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-#include <string>
-#include "VSTDriver.h"
-#include <assert.h>
-#include <filesystem>
-
-using std::vector;
-
-enum Command : uint32_t
-{
-	Exit = 0,
-	GetChunkData = 1,
-	SetChunkData = 2,
-	VstiHasEditor = 3,
-	DisplayEditorModal = 4,
-	SetSampleRate = 5,
-	Reset = 6,
-	SendMidiEvent = 7,
-	SendMidiSystemExclusiveEvent = 8,
-	RenderAudioSamples = 9,
-};
-
-VSTDriver::VSTDriver()
-{
-	isInitialized = false;
-	isTerminating = false;
-	hProcess = NULL;
-	hThread = NULL;
-	hReadEvent = NULL;
-	hChildStd_IN_Rd = NULL;
-	/// <summary>
-	/// The MIDI input of the VSTi DLL
-	/// </summary>
-	hChildStd_IN_Wr = NULL;
-	/// <summary>
-	/// The Audio output of the VSTi DLL
-	/// </summary>
-	hChildStd_OUT_Rd = NULL;
-	hChildStd_OUT_Wr = NULL;
-	audioOutputs = 0;
-	effectName = NULL;
-	vendor = NULL;
-	product = NULL;
-}
-
-VSTDriver::~VSTDriver()
-{
-	CloseVSTDriver();
-	delete[] effectName;
-	delete[] vendor;
-	delete[] product;
-}
-
-static WORD getwordle(BYTE* pData)
-{
-	return (WORD)(pData[0] | (((WORD)pData[1]) << 8));
-}
-
-static DWORD getdwordle(BYTE* pData)
-{
-	return pData[0] | (((DWORD)pData[1]) << 8) | (((DWORD)pData[2]) << 16) | (((DWORD)pData[3]) << 24);
-}
-
-unsigned VSTDriver::test_plugin_platform() {
-#define iMZHeaderSize (0x40)
-#define iPEHeaderSize (4 + 20 + 224)
-
-	BYTE peheader[iPEHeaderSize];
-	DWORD dwOffsetPE;
-
-	FILE* f = _tfopen(szPluginPath, _T("rb"));
-	if (!f) goto error;
-	if (fread(peheader, 1, iMZHeaderSize, f) < iMZHeaderSize) goto error;
-	if (getwordle(peheader) != 0x5A4D) goto error;
-	dwOffsetPE = getdwordle(peheader + 0x3c);
-	if (fseek(f, dwOffsetPE, SEEK_SET) != 0) goto error;
-	if (fread(peheader, 1, iPEHeaderSize, f) < iPEHeaderSize) goto error;
-	fclose(f); f = NULL;
-	if (getdwordle(peheader) != 0x00004550) goto error;
-	switch (getwordle(peheader + 4)) {
-		case 0x014C: return 32;
-		case 0x8664: return 64;
-	}
-
-error:
-	if (f) fclose(f);
-	return 0;
-}
-
-/// <summary>
-/// Initialize the path to the VSTi plugin
-/// </summary>
-/// <param name="effect">The path to the VSTi</param>
-void VSTDriver::InitializeVstiPath(TCHAR* szPath)
-{
-	if (szPath)
-	{
-		DWORD pluginPathLength = 0;
-		pluginPathLength = _tcslen(szPath) * sizeof(TCHAR);
-		szPluginPath = (TCHAR*)calloc(pluginPathLength + sizeof(TCHAR), 1);
-		_tcscpy(szPluginPath, szPath);
-	}
-	else
-	{
-		HKEY hKey;
-		long result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver", 0, KEY_READ | KEY_WOW64_32KEY, &hKey);
-
-		if (result != NO_ERROR)
-		{
-			return;
-		}
-
-		ULONG size;
-		DWORD registryType = REG_NONE;
-
-		/// Get the current VSTi plugin path. Example: C:\Program Files (x86)\yamaha_syxg50_vsti\syxg50.dll
-		result = RegQueryValueEx(hKey, L"plugin", NULL, &registryType, NULL, &size);
-
-		if (result != NO_ERROR || size == 0 || (registryType != REG_SZ && registryType != REG_EXPAND_SZ))
-		{
-			return;
-		}
-
-		szPluginPath = (TCHAR*)calloc(size, sizeof(TCHAR));
-		result = RegQueryValueEx(hKey, L"plugin", NULL, &registryType, (LPBYTE)szPluginPath, &size);
-
-		if (result != NO_ERROR || size == 0 || (registryType != REG_SZ && registryType != REG_EXPAND_SZ))
-		{
-			return;
-		}
-
-		RegCloseKey(hKey);
-	}
-
-	uPluginPlatform = test_plugin_platform();
-}
-
-/// <summary>
-/// Load the settings of the VSTi plugin
-/// </summary>
-void VSTDriver::LoadVstiSettings()
-{
-	HKEY hKey;
-	long result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver\\Persistence", 0, KEY_READ | KEY_WOW64_32KEY, &hKey);
-
-	if (result != NO_ERROR)
-	{
-		return;
-	}
-
-	ULONG chunkSize;
-	vector<uint8_t> chunk;
-	DWORD registryType = REG_NONE;
-
-	/// Get the VSTi plugin settings
-	result = RegQueryValueEx(hKey, std::filesystem::path(szPluginPath).stem().c_str(), NULL, &registryType, NULL, &chunkSize);
-
-	if (result != NO_ERROR || chunkSize == 0 || registryType != REG_BINARY)
-	{
-		RegCloseKey(hKey);
-		return;
-	}
-
-	chunk.resize(chunkSize);
-
-	result = RegQueryValueEx(hKey, std::filesystem::path(szPluginPath).stem().c_str(), NULL, &registryType, (LPBYTE)chunk.data(), &chunkSize);
-
-	if (result != NO_ERROR)
-	{
-		RegCloseKey(hKey);
-		return;
-	}
-
-	/// Set the VSTi plugin settings
-	SetChunk(chunk.data(), chunkSize);
-
-	RegCloseKey(hKey);
-}
-
-/// <summary>
-/// Save the settings of the VSTi plugin
-/// </summary>
-void VSTDriver::SaveVstiSettings()
-{
-	if (!szPluginPath)
-	{
-		return;
-	}
-
-	HKEY hKey;
-
-	/// Create the Persistence registry subkey
-	long result = RegCreateKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver\\Persistence", 0, 0, 0, KEY_WRITE | KEY_WOW64_32KEY, NULL, &hKey, NULL);
-
-	if (result != NO_ERROR)
-	{
-		return;
-	}
-
-	/// Get the VSTi plugin settings
-	vector<uint8_t> chunk;
-	GetChunk(chunk);
-
-	if (chunk.size() > 0)
-	{
-		/// Save the VSTi plugin settings
-		RegSetValueEx(hKey, std::filesystem::path(szPluginPath).stem().c_str(), 0, REG_BINARY, (LPBYTE)chunk.data(), chunk.size());
-	}
-
-	RegCloseKey(hKey);
-}
-
-static inline char print_hex_digit(unsigned val)
-{
-	static const char table[16] = { '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' };
-	assert((val & ~0xF) == 0);
-	return table[val];
-}
-
-static void print_hex(unsigned val, std::wstring& out, unsigned bytes)
-{
-	unsigned n;
-	for (n = 0; n < bytes; n++)
-	{
-		unsigned char c = (unsigned char)((val >> ((bytes - 1 - n) << 3)) & 0xFF);
-		out += print_hex_digit(c >> 4);
-		out += print_hex_digit(c & 0xF);
-	}
-}
-
-static void print_guid(const GUID& p_guid, std::wstring& out)
-{
-	print_hex(p_guid.Data1, out, 4);
-	out += '-';
-	print_hex(p_guid.Data2, out, 2);
-	out += '-';
-	print_hex(p_guid.Data3, out, 2);
-	out += '-';
-	print_hex(p_guid.Data4[0], out, 1);
-	print_hex(p_guid.Data4[1], out, 1);
-	out += '-';
-	print_hex(p_guid.Data4[2], out, 1);
-	print_hex(p_guid.Data4[3], out, 1);
-	print_hex(p_guid.Data4[4], out, 1);
-	print_hex(p_guid.Data4[5], out, 1);
-	print_hex(p_guid.Data4[6], out, 1);
-	print_hex(p_guid.Data4[7], out, 1);
-}
-
-static bool GeneratePipeName(std::wstring& pipeName)
-{
-	GUID guid;
-	if (FAILED(CoCreateGuid(&guid)))
-	{
-		return false;
-	}
-
-	pipeName = L"\\\\.\\pipe\\";
-	print_guid(guid, pipeName);
-
-	return true;
-}
-
-bool VSTDriver::connect_pipe(HANDLE hPipe)
-{
-	OVERLAPPED ol = {};
-	ol.hEvent = hReadEvent;
-	ResetEvent(hReadEvent);
-	if (!ConnectNamedPipe(hPipe, &ol))
-	{
-		DWORD error = GetLastError();
-		if (error == ERROR_PIPE_CONNECTED)
-		{
-			return true;
-		}
-
-		if (error != ERROR_IO_PENDING)
-		{
-			return false;
-		}
-
-		if (WaitForSingleObject(hReadEvent, 10000) == WAIT_TIMEOUT)
-		{
-			return false;
-		}
-	}
-	return true;
-}
-
-extern "C" { extern HINSTANCE hinst_vst_driver; };
-
-bool VSTDriver::process_create(uint32_t** error)
-{
-	isTerminating = false;
-
-	if (uPluginPlatform != 32 && uPluginPlatform != 64)
-	{
-		return false;
-	}
-
-	SECURITY_ATTRIBUTES saAttr{};
-	saAttr.nLength = sizeof(saAttr);
-	saAttr.bInheritHandle = TRUE;
-	saAttr.lpSecurityDescriptor = NULL;
-
-	if (!isInitialized)
-	{
-		if (FAILED(CoInitialize(NULL)))
-		{
-			return false;
-		}
-		isInitialized = true;
-	}
-
-	hReadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-
-	std::wstring pipeNameIn, pipeNameOut;
-	if (!GeneratePipeName(pipeNameIn) || !GeneratePipeName(pipeNameOut))
-	{
-		process_terminate();
-		return false;
-	}
-
-	HANDLE hPipe = CreateNamedPipe(pipeNameIn.c_str(), PIPE_ACCESS_OUTBOUND | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, &saAttr);
-	if (hPipe == INVALID_HANDLE_VALUE)
-	{
-		process_terminate();
-		return false;
-	}
-	hChildStd_IN_Rd = CreateFile(pipeNameIn.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &saAttr, OPEN_EXISTING, 0, NULL);
-	DuplicateHandle(GetCurrentProcess(), hPipe, GetCurrentProcess(), &hChildStd_IN_Wr, 0, FALSE, DUPLICATE_SAME_ACCESS);
-	CloseHandle(hPipe);
-
-	hPipe = CreateNamedPipe(pipeNameOut.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED, PIPE_READMODE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, &saAttr);
-	if (hPipe == INVALID_HANDLE_VALUE)
-	{
-		process_terminate();
-		return false;
-	}
-	hChildStd_OUT_Wr = CreateFile(pipeNameOut.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &saAttr, OPEN_EXISTING, 0, NULL);
-	DuplicateHandle(GetCurrentProcess(), hPipe, GetCurrentProcess(), &hChildStd_OUT_Rd, 0, FALSE, DUPLICATE_SAME_ACCESS);
-	CloseHandle(hPipe);
-
-	std::wstring szCmdLine = L"\"";
-
-	TCHAR my_path[MAX_PATH];
-	GetModuleFileName(hinst_vst_driver, my_path, _countof(my_path));
-
-	szCmdLine += my_path;
-	szCmdLine.resize(szCmdLine.find_last_of('\\') + 1);
-	if (szCmdLine.find(L"vstmididrv\\") == std::string::npos)
-	{
-		szCmdLine += L"vstmididrv\\";
-	}
-	szCmdLine += (uPluginPlatform == 64) ? L"vsthost64.exe" : L"vsthost32.exe";
-	szCmdLine += L"\" \"";
-	szCmdLine += szPluginPath;
-	szCmdLine += L"\" ";
-
-	unsigned sum = 0;
-
-	const TCHAR* ch = szPluginPath;
-	while (*ch)
-	{
-		sum += (TCHAR)(*ch++ * 820109);
-	}
-
-	print_hex(sum, szCmdLine, 4);
-
-	PROCESS_INFORMATION piProcInfo;
-	STARTUPINFO siStartInfo = { 0 };
-
-	siStartInfo.cb = sizeof(siStartInfo);
-	siStartInfo.hStdInput = hChildStd_IN_Rd;
-	siStartInfo.hStdOutput = hChildStd_OUT_Wr;
-	siStartInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
-	siStartInfo.dwFlags |= STARTF_USESTDHANDLES;
-
-	TCHAR CmdLine[MAX_PATH];
-	_tcscpy_s(CmdLine, _countof(CmdLine), szCmdLine.c_str());
-
-	/// Start the VST Host process with the VSTi
-	if (!CreateProcess(NULL, CmdLine, NULL, NULL, TRUE, 0, NULL, NULL, &siStartInfo, &piProcInfo))
-	{
-		process_terminate();
-		return false;
-	}
-
-	// Close remote handles so pipes will break when process terminates
-	CloseHandle(hChildStd_OUT_Wr);
-	CloseHandle(hChildStd_IN_Rd);
-	hChildStd_OUT_Wr = NULL;
-	hChildStd_IN_Rd = NULL;
-
-	hProcess = piProcInfo.hProcess;
-	hThread = piProcInfo.hThread;
-
-#ifdef NDEBUG
-	SetPriorityClass(hProcess, GetPriorityClass(GetCurrentProcess()));
-	SetThreadPriority(hThread, GetThreadPriority(GetCurrentThread()));
-#endif
-
-	uint32_t status = ReceiveData();
-
-	if (status != 0)
-	{
-		process_terminate();
-		*error = new uint32_t(status);
-		return false;
-	}
-
-	uint32_t effectNameLength = ReceiveData();
-	uint32_t vendorLength = ReceiveData();
-	uint32_t productLength = ReceiveData();
-	vendorVersion = ReceiveData();
-	uniqueId = ReceiveData();
-	audioOutputs = ReceiveData();
-
-	delete[] effectName;
-	delete[] vendor;
-	delete[] product;
-
-	effectName = new char[effectNameLength + 1];
-	vendor = new char[vendorLength + 1];
-	product = new char[productLength + 1];
-
-	ReceiveData(effectName, effectNameLength);
-	ReceiveData(vendor, vendorLength);
-	ReceiveData(product, productLength);
-
-	effectName[effectNameLength] = 0;
-	vendor[vendorLength] = 0;
-	product[productLength] = 0;
-
-	return true;
-}
-
-void VSTDriver::process_terminate()
-{
-	if (isTerminating)
-	{
-		return;
-	}
-
-	isTerminating = true;
-
-	if (hProcess)
-	{
-		SendData(Command::Exit);
-		// TerminateProcess is asynchronous; it initiates termination and returns immediately.
-		TerminateProcess(hProcess, 0);
-		// If you need to be sure the process has terminated, call the WaitForSingleObject function with a handle to the process.
-		WaitForSingleObject(hProcess, 5000);
-
-		CloseHandle(hThread);
-		hThread = NULL;
-
-		CloseHandle(hProcess);
-		hProcess = NULL;
-	}
-	if (hChildStd_IN_Rd)
-	{
-		CloseHandle(hChildStd_IN_Rd);
-		hChildStd_IN_Rd = NULL;
-	}
-	if (hChildStd_IN_Wr)
-	{
-		CloseHandle(hChildStd_IN_Wr);
-		hChildStd_IN_Wr = NULL;
-	}
-	if (hChildStd_OUT_Rd)
-	{
-		CloseHandle(hChildStd_OUT_Rd);
-		hChildStd_OUT_Rd = NULL;
-	}
-	if (hChildStd_OUT_Wr)
-	{
-		CloseHandle(hChildStd_OUT_Wr);
-		hChildStd_OUT_Wr = NULL;
-	}
-	if (hReadEvent)
-	{
-		CloseHandle(hReadEvent);
-		hReadEvent = NULL;
-	}
-	if (isInitialized)
-	{
-		CoUninitialize();
-		isInitialized = false;
-	}
-}
-
-bool VSTDriver::process_running()
-{
-	return hProcess && WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
-}
-
-static void ProcessPendingMessages()
-{
-	MSG msg = {};
-	while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
-	{
-		DispatchMessage(&msg);
-	}
-}
-
-uint32_t VSTDriver::ReceivePipeData(void* out, uint32_t size)
-{
-	OVERLAPPED ol = {};
-	ol.hEvent = hReadEvent;
-	ResetEvent(hReadEvent);
-	SetLastError(NO_ERROR);
-	DWORD received;
-	if (ReadFile(hChildStd_OUT_Rd, out, size, &received, &ol))
-	{
-		return received;
-	}
-
-	if (GetLastError() != ERROR_IO_PENDING)
-	{
-		return 0;
-	}
-
-	const HANDLE handles[1] = { hReadEvent };
-	SetLastError(NO_ERROR);
-	DWORD state;
-	for (;;)
-	{
-		state = MsgWaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE, QS_ALLEVENTS);
-		if (state == WAIT_OBJECT_0 + _countof(handles))
-		{
-			ProcessPendingMessages();
-		}
-		else
-		{
-			break;
-		}
-	}
-
-	if (state == WAIT_OBJECT_0 && GetOverlappedResult(hChildStd_OUT_Rd, &ol, &received, TRUE))
-	{
-		return received;
-	}
-
-#if 0 && _WIN32_WINNT >= 0x600
-	CancelIoEx(hChildStd_OUT_Rd, &ol);
-#else
-	CancelIo(hChildStd_OUT_Rd);
-#endif
-
-	return 0;
-}
-
-void VSTDriver::ReceiveData(void* out, uint32_t size)
-{
-	if (size && process_running())
-	{
-		uint8_t* ptr = (uint8_t*)out;
-		uint32_t done = 0;
-		while (done < size)
-		{
-			uint32_t received = ReceivePipeData(ptr + done, size - done);
-			if (received == 0)
-			{
-				memset(out, 0xFF, size);
-				break;
-			}
-			done += received;
-		}
-	}
-	else
-	{
-		memset(out, 0xFF, size);
-	}
-}
-
-uint32_t VSTDriver::ReceiveData()
-{
-	uint32_t code;
-	ReceiveData(&code, sizeof(code));
-	return code;
-}
-
-void VSTDriver::SendData(const void* in, uint32_t size)
-{
-	if (size && process_running())
-	{
-		DWORD bytesWritten;
-		if (!WriteFile(hChildStd_IN_Wr, in, size, &bytesWritten, NULL) || bytesWritten < size)
-		{
-			process_terminate();
-		}
-	}
-}
-
-void VSTDriver::SendData(uint32_t code)
-{
-	SendData(&code, sizeof(code));
-}
-
-void VSTDriver::GetEffectName(std::string& out)
-{
-	out = effectName;
-}
-
-void VSTDriver::GetVendorString(std::string& out)
-{
-	out = vendor;
-}
-
-void VSTDriver::GetProductString(std::string& out)
-{
-	out = product;
-}
-
-/// <summary>
-/// Get the VSTi vendor-specific version
-/// </summary>
-/// <returns>The VSTi vendor-specific version</returns>
-long VSTDriver::GetVendorVersion()
-{
-	return vendorVersion;
-}
-
-/// <summary>
-/// Get the unique id of the VSTi
-/// </summary>
-/// <returns>The unique id of the VSTi</returns>
-long VSTDriver::GetUniqueID()
-{
-	return uniqueId;
-}
-
-void VSTDriver::CloseVSTDriver()
-{
-	SaveVstiSettings();
-	process_terminate();
-
-	if (szPluginPath)
-	{
-		free(szPluginPath);
-
-		szPluginPath = NULL;
-	}
-}
-
-bool VSTDriver::OpenVSTDriver(TCHAR* szPath, uint32_t** error, unsigned int sampleRate)
-{
-	CloseVSTDriver();
-
-	InitializeVstiPath(szPath);
-
-	if (!process_create(error))
-	{
-		return false;
-	}
-
-	if (!SetSampleRate(sampleRate))
-	{
-		return false;
-	}
-
-	if (!SetChunk(blChunk))
-	{
-		return false;
-	}
-
-	LoadVstiSettings();
-
-	DisplayEditorModal();
-
-	//timeSetEvent(1000, 10, (LPTIMECALLBACK)TimeProc, (DWORD)this, TIME_ONESHOT);
-
-	return true;
-}
-
-void VSTDriver::GetChunk(vector<uint8_t>& out)
-{
-	SendData(Command::GetChunkData);
-
-	if (ReceiveData())
-	{
-		process_terminate();
-	}
-	else
-	{
-		uint32_t size = ReceiveData();
-
-		out.resize(size);
-
-		ReceiveData(&out[0], size);
-	}
-}
-
-bool VSTDriver::SetChunk(const void* in, unsigned size)
-{
-	SendData(Command::SetChunkData);
-	SendData(size);
-	SendData(in, size);
-	if (ReceiveData())
-	{
-		process_terminate();
-		return false;
-	}
-	return true;
-}
-
-bool VSTDriver::SetChunk(std::vector<std::uint8_t> blChunk)
-{
-	return SetChunk(blChunk.data(), blChunk.size());
-}
-
-bool VSTDriver::HasEditor()
-{
-	SendData(Command::VstiHasEditor);
-
-	if (ReceiveData())
-	{
-		process_terminate();
-		return false;
-	}
-	return ReceiveData();
-}
-
-void VSTDriver::DisplayEditorModal()
-{
-	SendData(Command::DisplayEditorModal);
-
-	if (ReceiveData())
-	{
-		process_terminate();
-	}
-}
-
-bool VSTDriver::SetSampleRate(uint32_t sampleRate)
-{
-	SendData(Command::SetSampleRate);
-	SendData(sizeof(uint32_t));
-	SendData(sampleRate);
-
-	if (ReceiveData())
-	{
-		process_terminate();
-		return false;
-	}
-	return true;
-}
-
-void VSTDriver::ResetDriver()
-{
-	SaveVstiSettings();
-
-	SendData(Command::Reset);
-
-	if (ReceiveData())
-	{
-		process_terminate();
-	}
-}
-
-void VSTDriver::ProcessMIDIMessage(DWORD dwPort, DWORD dwParam1)
-{
-	dwParam1 = (dwParam1 & 0xFFFFFF) | (dwPort << 24);
-	SendData(Command::SendMidiEvent);
-	SendData(dwParam1);
-
-	if (ReceiveData())
-	{
-		process_terminate();
-	}
-}
-
-void VSTDriver::ProcessSysEx(DWORD dwPort, const unsigned char* sysexbuffer, int exlen)
-{
-	dwPort = (dwPort << 24) | (exlen & 0xFFFFFF);
-	SendData(Command::SendMidiSystemExclusiveEvent);
-	SendData(dwPort);
-	SendData(sysexbuffer, exlen);
-
-	if (ReceiveData())
-	{
-		process_terminate();
-	}
-}
-
-void VSTDriver::RenderFloat(float* samples, int len, float volume)
-{
-	SendData(Command::RenderAudioSamples);
-	SendData(len);
-
-	if (ReceiveData())
-	{
-		process_terminate();
-		memset(samples, 0, sizeof(*samples) * len * audioOutputs);
-		return;
-	}
-
-	while (len)
-	{
-		unsigned len_to_do = len;
-		if (len_to_do > 4096)
-		{
-			len_to_do = 4096;
-		}
-		ReceiveData(samples, sizeof(*samples) * len_to_do * audioOutputs);
-		for (unsigned i = 0; i < len_to_do * audioOutputs; ++i)
-		{
-			samples[i] *= volume;
-		}
-		samples += len_to_do * audioOutputs;
-		len -= len_to_do;
-	}
-}
-
-void VSTDriver::Render(short* samples, int len, float volume)
-{
-	float* float_out = (float*)_alloca(512 * audioOutputs * sizeof(*float_out));
-	while (len > 0)
-	{
-		int len_todo = len > 512 ? 512 : len;
-		RenderFloat(float_out, len_todo, volume);
-		for (unsigned i = 0; i < len_todo * audioOutputs; ++i)
-		{
-			int sample = (float_out[i] * 32768.f);
-			if ((sample + 0x8000) & 0xFFFF0000)
-			{
-				sample = 0x7FFF ^ (sample >> 31);
-			}
-			samples[0] = sample;
-			++samples;
-		}
-		len -= len_todo;
-	}
-}
+/* Copyright (C) 2011 Chris Moeller, Brad Miller
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include "VSTDriver.h"
+#include "DriverSettings.h"
+#include <assert.h>
+#include <filesystem>
+#include <future>
+
+using std::vector;
+
+enum Command : uint32_t
+{
+	Exit = 0,
+	GetChunkData = 1,
+	SetChunkData = 2,
+	VstiHasEditor = 3,
+	DisplayEditorModal = 4,
+	SetSampleRate = 5,
+	Reset = 6,
+	SendMidiEvent = 7,
+	SendMidiSystemExclusiveEvent = 8,
+	RenderAudioSamples = 9,
+	OpenSharedAudio = 10,
+	Negotiate = 11,
+	OpenControlChannel = 12,
+	SetSubBlockSplit = 13,
+	StartBackgroundIdle = 14,
+	SetBlockSize = 15,
+};
+
+/// <summary>
+/// The status of a request which could not be delivered to the VST host
+/// </summary>
+static const uint32_t RequestFailed = 0xFFFFFFFF;
+
+/// <summary>
+/// The default time between two effIdle calls of the idle thread of the VST host, in milliseconds
+/// </summary>
+static const uint32_t DefaultIdleInterval = 10;
+
+enum
+{
+	/// <summary>
+	/// The largest and the default block size
+	/// </summary>
+	BUFFER_SIZE = 4096,
+	/// <summary>
+	/// The shortest deadline of a render reply in milliseconds
+	/// </summary>
+	MIN_RENDER_DEADLINE = 2
+};
+
+VSTDriver::VSTDriver()
+{
+	isInitialized = false;
+	isTerminating = false;
+	hProcess = NULL;
+	hThread = NULL;
+	hostVersion = 0;
+	capabilities = 0;
+	hControlThread = NULL;
+	controlOpen = false;
+	nextRequestId = 0;
+	InitializeCriticalSection(&controlLock);
+	audioOutputs = 0;
+	sampleRate = 44100;
+	blockSize = BUFFER_SIZE;
+	/// The reply is due when the audio device needs its buffer
+	renderDeadline = GetDriverSetting(L"RenderDeadline", 100);
+	lateReplyFrames = 0;
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	counterFrequency = frequency.QuadPart;
+	renderStatistics = {};
+	renderWait.Init(GetDriverSetting(L"DriverSpinWait", 0));
+	effectName = NULL;
+	vendor = NULL;
+	product = NULL;
+}
+
+VSTDriver::~VSTDriver()
+{
+	CloseVSTDriver();
+	delete[] effectName;
+	delete[] vendor;
+	delete[] product;
+	DeleteCriticalSection(&controlLock);
+}
+
+static WORD getwordle(BYTE* pData)
+{
+	return (WORD)(pData[0] | (((WORD)pData[1]) << 8));
+}
+
+static DWORD getdwordle(BYTE* pData)
+{
+	return pData[0] | (((DWORD)pData[1]) << 8) | (((DWORD)pData[2]) << 16) | (((DWORD)pData[3]) << 24);
+}
+
+unsigned VSTDriver::test_plugin_platform() {
+#define iMZHeaderSize (0x40)
+#define iPEHeaderSize (4 + 20 + 224)
+
+	BYTE peheader[iPEHeaderSize];
+	DWORD dwOffsetPE;
+
+	FILE* f = _tfopen(szPluginPath, _T("rb"));
+	if (!f) goto error;
+	if (fread(peheader, 1, iMZHeaderSize, f) < iMZHeaderSize) goto error;
+	if (getwordle(peheader) != 0x5A4D) goto error;
+	dwOffsetPE = getdwordle(peheader + 0x3c);
+	if (fseek(f, dwOffsetPE, SEEK_SET) != 0) goto error;
+	if (fread(peheader, 1, iPEHeaderSize, f) < iPEHeaderSize) goto error;
+	fclose(f); f = NULL;
+	if (getdwordle(peheader) != 0x00004550) goto error;
+	switch (getwordle(peheader + 4)) {
+		case 0x014C: return 32;
+		case 0x8664: return 64;
+	}
+
+error:
+	if (f) fclose(f);
+	return 0;
+}
+
+/// <summary>
+/// Initialize the path to the VSTi plugin
+/// </summary>
+/// <param name="effect">The path to the VSTi</param>
+void VSTDriver::InitializeVstiPath(TCHAR* szPath)
+{
+	if (szPath)
+	{
+		DWORD pluginPathLength = 0;
+		pluginPathLength = _tcslen(szPath) * sizeof(TCHAR);
+		szPluginPath = (TCHAR*)calloc(pluginPathLength + sizeof(TCHAR), 1);
+		_tcscpy(szPluginPath, szPath);
+	}
+	else
+	{
+		HKEY hKey;
+		long result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver", 0, KEY_READ | KEY_WOW64_32KEY, &hKey);
+
+		if (result != NO_ERROR)
+		{
+			return;
+		}
+
+		ULONG size;
+		DWORD registryType = REG_NONE;
+
+		/// Get the current VSTi plugin path. Example: C:\Program Files (x86)\yamaha_syxg50_vsti\syxg50.dll
+		result = RegQueryValueEx(hKey, L"plugin", NULL, &registryType, NULL, &size);
+
+		if (result != NO_ERROR || size == 0 || (registryType != REG_SZ && registryType != REG_EXPAND_SZ))
+		{
+			return;
+		}
+
+		szPluginPath = (TCHAR*)calloc(size, sizeof(TCHAR));
+		result = RegQueryValueEx(hKey, L"plugin", NULL, &registryType, (LPBYTE)szPluginPath, &size);
+
+		if (result != NO_ERROR || size == 0 || (registryType != REG_SZ && registryType != REG_EXPAND_SZ))
+		{
+			return;
+		}
+
+		RegCloseKey(hKey);
+	}
+
+	uPluginPlatform = test_plugin_platform();
+}
+
+/// <summary>
+/// Load the settings of the VSTi plugin
+/// </summary>
+void VSTDriver::LoadVstiSettings()
+{
+	HKEY hKey;
+	long result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver\\Persistence", 0, KEY_READ | KEY_WOW64_32KEY, &hKey);
+
+	if (result != NO_ERROR)
+	{
+		return;
+	}
+
+	ULONG chunkSize;
+	vector<uint8_t> chunk;
+	DWORD registryType = REG_NONE;
+
+	/// Get the VSTi plugin settings
+	result = RegQueryValueEx(hKey, std::filesystem::path(szPluginPath).stem().c_str(), NULL, &registryType, NULL, &chunkSize);
+
+	if (result != NO_ERROR || chunkSize == 0 || registryType != REG_BINARY)
+	{
+		RegCloseKey(hKey);
+		return;
+	}
+
+	chunk.resize(chunkSize);
+
+	result = RegQueryValueEx(hKey, std::filesystem::path(szPluginPath).stem().c_str(), NULL, &registryType, (LPBYTE)chunk.data(), &chunkSize);
+
+	if (result != NO_ERROR)
+	{
+		RegCloseKey(hKey);
+		return;
+	}
+
+	/// Set the VSTi plugin settings
+	SetChunk(chunk.data(), chunkSize);
+
+	RegCloseKey(hKey);
+}
+
+/// <summary>
+/// Save the settings of the VSTi plugin
+/// </summary>
+void VSTDriver::SaveVstiSettings()
+{
+	if (!szPluginPath)
+	{
+		return;
+	}
+
+	/// Get the VSTi plugin settings
+	vector<uint8_t> chunk;
+	GetChunk(chunk);
+
+	SaveVstiSettings(chunk);
+}
+
+/// <summary>
+/// Save the settings of the VSTi plugin
+/// </summary>
+/// <param name="chunk">The settings returned by GetChunk</param>
+void VSTDriver::SaveVstiSettings(const vector<uint8_t>& chunk)
+{
+	if (!szPluginPath || chunk.empty())
+	{
+		return;
+	}
+
+	HKEY hKey;
+
+	/// Create the Persistence registry subkey
+	long result = RegCreateKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver\\Persistence", 0, 0, 0, KEY_WRITE | KEY_WOW64_32KEY, NULL, &hKey, NULL);
+
+	if (result != NO_ERROR)
+	{
+		return;
+	}
+
+	/// Save the VSTi plugin settings
+	RegSetValueEx(hKey, std::filesystem::path(szPluginPath).stem().c_str(), 0, REG_BINARY, (LPBYTE)chunk.data(), chunk.size());
+
+	RegCloseKey(hKey);
+}
+
+static inline char print_hex_digit(unsigned val)
+{
+	static const char table[16] = { '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' };
+	assert((val & ~0xF) == 0);
+	return table[val];
+}
+
+static void print_hex(unsigned val, std::wstring& out, unsigned bytes)
+{
+	unsigned n;
+	for (n = 0; n < bytes; n++)
+	{
+		unsigned char c = (unsigned char)((val >> ((bytes - 1 - n) << 3)) & 0xFF);
+		out += print_hex_digit(c >> 4);
+		out += print_hex_digit(c & 0xF);
+	}
+}
+
+static void print_guid(const GUID& p_guid, std::wstring& out)
+{
+	print_hex(p_guid.Data1, out, 4);
+	out += '-';
+	print_hex(p_guid.Data2, out, 2);
+	out += '-';
+	print_hex(p_guid.Data3, out, 2);
+	out += '-';
+	print_hex(p_guid.Data4[0], out, 1);
+	print_hex(p_guid.Data4[1], out, 1);
+	out += '-';
+	print_hex(p_guid.Data4[2], out, 1);
+	print_hex(p_guid.Data4[3], out, 1);
+	print_hex(p_guid.Data4[4], out, 1);
+	print_hex(p_guid.Data4[5], out, 1);
+	print_hex(p_guid.Data4[6], out, 1);
+	print_hex(p_guid.Data4[7], out, 1);
+}
+
+static bool GeneratePipeName(std::wstring& pipeName)
+{
+	GUID guid;
+	if (FAILED(CoCreateGuid(&guid)))
+	{
+		return false;
+	}
+
+	pipeName = L"\\\\.\\pipe\\";
+	print_guid(guid, pipeName);
+
+	return true;
+}
+
+static bool GenerateMappingName(std::wstring& mappingName)
+{
+	GUID guid;
+	if (FAILED(CoCreateGuid(&guid)))
+	{
+		return false;
+	}
+
+	mappingName = L"Local\\vstmididrv-";
+	print_guid(guid, mappingName);
+
+	return true;
+}
+
+extern "C" { extern HINSTANCE hinst_vst_driver; };
+
+bool VSTDriver::process_create(uint32_t** error)
+{
+	isTerminating = false;
+
+	if (uPluginPlatform != 32 && uPluginPlatform != 64)
+	{
+		return false;
+	}
+
+	if (!isInitialized)
+	{
+		if (FAILED(CoInitialize(NULL)))
+		{
+			return false;
+		}
+		isInitialized = true;
+	}
+
+	std::wstring pipeNameIn, pipeNameOut;
+	if (!GeneratePipeName(pipeNameIn) || !GeneratePipeName(pipeNameOut))
+	{
+		process_terminate();
+		return false;
+	}
+
+	/// The stdin / stdout of the VST host
+	HANDLE hChildStd_IN_Rd;
+	HANDLE hChildStd_OUT_Wr;
+
+	if (!transport.Create(pipeNameOut, pipeNameIn, hChildStd_IN_Rd, hChildStd_OUT_Wr))
+	{
+		process_terminate();
+		return false;
+	}
+
+	if (!transport.Connect(10000))
+	{
+		CloseHandle(hChildStd_OUT_Wr);
+		CloseHandle(hChildStd_IN_Rd);
+		process_terminate();
+		return false;
+	}
+
+	/// The CaptureSize setting (in MiB) records the session to %TEMP%\vstmididrv-<process id>.cap, vsthost /replay plays it again.
+	/// The control lane is not used while capturing, the control requests are recorded with the render pipe
+	DWORD captureSize = GetDriverSetting(L"CaptureSize", 0);
+	TCHAR tempPath[MAX_PATH];
+	if (captureSize && GetTempPath(_countof(tempPath), tempPath))
+	{
+		std::wstring capturePath = tempPath;
+		capturePath += L"vstmididrv-" + std::to_wstring(GetCurrentProcessId()) + L".cap";
+
+		if (capture.Create(capturePath.c_str(), (uint64_t)captureSize << 20, szPluginPath, uPluginPlatform))
+		{
+			captureTransport.Attach(&transport, &capture);
+		}
+	}
+
+	channel.Attach(capture.IsOpen() ? (Transport*)&captureTransport : &transport);
+
+	std::wstring szCmdLine = L"\"";
+
+	TCHAR my_path[MAX_PATH];
+	GetModuleFileName(hinst_vst_driver, my_path, _countof(my_path));
+
+	szCmdLine += my_path;
+	szCmdLine.resize(szCmdLine.find_last_of('\\') + 1);
+	if (szCmdLine.find(L"vstmididrv\\") == std::string::npos)
+	{
+		szCmdLine += L"vstmididrv\\";
+	}
+	szCmdLine += (uPluginPlatform == 64) ? L"vsthost64.exe" : L"vsthost32.exe";
+	szCmdLine += L"\" \"";
+	szCmdLine += szPluginPath;
+	szCmdLine += L"\" ";
+
+	unsigned sum = 0;
+
+	const TCHAR* ch = szPluginPath;
+	while (*ch)
+	{
+		sum += (TCHAR)(*ch++ * 820109);
+	}
+
+	print_hex(sum, szCmdLine, 4);
+
+	PROCESS_INFORMATION piProcInfo;
+	STARTUPINFO siStartInfo = { 0 };
+
+	siStartInfo.cb = sizeof(siStartInfo);
+	siStartInfo.hStdInput = hChildStd_IN_Rd;
+	siStartInfo.hStdOutput = hChildStd_OUT_Wr;
+	siStartInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	siStartInfo.dwFlags |= STARTF_USESTDHANDLES;
+
+	TCHAR CmdLine[MAX_PATH];
+	_tcscpy_s(CmdLine, _countof(CmdLine), szCmdLine.c_str());
+
+	/// Start the VST Host process with the VSTi
+	BOOL created = CreateProcess(NULL, CmdLine, NULL, NULL, TRUE, 0, NULL, NULL, &siStartInfo, &piProcInfo);
+
+	// Close remote handles so pipes will break when process terminates
+	CloseHandle(hChildStd_OUT_Wr);
+	CloseHandle(hChildStd_IN_Rd);
+
+	if (!created)
+	{
+		process_terminate();
+		return false;
+	}
+
+	hProcess = piProcInfo.hProcess;
+	hThread = piProcInfo.hThread;
+
+#ifdef NDEBUG
+	SetPriorityClass(hProcess, GetPriorityClass(GetCurrentProcess()));
+	SetThreadPriority(hThread, GetThreadPriority(GetCurrentThread()));
+#endif
+
+	uint32_t status = ReceiveData();
+
+	if (status != 0)
+	{
+		process_terminate();
+		*error = new uint32_t(status);
+		return false;
+	}
+
+	uint32_t effectNameLength = ReceiveData();
+	uint32_t vendorLength = ReceiveData();
+	uint32_t productLength = ReceiveData();
+	vendorVersion = ReceiveData();
+	uniqueId = ReceiveData();
+	audioOutputs = ReceiveData();
+
+	delete[] effectName;
+	delete[] vendor;
+	delete[] product;
+
+	effectName = new char[effectNameLength + 1];
+	vendor = new char[vendorLength + 1];
+	product = new char[productLength + 1];
+
+	ReceiveData(effectName, effectNameLength);
+	ReceiveData(vendor, vendorLength);
+	ReceiveData(product, productLength);
+
+	effectName[effectNameLength] = 0;
+	vendor[vendorLength] = 0;
+	product[productLength] = 0;
+
+	Negotiate();
+
+	/// The shared audio ring is sized for the block size
+	if (!(capabilities & Capability::BlockSize) || !SetBlockSize(blockSize))
+	{
+		blockSize = BUFFER_SIZE;
+	}
+
+	if (capabilities & Capability::SharedAudio)
+	{
+		OpenSharedAudio();
+	}
+
+	if (capabilities & Capability::ControlLane)
+	{
+		OpenControlChannel();
+	}
+
+	if (capabilities & Capability::SubBlockSplit)
+	{
+		SetSubBlockSplit();
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Exchange the protocol version and the capabilities with the VST host.
+/// Only the capabilities announced by both sides are used afterwards.
+/// </summary>
+/// <returns>true if the VST host took part in the handshake</returns>
+bool VSTDriver::Negotiate()
+{
+	hostVersion = 0;
+	capabilities = 0;
+
+	/// A capture only records the render pipe, so the control requests stay on it while capturing
+	uint32_t offered = SupportedCapabilities;
+	if (capture.IsOpen())
+	{
+		offered &= ~Capability::ControlLane;
+	}
+
+	SendData(Command::Negotiate);
+	SendData(ProtocolVersion);
+	SendData(offered);
+
+	if (ReceiveData())
+	{
+		return false;
+	}
+
+	hostVersion = ReceiveData();
+	capabilities = ReceiveData() & offered;
+
+	return true;
+}
+
+/// <summary>
+/// Create the shared audio ring and hand it over to the VST host.
+/// If this fails, the rendered audio keeps coming through the pipe.
+/// </summary>
+/// <returns>true if the VST host writes the rendered audio to the shared audio ring</returns>
+bool VSTDriver::OpenSharedAudio()
+{
+	/// The ring holds two blocks, its capacity has to be a power of two and device periods like 441 or 480 frames are not
+	uint32_t capacity = 1;
+	while (capacity < blockSize * 2)
+	{
+		capacity <<= 1;
+	}
+
+	std::wstring mappingName;
+	if (!GenerateMappingName(mappingName) || !sharedAudio.Create(mappingName.c_str(), capacity, audioOutputs))
+	{
+		sharedAudio.Close();
+		return false;
+	}
+
+	sharedAudio.SetHostSpinMicroseconds(GetDriverSetting(L"HostSpinWait", 0));
+
+	uint32_t size = (mappingName.length() + 1) * sizeof(wchar_t);
+	SendData(Command::OpenSharedAudio);
+	SendData(size);
+	SendData(mappingName.c_str(), size);
+
+	if (ReceiveData())
+	{
+		sharedAudio.Close();
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Create the control lane and let the VST host connect to it.
+/// If this fails, the control requests keep going through the render pipe.
+/// </summary>
+/// <returns>true if the control requests go through the control lane</returns>
+bool VSTDriver::OpenControlChannel()
+{
+	std::wstring pipeNameIn, pipeNameOut;
+	if (!GeneratePipeName(pipeNameIn) || !GeneratePipeName(pipeNameOut) || !controlTransport.Listen(pipeNameOut, pipeNameIn))
+	{
+		controlTransport.Close();
+		return false;
+	}
+
+	/// The pipe the VST host reads from, then the pipe it writes to
+	uint32_t sizeIn = (pipeNameIn.length() + 1) * sizeof(wchar_t);
+	uint32_t sizeOut = (pipeNameOut.length() + 1) * sizeof(wchar_t);
+	SendData(Command::OpenControlChannel);
+	SendData(sizeIn);
+	SendData(pipeNameIn.c_str(), sizeIn);
+	SendData(sizeOut);
+	SendData(pipeNameOut.c_str(), sizeOut);
+
+	if (ReceiveData() || !controlTransport.Connect(10000))
+	{
+		controlTransport.Close();
+		return false;
+	}
+
+	controlChannel.Attach(&controlTransport, false);
+	controlOpen = true;
+
+	hControlThread = CreateThread(NULL, 0, ControlThreadProc, this, 0, NULL);
+	if (!hControlThread)
+	{
+		controlOpen = false;
+		controlTransport.Close();
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Let the VST host split the rendering at the events, if this is turned on for the VSTi.
+/// The minimum sub-block size in frames is a DWORD value in the Sub-Block Split registry subkey, named after the VSTi like its persisted settings.
+/// </summary>
+/// <returns>true if the VST host splits the rendering</returns>
+bool VSTDriver::SetSubBlockSplit()
+{
+	if (!szPluginPath)
+	{
+		return false;
+	}
+
+	HKEY hKey;
+	long result = RegOpenKeyEx(HKEY_CURRENT_USER, L"Software\\VSTi Driver\\Sub-Block Split", 0, KEY_READ | KEY_WOW64_32KEY, &hKey);
+
+	if (result != NO_ERROR)
+	{
+		return false;
+	}
+
+	DWORD minimumFrames = 0;
+	DWORD size = sizeof(minimumFrames);
+	DWORD registryType = REG_NONE;
+
+	result = RegQueryValueEx(hKey, std::filesystem::path(szPluginPath).stem().c_str(), NULL, &registryType, (LPBYTE)&minimumFrames, &size);
+
+	RegCloseKey(hKey);
+
+	if (result != NO_ERROR || registryType != REG_DWORD || !minimumFrames)
+	{
+		return false;
+	}
+
+	SendData(Command::SetSubBlockSplit);
+	SendData(sizeof(uint32_t));
+	SendData(minimumFrames);
+
+	return ReceiveData() == 0;
+}
+
+/// <summary>
+/// Let the VST host warm up the VSTi and call effIdle on its idle thread, instead of on the render path.
+/// The time between two effIdle calls is the IdleInterval setting in milliseconds.
+/// </summary>
+/// <returns>true if the VST host idles the VSTi in the background</returns>
+bool VSTDriver::StartBackgroundIdle()
+{
+	SendData(Command::StartBackgroundIdle);
+	SendData(sizeof(uint32_t));
+	SendData(GetDriverSetting(L"IdleInterval", DefaultIdleInterval));
+
+	return ReceiveData() == 0;
+}
+
+/// <summary>
+/// Let the VST host pass the block size to the VSTi and size its buffers for it
+/// </summary>
+/// <param name="blockSize">The requested block size</param>
+/// <returns>true if the VST host renders in blocks of blockSize, it may have adjusted it to its limits</returns>
+bool VSTDriver::SetBlockSize(uint32_t blockSize)
+{
+	SendData(Command::SetBlockSize);
+	SendData(sizeof(uint32_t));
+	SendData(blockSize);
+
+	if (ReceiveData())
+	{
+		return false;
+	}
+
+	this->blockSize = ReceiveData();
+	return this->blockSize != 0;
+}
+
+/// <summary>
+/// Wait for the control lane thread, it ends when the VST host is gone
+/// </summary>
+void VSTDriver::CloseControlChannel()
+{
+	if (hControlThread)
+	{
+		WaitForSingleObject(hControlThread, 5000);
+		CloseHandle(hControlThread);
+		hControlThread = NULL;
+	}
+
+	controlTransport.Close();
+	controlOpen = false;
+}
+
+void VSTDriver::process_terminate()
+{
+	/// The events are not going anywhere anymore, the referenced System Exclusive messages are returned to their owners
+	eventBatch.Clear();
+	blockBatch.Clear();
+
+	if (isTerminating)
+	{
+		return;
+	}
+
+	isTerminating = true;
+
+	sharedAudio.Close();
+
+	if (hProcess)
+	{
+		SendData(Command::Exit);
+		channel.Flush();
+		// TerminateProcess is asynchronous; it initiates termination and returns immediately.
+		TerminateProcess(hProcess, 0);
+		// If you need to be sure the process has terminated, call the WaitForSingleObject function with a handle to the process.
+		WaitForSingleObject(hProcess, 5000);
+
+		CloseHandle(hThread);
+		hThread = NULL;
+
+		CloseHandle(hProcess);
+		hProcess = NULL;
+	}
+	transport.Close();
+	capture.Close();
+	CloseControlChannel();
+	capabilities = 0;
+	lateReplyFrames = 0;
+	if (isInitialized)
+	{
+		CoUninitialize();
+		isInitialized = false;
+	}
+}
+
+bool VSTDriver::process_running()
+{
+	return hProcess && WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+}
+
+void VSTDriver::ReceiveData(void* out, uint32_t size)
+{
+	if (!size)
+	{
+		return;
+	}
+
+	/// Pending requests are flushed by the channel before it waits for the reply
+	if (!process_running() || !channel.Read(out, size))
+	{
+		memset(out, 0xFF, size);
+	}
+}
+
+uint32_t VSTDriver::ReceiveData()
+{
+	uint32_t code;
+	ReceiveData(&code, sizeof(code));
+	return code;
+}
+
+void VSTDriver::SendData(const void* in, uint32_t size)
+{
+	if (size && process_running())
+	{
+		if (!channel.Write(in, size))
+		{
+			process_terminate();
+		}
+	}
+}
+
+void VSTDriver::SendData(uint32_t code)
+{
+	SendData(&code, sizeof(code));
+}
+
+void VSTDriver::GetEffectName(std::string& out)
+{
+	out = effectName;
+}
+
+void VSTDriver::GetVendorString(std::string& out)
+{
+	out = vendor;
+}
+
+void VSTDriver::GetProductString(std::string& out)
+{
+	out = product;
+}
+
+/// <summary>
+/// Get the VSTi vendor-specific version
+/// </summary>
+/// <returns>The VSTi vendor-specific version</returns>
+long VSTDriver::GetVendorVersion()
+{
+	return vendorVersion;
+}
+
+/// <summary>
+/// Get the unique id of the VSTi
+/// </summary>
+/// <returns>The unique id of the VSTi</returns>
+long VSTDriver::GetUniqueID()
+{
+	return uniqueId;
+}
+
+/// <summary>
+/// Get the I/O counters of the connection to the VST host
+/// </summary>
+/// <param name="out">The I/O counters</param>
+void VSTDriver::GetChannelStatistics(ChannelStatistics& out)
+{
+	channel.GetStatistics(out);
+}
+
+/// <summary>
+/// Get the counters of the render replies which missed their deadline
+/// </summary>
+/// <param name="out">The counters</param>
+void VSTDriver::GetRenderStatistics(RenderStatistics& out)
+{
+	out = renderStatistics;
+}
+
+/// <summary>
+/// Get the durations of the waits for the render replies
+/// </summary>
+/// <param name="out">The histogram</param>
+void VSTDriver::GetRenderWaitHistogram(WaitHistogram& out)
+{
+	renderWait.GetHistogram(out);
+}
+
+/// <summary>
+/// Get the startup time and the CPU time of the VST host
+/// </summary>
+/// <param name="out">The counters</param>
+void VSTDriver::GetHostStatistics(HostStatistics& out)
+{
+	out.startupMicroseconds = startupMicroseconds;
+	out.cpuMicroseconds = 0;
+	out.headless = headless;
+
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (hProcess && GetProcessTimes(hProcess, &creationTime, &exitTime, &kernelTime, &userTime))
+	{
+		/// 100 ns units
+		ULARGE_INTEGER kernel = { kernelTime.dwLowDateTime, kernelTime.dwHighDateTime };
+		ULARGE_INTEGER user = { userTime.dwLowDateTime, userTime.dwHighDateTime };
+		out.cpuMicroseconds = (kernel.QuadPart + user.QuadPart) / 10;
+	}
+}
+
+void VSTDriver::CloseVSTDriver()
+{
+	SaveVstiSettings();
+	process_terminate();
+
+	if (szPluginPath)
+	{
+		free(szPluginPath);
+
+		szPluginPath = NULL;
+	}
+}
+
+/// <summary>
+/// Start the VST host and load the VSTi
+/// </summary>
+/// <param name="szPath">The path of the VSTi, NULL for the one in the registry</param>
+/// <param name="error">Receives the status of the VST host if it could not load the VSTi</param>
+/// <param name="sampleRate">The sample rate</param>
+/// <param name="blockSize">The period of the audio device in frames, the VST host renders in blocks of this size, 0 for 4096</param>
+/// <returns>true on success</returns>
+bool VSTDriver::OpenVSTDriver(TCHAR* szPath, uint32_t** error, unsigned int sampleRate, unsigned int blockSize)
+{
+	CloseVSTDriver();
+
+	this->blockSize = blockSize && blockSize < BUFFER_SIZE ? blockSize : BUFFER_SIZE;
+
+	LARGE_INTEGER frequency, startTime, endTime;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&startTime);
+
+	/// A headless session never opens the editor by itself, so no GUI competes with the rendering
+	headless = GetDriverSetting(L"Headless", 0) != 0;
+	startupMicroseconds = 0;
+
+	InitializeVstiPath(szPath);
+
+	if (!process_create(error))
+	{
+		return false;
+	}
+
+	if (!SetSampleRate(sampleRate))
+	{
+		return false;
+	}
+
+	if (!SetChunk(blChunk))
+	{
+		return false;
+	}
+
+	LoadVstiSettings();
+
+	/// The VSTi warms up with its settings while the device is started
+	if (capabilities & Capability::BackgroundIdle)
+	{
+		StartBackgroundIdle();
+	}
+
+	if (!headless)
+	{
+		DisplayEditorModal();
+	}
+
+	QueryPerformanceCounter(&endTime);
+	startupMicroseconds = (endTime.QuadPart - startTime.QuadPart) * 1000000 / frequency.QuadPart;
+
+	//timeSetEvent(1000, 10, (LPTIMECALLBACK)TimeProc, (DWORD)this, TIME_ONESHOT);
+
+	return true;
+}
+
+/// <summary>
+/// Send a request on the control lane, the completion is called with the status and the reply of the VST host.
+/// Without the control lane the request goes through the render pipe and completes before this returns.
+/// </summary>
+/// <param name="command">The command</param>
+/// <param name="payload">The payload of the request</param>
+/// <param name="size">The size of the payload</param>
+/// <param name="completion">Called when the request completes, may be empty</param>
+void VSTDriver::SendControlRequest(uint32_t command, const void* payload, uint32_t size, ControlCompletion completion)
+{
+	if (!hControlThread)
+	{
+		vector<uint8_t> reply;
+		uint32_t status = SendPipeRequest(command, payload, size, reply);
+		if (completion)
+		{
+			completion(status, reply);
+		}
+		return;
+	}
+
+	EnterCriticalSection(&controlLock);
+
+	bool queued = controlOpen;
+	if (queued)
+	{
+		uint32_t requestId = ++nextRequestId;
+		pendingRequests[requestId] = completion;
+
+		/// Request: command, request id, payload size, payload
+		uint32_t header[3] = { command, requestId, size };
+		controlChannel.Write(header, sizeof(header));
+		if (size)
+		{
+			controlChannel.Write(payload, size);
+		}
+
+		if (!controlChannel.Flush())
+		{
+			pendingRequests.erase(requestId);
+			queued = false;
+		}
+	}
+
+	LeaveCriticalSection(&controlLock);
+
+	if (!queued && completion)
+	{
+		completion(RequestFailed, vector<uint8_t>());
+	}
+}
+
+/// <summary>
+/// Send a control request through the render pipe and wait for the reply
+/// </summary>
+/// <returns>The status returned by the VST host</returns>
+uint32_t VSTDriver::SendPipeRequest(uint32_t command, const void* payload, uint32_t size, vector<uint8_t>& reply)
+{
+	ResyncHost(true);
+
+	SendData(command);
+	if (command == Command::SetChunkData)
+	{
+		SendData(size);
+	}
+	SendData(payload, size);
+
+	/// The request comes from a thread with windows, such as the one which shows the editor, it stays responsive
+	transport.SetPumpMessages(true);
+	uint32_t status = ReceiveData();
+	transport.SetPumpMessages(false);
+
+	if (status)
+	{
+		process_terminate();
+		return status;
+	}
+
+	switch (command)
+	{
+		case Command::GetChunkData:
+			reply.resize(ReceiveData());
+			ReceiveData(reply.data(), reply.size());
+			break;
+
+		case Command::VstiHasEditor:
+			reply.resize(sizeof(uint32_t));
+			ReceiveData(reply.data(), reply.size());
+			break;
+	}
+
+	return status;
+}
+
+DWORD WINAPI VSTDriver::ControlThreadProc(LPVOID lpParameter)
+{
+	((VSTDriver*)lpParameter)->ReceiveControlReplies();
+	return 0;
+}
+
+/// <summary>
+/// Complete the control requests as their replies arrive, until the control lane breaks
+/// </summary>
+void VSTDriver::ReceiveControlReplies()
+{
+	vector<uint8_t> reply;
+
+	for (;;)
+	{
+		/// Reply: request id, status, payload size, payload
+		uint32_t header[3];
+		if (!controlChannel.Read(header, sizeof(header)))
+		{
+			break;
+		}
+
+		reply.resize(header[2]);
+		if (header[2] && !controlChannel.Read(reply.data(), header[2]))
+		{
+			break;
+		}
+
+		ControlCompletion completion;
+
+		EnterCriticalSection(&controlLock);
+		auto pending = pendingRequests.find(header[0]);
+		if (pending != pendingRequests.end())
+		{
+			completion = std::move(pending->second);
+			pendingRequests.erase(pending);
+		}
+		LeaveCriticalSection(&controlLock);
+
+		if (completion)
+		{
+			completion(header[1], reply);
+		}
+	}
+
+	/// The VST host is gone, fail the requests which are still waiting
+	std::map<uint32_t, ControlCompletion> failed;
+
+	EnterCriticalSection(&controlLock);
+	controlOpen = false;
+	failed.swap(pendingRequests);
+	LeaveCriticalSection(&controlLock);
+
+	reply.clear();
+	for (auto& request : failed)
+	{
+		if (request.second)
+		{
+			request.second(RequestFailed, reply);
+		}
+	}
+}
+
+void VSTDriver::GetChunkAsync(std::function<void(const vector<uint8_t>& chunk)> completion)
+{
+	SendControlRequest(Command::GetChunkData, NULL, 0, [completion](uint32_t status, const vector<uint8_t>& reply)
+	{
+		completion(status ? vector<uint8_t>() : reply);
+	});
+}
+
+void VSTDriver::SetChunkAsync(const void* in, unsigned size, std::function<void(bool success)> completion)
+{
+	SendControlRequest(Command::SetChunkData, in, size, [completion](uint32_t status, const vector<uint8_t>&)
+	{
+		if (completion)
+		{
+			completion(status == 0);
+		}
+	});
+}
+
+void VSTDriver::HasEditorAsync(std::function<void(bool hasEditor)> completion)
+{
+	SendControlRequest(Command::VstiHasEditor, NULL, 0, [completion](uint32_t status, const vector<uint8_t>& reply)
+	{
+		uint32_t hasEditor = 0;
+		if (!status && reply.size() >= sizeof(hasEditor))
+		{
+			memcpy(&hasEditor, reply.data(), sizeof(hasEditor));
+		}
+		completion(hasEditor != 0);
+	});
+}
+
+void VSTDriver::DisplayEditorModalAsync(std::function<void(bool success)> completion)
+{
+	SendControlRequest(Command::DisplayEditorModal, NULL, 0, [completion](uint32_t status, const vector<uint8_t>&)
+	{
+		if (completion)
+		{
+			completion(status == 0);
+		}
+	});
+}
+
+/// <summary>
+/// Save the settings of the VSTi and recreate it in the VST host
+/// </summary>
+/// <param name="completion">Called when the VSTi is recreated, may be empty</param>
+void VSTDriver::ResetDriverAsync(std::function<void(bool success)> completion)
+{
+	eventBatch.Clear();
+
+	GetChunkAsync([this, completion](const vector<uint8_t>& chunk)
+	{
+		SaveVstiSettings(chunk);
+
+		SendControlRequest(Command::Reset, NULL, 0, [completion](uint32_t status, const vector<uint8_t>&)
+		{
+			if (completion)
+			{
+				completion(status == 0);
+			}
+		});
+	});
+}
+
+void VSTDriver::GetChunk(vector<uint8_t>& out)
+{
+	std::promise<void> done;
+	std::future<void> result = done.get_future();
+
+	GetChunkAsync([&out, &done](const vector<uint8_t>& chunk)
+	{
+		out = chunk;
+		done.set_value();
+	});
+
+	result.wait();
+}
+
+bool VSTDriver::SetChunk(const void* in, unsigned size)
+{
+	std::promise<bool> done;
+	std::future<bool> result = done.get_future();
+
+	SetChunkAsync(in, size, [&done](bool success)
+	{
+		done.set_value(success);
+	});
+
+	return result.get();
+}
+
+bool VSTDriver::SetChunk(std::vector<std::uint8_t> blChunk)
+{
+	return SetChunk(blChunk.data(), blChunk.size());
+}
+
+bool VSTDriver::HasEditor()
+{
+	std::promise<bool> done;
+	std::future<bool> result = done.get_future();
+
+	HasEditorAsync([&done](bool hasEditor)
+	{
+		done.set_value(hasEditor);
+	});
+
+	return result.get();
+}
+
+void VSTDriver::DisplayEditorModal()
+{
+	std::promise<void> done;
+	std::future<void> result = done.get_future();
+
+	DisplayEditorModalAsync([&done](bool)
+	{
+		done.set_value();
+	});
+
+	result.wait();
+}
+
+bool VSTDriver::SetSampleRate(uint32_t sampleRate)
+{
+	ResyncHost(true);
+
+	this->sampleRate = sampleRate;
+
+	SendData(Command::SetSampleRate);
+	SendData(sizeof(uint32_t));
+	SendData(sampleRate);
+
+	if (ReceiveData())
+	{
+		process_terminate();
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Discard the queued MIDI events which were not sent to the VST host yet.
+/// The referenced System Exclusive messages are released, so their buffers go back to the client.
+/// </summary>
+void VSTDriver::DiscardQueuedEvents()
+{
+	eventBatch.Clear();
+	/// The events of a late block are with the VST host already
+	blockBatch.Clear();
+}
+
+void VSTDriver::ResetDriver()
+{
+	std::promise<void> done;
+	std::future<void> result = done.get_future();
+
+	ResetDriverAsync([&done](bool)
+	{
+		done.set_value();
+	});
+
+	result.wait();
+}
+
+void VSTDriver::ProcessMIDIMessage(DWORD dwPort, DWORD dwParam1)
+{
+	ResyncHost(true);
+
+	dwParam1 = (dwParam1 & 0xFFFFFF) | (dwPort << 24);
+	SendData(Command::SendMidiEvent);
+	SendData(dwParam1);
+
+	if (ReceiveData())
+	{
+		process_terminate();
+	}
+}
+
+void VSTDriver::ProcessSysEx(DWORD dwPort, const unsigned char* sysexbuffer, int exlen)
+{
+	ResyncHost(true);
+
+	dwPort = (dwPort << 24) | (exlen & 0xFFFFFF);
+	SendData(Command::SendMidiSystemExclusiveEvent);
+	SendData(dwPort);
+	SendData(sysexbuffer, exlen);
+
+	if (ReceiveData())
+	{
+		process_terminate();
+	}
+}
+
+/// <summary>
+/// Queue a MIDI message, it is sent to the VST host along with the next render request
+/// </summary>
+/// <param name="dwPort">The port</param>
+/// <param name="dwParam1">The MIDI message</param>
+/// <param name="dwOffset">The frame offset of the message within the next rendered frames</param>
+void VSTDriver::QueueMIDIMessage(DWORD dwPort, DWORD dwParam1, DWORD dwOffset)
+{
+	eventBatch.AppendMessage(dwPort, dwParam1, dwOffset);
+}
+
+/// <summary>
+/// Queue a MIDI System Exclusive message, it is sent to the VST host along with the next render request
+/// </summary>
+/// <param name="dwPort">The port</param>
+/// <param name="sysexbuffer">The MIDI System Exclusive message</param>
+/// <param name="exlen">The length of the MIDI System Exclusive message</param>
+/// <param name="dwOffset">The frame offset of the message within the next rendered frames</param>
+/// <param name="release">
+/// If set the message is not copied, it is written to the VST host from sysexbuffer
+/// and release is called with context once the VST host has replied to the render request which carried it, or the message is discarded
+/// </param>
+/// <param name="context">Passed to release</param>
+void VSTDriver::QueueSysEx(DWORD dwPort, const unsigned char* sysexbuffer, int exlen, DWORD dwOffset, SysExRelease release, void* context)
+{
+	if (release)
+	{
+		eventBatch.AppendSysExReference(dwPort, sysexbuffer, exlen, dwOffset, release, context);
+	}
+	else
+	{
+		eventBatch.AppendSysEx(dwPort, sysexbuffer, exlen, dwOffset);
+	}
+}
+
+/// <summary>
+/// Receive the reply of the render request which missed its deadline and discard it
+/// </summary>
+/// <param name="wait">Wait for the reply, otherwise return at once if it has not arrived yet</param>
+/// <returns>true when no render reply is outstanding anymore</returns>
+bool VSTDriver::ResyncHost(bool wait)
+{
+	if (!lateReplyFrames)
+	{
+		return true;
+	}
+
+	if (!process_running() || !channel.IsGood())
+	{
+		lateReplyFrames = 0;
+		process_terminate();
+		return true;
+	}
+
+	if (!wait && !channel.Wait(0))
+	{
+		return false;
+	}
+
+	uint32_t frames = lateReplyFrames;
+	lateReplyFrames = 0;
+
+	if (ReceiveData())
+	{
+		process_terminate();
+		return true;
+	}
+
+	if (sharedAudio.IsOpen())
+	{
+		sharedAudio.Skip(frames);
+	}
+	else
+	{
+		lateReplyBuffer.resize(frames * audioOutputs);
+		ReceiveData(lateReplyBuffer.data(), sizeof(float) * frames * audioOutputs);
+	}
+
+	/// The VST host is done with the events of the late block
+	blockBatch.Clear();
+
+	++renderStatistics.resyncedBlocks;
+
+	return true;
+}
+
+void VSTDriver::RenderFloat(float* samples, int len, float volume)
+{
+	while (len > 0)
+	{
+		unsigned len_to_do = len;
+		if (len_to_do > blockSize)
+		{
+			len_to_do = blockSize;
+		}
+
+		/// While the VST host is still busy with a late block the block is not requested, its events go along with the next one
+		if (!ResyncHost(false))
+		{
+			eventBatch.Postpone(len_to_do);
+			memset(samples, 0, sizeof(*samples) * len_to_do * audioOutputs);
+			++renderStatistics.skippedBlocks;
+
+			samples += len_to_do * audioOutputs;
+			len -= len_to_do;
+			continue;
+		}
+
+		/// The queued events go along with the block they fall into
+		blockBatch.Clear();
+		eventBatch.TakeBlock(len_to_do, blockBatch);
+
+		if (capabilities & Capability::EventBatch)
+		{
+			SendData(Command::RenderAudioSamples);
+			SendData(len_to_do);
+			SendData(blockBatch.GetSize());
+			blockBatch.WriteTo([this](const void* data, uint32_t size)
+			{
+				SendData(data, size);
+				return true;
+			});
+		}
+		else
+		{
+			/// The VST host does not take batches, send the events one by one
+			blockEvents.clear();
+			blockBatch.WriteTo([this](const void* data, uint32_t size)
+			{
+				blockEvents.insert(blockEvents.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+				return true;
+			});
+
+			MidiEventReader reader(blockEvents.data(), (uint32_t)blockEvents.size());
+
+			uint32_t port;
+			uint32_t message;
+			const uint8_t* sysEx;
+			uint32_t length;
+			uint32_t offset;
+
+			while (reader.Next(port, message, sysEx, length, offset))
+			{
+				if (sysEx)
+				{
+					ProcessSysEx(port, sysEx, length);
+				}
+				else
+				{
+					ProcessMIDIMessage(port, message);
+				}
+			}
+
+			SendData(Command::RenderAudioSamples);
+			SendData(len_to_do);
+		}
+
+		LARGE_INTEGER requestTime;
+		QueryPerformanceCounter(&requestTime);
+
+		/// Spin for the reply before the wait on the pipe blocks in the kernel
+		if (sharedAudio.IsOpen() && (capabilities & Capability::SpinWait))
+		{
+			/// The request has to be on its way before the VST host sees the counter
+			channel.Flush();
+			renderWait.Spin(sharedAudio.GetReplyCount(), sharedAudio.PublishRequest());
+		}
+		else
+		{
+			renderWait.Spin(NULL, 0);
+		}
+
+		/// A slow VSTi must not stall the audio device, the block is played as silence and the reply is discarded when it arrives.
+		/// The deadline is the time the rest of the device buffer plays, the device needs the buffer by then.
+		if (renderDeadline && process_running())
+		{
+			DWORD deadline = (DWORD)((uint64_t)len * renderDeadline * 1000 / ((uint64_t)sampleRate * 100));
+			if (deadline < MIN_RENDER_DEADLINE)
+			{
+				deadline = MIN_RENDER_DEADLINE;
+			}
+
+			if (!channel.Wait(deadline) && channel.IsGood() && process_running())
+			{
+				renderWait.Finish();
+
+				lateReplyFrames = len_to_do;
+				memset(samples, 0, sizeof(*samples) * len_to_do * audioOutputs);
+				++renderStatistics.lateBlocks;
+				++renderStatistics.slowBlocks;
+
+				samples += len_to_do * audioOutputs;
+				len -= len_to_do;
+				continue;
+			}
+		}
+
+		uint32_t status = ReceiveData();
+		renderWait.Finish();
+
+		if (status)
+		{
+			process_terminate();
+			memset(samples, 0, sizeof(*samples) * len * audioOutputs);
+			return;
+		}
+
+		/// The VST host has consumed the events of the block
+		blockBatch.Clear();
+
+		/// The VSTi cannot keep up if it renders slower than real time
+		LARGE_INTEGER replyTime;
+		QueryPerformanceCounter(&replyTime);
+		if ((uint64_t)(replyTime.QuadPart - requestTime.QuadPart) * sampleRate > (uint64_t)len_to_do * counterFrequency)
+		{
+			++renderStatistics.slowBlocks;
+		}
+
+		if (sharedAudio.IsOpen())
+		{
+			/// The VST host has already written the frames to the shared audio ring
+			unsigned done = sharedAudio.Read(samples, len_to_do, volume);
+			if (done < len_to_do)
+			{
+				memset(samples + done * audioOutputs, 0, sizeof(*samples) * (len_to_do - done) * audioOutputs);
+			}
+		}
+		else
+		{
+			ReceiveData(samples, sizeof(*samples) * len_to_do * audioOutputs);
+			for (unsigned i = 0; i < len_to_do * audioOutputs; ++i)
+			{
+				samples[i] *= volume;
+			}
+		}
+
+		samples += len_to_do * audioOutputs;
+		len -= len_to_do;
+	}
+}
+
+void VSTDriver::Render(short* samples, int len, float volume)
+{
+	float* float_out = (float*)_alloca(blockSize * audioOutputs * sizeof(*float_out));
+	while (len > 0)
+	{
+		int len_todo = len > (int)blockSize ? blockSize : len;
+		RenderFloat(float_out, len_todo, volume);
+		for (unsigned i = 0; i < len_todo * audioOutputs; ++i)
+		{
+			int sample = (float_out[i] * 32768.f);
+			if ((sample + 0x8000) & 0xFFFF0000)
+			{
+				sample = 0x7FFF ^ (sample >> 31);
+			}
+			samples[0] = sample;
+			++samples;
+		}
+		len -= len_todo;
+	}
+}
@@ -1,164 +1,330 @@
-/* Copyright (C) 2011 Chris Moeller, Brad Miller
- *
- *  This program is free software: you can redistribute it and/or modify
- *  it under the terms of the GNU Lesser General Public License as published by
- *  the Free Software Foundation, either version 2.1 of the License, or
- *  (at your option) any later version.
- *
- *  This program is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- *  GNU Lesser General Public License for more details.
- *
- *  You should have received a copy of the GNU Lesser General Public License
- *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-#ifndef __VSTDRIVER_H__
-#define __VSTDRIVER_H__
-
-#include <windows.h>
-#include <malloc.h>
-#include <stdio.h>
-#include <tchar.h>
-#include "../external_packages/aeffect.h"
-#include "../external_packages/aeffectx.h"
-#include <cstdint>
-#include <vector>
-
-class VSTDriver
-{
-private:
-    TCHAR* szPluginPath = NULL;
-    unsigned     uPluginPlatform;
-
-    bool         isInitialized;
-    bool         isTerminating;
-    HANDLE       hProcess;
-    HANDLE       hThread;
-    HANDLE       hReadEvent;
-    HANDLE       hChildStd_IN_Rd;
-    HANDLE       hChildStd_IN_Wr;
-    HANDLE       hChildStd_OUT_Rd;
-    HANDLE       hChildStd_OUT_Wr;
-
-    std::vector<std::uint8_t> blChunk;
-
-    /// <summary>
-    /// The number of VSTi audio outputs
-    /// </summary>
-    unsigned audioOutputs;
-
-    /// <summary>
-    /// The name of the VSTi
-    /// </summary>
-    char* effectName;
-    char* vendor;
-    char* product;
-    /// <summary>
-    /// The VSTi vendor-specific version
-    /// </summary>
-    uint32_t vendorVersion;
-    /// <summary>
-    /// The unique id of the VSTi
-    /// </summary>
-    uint32_t uniqueId;
-
-    unsigned test_plugin_platform();
-    bool connect_pipe(HANDLE hPipe);
-    bool process_create(uint32_t** error = NULL);
-    void process_terminate();
-    bool process_running();
-    uint32_t ReceiveData();
-    void ReceiveData(void* buffer, uint32_t size);
-    uint32_t ReceivePipeData(void* buffer, uint32_t size);
-    void SendData(uint32_t code);
-    void SendData(const void* buffer, uint32_t size);
-
-    void LoadVstiSettings();
-    void InitializeVstiPath(TCHAR* szPath);
-
-public:
-    VSTDriver();
-    ~VSTDriver();
-    void CloseVSTDriver();
-    bool OpenVSTDriver(TCHAR* szPath = NULL, uint32_t** error = NULL, unsigned int sampleRate = 44100);
-    void SaveVstiSettings();
-    void ResetDriver();
-    void ProcessMIDIMessage(DWORD dwPort, DWORD dwParam1);
-    void ProcessSysEx(DWORD dwPort, const unsigned char* sysexbuffer, int exlen);
-    void Render(short* samples, int len, float volume = 1.0f);
-    void RenderFloat(float* samples, int len, float volume = 1.0f);
-
-    void GetEffectName(std::string& out);
-    void GetVendorString(std::string& out);
-    void GetProductString(std::string& out);
-    long GetVendorVersion();
-    long GetUniqueID();
-
-    // configuration
-    void GetChunk(std::vector<uint8_t>& out);
-    bool SetChunk(const void* in, unsigned size);
-    bool SetChunk(std::vector<std::uint8_t> blChunk);
-    bool SetSampleRate(uint32_t sampleRate);
-
-    // editor
-    bool HasEditor();
-    void DisplayEditorModal();
-};
-
-static LPTIMECALLBACK TimeProc(UINT uTimerID, UINT uMsg, DWORD_PTR dwUser, DWORD_PTR dw1, DWORD_PTR dw2)
-{
-    VSTDriver* effect = (VSTDriver*)dwUser;
-
-    /// Play note C4 (middle C)
-    /// 0x90
-    ///			9 - Note On
-    ///			0 - Midi Channel
-    /// 0x3C
-    ///			Note C4
-    /// 0x64
-    ///			Velocity (100)
-    effect->ProcessMIDIMessage(0, 0x00403C90);
-    Sleep(40);
-
-    /// Play note D4
-    effect->ProcessMIDIMessage(0, 0x00403E90);
-    effect->ProcessMIDIMessage(0, 0x00403C80);
-    Sleep(40);
-
-    /// Play note E4
-    effect->ProcessMIDIMessage(0, 0x00404090);
-    effect->ProcessMIDIMessage(0, 0x00403E80);
-    Sleep(40);
-
-    /// Play note F4
-    effect->ProcessMIDIMessage(0, 0x00404190);
-    effect->ProcessMIDIMessage(0, 0x00404080);
-    Sleep(40);
-
-    /// Play note G4
-    effect->ProcessMIDIMessage(0, 0x00404390);
-    effect->ProcessMIDIMessage(0, 0x00404180);
-    Sleep(40);
-
-    /// Play note A4
-    effect->ProcessMIDIMessage(0, 0x00404590);
-    effect->ProcessMIDIMessage(0, 0x00404380);
-    Sleep(40);
-
-    /// Play note B4
-    effect->ProcessMIDIMessage(0, 0x00404790);
-    effect->ProcessMIDIMessage(0, 0x00404580);
-    Sleep(40);
-
-    /// Play note C5
-    effect->ProcessMIDIMessage(0, 0x00404890);
-    effect->ProcessMIDIMessage(0, 0x00404780);
-    Sleep(40);
-    effect->ProcessMIDIMessage(0, 0x00404880);
-
-    return 0;
-}
-
+/* Copyright (C) 2011 Chris Moeller, Brad Miller
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VSTDRIVER_H__
+#define __VSTDRIVER_H__
+
+#include <windows.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <tchar.h>
+#include "../external_packages/aeffect.h"
+#include "../external_packages/aeffectx.h"
+#include "../common/shared_audio.h"
+#include "../common/midi_events.h"
+#include "../common/pipe_transport.h"
+#include "../common/channel.h"
+#include "../common/wait_policy.h"
+#include "../common/capture.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+/// <summary>
+/// Called with the status and the reply payload when a control request completes
+/// </summary>
+typedef std::function<void(uint32_t status, const std::vector<uint8_t>& reply)> ControlCompletion;
+
+/// <summary>
+/// The counters of the render replies which missed their deadline
+/// </summary>
+struct RenderStatistics
+{
+    /// <summary>
+    /// The number of blocks played as silence because their reply missed the deadline
+    /// </summary>
+    uint64_t lateBlocks;
+    /// <summary>
+    /// The number of blocks played as silence without a request, because the VST host was still busy with a late block
+    /// </summary>
+    uint64_t skippedBlocks;
+    /// <summary>
+    /// The number of late replies which arrived afterwards and were discarded
+    /// </summary>
+    uint64_t resyncedBlocks;
+    /// <summary>
+    /// The number of blocks whose reply took longer than the block plays, whether or not it missed the deadline
+    /// </summary>
+    uint64_t slowBlocks;
+};
+
+/// <summary>
+/// The cost of the VST host process
+/// </summary>
+struct HostStatistics
+{
+    /// <summary>
+    /// The time OpenVSTDriver took, from starting the VST host to the restored VSTi settings and the editor if it is shown
+    /// </summary>
+    uint64_t startupMicroseconds;
+    /// <summary>
+    /// The CPU time used by the VST host process, user and kernel
+    /// </summary>
+    uint64_t cpuMicroseconds;
+    /// <summary>
+    /// The session was opened without the editor
+    /// </summary>
+    bool headless;
+};
+
+class VSTDriver
+{
+private:
+    TCHAR* szPluginPath = NULL;
+    unsigned     uPluginPlatform;
+
+    bool         isInitialized;
+    bool         isTerminating;
+    HANDLE       hProcess;
+    HANDLE       hThread;
+
+    /// <summary>
+    /// The connection to the VST host
+    /// </summary>
+    PipeTransport transport;
+
+    /// <summary>
+    /// Buffers the I/O on the transport
+    /// </summary>
+    BufferedChannel channel;
+
+    /// <summary>
+    /// Records the traffic on the transport when the CaptureSize setting is set
+    /// </summary>
+    CaptureLog capture;
+    CaptureTransport captureTransport;
+
+    /// <summary>
+    /// The control lane, chunk, editor and reset requests do not wait behind rendering
+    /// </summary>
+    PipeTransport controlTransport;
+    BufferedChannel controlChannel;
+    HANDLE hControlThread;
+
+    /// <summary>
+    /// Guards the writes to the control lane and the pending requests
+    /// </summary>
+    CRITICAL_SECTION controlLock;
+    bool controlOpen;
+    uint32_t nextRequestId;
+    std::map<uint32_t, ControlCompletion> pendingRequests;
+
+    /// <summary>
+    /// The protocol version and the capabilities negotiated with the VST host
+    /// </summary>
+    uint32_t hostVersion;
+    uint32_t capabilities;
+
+    std::vector<std::uint8_t> blChunk;
+
+    /// <summary>
+    /// The rendered audio returned by the VST host, when the shared memory transport is in use
+    /// </summary>
+    SharedAudioRing sharedAudio;
+
+    /// <summary>
+    /// The MIDI events which are sent along with the next render request
+    /// </summary>
+    MidiEventBatch eventBatch;
+
+    /// <summary>
+    /// The MIDI events of the block which is rendered next, kept until the VST host has replied to its render request
+    /// </summary>
+    MidiEventBatch blockBatch;
+
+    /// <summary>
+    /// The events of the block in the wire format, when the VST host does not take batches
+    /// </summary>
+    std::vector<uint8_t> blockEvents;
+
+    /// <summary>
+    /// The number of VSTi audio outputs
+    /// </summary>
+    unsigned audioOutputs;
+
+    uint32_t sampleRate;
+
+    /// <summary>
+    /// The largest block of a render request, the period of the audio device when the VST host accepted it
+    /// </summary>
+    uint32_t blockSize;
+
+    /// <summary>
+    /// The deadline of a render reply in percent of the duration of the rest of the device buffer, 100 by default, 0 waits without a deadline
+    /// </summary>
+    DWORD renderDeadline;
+
+    /// <summary>
+    /// The number of frames of the render request whose reply missed its deadline, 0 if none is outstanding
+    /// </summary>
+    uint32_t lateReplyFrames;
+    /// <summary>
+    /// The frequency of the performance counter, the time of the render replies is measured with it
+    /// </summary>
+    LONGLONG counterFrequency;
+    std::vector<float> lateReplyBuffer;
+    RenderStatistics renderStatistics;
+
+    /// <summary>
+    /// The session does not show the editor when it is opened, it can still be shown with DisplayEditorModalAsync
+    /// </summary>
+    bool headless = false;
+    uint64_t startupMicroseconds = 0;
+
+    /// <summary>
+    /// The wait for the render replies
+    /// </summary>
+    SpinWaitPolicy renderWait;
+
+    /// <summary>
+    /// The name of the VSTi
+    /// </summary>
+    char* effectName;
+    char* vendor;
+    char* product;
+    /// <summary>
+    /// The VSTi vendor-specific version
+    /// </summary>
+    uint32_t vendorVersion;
+    /// <summary>
+    /// The unique id of the VSTi
+    /// </summary>
+    uint32_t uniqueId;
+
+    unsigned test_plugin_platform();
+    bool process_create(uint32_t** error = NULL);
+    void process_terminate();
+    bool process_running();
+    bool Negotiate();
+    bool OpenSharedAudio();
+    bool OpenControlChannel();
+    bool SetSubBlockSplit();
+    bool StartBackgroundIdle();
+    bool SetBlockSize(uint32_t blockSize);
+    void CloseControlChannel();
+    bool ResyncHost(bool wait);
+    static DWORD WINAPI ControlThreadProc(LPVOID lpParameter);
+    void ReceiveControlReplies();
+    void SendControlRequest(uint32_t command, const void* payload, uint32_t size, ControlCompletion completion);
+    uint32_t SendPipeRequest(uint32_t command, const void* payload, uint32_t size, std::vector<uint8_t>& reply);
+    uint32_t ReceiveData();
+    void ReceiveData(void* buffer, uint32_t size);
+    void SendData(uint32_t code);
+    void SendData(const void* buffer, uint32_t size);
+
+    void LoadVstiSettings();
+    void SaveVstiSettings(const std::vector<uint8_t>& chunk);
+    void InitializeVstiPath(TCHAR* szPath);
+
+public:
+    VSTDriver();
+    ~VSTDriver();
+    void CloseVSTDriver();
+    bool OpenVSTDriver(TCHAR* szPath = NULL, uint32_t** error = NULL, unsigned int sampleRate = 44100, unsigned int blockSize = 0);
+    void SaveVstiSettings();
+    void ResetDriver();
+    void DiscardQueuedEvents();
+    void ProcessMIDIMessage(DWORD dwPort, DWORD dwParam1);
+    void ProcessSysEx(DWORD dwPort, const unsigned char* sysexbuffer, int exlen);
+    void QueueMIDIMessage(DWORD dwPort, DWORD dwParam1, DWORD dwOffset = 0);
+    void QueueSysEx(DWORD dwPort, const unsigned char* sysexbuffer, int exlen, DWORD dwOffset = 0, SysExRelease release = NULL, void* context = NULL);
+    void Render(short* samples, int len, float volume = 1.0f);
+    void RenderFloat(float* samples, int len, float volume = 1.0f);
+
+    void GetEffectName(std::string& out);
+    void GetVendorString(std::string& out);
+    void GetProductString(std::string& out);
+    long GetVendorVersion();
+    long GetUniqueID();
+    void GetChannelStatistics(ChannelStatistics& out);
+    void GetRenderStatistics(RenderStatistics& out);
+    void GetRenderWaitHistogram(WaitHistogram& out);
+    void GetHostStatistics(HostStatistics& out);
+
+    // configuration
+    void GetChunk(std::vector<uint8_t>& out);
+    bool SetChunk(const void* in, unsigned size);
+    bool SetChunk(std::vector<std::uint8_t> blChunk);
+    bool SetSampleRate(uint32_t sampleRate);
+
+    // editor
+    bool HasEditor();
+    void DisplayEditorModal();
+
+    // asynchronous requests, the completion is called on the control lane thread
+    void GetChunkAsync(std::function<void(const std::vector<uint8_t>& chunk)> completion);
+    void SetChunkAsync(const void* in, unsigned size, std::function<void(bool success)> completion = nullptr);
+    void HasEditorAsync(std::function<void(bool hasEditor)> completion);
+    void DisplayEditorModalAsync(std::function<void(bool success)> completion = nullptr);
+    void ResetDriverAsync(std::function<void(bool success)> completion = nullptr);
+};
+
+static LPTIMECALLBACK TimeProc(UINT uTimerID, UINT uMsg, DWORD_PTR dwUser, DWORD_PTR dw1, DWORD_PTR dw2)
+{
+    VSTDriver* effect = (VSTDriver*)dwUser;
+
+    /// Play note C4 (middle C)
+    /// 0x90
+    ///			9 - Note On
+    ///			0 - Midi Channel
+    /// 0x3C
+    ///			Note C4
+    /// 0x64
+    ///			Velocity (100)
+    effect->ProcessMIDIMessage(0, 0x00403C90);
+    Sleep(40);
+
+    /// Play note D4
+    effect->ProcessMIDIMessage(0, 0x00403E90);
+    effect->ProcessMIDIMessage(0, 0x00403C80);
+    Sleep(40);
+
+    /// Play note E4
+    effect->ProcessMIDIMessage(0, 0x00404090);
+    effect->ProcessMIDIMessage(0, 0x00403E80);
+    Sleep(40);
+
+    /// Play note F4
+    effect->ProcessMIDIMessage(0, 0x00404190);
+    effect->ProcessMIDIMessage(0, 0x00404080);
+    Sleep(40);
+
+    /// Play note G4
+    effect->ProcessMIDIMessage(0, 0x00404390);
+    effect->ProcessMIDIMessage(0, 0x00404180);
+    Sleep(40);
+
+    /// Play note A4
+    effect->ProcessMIDIMessage(0, 0x00404590);
+    effect->ProcessMIDIMessage(0, 0x00404380);
+    Sleep(40);
+
+    /// Play note B4
+    effect->ProcessMIDIMessage(0, 0x00404790);
+    effect->ProcessMIDIMessage(0, 0x00404580);
+    Sleep(40);
+
+    /// Play note C5
+    effect->ProcessMIDIMessage(0, 0x00404890);
+    effect->ProcessMIDIMessage(0, 0x00404780);
+    Sleep(40);
+    effect->ProcessMIDIMessage(0, 0x00404880);
+
+    return 0;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <cstdio>
+
+/// <summary>
+/// The number of failed checks of the test
+/// </summary>
+static int checkFailures = 0;
+
+/// <summary>
+/// Report a failed condition and keep going, the test returns the failures when it is done
+/// </summary>
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++checkFailures; \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,207 @@
+/// <summary>
+/// Checks PlaybackClock and MessagePlacement against a simulated audio clock:
+/// render calls which observe the played frames with jitter, and messages which arrive at known times.
+/// </summary>
+
+#include "../driver/MessagePlacement.h"
+#include "check.h"
+
+static const int64_t frequency = 9600000;
+static const int64_t sampleRate = 48000;
+static const uint32_t blockFrames = 480;
+
+/// <summary>
+/// The performance counter value at which a frame is really played
+/// </summary>
+static int64_t GetFrameTime(int64_t origin, int64_t frame)
+{
+    return origin + frame * frequency / sampleRate;
+}
+
+/// <summary>
+/// A deterministic jitter of up to plus or minus range ticks
+/// </summary>
+static int64_t GetJitter(uint32_t& seed, int64_t range)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (int64_t)(seed >> 8) % (2 * range + 1) - range;
+}
+
+static int64_t Abs(int64_t value)
+{
+    return value < 0 ? -value : value;
+}
+
+/// <summary>
+/// The clock follows the played frames with less jitter than the observations, and jumps on a dropout
+/// </summary>
+static void TestClockJitter()
+{
+    const int64_t origin = 123456789;
+    const int64_t jitter = frequency * 2 / 1000;
+
+    PlaybackClock clock;
+    clock.Init(frequency, sampleRate);
+
+    uint32_t seed = 1;
+    int64_t maxError = 0;
+    int64_t totalError = 0;
+    const int blocks = 2000;
+
+    for (int block = 0; block < blocks; ++block)
+    {
+        int64_t frame = (int64_t)block * blockFrames;
+        int64_t smoothed = clock.Update(GetFrameTime(origin, frame) + GetJitter(seed, jitter), frame);
+
+        // After the clock settled
+        if (block >= 100)
+        {
+            int64_t error = Abs(smoothed - GetFrameTime(origin, frame));
+            maxError = error > maxError ? error : maxError;
+            totalError += error;
+        }
+    }
+
+    CHECK(maxError < jitter / 2);
+    CHECK(totalError / (blocks - 100) < jitter / 8);
+
+    // A stall of 200 ms moves the clock at once
+    int64_t frame = (int64_t)blocks * blockFrames;
+    int64_t stalled = GetFrameTime(origin, frame) + frequency / 5;
+    CHECK(clock.Update(stalled, frame) == stalled);
+
+    // A reset takes the next observation as it is
+    clock.Reset();
+    CHECK(clock.Update(1000, 0) == 1000);
+}
+
+/// <summary>
+/// Messages which arrive evenly are placed evenly, whatever the jitter of the render calls
+/// </summary>
+static void TestPlacementJitter()
+{
+    const int64_t origin = 5000000;
+    const int64_t jitter = frequency * 3 / 1000;
+    const uint32_t latencyFrames = sampleRate * 20 / 1000;
+    const int64_t messageInterval = frequency / 1000;
+    const int blocks = 3000;
+
+    PlaybackClock clock;
+    clock.Init(frequency, sampleRate);
+    MessagePlacement placement;
+    placement.Init(frequency, sampleRate, latencyFrames);
+
+    uint32_t seed = 7;
+    int64_t nextMessage = origin;
+    int64_t previousFrame = -1;
+    bool ordered = true;
+    bool inHorizon = true;
+    int64_t minDeviation = INT64_MAX;
+    int64_t maxDeviation = INT64_MIN;
+
+    for (int block = 0; block < blocks; ++block)
+    {
+        int64_t blockStart = (int64_t)block * blockFrames;
+
+        // The render call of the block happens one block before its frames are played, give or take the jitter
+        int64_t renderTime = GetFrameTime(origin, blockStart) - frequency * blockFrames / sampleRate + GetJitter(seed, jitter);
+        if (renderTime < nextMessage)
+        {
+            continue;
+        }
+
+        placement.BeginBlock(blockFrames, clock.Update(renderTime, blockStart), latencyFrames);
+
+        for (; nextMessage <= renderTime; nextMessage += messageInterval)
+        {
+            uint32_t offset = placement.Place(nextMessage);
+            int64_t frame = blockStart + offset;
+
+            inHorizon &= offset < blockFrames + latencyFrames;
+            ordered &= frame >= previousFrame;
+            previousFrame = frame;
+
+            // The frame at which the message was played minus the frame of its arrival, after the clock settled
+            if (block >= 200)
+            {
+                int64_t deviation = frame - (nextMessage - origin) * sampleRate / frequency;
+                minDeviation = deviation < minDeviation ? deviation : minDeviation;
+                maxDeviation = deviation > maxDeviation ? deviation : maxDeviation;
+            }
+        }
+
+        placement.EndBlock();
+    }
+
+    CHECK(ordered);
+    CHECK(inHorizon);
+
+    // The latency of the messages varies by less than half the jitter of the render calls, which is 288 frames from end to end
+    CHECK(maxDeviation - minDeviation < (2 * jitter * sampleRate / frequency) / 2);
+}
+
+/// <summary>
+/// Early messages are clamped to the horizon and carried into the next block, late ones go to its start
+/// </summary>
+static void TestClamping()
+{
+    const uint32_t latencyFrames = 100;
+    const int64_t reference = 1000000;
+    const int64_t ticksPerFrame = frequency / sampleRate;
+
+    MessagePlacement placement;
+    placement.Init(frequency, sampleRate, latencyFrames);
+
+    placement.BeginBlock(blockFrames, reference, 0);
+    CHECK(placement.Place(reference - 10 * ticksPerFrame) == 0);
+    CHECK(placement.Place(reference + 10 * ticksPerFrame) == 10);
+    CHECK(placement.Place(reference + 500 * ticksPerFrame) == 500);
+    // Far ahead, the last frame within the latency
+    CHECK(placement.Place(reference + frequency) == blockFrames + latencyFrames - 1);
+    // Never before the previous message
+    CHECK(placement.Place(reference + 20 * ticksPerFrame) == blockFrames + latencyFrames - 1);
+    placement.EndBlock();
+
+    // The next block starts behind the carried message, even for a late message
+    placement.BeginBlock(blockFrames, reference + frequency, 0);
+    CHECK(placement.Place(reference) == latencyFrames - 1);
+    CHECK(placement.Place(reference + frequency + 200 * ticksPerFrame) == 200);
+    placement.EndBlock();
+
+    // Nothing is carried over a block which ends before its last message
+    placement.BeginBlock(blockFrames, reference, 0);
+    CHECK(placement.Place(reference) == 0);
+    placement.EndBlock();
+
+    // Without a reference the messages go where the previous one went
+    placement.BeginBlock(blockFrames, 0, 0);
+    CHECK(placement.Place(reference + frequency) == 0);
+    placement.EndBlock();
+
+    // A reset drops the carried offset
+    placement.BeginBlock(blockFrames, reference, 0);
+    CHECK(placement.Place(reference + frequency) == blockFrames + latencyFrames - 1);
+    placement.EndBlock();
+    placement.Reset();
+    placement.BeginBlock(blockFrames, reference, 0);
+    CHECK(placement.Place(reference) == 0);
+    placement.EndBlock();
+
+    // Without latency nothing goes past the block
+    placement.Init(frequency, sampleRate, 0);
+    placement.BeginBlock(blockFrames, reference, 0);
+    CHECK(placement.Place(reference + frequency) == blockFrames - 1);
+    placement.EndBlock();
+    placement.BeginBlock(blockFrames, reference, 0);
+    CHECK(placement.Place(reference) == 0);
+    placement.EndBlock();
+}
+
+int main()
+{
+    TestClockJitter();
+    TestPlacementJitter();
+    TestClamping();
+
+    return checkFailures ? 1 : 0;
+}
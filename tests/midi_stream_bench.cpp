@@ -0,0 +1,304 @@
+/// <summary>
+/// Compares the MidiStream queue with the single ring it replaced.
+/// Producer threads put numbered channel messages like WINMM clients, one consumer thread drains them like the render path.
+/// Reports the throughput and the latency from the put to the drain, and checks that every message arrives once and in order.
+/// midi_stream_bench [--messages N] [--quick], --quick runs a short pass for the tests.
+/// </summary>
+
+#include "../driver/MidiStream.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace VSTMIDIDRV;
+
+namespace VSTMIDIDRV
+{
+    static SysExSlab sysExSlabs[2];
+
+    SysExSlab& GetSysExSlab(DWORD port) noexcept
+    {
+        return sysExSlabs[port < _countof(sysExSlabs) ? port : 0];
+    }
+}
+
+/// <summary>
+/// The channel message part of the ring of the driver before MidiStream, as it was.
+/// It is a single producer ring, so the producers take a lock, and the consumer takes one per message like its synthMutex.
+/// </summary>
+class BaselineMidiStream
+{
+private:
+    static const unsigned int maxPos = 1024;
+    unsigned int startpos = 0;
+    unsigned int endpos = 0;
+
+    struct message
+    {
+        void* sysex;
+        DWORD msg;
+        DWORD port_type;
+    };
+
+    message stream[maxPos];
+
+public:
+    DWORD PutMessage(DWORD uDeviceID, DWORD dwParam1) noexcept
+    {
+        unsigned int newEndpos = endpos;
+
+        ++newEndpos;
+
+        // Check for buffer rolloff
+        if (newEndpos == maxPos)
+        {
+            newEndpos = 0;
+        }
+
+        // Check for buffer full
+        if (startpos == newEndpos)
+        {
+            return MIDIERR_NOTREADY;
+        }
+
+        // Put data and update endpos
+        stream[endpos].sysex = 0;
+        stream[endpos].msg = dwParam1;
+        stream[endpos].port_type = uDeviceID;
+        endpos = newEndpos;
+
+        return MMSYSERR_NOERROR;
+    }
+
+    void GetMessage(DWORD& port, DWORD& message) noexcept
+    {
+        port = stream[startpos].port_type & 0x7fffffff;
+        message = stream[startpos].msg;
+
+        ++startpos;
+
+        // Check for buffer rolloff
+        if (startpos == maxPos)
+        {
+            startpos = 0;
+        }
+    }
+
+    DWORD PeekMessageCount() noexcept
+    {
+        if (endpos < startpos)
+        {
+            return endpos + maxPos - startpos;
+        }
+        else
+        {
+            return endpos - startpos;
+        }
+    }
+};
+
+class BaselineQueue
+{
+private:
+    BaselineMidiStream stream;
+    std::mutex lock;
+
+public:
+    static const char* GetName()
+    {
+        return "baseline ring";
+    }
+
+    bool Put(DWORD message)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return stream.PutMessage(0, message) == MMSYSERR_NOERROR;
+    }
+
+    DWORD Drain(DWORD* messages, DWORD maxCount)
+    {
+        DWORD count = 0;
+        while (count < maxCount)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!stream.PeekMessageCount())
+            {
+                break;
+            }
+
+            DWORD port;
+            stream.GetMessage(port, messages[count++]);
+        }
+        return count;
+    }
+};
+
+class MidiStreamQueue
+{
+private:
+    MidiStream stream;
+
+public:
+    MidiStreamQueue()
+    {
+        stream.Init(MidiStream::defaultCapacity, MidiStream::Reject, 0);
+    }
+
+    static const char* GetName()
+    {
+        return "MidiStream";
+    }
+
+    bool Put(DWORD message)
+    {
+        return stream.PutMessage(0, message) == MMSYSERR_NOERROR;
+    }
+
+    DWORD Drain(DWORD* messages, DWORD maxCount)
+    {
+        MidiStream::Message taken[64];
+        DWORD count = stream.GetMessages(taken, maxCount < _countof(taken) ? maxCount : _countof(taken));
+        for (DWORD i = 0; i < count; ++i)
+        {
+            messages[i] = taken[i].message;
+        }
+        return count;
+    }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static int64_t GetNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/// <summary>
+/// Run the producers and the consumer over a queue
+/// </summary>
+/// <returns>false if a message was lost, duplicated or reordered</returns>
+template <class Queue>
+static bool Run(unsigned producers, DWORD messagesPerProducer)
+{
+    Queue queue;
+
+    /// The put time of every message, the consumer finds it by the producer and the count it has seen from it
+    std::vector<std::vector<int64_t>> putTimes(producers, std::vector<int64_t>(messagesPerProducer));
+    std::atomic<uint64_t> rejected(0);
+    std::atomic<bool> start(false);
+
+    std::vector<std::thread> threads;
+    for (unsigned producer = 0; producer < producers; ++producer)
+    {
+        threads.emplace_back([&, producer]()
+        {
+            while (!start)
+            {
+                std::this_thread::yield();
+            }
+
+            uint64_t retries = 0;
+            for (DWORD i = 0; i < messagesPerProducer; ++i)
+            {
+                /// Note on of the producer, the low 16 bits of the count in the data bytes
+                DWORD message = 0x90 | (producer << 8) | ((i & 0xFFFF) << 16);
+                putTimes[producer][i] = GetNanoseconds();
+                while (!queue.Put(message))
+                {
+                    ++retries;
+                    std::this_thread::yield();
+                    putTimes[producer][i] = GetNanoseconds();
+                }
+            }
+            rejected += retries;
+        });
+    }
+
+    std::vector<DWORD> received(producers, 0);
+    std::vector<int64_t> latencies;
+    latencies.reserve((size_t)producers * messagesPerProducer);
+    bool ordered = true;
+
+    uint64_t total = (uint64_t)producers * messagesPerProducer;
+    uint64_t drained = 0;
+    DWORD messages[64];
+
+    Clock::time_point begin = Clock::now();
+    start = true;
+
+    while (drained < total)
+    {
+        DWORD count = queue.Drain(messages, _countof(messages));
+        if (!count)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        int64_t now = GetNanoseconds();
+        for (DWORD i = 0; i < count; ++i)
+        {
+            DWORD producer = (messages[i] >> 8) & 0xFF;
+            if (producer >= producers || received[producer] >= messagesPerProducer || (messages[i] >> 16) != (received[producer] & 0xFFFF))
+            {
+                ordered = false;
+                continue;
+            }
+
+            latencies.push_back(now - putTimes[producer][received[producer]]);
+            ++received[producer];
+        }
+        drained += count;
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double fraction)
+    {
+        return latencies.empty() ? 0.0 : latencies[(size_t)(fraction * (latencies.size() - 1))] / 1000.0;
+    };
+
+    printf("%-14s %9u %13.0f %9.2f %9.2f %9.2f %10.2f %10llu %s\n", Queue::GetName(), producers, total / seconds,
+        percentile(0.5), percentile(0.99), percentile(0.999), percentile(1.0), (unsigned long long)rejected.load(), ordered ? "ok" : "LOST OR REORDERED");
+
+    return ordered;
+}
+
+int main(int argc, char* argv[])
+{
+    DWORD messagesPerProducer = 1000000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--quick"))
+        {
+            messagesPerProducer = 20000;
+        }
+        else if (!strcmp(argv[i], "--messages") && i + 1 < argc)
+        {
+            messagesPerProducer = (DWORD)atol(argv[++i]);
+        }
+    }
+
+    printf("%-14s %9s %13s %9s %9s %9s %10s %10s\n", "queue", "producers", "messages/s", "p50 us", "p99 us", "p99.9 us", "max us", "full");
+
+    bool passed = true;
+    for (unsigned producers : { 1u, 2u, 4u })
+    {
+        passed &= Run<BaselineQueue>(producers, messagesPerProducer);
+        passed &= Run<MidiStreamQueue>(producers, messagesPerProducer);
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+/// <summary>
+/// Checks the DropOldest overflow policy of MidiStream: the messages which end notes are never dropped.
+/// </summary>
+
+#include "../driver/MidiStream.h"
+#include "check.h"
+
+using namespace VSTMIDIDRV;
+
+namespace VSTMIDIDRV
+{
+    static SysExSlab sysExSlabs[2];
+
+    SysExSlab& GetSysExSlab(DWORD port) noexcept
+    {
+        return sysExSlabs[port < _countof(sysExSlabs) ? port : 0];
+    }
+}
+
+int main()
+{
+    MidiStream stream;
+    stream.Init(4, MidiStream::DropOldest, 0);
+    CHECK(stream.GetCapacity() == 4);
+
+    // Sustain off, all sounds off, all notes off and a modulation wheel fill the queue
+    const DWORD sustainOff = 0x0040B0;
+    const DWORD allSoundsOff = 0x0078B1;
+    const DWORD allNotesOff = 0x007BB2;
+    const DWORD modulation = 0x4001B0;
+    CHECK(stream.PutMessage(0, sustainOff) == MMSYSERR_NOERROR);
+    CHECK(stream.PutMessage(0, allSoundsOff) == MMSYSERR_NOERROR);
+    CHECK(stream.PutMessage(0, allNotesOff) == MMSYSERR_NOERROR);
+    CHECK(stream.PutMessage(0, modulation) == MMSYSERR_NOERROR);
+
+    // The modulation wheel makes room for the expression, and the expression for the sustain pedal,
+    // then the queue holds nothing which may be dropped
+    const DWORD expression = 0x7F0BB0;
+    const DWORD sustainOn = 0x7F40B0;
+    CHECK(stream.PutMessage(0, expression) == MMSYSERR_NOERROR);
+    CHECK(stream.PutMessage(0, sustainOn) == MMSYSERR_NOERROR);
+    CHECK(stream.PutMessage(0, modulation) == MIDIERR_NOTREADY);
+
+    MidiStream::Message messages[8];
+    DWORD count = stream.GetMessages(messages, _countof(messages));
+    CHECK(count == 4);
+    if (count == 4)
+    {
+        CHECK(messages[0].message == sustainOff);
+        CHECK(messages[1].message == allSoundsOff);
+        CHECK(messages[2].message == allNotesOff);
+        CHECK(messages[3].message == sustainOn);
+    }
+
+    MidiQueueStatistics statistics;
+    stream.GetStatistics(0, statistics);
+    CHECK(statistics.dropped == 2 && statistics.rejected == 1 && statistics.pending == 0);
+
+    return checkFailures ? 1 : 0;
+}
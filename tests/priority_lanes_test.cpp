@@ -0,0 +1,233 @@
+/// <summary>
+/// Checks PriorityLanes together with MessagePlacement and MidiEventBatch, the way the render path queues a block:
+/// with a MIDI latency the messages are placed past the end of the block, and a System Exclusive upload over the
+/// budget defers the messages which depend on it. Every message has to be played in the order of arrival.
+/// </summary>
+
+#include "../driver/MessagePlacement.h"
+#include "../driver/PriorityLanes.h"
+#include "check.h"
+
+using namespace VSTMIDIDRV;
+
+namespace VSTMIDIDRV
+{
+    static SysExSlab sysExSlabs[2];
+
+    SysExSlab& GetSysExSlab(DWORD port) noexcept
+    {
+        return sysExSlabs[port < _countof(sysExSlabs) ? port : 0];
+    }
+}
+
+static const int64_t frequency = 9600000;
+static const int64_t sampleRate = 48000;
+static const int64_t ticksPerFrame = frequency / sampleRate;
+static const uint32_t blockFrames = 100;
+static const uint32_t latencyFrames = 100;
+static const DWORD bulkBudget = 64;
+
+static unsigned char sysExData[4][bulkBudget];
+
+/// <summary>
+/// A message which arrives at a frame of the first block, relative to the reference
+/// </summary>
+struct Arrival
+{
+    DWORD message;
+    int sysEx;
+    int64_t frame;
+};
+
+/// <summary>
+/// A message as the VST host receives it
+/// </summary>
+struct Played
+{
+    DWORD message;
+    /// <summary>
+    /// The first data byte of a System Exclusive message, 0 for a short message
+    /// </summary>
+    uint8_t sysEx;
+    uint32_t frame;
+};
+
+/// <summary>
+/// Queue the messages of a block like MidiSynth::QueueMidiMessages, without the coalescer and the voice governor
+/// </summary>
+static void QueueBlock(PriorityLanes& lanes, MessagePlacement& placement, MidiEventBatch& batch, int64_t reference,
+    const Arrival* arrivals, size_t count)
+{
+    std::vector<ScheduledMessage> block;
+    lanes.BeginBlock(block, blockFrames);
+    placement.BeginBlock(blockFrames, reference, 0);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        MidiStream::Message message = {};
+        message.message = arrivals[i].message;
+        if (arrivals[i].sysEx >= 0)
+        {
+            message.sysEx = sysExData[arrivals[i].sysEx];
+            message.sysExLength = bulkBudget;
+        }
+        message.timestamp = reference + arrivals[i].frame * ticksPerFrame;
+
+        ScheduledMessage scheduled = { message, placement.Place(message.timestamp), false };
+        block.push_back(scheduled);
+    }
+
+    for (const ScheduledMessage& scheduled : block)
+    {
+        if (!lanes.Admit(scheduled))
+        {
+            continue;
+        }
+
+        if (scheduled.message.sysEx)
+        {
+            batch.AppendSysEx(0, scheduled.message.sysEx, scheduled.message.sysExLength, scheduled.offset);
+        }
+        else
+        {
+            batch.AppendMessage(0, scheduled.message.message, scheduled.offset);
+        }
+    }
+
+    placement.EndBlock();
+}
+
+/// <summary>
+/// Render a block like VSTDriver::RenderFloat, the events of the block are played
+/// </summary>
+static void RenderBlock(MidiEventBatch& batch, uint32_t blockStart, std::vector<Played>& played)
+{
+    MidiEventBatch block;
+    batch.TakeBlock(blockFrames, block);
+
+    std::vector<uint8_t> events;
+    block.WriteTo([&events](const void* data, uint32_t size)
+    {
+        events.insert(events.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+        return true;
+    });
+
+    MidiEventReader reader(events.data(), (uint32_t)events.size());
+    uint32_t port;
+    uint32_t message;
+    const uint8_t* sysEx;
+    uint32_t length;
+    uint32_t offset;
+    while (reader.Next(port, message, sysEx, length, offset))
+    {
+        Played event = { message, sysEx ? sysEx[0] : (uint8_t)0, blockStart + offset };
+        played.push_back(event);
+    }
+}
+
+/// <summary>
+/// A patch upload in the latency window, then a program change and a note of its channel.
+/// The second System Exclusive message is over the budget and deferred, the program change and the note stay behind it,
+/// and all of them have to be played after the note which was sent before them.
+/// </summary>
+static void TestDeferredWithLatency()
+{
+    const int64_t reference = 1000000;
+    const Arrival arrivals[] =
+    {
+        { 0x7F3C90, -1, 150 },
+        { 0, 0, 160 },
+        { 0, 1, 170 },
+        { 0, 2, 175 },
+        { 0x05C0, -1, 180 },
+        { 0x7F4090, -1, 190 },
+    };
+
+    for (int i = 0; i < 4; ++i)
+    {
+        memset(sysExData[i], 0xF0 + i, bulkBudget);
+    }
+
+    PriorityLanes lanes;
+    lanes.Init(bulkBudget);
+    MessagePlacement placement;
+    placement.Init(frequency, sampleRate, latencyFrames);
+    MidiEventBatch batch;
+    std::vector<Played> played;
+
+    QueueBlock(lanes, placement, batch, reference, arrivals, _countof(arrivals));
+    RenderBlock(batch, 0, played);
+
+    // The later blocks have no new messages, the deferred ones go out one System Exclusive message per block
+    for (uint32_t block = 1; block < 6; ++block)
+    {
+        QueueBlock(lanes, placement, batch, reference + block * blockFrames * ticksPerFrame, NULL, 0);
+        RenderBlock(batch, block * blockFrames, played);
+    }
+
+    CHECK(played.size() == _countof(arrivals));
+    if (played.size() != _countof(arrivals))
+    {
+        return;
+    }
+
+    bool ordered = true;
+    bool notEarly = true;
+    for (size_t i = 0; i < played.size(); ++i)
+    {
+        const Arrival& arrival = arrivals[i];
+        ordered &= arrival.sysEx >= 0 ? played[i].sysEx == sysExData[arrival.sysEx][0] : played[i].message == arrival.message;
+        ordered &= !i || played[i].frame >= played[i - 1].frame;
+        notEarly &= played[i].frame >= arrival.frame;
+    }
+    CHECK(ordered);
+    CHECK(notEarly);
+
+    // The messages which were not deferred keep their frame
+    CHECK(played[0].frame == 150);
+    CHECK(played[1].frame == 160);
+    // The deferred message keeps its position in the latency window rather than moving to the start of the next block
+    CHECK(played[2].frame == 170);
+    CHECK(played[3].frame == 200);
+}
+
+/// <summary>
+/// Deferred messages which are already due go to the start of the block
+/// </summary>
+static void TestDeferredDue()
+{
+    const Arrival arrivals[] =
+    {
+        { 0, 0, 10 },
+        { 0, 1, 20 },
+        { 0x05C0, -1, 30 },
+    };
+
+    PriorityLanes lanes;
+    lanes.Init(bulkBudget);
+    MessagePlacement placement;
+    placement.Init(frequency, sampleRate, 0);
+    MidiEventBatch batch;
+    std::vector<Played> played;
+
+    QueueBlock(lanes, placement, batch, 1000000, arrivals, _countof(arrivals));
+    RenderBlock(batch, 0, played);
+    QueueBlock(lanes, placement, batch, 1000000 + blockFrames * ticksPerFrame, NULL, 0);
+    RenderBlock(batch, blockFrames, played);
+
+    CHECK(played.size() == 3);
+    if (played.size() == 3)
+    {
+        CHECK(played[0].frame == 10);
+        CHECK(played[1].frame == blockFrames && played[1].sysEx == sysExData[1][0]);
+        CHECK(played[2].frame == blockFrames && played[2].message == 0x05C0);
+    }
+}
+
+int main()
+{
+    TestDeferredWithLatency();
+    TestDeferredDue();
+
+    return checkFailures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/// <summary>
+/// Runs a SharedAudioRing across two processes on the POSIX shared memory backend:
+/// the child writes numbered frames like the VST host, the parent reads them back like the driver.
+/// </summary>
+
+#include "../common/shared_audio.h"
+#include "check.h"
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const uint32_t capacity = 256;
+static const uint32_t channels = 2;
+static const uint32_t blockFrames = 100;
+static const uint32_t blocks = 1000;
+
+static int RunHost(const wchar_t* name)
+{
+    SharedAudioRing ring;
+    if (!ring.Open(name))
+    {
+        return 2;
+    }
+
+    float left[blockFrames], right[blockFrames];
+    float* planar[channels] = { left, right };
+    uint32_t frame = 0;
+
+    for (uint32_t block = 0; block < blocks; ++block)
+    {
+        /// Wait for the render request of the block
+        while (SharedCounterLoad(ring.GetRequestCount()) <= (SharedCounter)block)
+        {
+            usleep(10);
+        }
+
+        for (uint32_t i = 0; i < blockFrames; ++i, ++frame)
+        {
+            left[i] = (float)frame;
+            right[i] = -(float)frame;
+        }
+
+        if (ring.Write(planar, blockFrames) != blockFrames)
+        {
+            return 3;
+        }
+        ring.PublishReply();
+    }
+
+    return 0;
+}
+
+int main()
+{
+    std::wstring name = L"Local\\vstmididrv-test-" + std::to_wstring(getpid());
+
+    SharedAudioRing ring;
+    CHECK(!ring.Create(name.c_str(), 100, channels));
+    CHECK(ring.Create(name.c_str(), capacity, channels));
+    CHECK(ring.GetCapacity() == capacity && ring.GetChannels() == channels);
+
+    /// A second ring of the same name is refused while the first one exists
+    SharedAudioRing duplicate;
+    CHECK(!duplicate.Create(name.c_str(), capacity, channels));
+
+    pid_t host = fork();
+    if (!host)
+    {
+        _exit(RunHost(name.c_str()));
+    }
+
+    float out[blockFrames * channels];
+    uint32_t frame = 0;
+    bool ordered = true;
+
+    for (uint32_t block = 0; block < blocks; ++block)
+    {
+        ring.PublishRequest();
+        while (SharedCounterLoad(ring.GetReplyCount()) <= (SharedCounter)block)
+        {
+            usleep(10);
+        }
+
+        CHECK(ring.GetAvailable() == blockFrames);
+        CHECK(ring.Read(out, blockFrames, 0.5f) == blockFrames);
+        for (uint32_t i = 0; i < blockFrames; ++i, ++frame)
+        {
+            ordered &= out[i * 2] == frame * 0.5f && out[i * 2 + 1] == -(frame * 0.5f);
+        }
+    }
+    CHECK(ordered);
+
+    int status = 0;
+    waitpid(host, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /// The name is removed with the ring of the driver
+    ring.Close();
+    SharedAudioRing reopened;
+    CHECK(!reopened.Open(name.c_str()));
+
+    return checkFailures ? 1 : 0;
+}
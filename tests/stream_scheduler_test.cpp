@@ -0,0 +1,406 @@
+/// <summary>
+/// Plays MIDIEVENT buffers through StreamScheduler against a fake frame clock, which renders blocks and counts their frames,
+/// and checks the frames at which a recording sink receives the events, the callbacks and the returned buffers.
+/// </summary>
+
+#include "../driver/StreamScheduler.h"
+#include "check.h"
+#include <vector>
+
+static const uint32_t sampleRate = 48000;
+
+/// <summary>
+/// The buffer of a MIDI stream, built from MIDIEVENTs
+/// </summary>
+class EventBuffer
+{
+private:
+    std::vector<uint8_t> data;
+
+    void AppendWord(uint32_t word)
+    {
+        const uint8_t* bytes = (const uint8_t*)&word;
+        data.insert(data.end(), bytes, bytes + sizeof(word));
+    }
+
+public:
+    /// <summary>
+    /// Append an event without parameters, returns its offset in the buffer
+    /// </summary>
+    uint32_t Append(uint32_t deltaTime, uint32_t eventWord)
+    {
+        uint32_t offset = (uint32_t)data.size();
+        AppendWord(deltaTime);
+        AppendWord(0);
+        AppendWord(eventWord);
+        return offset;
+    }
+
+    /// <summary>
+    /// Append a long event, its parameters are padded to a multiple of 4 bytes
+    /// </summary>
+    uint32_t AppendLong(uint32_t deltaTime, const std::vector<uint8_t>& parameters, uint32_t flags = 0)
+    {
+        uint32_t offset = Append(deltaTime, StreamScheduler::LongFlag | flags | (uint32_t)parameters.size());
+        data.insert(data.end(), parameters.begin(), parameters.end());
+        data.resize((data.size() + 3) & ~(size_t)3);
+        return offset;
+    }
+
+    StreamScheduler::Buffer Get(void* context) const
+    {
+        StreamScheduler::Buffer buffer = { data.data(), (uint32_t)data.size(), context };
+        return buffer;
+    }
+};
+
+/// <summary>
+/// Records what the scheduler plays, at the frame of the fake clock
+/// </summary>
+struct RecordingSink
+{
+    struct Event
+    {
+        uint64_t frame;
+        uint32_t message;
+        std::vector<uint8_t> data;
+    };
+
+    struct Callback
+    {
+        uint64_t frame;
+        void* context;
+        uint32_t bufferOffset;
+    };
+
+    /// <summary>
+    /// The frame of the fake clock at which the current block starts
+    /// </summary>
+    uint64_t blockStart = 0;
+    uint32_t blockFrames = 0;
+    bool offsetsInBlock = true;
+
+    std::vector<Event> events;
+    std::vector<Callback> callbacks;
+    std::vector<void*> done;
+
+    void ShortMessage(uint32_t offset, uint32_t message)
+    {
+        offsetsInBlock &= offset < blockFrames;
+        events.push_back({ blockStart + offset, message, {} });
+    }
+
+    void LongMessage(uint32_t offset, const uint8_t* data, uint32_t length)
+    {
+        offsetsInBlock &= offset < blockFrames;
+        events.push_back({ blockStart + offset, 0, std::vector<uint8_t>(data, data + length) });
+    }
+
+    void Position(void* context, uint32_t bufferOffset)
+    {
+        callbacks.push_back({ blockStart, context, bufferOffset });
+    }
+
+    void Done(void* context)
+    {
+        done.push_back(context);
+    }
+};
+
+/// <summary>
+/// The frame clock of the rendered audio, it renders the stream in blocks like the audio device asks for them
+/// </summary>
+struct FrameClock
+{
+    uint64_t frame = 0;
+
+    void Render(StreamScheduler& scheduler, RecordingSink& sink, uint32_t frames)
+    {
+        sink.blockStart = frame;
+        sink.blockFrames = frames;
+        scheduler.Render(frames, sink);
+        frame += frames;
+    }
+
+    void Advance(StreamScheduler& scheduler, RecordingSink& sink, uint64_t frames, uint32_t blockFrames)
+    {
+        while (frames)
+        {
+            uint32_t block = frames < blockFrames ? (uint32_t)frames : blockFrames;
+            Render(scheduler, sink, block);
+            frames -= block;
+        }
+    }
+};
+
+static const uint32_t NoteOn = 0x7F3C90;
+
+/// <summary>
+/// Ticks per quarter note: 120 beats per minute and 96 ticks make 250 frames per tick at 48 kHz, a tempo event changes that
+/// </summary>
+static void TestPpqnAndTempo()
+{
+    StreamScheduler scheduler;
+    scheduler.Init(sampleRate);
+    scheduler.Restart();
+
+    int context;
+    EventBuffer buffer;
+    buffer.Append(0, NoteOn);
+    buffer.Append(96, NoteOn + 1);
+    buffer.Append(96, NoteOn + 2);
+    // Twice as fast from here on
+    buffer.Append(0, (StreamScheduler::TempoEvent << 24) | 250000);
+    buffer.Append(96, NoteOn + 3);
+    scheduler.Enqueue(buffer.Get(&context));
+
+    RecordingSink sink;
+    FrameClock clock;
+    clock.Advance(scheduler, sink, 96000, 441);
+
+    CHECK(sink.offsetsInBlock);
+    CHECK(sink.events.size() == 4);
+    if (sink.events.size() == 4)
+    {
+        CHECK(sink.events[0].frame == 0 && sink.events[0].message == NoteOn);
+        CHECK(sink.events[1].frame == 24000 && sink.events[1].message == NoteOn + 1);
+        CHECK(sink.events[2].frame == 48000);
+        CHECK(sink.events[3].frame == 60000);
+    }
+    CHECK(scheduler.GetTempo() == 250000);
+    CHECK(sink.done.size() == 1 && sink.done[0] == &context);
+    CHECK(scheduler.IsEmpty());
+
+    // The time division of a standard MIDI file header, 480 ticks per quarter note
+    scheduler.Init(sampleRate);
+    scheduler.SetTimeDivision(480);
+    scheduler.Restart();
+
+    EventBuffer fine;
+    fine.Append(480, NoteOn);
+    fine.Append(1, NoteOn);
+    scheduler.Enqueue(fine.Get(&context));
+
+    RecordingSink fineSink;
+    FrameClock fineClock;
+    fineClock.Advance(scheduler, fineSink, 48000, 256);
+    CHECK(fineSink.events.size() == 2 && fineSink.events[0].frame == 24000 && fineSink.events[1].frame == 24050);
+}
+
+/// <summary>
+/// SMPTE time division: frames per second and ticks per frame, 29 is 30 drop frame
+/// </summary>
+static void TestSmpte()
+{
+    StreamScheduler scheduler;
+    int context;
+
+    // 25 frames per second, 40 ticks per frame, 1000 ticks per second
+    scheduler.Init(sampleRate);
+    scheduler.SetTimeDivision(0x8000 | ((uint8_t)-25 << 8) | 40);
+    scheduler.Restart();
+
+    EventBuffer buffer;
+    buffer.Append(1000, NoteOn);
+    buffer.Append(1, NoteOn);
+    scheduler.Enqueue(buffer.Get(&context));
+
+    RecordingSink sink;
+    FrameClock clock;
+    clock.Advance(scheduler, sink, 96000, 480);
+    CHECK(sink.events.size() == 2 && sink.events[0].frame == 48000 && sink.events[1].frame == 48048);
+
+    // 29.97 frames per second, 100 ticks per frame, a second of the stream is 2997 ticks
+    scheduler.Init(sampleRate);
+    scheduler.SetTimeDivision(0x8000 | ((uint8_t)-29 << 8) | 100);
+    scheduler.Restart();
+
+    EventBuffer dropFrame;
+    dropFrame.Append(2997, NoteOn);
+    scheduler.Enqueue(dropFrame.Get(&context));
+
+    RecordingSink dropFrameSink;
+    FrameClock dropFrameClock;
+    dropFrameClock.Advance(scheduler, dropFrameSink, 96000, 480);
+    CHECK(dropFrameSink.events.size() == 1 && dropFrameSink.events[0].frame >= 47999 && dropFrameSink.events[0].frame <= 48000);
+}
+
+/// <summary>
+/// A buffer which arrives after its events were due plays them at once, the following events keep their spacing
+/// </summary>
+static void TestLateBuffer()
+{
+    StreamScheduler scheduler;
+    scheduler.Init(sampleRate);
+    scheduler.Restart();
+
+    RecordingSink sink;
+    FrameClock clock;
+    clock.Advance(scheduler, sink, 10 * 512, 512);
+
+    int first, second;
+    EventBuffer late;
+    late.Append(0, NoteOn);
+    late.Append(4, NoteOn + 1);
+    scheduler.Enqueue(late.Get(&first));
+
+    clock.Render(scheduler, sink, 512);
+    CHECK(sink.events.size() == 1 && sink.events[0].frame == 5120);
+
+    // The next event is 4 ticks after the late one, not after tick 0
+    clock.Advance(scheduler, sink, 1024, 512);
+    CHECK(sink.events.size() == 2 && sink.events[1].frame == 5120 + 1000);
+
+    // A second buffer, queued after the stream ran dry, follows at once
+    EventBuffer next;
+    next.Append(0, NoteOn + 2);
+    scheduler.Enqueue(next.Get(&second));
+    clock.Render(scheduler, sink, 512);
+    CHECK(sink.events.size() == 3 && sink.events[2].frame == 5120 + 1536);
+    CHECK(sink.done.size() == 2 && sink.done[0] == &first && sink.done[1] == &second);
+}
+
+/// <summary>
+/// Events with MEVT_F_CALLBACK report their offset in the buffer, also long events and NOPs, which send nothing
+/// </summary>
+static void TestCallbacks()
+{
+    StreamScheduler scheduler;
+    scheduler.Init(sampleRate);
+    scheduler.Restart();
+
+    int first, second;
+    const std::vector<uint8_t> sysEx = { 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7 };
+
+    EventBuffer buffer;
+    uint32_t shortOffset = buffer.Append(0, StreamScheduler::CallbackFlag | NoteOn);
+    buffer.Append(1, NoteOn);
+    uint32_t longOffset = buffer.AppendLong(1, sysEx, StreamScheduler::CallbackFlag);
+    scheduler.Enqueue(buffer.Get(&first));
+
+    EventBuffer nop;
+    nop.Append(0, NoteOn);
+    uint32_t nopOffset = nop.Append(2, StreamScheduler::CallbackFlag | (StreamScheduler::NopEvent << 24) | 0x123);
+    scheduler.Enqueue(nop.Get(&second));
+
+    RecordingSink sink;
+    FrameClock clock;
+    clock.Advance(scheduler, sink, 4800, 480);
+
+    CHECK(shortOffset == 0 && longOffset == 24 && nopOffset == 12);
+    CHECK(sink.callbacks.size() == 3);
+    if (sink.callbacks.size() == 3)
+    {
+        CHECK(sink.callbacks[0].context == &first && sink.callbacks[0].bufferOffset == shortOffset);
+        CHECK(sink.callbacks[1].context == &first && sink.callbacks[1].bufferOffset == longOffset);
+        CHECK(sink.callbacks[2].context == &second && sink.callbacks[2].bufferOffset == nopOffset);
+        CHECK(sink.callbacks[2].frame == 960);
+    }
+
+    // The NOP sends nothing, the long event its parameters without the padding
+    CHECK(sink.events.size() == 4);
+    if (sink.events.size() == 4)
+    {
+        CHECK(sink.events[2].frame == 500 && sink.events[2].data == sysEx);
+        CHECK(sink.events[3].frame == 500);
+    }
+    CHECK(sink.done.size() == 2 && sink.done[0] == &first && sink.done[1] == &second);
+}
+
+/// <summary>
+/// A paused stream plays nothing and stands still, a restarted one goes on where it stopped
+/// </summary>
+static void TestPauseRestart()
+{
+    StreamScheduler scheduler;
+    scheduler.Init(sampleRate);
+
+    int context;
+    EventBuffer buffer;
+    buffer.Append(0, NoteOn);
+    buffer.Append(96, NoteOn + 1);
+    scheduler.Enqueue(buffer.Get(&context));
+
+    RecordingSink sink;
+    FrameClock clock;
+
+    // A new stream is paused until it is restarted
+    CHECK(!scheduler.IsRunning());
+    clock.Advance(scheduler, sink, 4800, 480);
+    CHECK(sink.events.empty());
+
+    scheduler.Restart();
+    uint64_t started = clock.frame;
+    clock.Advance(scheduler, sink, 12000, 480);
+    CHECK(sink.events.size() == 1 && sink.events[0].frame == started);
+
+    scheduler.Pause();
+    uint64_t ticks, milliseconds;
+    scheduler.GetPosition(ticks, milliseconds);
+    CHECK(ticks == 48 && milliseconds == 250);
+
+    clock.Advance(scheduler, sink, 48000, 480);
+    CHECK(sink.events.size() == 1);
+    uint64_t pausedTicks, pausedMilliseconds;
+    scheduler.GetPosition(pausedTicks, pausedMilliseconds);
+    CHECK(pausedTicks == ticks && pausedMilliseconds == milliseconds);
+
+    // The second event is due 24000 frames of running after the first, the pause does not count
+    scheduler.Restart();
+    clock.Advance(scheduler, sink, 48000, 480);
+    CHECK(sink.events.size() == 2 && sink.events[1].frame == started + 24000 + 48000);
+}
+
+/// <summary>
+/// The position counts the ticks and the time of the stream, Stop returns the queued buffers and rewinds it
+/// </summary>
+static void TestStopAndPosition()
+{
+    StreamScheduler scheduler;
+    scheduler.Init(sampleRate);
+    scheduler.Restart();
+
+    int first, second;
+    EventBuffer buffer;
+    buffer.Append(10, NoteOn);
+    buffer.Append(1000, NoteOn);
+    scheduler.Enqueue(buffer.Get(&first));
+    EventBuffer more;
+    more.Append(0, NoteOn);
+    scheduler.Enqueue(more.Get(&second));
+
+    RecordingSink sink;
+    FrameClock clock;
+    clock.Advance(scheduler, sink, 24000, 500);
+
+    uint64_t ticks, milliseconds;
+    scheduler.GetPosition(ticks, milliseconds);
+    CHECK(ticks == 96 && milliseconds == 500);
+    CHECK(sink.events.size() == 1);
+
+    scheduler.Stop(sink);
+    CHECK(sink.done.size() == 2 && sink.done[0] == &first && sink.done[1] == &second);
+    CHECK(scheduler.IsEmpty());
+    scheduler.GetPosition(ticks, milliseconds);
+    CHECK(ticks == 0 && milliseconds == 0);
+
+    // A buffer queued after the stop starts from tick 0 again
+    EventBuffer again;
+    again.Append(10, NoteOn);
+    scheduler.Enqueue(again.Get(&first));
+    uint64_t restarted = clock.frame;
+    clock.Advance(scheduler, sink, 4800, 500);
+    CHECK(sink.events.size() == 2 && sink.events[1].frame == restarted + 2500);
+}
+
+int main()
+{
+    TestPpqnAndTempo();
+    TestSmpte();
+    TestLateBuffer();
+    TestCallbacks();
+    TestPauseRestart();
+    TestStopAndPosition();
+
+    return checkFailures ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+/// <summary>
+/// Measures the protocol between the VST driver and the VST host over SocketTransport and BufferedChannel.
+/// The test starts itself as the VST host (fork / exec with the socket as stdin / stdout), which answers render requests
+/// in the shape of the pipe protocol: the request carries the events of the block, the reply the rendered frames.
+/// It checks every reply and prints the round trip latency and the bulk throughput, so a protocol change can be compared.
+/// transport_test [--max-p99-us N] fails when the 99th percentile of the round trip is above N microseconds.
+/// </summary>
+
+#include "../common/channel.h"
+#include "../common/socket_transport.h"
+#include "check.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/// <summary>
+/// The commands of the VST host which are used here
+/// </summary>
+enum Command : uint32_t
+{
+    Exit = 0,
+    RenderAudioSamples = 9,
+    /// <summary>
+    /// Not a command of the VST host, the payload is acknowledged with its checksum
+    /// </summary>
+    Bulk = 100,
+};
+
+static const uint32_t channels = 2;
+static const uint32_t blockFrames = 512;
+static const uint32_t eventBytes = 96;
+static const uint32_t blocks = 5000;
+static const uint32_t bulkChunk = 65536;
+static const uint32_t bulkChunks = 1024;
+
+static uint32_t Checksum(const uint8_t* data, uint32_t size)
+{
+    uint32_t sum = 2166136261u;
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        sum = (sum ^ data[i]) * 16777619u;
+    }
+    return sum;
+}
+
+/// <summary>
+/// The VST host side, runs until the Exit command or a broken connection
+/// </summary>
+static int RunHost()
+{
+    SocketTransport transport;
+    transport.Attach(0, 1);
+
+    BufferedChannel channel;
+    channel.Attach(&transport);
+
+    std::vector<uint8_t> payload;
+    std::vector<float> frames;
+
+    for (;;)
+    {
+        uint32_t header[2];
+        if (!channel.Read(header, sizeof(header)))
+        {
+            return 2;
+        }
+
+        if (header[0] == Command::Exit)
+        {
+            return 0;
+        }
+
+        payload.resize(header[1]);
+        if (header[1] && !channel.Read(payload.data(), header[1]))
+        {
+            return 2;
+        }
+
+        uint32_t status = 0;
+        channel.Write(&status, sizeof(status));
+
+        if (header[0] == Command::RenderAudioSamples)
+        {
+            /// The frames carry the first event byte, so the driver side can tell the replies apart
+            frames.assign(blockFrames * channels, header[1] ? (float)payload[0] : 0.0f);
+            channel.Write(frames.data(), (uint32_t)(frames.size() * sizeof(float)));
+        }
+        else
+        {
+            uint32_t checksum = Checksum(payload.data(), header[1]);
+            channel.Write(&checksum, sizeof(checksum));
+        }
+
+        if (!channel.Flush())
+        {
+            return 2;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && !strcmp(argv[1], "--host"))
+    {
+        return RunHost();
+    }
+
+    double maxP99 = 0;
+    if (argc > 2 && !strcmp(argv[1], "--max-p99-us"))
+    {
+        maxP99 = atof(argv[2]);
+    }
+
+    SocketTransport transport;
+    int childSocket;
+    if (!transport.Create(childSocket))
+    {
+        fprintf(stderr, "socketpair failed\n");
+        return 1;
+    }
+
+    pid_t host = fork();
+    if (!host)
+    {
+        dup2(childSocket, 0);
+        dup2(childSocket, 1);
+        close(childSocket);
+        execl("/proc/self/exe", argv[0], "--host", (char*)NULL);
+        execlp(argv[0], argv[0], "--host", (char*)NULL);
+        _exit(127);
+    }
+    close(childSocket);
+
+    CHECK(host > 0);
+    CHECK(transport.Connect(10000));
+
+    BufferedChannel channel;
+    channel.Attach(&transport);
+
+    typedef std::chrono::steady_clock Clock;
+
+    /// Render round trips
+    std::vector<uint8_t> events(eventBytes);
+    std::vector<float> frames(blockFrames * channels);
+    std::vector<double> latencies;
+    latencies.reserve(blocks);
+    bool replies = true;
+
+    for (uint32_t block = 0; block < blocks && channel.IsGood(); ++block)
+    {
+        memset(events.data(), (int)(block & 0x7F), eventBytes);
+
+        Clock::time_point start = Clock::now();
+
+        uint32_t header[2] = { Command::RenderAudioSamples, eventBytes };
+        channel.Write(header, sizeof(header));
+        channel.Write(events.data(), eventBytes);
+        channel.Flush();
+
+        uint32_t status = 1;
+        replies &= channel.Read(&status, sizeof(status)) && !status;
+        replies &= channel.Read(frames.data(), (uint32_t)(frames.size() * sizeof(float)));
+
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+
+        replies &= frames.front() == (float)(block & 0x7F) && frames.back() == (float)(block & 0x7F);
+    }
+    CHECK(replies);
+    CHECK(latencies.size() == blocks);
+
+    /// Bulk transfer, like a chunk upload
+    std::vector<uint8_t> chunk(bulkChunk);
+    bool acknowledged = true;
+
+    Clock::time_point bulkStart = Clock::now();
+    for (uint32_t i = 0; i < bulkChunks && channel.IsGood(); ++i)
+    {
+        for (uint32_t j = 0; j < bulkChunk; ++j)
+        {
+            chunk[j] = (uint8_t)(i + j);
+        }
+
+        uint32_t header[2] = { Command::Bulk, bulkChunk };
+        channel.Write(header, sizeof(header));
+        channel.Write(chunk.data(), bulkChunk);
+        channel.Flush();
+
+        uint32_t reply[2] = { 1, 0 };
+        acknowledged &= channel.Read(reply, sizeof(reply)) && !reply[0] && reply[1] == Checksum(chunk.data(), bulkChunk);
+    }
+    double bulkSeconds = std::chrono::duration<double>(Clock::now() - bulkStart).count();
+    CHECK(acknowledged);
+
+    uint32_t exitCommand[2] = { Command::Exit, 0 };
+    channel.Write(exitCommand, sizeof(exitCommand));
+    CHECK(channel.Flush());
+
+    int status = 0;
+    waitpid(host, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        double p50 = latencies[latencies.size() / 2];
+        double p99 = latencies[latencies.size() * 99 / 100];
+        double total = 0;
+        for (double latency : latencies)
+        {
+            total += latency;
+        }
+
+        printf("render round trip: %u blocks of %u frames, mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            blocks, blockFrames, total / latencies.size(), p50, p99, latencies.back());
+        printf("bulk: %u MiB in %.3f s, %.1f MiB/s\n", bulkChunks * bulkChunk >> 20, bulkSeconds, (bulkChunks * bulkChunk >> 20) / bulkSeconds);
+
+        if (maxP99 > 0)
+        {
+            CHECK(p99 <= maxP99);
+        }
+    }
+
+    return checkFailures ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+#ifndef __WIN32_SHIM_MMSYSTEM_H__
+#define __WIN32_SHIM_MMSYSTEM_H__
+
+#include <windows.h>
+
+#define MMSYSERR_NOERROR 0
+#define MIDIERR_NOTREADY 67
+
+#endif
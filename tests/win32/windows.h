@@ -0,0 +1,75 @@
+#ifndef __WIN32_SHIM_WINDOWS_H__
+#define __WIN32_SHIM_WINDOWS_H__
+
+/// <summary>
+/// The part of the Windows API which the portable headers of the driver use, so their tests build on POSIX systems
+/// </summary>
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <unistd.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG;
+
+typedef union
+{
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#define _countof(array) (sizeof(array) / sizeof((array)[0]))
+
+inline LONG InterlockedIncrement(volatile LONG* target)
+{
+    return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* target)
+{
+    return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchange(volatile LONG* target, LONG value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedCompareExchange(volatile LONG* target, LONG exchange, LONG comparand)
+{
+    __atomic_compare_exchange_n(target, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+inline int QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+    frequency->QuadPart = 1000000000;
+    return 1;
+}
+
+inline int QueryPerformanceCounter(LARGE_INTEGER* counter)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    counter->QuadPart = (LONGLONG)now.tv_sec * 1000000000 + now.tv_nsec;
+    return 1;
+}
+
+inline DWORD GetTickCount()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (DWORD)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+inline void Sleep(DWORD milliseconds)
+{
+    usleep(milliseconds * 1000);
+}
+
+#endif
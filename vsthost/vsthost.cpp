@@ -1,991 +1,1871 @@
-// vsthost.cpp : Defines the entry point for the console application.
-//
-
-#include "stdafx.h"
-#include <string>
-
-// #define LOG_EXCHANGE
-
-using std::vector;
-
-enum
-{
-    BUFFER_SIZE = 4096
-};
-
-enum Command : uint32_t
-{
-    GetChunkData = 1,
-    SetChunkData = 2,
-    HasEditor = 3,
-    DisplayEditorModal = 4,
-    SetSampleRate = 5,
-    Reset = 6,
-    SendMidiEvent = 7,
-    SendMidiSystemExclusiveEvent = 8,
-    RenderAudioSamples = 9,
-};
-
-enum Response : uint32_t
-{
-    NoError = 0,
-    CannotLoadVstiDll = 6,
-    CannotGetProcAddress = 7,
-    NotAVsti = 8,
-    CannotReset = 8,
-    VstiIsNotAMidiSynth = 9,
-    CannotSetSampleRate = 10,
-    CannotRenderAudioSamples = 11,
-    CommandUnknown = 12,
-};
-
-enum Error : uint32_t
-{
-    InvalidCommandLineArguments = 1,
-    MalformedChecksum = 2,
-    ChecksumMismatch = 3,
-    Comctl32LoadFailed = 4,
-    ComStaInitializationFailed = 5,
-};
-
-/// <summary>
-/// VSTi MIDI event and VSTi Midi System Exclusive Event
-/// </summary>
-struct MidiEvent
-{
-    struct MidiEvent* next;
-    unsigned port;
-    union
-    {
-        VstMidiEvent midiEvent;
-        VstMidiSysexEvent sysexEvent;
-    } ev;
-};
-
-MidiEvent* evChain = NULL;
-MidiEvent* evTail = NULL;
-
-bool need_idle = false;
-bool idle_started = false;
-
-static char* dll_dir = NULL;
-
-static HANDLE null_file = NULL;
-static HANDLE pipe_in = NULL;
-static HANDLE pipe_out = NULL;
-
-void FreeMidiEventChain()
-{
-    MidiEvent* ev = evChain;
-    while (ev)
-    {
-        MidiEvent* next = ev->next;
-        if (ev->port && ev->ev.sysexEvent.type == VstEventTypes::kVstSysExType)
-        {
-            free(ev->ev.sysexEvent.sysexDump);
-        }
-        free(ev);
-        ev = next;
-    }
-    evChain = NULL;
-    evTail = NULL;
-}
-
-#ifdef LOG_EXCHANGE
-unsigned exchange_count = 0;
-#endif
-
-/// <summary>
-/// Send data to the VST driver via the pipe output 
-/// </summary>
-/// <param name="data">The data to send</param>
-/// <param name="size">The size of the data</param>
-void SendData(const void* data, uint32_t size)
-{
-    if (size)
-    {
-        DWORD dwWritten;
-        WriteFile(pipe_out, data, size, &dwWritten, NULL);
-#ifdef LOG_EXCHANGE
-        TCHAR logfile[MAX_PATH];
-        _stprintf_s(logfile, _T("C:\\temp\\log\\bytes_%08u.out"), ++exchange_count);
-        FILE* f = _tfopen(logfile, _T("wb"));
-        fwrite(data, 1, size, f);
-        fclose(f);
-#endif
-    }
-}
-
-/// <summary>
-/// Send data to the VST driver via the pipe output 
-/// </summary>
-/// <param name="data">The data to send</param>
-void SendData(uint32_t data)
-{
-    SendData(&data, sizeof(data));
-}
-
-/// <summary>
-/// Send data to the VST driver via the pipe output 
-/// </summary>
-/// <param name="data">The data to send</param>
-void SendData(const char* data)
-{
-    SendData(data, strlen(data));
-}
-
-/// <summary>
-/// Send data to the VST driver via the pipe output 
-/// </summary>
-/// <param name="data">The data to send</param>
-void SendData(vector<uint8_t> data)
-{
-    SendData(data.data(), data.size());
-}
-
-/// <summary>
-/// Receive data from the VST driver via the pipe input
-/// </summary>
-/// <param name="data">The received data</param>
-/// <param name="size">The size of the data</param>
-void ReceiveData(void* data, uint32_t size)
-{
-    DWORD dwRead;
-    if (ReadFile(pipe_in, data, size, &dwRead, NULL) && dwRead >= size)
-    {
-#ifdef LOG_EXCHANGE
-        TCHAR logfile[MAX_PATH];
-        _stprintf_s(logfile, _T("C:\\temp\\log\\bytes_%08u.in"), ++exchange_count);
-        FILE* f = _tfopen(logfile, _T("wb"));
-        fwrite(data, 1, size, f);
-        fclose(f);
-#endif
-    }
-    else
-    {
-        memset(data, 0, size);
-#ifdef LOG_EXCHANGE
-        TCHAR logfile[MAX_PATH];
-        _stprintf_s(logfile, _T("C:\\temp\\log\\bytes_%08u.err"), ++exchange_count);
-        FILE* f = _tfopen(logfile, _T("wb"));
-        _ftprintf(f, _T("Wanted %u bytes, got %u"), size, dwRead);
-        fclose(f);
-#endif
-    }
-}
-
-/// <summary>
-/// Receive data from the VST driver via the pipe input
-/// </summary>
-uint32_t ReceiveData()
-{
-    uint32_t data;
-    ReceiveData(&data, sizeof(data));
-    return data;
-}
-
-void GetChunk(AEffect* pEffect, vector<uint8_t>& out)
-{
-    out.resize(0);
-    uint32_t unique_id = pEffect->uniqueID;
-    append_be(out, unique_id);
-    bool type_chunked = !!(pEffect->flags & VstAEffectFlags::effFlagsProgramChunks);
-    append_be(out, type_chunked);
-    if (!type_chunked)
-    {
-        uint32_t num_params = pEffect->numParams;
-        append_be(out, num_params);
-        for (unsigned i = 0; i < num_params; ++i)
-        {
-            float parameter = pEffect->getParameter(pEffect, i);
-            append_be(out, parameter);
-        }
-    }
-    else
-    {
-        void* chunk;
-        uint32_t size = pEffect->dispatcher(pEffect, AEffectOpcodes::effGetChunk, 0, 0, &chunk, 0);
-        append_be(out, size);
-        size_t chunk_size = out.size();
-        out.resize(chunk_size + size);
-        memcpy(&out[chunk_size], chunk, size);
-    }
-}
-
-void SetChunk(AEffect* pEffect, vector<uint8_t> const& in)
-{
-    unsigned size = in.size();
-    if (pEffect && size)
-    {
-        const uint8_t* inc = in.data();
-        uint32_t effect_id;
-        retrieve_be(effect_id, inc, size);
-        if (effect_id != pEffect->uniqueID)
-        {
-            return;
-        }
-
-        bool type_chunked;
-        retrieve_be(type_chunked, inc, size);
-
-        if (type_chunked != !!(pEffect->flags & VstAEffectFlags::effFlagsProgramChunks))
-        {
-            return;
-        }
-
-        if (!type_chunked)
-        {
-            uint32_t num_params;
-            retrieve_be(num_params, inc, size);
-            if (num_params != pEffect->numParams)
-            {
-                return;
-            }
-            for (unsigned i = 0; i < num_params; ++i)
-            {
-                float parameter;
-                retrieve_be(parameter, inc, size);
-                pEffect->setParameter(pEffect, i, parameter);
-            }
-        }
-        else
-        {
-            uint32_t chunk_size;
-            retrieve_be(chunk_size, inc, size);
-            if (chunk_size > size)
-            {
-                return;
-            }
-            pEffect->dispatcher(pEffect, AEffectOpcodes::effSetChunk, 0, chunk_size, (void*)inc, 0);
-        }
-    }
-}
-
-struct MyDLGTEMPLATE : DLGTEMPLATE
-{
-    WORD ext[3];
-    MyDLGTEMPLATE()
-    {
-        memset(this, 0, sizeof(*this));
-    };
-};
-
-INT_PTR CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
-{
-    AEffect* effect;
-    switch (uMsg)
-    {
-        case WM_INITDIALOG:
-        {
-            SetWindowLongPtr(hwnd, GWLP_USERDATA, lParam);
-            SetWindowText(hwnd, L"VST Host");
-            SetTimer(hwnd, 1, 20, 0);
-            effect = (AEffect*)lParam;
-            if (effect)
-            {
-                char product[VstStringConstants::kVstMaxProductStrLen] = { 0 };
-                effect->dispatcher(effect, AEffectXOpcodes::effGetProductString, 0, 0, &product, 0);
-
-                SetWindowTextA(hwnd, (LPCSTR)product);
-
-                effect->dispatcher(effect, AEffectOpcodes::effEditOpen, 0, 0, hwnd, 0);
-                ERect* eRect = 0;
-                effect->dispatcher(effect, AEffectOpcodes::effEditGetRect, 0, 0, &eRect, 0);
-                if (eRect)
-                {
-                    int width = eRect->right - eRect->left;
-                    int height = eRect->bottom - eRect->top;
-                    if (width < 50)
-                    {
-                        width = 50;
-                    }
-                    if (height < 50)
-                    {
-                        height = 50;
-                    }
-                    RECT wRect;
-                    SetRect(&wRect, 0, 0, width, height);
-                    AdjustWindowRectEx(&wRect, GetWindowLong(hwnd, GWL_STYLE), FALSE, GetWindowLong(hwnd, GWL_EXSTYLE));
-                    width = wRect.right - wRect.left;
-                    height = wRect.bottom - wRect.top;
-                    SetWindowPos(hwnd, HWND_TOP, 0, 0, width, height, SWP_SHOWWINDOW | SWP_NOMOVE);
-                }
-            }
-        }
-        break;
-
-        case WM_TIMER:
-            effect = (AEffect*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
-            if (effect)
-            {
-                effect->dispatcher(effect, AEffectOpcodes::effEditIdle, 0, 0, 0, 0);
-            }
-            break;
-
-        case WM_CLOSE:
-        {
-            effect = (AEffect*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
-            KillTimer(hwnd, 1);
-            if (effect)
-            {
-                effect->dispatcher(effect, AEffectOpcodes::effEditClose, 0, 0, 0, 0);
-            }
-
-            EndDialog(hwnd, IDOK);
-        }
-        break;
-    }
-
-    return 0;
-}
-
-struct audioMasterData
-{
-    VstIntPtr effect_number;
-};
-
-static VstIntPtr VSTCALLBACK audioMaster(AEffect* effect, VstInt32 opcode, VstInt32 index, VstIntPtr value, void* ptr, float opt)
-{
-    audioMasterData* data = NULL;
-    if (effect)
-    {
-        data = (audioMasterData*)effect->user;
-    }
-
-    switch (opcode)
-    {
-        case AudioMasterOpcodes::audioMasterAutomate:
-            /// The user changed a parameter in plug-ins editor, which is out of the Host's control.
-            /// This ensures that the Host is notified of the parameter change, which
-            /// allows it to record these changes for automation.
-            /// [index]: parameter index
-            /// [opt]: parameter value
-            /// @see AudioEffect::setParameterAutomated
-            break;
-
-        case AudioMasterOpcodes::audioMasterVersion:
-            /// Used to ask for the Host's version
-            /// [return value]: Host VST version (for example 2400 for VST 2.4)
-            /// @see AudioEffect::getMasterVersion
-            return kVstVersion;
-
-        case AudioMasterOpcodes::audioMasterCurrentId:
-            /// [return value]: current unique identifier on shell plug-in
-            /// @see AudioEffect::getCurrentUniqueId
-            if (data)
-            {
-                return data->effect_number;
-            }
-            break;
-
-        case AudioMasterOpcodes::audioMasterIdle:
-            /// Give idle time to Host application, e.g. if plug-in editor is doing mouse tracking in a modal loop.
-            /// no arguments
-            /// @see AudioEffect::masterIdle
-            break;
-
-        case AudioMasterOpcodes::audioMasterPinConnected:
-            /// [return value]: 0=true, 1=false
-            /// [index]: pin index
-            /// [value]: 0=input, 1=output
-            /// @see AudioEffect::isInputConnected
-            /// @see AudioEffect::isOutputConnected
-            break;
-
-        case AudioMasterOpcodesX::audioMasterGetVendorString:
-            /// [ptr]: char buffer for vendor string, limited to #kVstMaxVendorStrLen
-            /// @see AudioEffectX::getHostVendorString
-            strncpy((char*)ptr, "NoWork, Inc.", VstStringConstants::kVstMaxVendorStrLen);
-            //strncpy((char *)ptr, "YAMAHA", 64);
-            break;
-
-        case AudioMasterOpcodesX::audioMasterGetProductString:
-            /// [ptr]: char buffer for vendor string, limited to #kVstMaxProductStrLen
-            /// @see AudioEffectX::getHostProductString
-            strncpy((char*)ptr, "VSTi Host Bridge", VstStringConstants::kVstMaxProductStrLen);
-            //strncpy((char *)ptr, "SOL/SQ01", 64);
-            break;
-
-        case AudioMasterOpcodesX::audioMasterGetVendorVersion:
-            /// [return value]: vendor-specific version
-            /// @see AudioEffectX::getHostVendorVersion
-            return 1010;
-
-        case AudioMasterOpcodesX::audioMasterGetLanguage:
-            /// [return value]: language code
-            /// @see VstHostLanguage
-            return VstHostLanguage::kVstLangEnglish;
-
-        case AudioMasterOpcodesX::audioMasterVendorSpecific:
-            /// no definition, vendor specific handling
-            /// @see AudioEffectX::hostVendorSpecific
-            /* Steinberg HACK */
-            if (ptr)
-            {
-                uint32_t* blah = (uint32_t*)(((char*)ptr) - 4);
-                if (*blah == 0x0737bb68)
-                {
-                    *blah ^= 0x5CC8F349;
-                    blah[2] = 0x19E;
-                    return 0x1E7;
-                }
-            }
-            break;
-
-        case AudioMasterOpcodesX::audioMasterGetDirectory:
-            /// [return value]: FSSpec on 32 bit MAC, else char*
-            /// @see AudioEffectX::getDirectory
-            return (VstIntPtr)dll_dir;
-
-            /* More crap */
-        case DECLARE_VST_DEPRECATED(audioMasterNeedIdle):
-            need_idle = true;
-            return 0;
-    }
-
-    return 0;
-}
-
-LONG __stdcall myExceptFilterProc(LPEXCEPTION_POINTERS param)
-{
-    if (IsDebuggerPresent())
-    {
-        return UnhandledExceptionFilter(param);
-    }
-    else
-    {
-        //DumpCrashInfo( param );
-        TerminateProcess(GetCurrentProcess(), 0);
-        return 0;// never reached
-    }
-}
-
-#pragma comment(lib, "Winmm")
-
-LPTIMECALLBACK TimeProc(UINT uTimerID, UINT uMsg, DWORD_PTR dwUser, DWORD_PTR dw1, DWORD_PTR dw2)
-{
-    MyDLGTEMPLATE vstiEditor;
-    AEffect* pEffect = (AEffect*)dwUser;
-    vstiEditor.style = WS_POPUPWINDOW | WS_DLGFRAME | WS_MINIMIZEBOX | WS_SYSMENU | WS_CAPTION | DS_MODALFRAME | DS_CENTER;
-    DialogBoxIndirectParam(0, &vstiEditor, 0, (DLGPROC)WindowProc, (LPARAM)pEffect);
-    return 0;
-}
-
-int CALLBACK _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdLine, int nCmdShow)
-{
-    int argc = 0;
-    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
-
-    if (argv == NULL || argc != 3)
-    {
-        return Error::InvalidCommandLineArguments;
-    }
-
-    /// Get the checksum from the 3rd argument
-    wchar_t* end_char = 0;
-    unsigned inputChecksum = wcstoul(argv[2], &end_char, 16);
-    if (end_char == argv[2] || *end_char)
-    {
-        return Error::MalformedChecksum;
-    }
-
-    /// Calculate the checksum from the 2nd argument
-    unsigned checksum = 0;
-    end_char = argv[1];
-    while (*end_char)
-    {
-        checksum += (TCHAR)(*end_char++ * 820109);
-    }
-
-    if (inputChecksum != checksum)
-    {
-        return Error::ChecksumMismatch;
-    }
-
-    AEffect* pEffect = { 0 };
-
-    audioMasterData effectData = { 0 };
-
-    vector<uint8_t> blState;
-
-    uint32_t sampleRate = 44100;
-
-    vector<uint8_t> chunk;
-    vector<float> sample_buffer;
-    //unsigned int samples_buffered = 0;
-
-    null_file = CreateFile(_T("NUL"), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
-
-    pipe_in = GetStdHandle(STD_INPUT_HANDLE);
-    pipe_out = GetStdHandle(STD_OUTPUT_HANDLE);
-
-    SetStdHandle(STD_INPUT_HANDLE, null_file);
-    SetStdHandle(STD_OUTPUT_HANDLE, null_file);
-
-    /// Carries information used to load common control classes from the dynamic-link library (DLL).
-    /// This structure is used with the InitCommonControlsEx function.
-    INITCOMMONCONTROLSEX icc{};
-    icc.dwSize = sizeof(icc);
-    icc.dwICC = ICC_WIN95_CLASSES | ICC_COOL_CLASSES | ICC_STANDARD_CLASSES;
-    /// Ensures that the common control DLL (Comctl32.dll) is loaded, and registers specific common control classes from the DLL.
-    /// An application must call this function before creating a common control.
-    if (!InitCommonControlsEx(&icc))
-    {
-        return Error::Comctl32LoadFailed;
-    }
-
-    /// Initializes the COM library on the current thread and identifies the concurrency model as single-thread apartment (STA).
-    if (FAILED(CoInitialize(NULL)))
-    {
-        return Error::ComStaInitializationFailed;
-    }
-
-#ifndef _DEBUG
-    SetUnhandledExceptionFilter(myExceptFilterProc);
-#endif
-
-    size_t dll_name_len = wcslen(argv[1]);
-    dll_dir = (char*)malloc(dll_name_len + 1);
-    wcstombs(dll_dir, argv[1], dll_name_len);
-    dll_dir[dll_name_len] = '\0';
-    char* slash = strrchr(dll_dir, '\\');
-    *slash = '\0';
-
-    uint32_t code = 0;
-
-    /// Load the VSTi DLL which is passed as the first argument
-    /// "C:\Projects\New\VST\VSTDriver\output\vsthost32.exe" "C:\Program Files (x86)\yamaha_syxg50_vsti\syxg50.dll" 001AF06A (1765482)
-    HMODULE vstiDll = LoadLibraryW(argv[1]);
-    if (!vstiDll)
-    {
-        code = Response::CannotLoadVstiDll;
-        goto exit;
-    }
-
-    main_func pMain = (main_func)GetProcAddress(vstiDll, "VSTPluginMain");
-    if (!pMain)
-    {
-        pMain = (main_func)GetProcAddress(vstiDll, "main");
-        if (!pMain)
-        {
-            pMain = (main_func)GetProcAddress(vstiDll, "MAIN");
-            if (!pMain)
-            {
-                code = Response::CannotGetProcAddress;
-                goto exit;
-            }
-        }
-    }
-
-#if 0
-    MessageBox(GetDesktopWindow(), argv[1], _T("HUUUURRRRRR"), 0);
-#endif
-
-    pEffect = pMain(&audioMaster);
-    if (!pEffect || pEffect->magic != kEffectMagic)
-    {
-        code = Response::NotAVsti;
-        goto exit;
-    }
-
-    pEffect->user = &effectData;
-    pEffect->dispatcher(pEffect, AEffectOpcodes::effOpen, 0, 0, 0, 0);
-
-    if (pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetPlugCategory, 0, 0, 0, 0) != kPlugCategSynth || pEffect->dispatcher(pEffect, AEffectXOpcodes::effCanDo, 0, 0, (void*)"receiveVstMidiEvent", 0) < 1)
-    {
-        code = Response::VstiIsNotAMidiSynth;
-        goto exit;
-    }
-
-    /// <summary>
-    /// The number of VSTi audio outputs
-    /// </summary>
-    uint32_t audioOutputs = min(pEffect->numOutputs, 2);
-
-    {
-        char effectName[VstStringConstants::kVstMaxEffectNameLen] = { 0 };
-        pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetEffectName, 0, 0, &effectName, 0);
-
-        char vendor[VstStringConstants::kVstMaxVendorStrLen] = { 0 };
-        pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetVendorString, 0, 0, &vendor, 0);
-
-        char product[VstStringConstants::kVstMaxProductStrLen] = { 0 };
-        pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetProductString, 0, 0, &product, 0);
-
-        uint32_t vendorVersion = pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetVendorVersion, 0, 0, 0, 0);
-        uint32_t uniqueId = pEffect->uniqueID;
-
-        SendData(Response::NoError);
-        SendData(strlen(effectName));
-        SendData(strlen(vendor));
-        SendData(strlen(product));
-        SendData(vendorVersion);
-        SendData(uniqueId);
-        SendData(audioOutputs);
-
-        SendData(effectName);
-        SendData(vendor);
-        SendData(product);
-    }
-
-    float** float_list_in;
-    float** float_list_out;
-    float* float_null;
-    float* float_out;
-
-    for (;;)
-    {
-        uint32_t command = ReceiveData();
-        if (!command)
-        {
-            break;
-        }
-
-        switch (command)
-        {
-            case Command::GetChunkData:
-            {
-                GetChunk(pEffect, chunk);
-
-                SendData(0u);
-                SendData(chunk.size());
-                SendData(chunk);
-            }
-            break;
-
-            case Command::SetChunkData:
-            {
-                uint32_t size = ReceiveData();
-                chunk.resize(size);
-                if (size)
-                {
-                    ReceiveData(chunk.data(), size);
-                }
-
-                SetChunk(pEffect, chunk);
-
-                SendData(0u);
-            }
-            break;
-
-            case Command::HasEditor:
-            {
-                uint32_t hasEditor = pEffect->flags & VstAEffectFlags::effFlagsHasEditor;
-
-                SendData(0u);
-                SendData(hasEditor);
-            }
-            break;
-
-            case Command::DisplayEditorModal:
-            {
-                if (pEffect->flags & VstAEffectFlags::effFlagsHasEditor)
-                {
-                    timeSetEvent(100, 10, (LPTIMECALLBACK)TimeProc, (DWORD)pEffect, TIME_ONESHOT);
-                }
-
-                SendData(0u);
-            }
-            break;
-
-            case Command::SetSampleRate:
-            {
-                uint32_t size = ReceiveData();
-                if (size != sizeof(sampleRate))
-                {
-                    code = Response::CannotSetSampleRate;
-                    goto exit;
-                }
-
-                sampleRate = ReceiveData();
-
-                SendData(0u);
-            }
-            break;
-
-            case Command::Reset:
-            {
-                if (blState.size())
-                {
-                    pEffect->dispatcher(pEffect, AEffectXOpcodes::effStopProcess, 0, 0, 0, 0);
-                }
-                pEffect->dispatcher(pEffect, AEffectOpcodes::effClose, 0, 0, 0, 0);
-
-                blState.resize(0);
-
-                FreeMidiEventChain();
-
-                pEffect = pMain(&audioMaster);
-                if (!pEffect)
-                {
-                    code = Response::CannotReset;
-                    goto exit;
-                }
-                pEffect->user = &effectData;
-                pEffect->dispatcher(pEffect, AEffectOpcodes::effOpen, 0, 0, 0, 0);
-                SetChunk(pEffect, chunk);
-
-                SendData(0u);
-            }
-            break;
-
-            case Command::SendMidiEvent:
-            {
-                MidiEvent* ev = (MidiEvent*)calloc(sizeof(MidiEvent), 1);
-                if (evTail)
-                {
-                    evTail->next = ev;
-                }
-                evTail = ev;
-                if (!evChain)
-                {
-                    evChain = ev;
-                }
-
-                uint32_t b = ReceiveData();
-
-                /// To Do - Limit the midi ports to one per host
-                ev->port = (b & 0x7F000000) >> 24;
-                if (ev->port > 2)
-                {
-                    ev->port = 2;
-                }
-                ev->ev.midiEvent.type = VstEventTypes::kVstMidiType;
-                ev->ev.midiEvent.byteSize = sizeof(ev->ev.midiEvent);
-                memcpy(&ev->ev.midiEvent.midiData, &b, 3);
-
-                SendData(0u);
-            }
-            break;
-
-            case Command::SendMidiSystemExclusiveEvent:
-            {
-                MidiEvent* ev = (MidiEvent*)calloc(sizeof(MidiEvent), 1);
-                if (evTail)
-                {
-                    evTail->next = ev;
-                }
-                evTail = ev;
-                if (!evChain)
-                {
-                    evChain = ev;
-                }
-
-                uint32_t size = ReceiveData();
-                uint32_t port = size >> 24;
-                size &= 0xFFFFFF;
-
-                ev->port = port;
-                if (ev->port > 2)
-                {
-                    ev->port = 2;
-                }
-                ev->ev.sysexEvent.type = VstEventTypes::kVstSysExType;
-                ev->ev.sysexEvent.byteSize = sizeof(ev->ev.sysexEvent);
-                ev->ev.sysexEvent.dumpBytes = size;
-                ev->ev.sysexEvent.sysexDump = (char*)malloc(size);
-
-                ReceiveData(ev->ev.sysexEvent.sysexDump, size);
-
-                SendData(0u);
-            }
-            break;
-
-            case Command::RenderAudioSamples:
-            {
-                if (!blState.size())
-                {
-                    pEffect->dispatcher(pEffect, AEffectOpcodes::effSetSampleRate, 0, 0, 0, float(sampleRate));
-                    pEffect->dispatcher(pEffect, AEffectOpcodes::effSetBlockSize, 0, BUFFER_SIZE, 0, 0);
-                    pEffect->dispatcher(pEffect, AEffectOpcodes::effMainsChanged, 0, 1, 0, 0);
-                    pEffect->dispatcher(pEffect, AEffectXOpcodes::effStartProcess, 0, 0, 0, 0);
-
-                    size_t buffer_size = sizeof(float*) * (pEffect->numInputs + audioOutputs * 3);   // float lists (inputs + outputs)
-                    buffer_size += sizeof(float) * BUFFER_SIZE;                                         // null input
-                    buffer_size += sizeof(float) * BUFFER_SIZE * audioOutputs * 3;                      // outputs
-
-                    blState.resize(buffer_size);
-
-                    float_list_in = (float**)blState.data();
-                    float_list_out = float_list_in + pEffect->numInputs;
-                    float_null = (float*)(float_list_out + audioOutputs * 3);
-                    float_out = float_null + BUFFER_SIZE;
-
-                    for (unsigned i = 0; i < pEffect->numInputs; ++i)
-                    {
-                        float_list_in[i] = float_null;
-                    }
-                    for (unsigned i = 0; i < audioOutputs * 3; ++i)
-                    {
-                        float_list_out[i] = float_out + BUFFER_SIZE * i;
-                    }
-
-                    memset(float_null, 0, sizeof(float) * BUFFER_SIZE);
-
-                    sample_buffer.resize((BUFFER_SIZE << 1) * audioOutputs);
-                }
-
-                if (need_idle)
-                {
-                    pEffect->dispatcher(pEffect, DECLARE_VST_DEPRECATED(effIdle), 0, 0, 0, 0);
-
-                    if (!idle_started)
-                    {
-                        unsigned idle_run = BUFFER_SIZE * 200;
-
-                        while (idle_run)
-                        {
-                            unsigned sampleFrames = min(idle_run, BUFFER_SIZE);
-
-                            pEffect->processReplacing(pEffect, float_list_in, float_list_out, sampleFrames);
-
-                            pEffect->dispatcher(pEffect, DECLARE_VST_DEPRECATED(effIdle), 0, 0, 0, 0);
-
-                            idle_run -= sampleFrames;
-                        }
-                    }
-                }
-
-                VstEvents* events = 0;
-
-                if (evChain)
-                {
-                    unsigned event_count = 0;
-                    MidiEvent* ev = evChain;
-                    while (ev)
-                    {
-                        ++event_count;
-                        ev = ev->next;
-                    }
-
-                    if (event_count > 0)
-                    {
-                        events = (VstEvents*)malloc(sizeof(VstInt32) + sizeof(VstIntPtr) + sizeof(VstEvent*) * event_count);
-
-                        events->numEvents = event_count;
-                        events->reserved = 0;
-
-                        ev = evChain;
-
-                        for (size_t i = 0; ev;)
-                        {
-                            if (ev->port == 0)
-                            {
-                                events->events[i++] = (VstEvent*)&ev->ev;
-                            }
-                            ev = ev->next;
-                        }
-
-                        pEffect->dispatcher(pEffect, AEffectXOpcodes::effProcessEvents, 0, 0, events, 0);
-                    }
-                }
-
-                if (need_idle)
-                {
-                    pEffect->dispatcher(pEffect, DECLARE_VST_DEPRECATED(effIdle), 0, 0, 0, 0);
-
-                    if (!idle_started)
-                    {
-                        if (events)
-                        {
-                            pEffect->dispatcher(pEffect, AEffectXOpcodes::effProcessEvents, 0, 0, events, 0);
-                        }
-
-                        idle_started = true;
-                    }
-                }
-
-                uint32_t count = ReceiveData();
-
-                SendData(0u);
-
-                while (count)
-                {
-                    unsigned sampleFrames = min(count, BUFFER_SIZE);
-
-                    pEffect->processReplacing(pEffect, float_list_in, float_list_out, sampleFrames);
-
-                    float* out = sample_buffer.data();
-
-                    if (audioOutputs == 2)
-                    {
-                        for (size_t i = 0; i < sampleFrames; ++i)
-                        {
-                            out[0] = float_out[i];
-                            out[1] = float_out[i + BUFFER_SIZE];
-                            out += 2;
-                        }
-                    }
-                    else
-                    {
-                        for (size_t i = 0; i < sampleFrames; ++i)
-                        {
-                            out[0] = float_out[i];
-                            ++out;
-                        }
-                    }
-
-                    SendData(sample_buffer.data(), sampleFrames * sizeof(float) * audioOutputs);
-
-                    count -= sampleFrames;
-                }
-
-                if (events)
-                {
-                    free(events);
-                }
-
-                FreeMidiEventChain();
-            }
-            break;
-
-            default:
-                code = Response::CommandUnknown;
-                goto exit;
-                break;
-        }
-    }
-
-exit:
-
-    if (pEffect)
-    {
-        if (blState.size())
-        {
-            pEffect->dispatcher(pEffect, AEffectXOpcodes::effStopProcess, 0, 0, 0, 0);
-        }
-
-        pEffect->dispatcher(pEffect, AEffectOpcodes::effClose, 0, 0, 0, 0);
-    }
-
-    FreeMidiEventChain();
-
-    if (vstiDll)
-    {
-        FreeLibrary(vstiDll);
-    }
-
-    CoUninitialize();
-
-    if (dll_dir)
-    {
-        free(dll_dir);
-    }
-
-    if (argv)
-    {
-        LocalFree(argv);
-    }
-
-    SendData(code);
-
-    if (null_file)
-    {
-        CloseHandle(null_file);
-
-        SetStdHandle(STD_INPUT_HANDLE, pipe_in);
-        SetStdHandle(STD_OUTPUT_HANDLE, pipe_out);
-    }
-
-    return code;
+// vsthost.cpp : Defines the entry point for the console application.
+//
+
+#include "stdafx.h"
+#include <string>
+#include "../common/shared_audio.h"
+#include "../common/midi_events.h"
+#include "../common/pipe_transport.h"
+#include "../common/channel.h"
+#include "../common/wait_policy.h"
+#include "../common/capture.h"
+
+// #define LOG_EXCHANGE
+
+using std::vector;
+
+enum
+{
+    /// <summary>
+    /// The largest and the default render block size, and the smallest one the VST driver can ask for
+    /// </summary>
+    BUFFER_SIZE = 4096,
+    MIN_BUFFER_SIZE = 16,
+};
+
+enum Command : uint32_t
+{
+    GetChunkData = 1,
+    SetChunkData = 2,
+    HasEditor = 3,
+    DisplayEditorModal = 4,
+    SetSampleRate = 5,
+    Reset = 6,
+    SendMidiEvent = 7,
+    SendMidiSystemExclusiveEvent = 8,
+    RenderAudioSamples = 9,
+    OpenSharedAudio = 10,
+    Negotiate = 11,
+    OpenControlChannel = 12,
+    SetSubBlockSplit = 13,
+    StartBackgroundIdle = 14,
+    SetBlockSize = 15,
+};
+
+enum Response : uint32_t
+{
+    NoError = 0,
+    CannotLoadVstiDll = 6,
+    CannotGetProcAddress = 7,
+    NotAVsti = 8,
+    CannotReset = 8,
+    VstiIsNotAMidiSynth = 9,
+    CannotSetSampleRate = 10,
+    CannotRenderAudioSamples = 11,
+    CommandUnknown = 12,
+    CannotOpenSharedAudio = 13,
+    CannotOpenControlChannel = 14,
+    CannotSetSubBlockSplit = 15,
+    CannotStartBackgroundIdle = 16,
+    CannotSetBlockSize = 17,
+};
+
+enum Error : uint32_t
+{
+    InvalidCommandLineArguments = 1,
+    MalformedChecksum = 2,
+    ChecksumMismatch = 3,
+    Comctl32LoadFailed = 4,
+    ComStaInitializationFailed = 5,
+    CannotOpenCapture = 6,
+};
+
+/// <summary>
+/// VSTi MIDI event and VSTi Midi System Exclusive Event
+/// </summary>
+struct MidiEvent
+{
+    unsigned port;
+    union
+    {
+        VstMidiEvent midiEvent;
+        VstMidiSysexEvent sysexEvent;
+    } ev;
+};
+
+bool need_idle = false;
+bool idle_started = false;
+
+static char* dll_dir = NULL;
+
+static HANDLE null_file = NULL;
+static HANDLE pipe_in = NULL;
+static HANDLE pipe_out = NULL;
+
+/// <summary>
+/// The connection to the VST driver
+/// </summary>
+static PipeTransport transport;
+
+/// <summary>
+/// Plays a session captured by the VST driver instead of the pipes, with /replay
+/// </summary>
+static CaptureLog captureLog;
+static ReplayTransport replayTransport;
+
+/// <summary>
+/// Buffers the I/O on the transport, the replies are flushed before the next command is read
+/// </summary>
+static BufferedChannel channel;
+
+/// <summary>
+/// The capabilities negotiated with the VST driver
+/// </summary>
+static uint32_t capabilities = 0;
+
+/// <summary>
+/// The shared audio ring which receives the rendered audio instead of the pipe output
+/// </summary>
+static SharedAudioRing sharedAudio;
+
+/// <summary>
+/// The wait for the next command, it spins for the next render request when the SpinWait capability is negotiated
+/// </summary>
+static SpinWaitPolicy commandWait;
+
+/// <summary>
+/// The number of render requests served
+/// </summary>
+static LONG renderRequests = 0;
+
+/// <summary>
+/// The payloads of the pending MIDI System Exclusive events.
+/// Payloads are carved out of reusable chunks and all of them are recycled at once when the events are freed.
+/// </summary>
+static class SysExArena
+{
+private:
+    static const size_t chunkSize = 65536;
+
+    vector<vector<uint8_t>> chunks;
+    size_t chunk = 0;
+    size_t used = 0;
+
+    /// <summary>
+    /// The payloads which are larger than a chunk
+    /// </summary>
+    vector<vector<uint8_t>> oversized;
+
+public:
+    /// <summary>
+    /// Get storage for a payload, valid until Recycle
+    /// </summary>
+    /// <param name="size">The size of the payload</param>
+    /// <returns>The storage</returns>
+    char* Allocate(size_t size)
+    {
+        if (size > chunkSize)
+        {
+            oversized.emplace_back(size);
+            return (char*)oversized.back().data();
+        }
+
+        if (chunks.empty() || used + size > chunkSize)
+        {
+            if (!chunks.empty())
+            {
+                ++chunk;
+                used = 0;
+            }
+            if (chunk == chunks.size())
+            {
+                chunks.emplace_back(chunkSize);
+            }
+        }
+
+        char* storage = (char*)chunks[chunk].data() + used;
+        used += (size + 7) & ~(size_t)7;
+        return storage;
+    }
+
+    /// <summary>
+    /// Make all the storage available again, the chunks are kept for the next render
+    /// </summary>
+    void Recycle()
+    {
+        chunk = 0;
+        used = 0;
+        oversized.clear();
+    }
+} sysExArena;
+
+/// <summary>
+/// The pending MIDI events of the next render, in a contiguous pool, and the VstEvents array which passes them to the VSTi.
+/// Both grow geometrically and keep their storage, so a render in steady state does not allocate.
+/// </summary>
+static class MidiEventPool
+{
+private:
+    static const size_t initialCapacity = 1024;
+
+    vector<MidiEvent> events;
+
+    /// <summary>
+    /// The VstEvents array, its events member is sized for the pending events
+    /// </summary>
+    vector<uint8_t> vstEvents;
+
+public:
+    MidiEventPool()
+    {
+        events.reserve(initialCapacity);
+        vstEvents.resize(offsetof(VstEvents, events) + sizeof(VstEvent*) * initialCapacity);
+    }
+
+    bool IsEmpty() const
+    {
+        return events.empty();
+    }
+
+    /// <summary>
+    /// Append a new event, valid until the next Append or Clear
+    /// </summary>
+    /// <param name="port">The port of the event</param>
+    /// <returns>The new event</returns>
+    MidiEvent* Append(unsigned port)
+    {
+        /// The new event is value initialized, all zero
+        events.emplace_back();
+        MidiEvent* ev = &events.back();
+
+        /// To Do - Limit the midi ports to one per host
+        ev->port = port;
+        if (ev->port > 2)
+        {
+            ev->port = 2;
+        }
+
+        return ev;
+    }
+
+    size_t GetCount() const
+    {
+        return events.size();
+    }
+
+    /// <summary>
+    /// Get the frame offset of a pending event within the rendered block
+    /// </summary>
+    uint32_t GetOffset(size_t index) const
+    {
+        return events[index].ev.midiEvent.deltaFrames;
+    }
+
+    /// <summary>
+    /// Sort the pending events by their frame offset, events with the same offset keep their order.
+    /// The events of a batch arrive sorted already, so this is mostly a single pass.
+    /// </summary>
+    void SortByOffset()
+    {
+        for (size_t i = 1; i < events.size(); ++i)
+        {
+            if (GetOffset(i - 1) <= GetOffset(i))
+            {
+                continue;
+            }
+
+            MidiEvent ev = events[i];
+            size_t j = i;
+            while (j && GetOffset(j - 1) > ev.ev.midiEvent.deltaFrames)
+            {
+                events[j] = events[j - 1];
+                --j;
+            }
+            events[j] = ev;
+        }
+    }
+
+    /// <summary>
+    /// Fill the VstEvents array with pending events of a port
+    /// </summary>
+    /// <param name="port">The port played by the VSTi</param>
+    /// <param name="first">The index of the first event</param>
+    /// <param name="last">The index after the last event</param>
+    /// <returns>The array, NULL when no event is pending for the port</returns>
+    VstEvents* GetVstEvents(unsigned port, size_t first = 0, size_t last = SIZE_MAX)
+    {
+        last = min(last, events.size());
+
+        size_t size = offsetof(VstEvents, events) + sizeof(VstEvent*) * (last - first);
+        if (vstEvents.size() < size)
+        {
+            vstEvents.resize(max(size, vstEvents.size() * 2));
+        }
+
+        VstEvents* out = (VstEvents*)vstEvents.data();
+        VstInt32 count = 0;
+
+        for (size_t i = first; i < last; ++i)
+        {
+            if (events[i].port == port)
+            {
+                out->events[count++] = (VstEvent*)&events[i].ev;
+            }
+        }
+
+        if (!count)
+        {
+            return NULL;
+        }
+
+        out->numEvents = count;
+        out->reserved = 0;
+
+        return out;
+    }
+
+    /// <summary>
+    /// Remove the pending events, the storage is kept for the next render
+    /// </summary>
+    void Clear()
+    {
+        events.clear();
+        sysExArena.Recycle();
+    }
+} midiEventPool;
+
+/// <summary>
+/// The counters of the sub-block splitting
+/// </summary>
+struct SplitStatistics
+{
+    enum : uint32_t
+    {
+        Buckets = 17,
+    };
+
+    uint64_t blocks;
+    uint64_t splits;
+    /// <summary>
+    /// Bucket i counts the blocks split i times, the last bucket also counts the blocks split more often
+    /// </summary>
+    uint64_t splitsPerBlock[Buckets];
+};
+
+/// <summary>
+/// Splits the processReplacing calls of a block at the frame offsets of its events, for a VSTi which ignores deltaFrames
+/// and applies every event at the start of the block it receives. Each sub-block gets the events which are due in it.
+/// Events closer than the minimum sub-block size to the start of a sub-block are played with it, to bound the overhead.
+/// </summary>
+static class SubBlockSplitter
+{
+private:
+    uint32_t minimumFrames = 0;
+
+    /// <summary>
+    /// The next pending event and the frame the next sub-block starts at
+    /// </summary>
+    size_t next = 0;
+    uint32_t position = 0;
+    uint32_t splits = 0;
+
+    SplitStatistics statistics = {};
+
+public:
+    /// <summary>
+    /// Set the minimum sub-block size
+    /// </summary>
+    /// <param name="minimumFrames">The minimum sub-block size in frames, 0 turns the splitting off</param>
+    void SetMinimumFrames(uint32_t minimumFrames)
+    {
+        this->minimumFrames = minimumFrames;
+    }
+
+    bool IsEnabled() const
+    {
+        return minimumFrames != 0;
+    }
+
+    /// <summary>
+    /// Start a block, after all its events were added
+    /// </summary>
+    void BeginBlock()
+    {
+        midiEventPool.SortByOffset();
+        next = 0;
+        position = 0;
+        splits = 0;
+    }
+
+    /// <summary>
+    /// Pass the events of the next sub-block to the VSTi
+    /// </summary>
+    /// <param name="effect">The VSTi</param>
+    /// <param name="maxFrames">The most frames the next processReplacing call can render</param>
+    /// <returns>The length of the sub-block</returns>
+    unsigned Next(AEffect* effect, unsigned maxFrames)
+    {
+        uint32_t end = position + maxFrames;
+        size_t last = next;
+        size_t count = midiEventPool.GetCount();
+
+        /// deltaFrames must stay within the sub-block, even when the minimum sub-block size is larger than the block size
+        uint32_t merged = min(position + minimumFrames, end);
+
+        while (last < count && midiEventPool.GetOffset(last) < merged)
+        {
+            ++last;
+        }
+
+        if (last < count && midiEventPool.GetOffset(last) < end)
+        {
+            end = midiEventPool.GetOffset(last);
+            ++splits;
+        }
+
+        VstEvents* events = midiEventPool.GetVstEvents(0, next, last);
+        if (events)
+        {
+            /// deltaFrames is relative to the sub-block now
+            for (VstInt32 i = 0; i < events->numEvents; ++i)
+            {
+                events->events[i]->deltaFrames = events->events[i]->deltaFrames > (VstInt32)position ? events->events[i]->deltaFrames - position : 0;
+            }
+
+            effect->dispatcher(effect, AEffectXOpcodes::effProcessEvents, 0, 0, events, 0);
+        }
+
+        unsigned frames = end - position;
+        next = last;
+        position = end;
+
+        return frames;
+    }
+
+    /// <summary>
+    /// Count the splits of the finished block
+    /// </summary>
+    void EndBlock()
+    {
+        ++statistics.blocks;
+        statistics.splits += splits;
+        ++statistics.splitsPerBlock[min(splits, (uint32_t)SplitStatistics::Buckets - 1)];
+    }
+
+    void GetStatistics(SplitStatistics& out) const
+    {
+        out = statistics;
+    }
+} subBlockSplitter;
+
+/// <summary>
+/// Append a MIDI event to the pending events
+/// </summary>
+/// <param name="port">The port of the event</param>
+/// <param name="message">The MIDI message</param>
+/// <param name="deltaFrames">The frame offset of the event within the next rendered block</param>
+void AddMidiEvent(unsigned port, uint32_t message, uint32_t deltaFrames = 0)
+{
+    MidiEvent* ev = midiEventPool.Append(port);
+    ev->ev.midiEvent.type = VstEventTypes::kVstMidiType;
+    ev->ev.midiEvent.byteSize = sizeof(ev->ev.midiEvent);
+    ev->ev.midiEvent.deltaFrames = deltaFrames;
+    memcpy(&ev->ev.midiEvent.midiData, &message, 3);
+}
+
+/// <summary>
+/// Append a MIDI System Exclusive event to the pending events
+/// </summary>
+/// <param name="port">The port of the event</param>
+/// <param name="size">The size of the System Exclusive message, the caller fills in the data</param>
+/// <param name="deltaFrames">The frame offset of the event within the next rendered block</param>
+/// <returns>The new event</returns>
+MidiEvent* AddSysExEvent(unsigned port, uint32_t size, uint32_t deltaFrames = 0)
+{
+    MidiEvent* ev = midiEventPool.Append(port);
+    ev->ev.sysexEvent.type = VstEventTypes::kVstSysExType;
+    ev->ev.sysexEvent.byteSize = sizeof(ev->ev.sysexEvent);
+    ev->ev.sysexEvent.deltaFrames = deltaFrames;
+    ev->ev.sysexEvent.dumpBytes = size;
+    ev->ev.sysexEvent.sysexDump = sysExArena.Allocate(size);
+    return ev;
+}
+
+/// <summary>
+/// Append all the events of a batch, received along with a render request, to the pending events
+/// </summary>
+/// <param name="batch">The received batch</param>
+/// <param name="frames">The number of frames of the render request</param>
+void AddMidiEventBatch(vector<uint8_t> const& batch, uint32_t frames)
+{
+    MidiEventReader reader(batch.data(), batch.size());
+
+    uint32_t port;
+    uint32_t message;
+    const uint8_t* sysEx;
+    uint32_t length;
+    uint32_t offset;
+
+    while (reader.Next(port, message, sysEx, length, offset))
+    {
+        /// deltaFrames must lie within the block passed to processReplacing
+        if (offset >= frames)
+        {
+            offset = frames ? frames - 1 : 0;
+        }
+
+        if (sysEx)
+        {
+            MidiEvent* ev = AddSysExEvent(port, length, offset);
+            memcpy(ev->ev.sysexEvent.sysexDump, sysEx, length);
+        }
+        else
+        {
+            AddMidiEvent(port, message, offset);
+        }
+    }
+}
+
+#ifdef LOG_EXCHANGE
+unsigned exchange_count = 0;
+#endif
+
+/// <summary>
+/// Send data to the VST driver via the pipe output 
+/// </summary>
+/// <param name="data">The data to send</param>
+/// <param name="size">The size of the data</param>
+void SendData(const void* data, uint32_t size)
+{
+    if (size)
+    {
+        channel.Write(data, size);
+#ifdef LOG_EXCHANGE
+        TCHAR logfile[MAX_PATH];
+        _stprintf_s(logfile, _T("C:\\temp\\log\\bytes_%08u.out"), ++exchange_count);
+        FILE* f = _tfopen(logfile, _T("wb"));
+        fwrite(data, 1, size, f);
+        fclose(f);
+#endif
+    }
+}
+
+/// <summary>
+/// Send data to the VST driver via the pipe output 
+/// </summary>
+/// <param name="data">The data to send</param>
+void SendData(uint32_t data)
+{
+    SendData(&data, sizeof(data));
+}
+
+/// <summary>
+/// Send data to the VST driver via the pipe output 
+/// </summary>
+/// <param name="data">The data to send</param>
+void SendData(const char* data)
+{
+    SendData(data, strlen(data));
+}
+
+/// <summary>
+/// Send data to the VST driver via the pipe output 
+/// </summary>
+/// <param name="data">The data to send</param>
+void SendData(vector<uint8_t> data)
+{
+    SendData(data.data(), data.size());
+}
+
+/// <summary>
+/// Receive data from the VST driver via the pipe input
+/// </summary>
+/// <param name="data">The received data</param>
+/// <param name="size">The size of the data</param>
+void ReceiveData(void* data, uint32_t size)
+{
+    if (channel.Read(data, size))
+    {
+#ifdef LOG_EXCHANGE
+        TCHAR logfile[MAX_PATH];
+        _stprintf_s(logfile, _T("C:\\temp\\log\\bytes_%08u.in"), ++exchange_count);
+        FILE* f = _tfopen(logfile, _T("wb"));
+        fwrite(data, 1, size, f);
+        fclose(f);
+#endif
+    }
+    else
+    {
+        memset(data, 0, size);
+#ifdef LOG_EXCHANGE
+        TCHAR logfile[MAX_PATH];
+        _stprintf_s(logfile, _T("C:\\temp\\log\\bytes_%08u.err"), ++exchange_count);
+        FILE* f = _tfopen(logfile, _T("wb"));
+        _ftprintf(f, _T("Wanted %u bytes, the pipe is broken"), size);
+        fclose(f);
+#endif
+    }
+}
+
+/// <summary>
+/// Receive data from the VST driver via the pipe input
+/// </summary>
+uint32_t ReceiveData()
+{
+    uint32_t data;
+    ReceiveData(&data, sizeof(data));
+    return data;
+}
+
+void GetChunk(AEffect* pEffect, vector<uint8_t>& out)
+{
+    out.resize(0);
+    uint32_t unique_id = pEffect->uniqueID;
+    append_be(out, unique_id);
+    bool type_chunked = !!(pEffect->flags & VstAEffectFlags::effFlagsProgramChunks);
+    append_be(out, type_chunked);
+    if (!type_chunked)
+    {
+        uint32_t num_params = pEffect->numParams;
+        append_be(out, num_params);
+        for (unsigned i = 0; i < num_params; ++i)
+        {
+            float parameter = pEffect->getParameter(pEffect, i);
+            append_be(out, parameter);
+        }
+    }
+    else
+    {
+        void* chunk;
+        uint32_t size = pEffect->dispatcher(pEffect, AEffectOpcodes::effGetChunk, 0, 0, &chunk, 0);
+        append_be(out, size);
+        size_t chunk_size = out.size();
+        out.resize(chunk_size + size);
+        memcpy(&out[chunk_size], chunk, size);
+    }
+}
+
+void SetChunk(AEffect* pEffect, vector<uint8_t> const& in)
+{
+    unsigned size = in.size();
+    if (pEffect && size)
+    {
+        const uint8_t* inc = in.data();
+        uint32_t effect_id;
+        retrieve_be(effect_id, inc, size);
+        if (effect_id != pEffect->uniqueID)
+        {
+            return;
+        }
+
+        bool type_chunked;
+        retrieve_be(type_chunked, inc, size);
+
+        if (type_chunked != !!(pEffect->flags & VstAEffectFlags::effFlagsProgramChunks))
+        {
+            return;
+        }
+
+        if (!type_chunked)
+        {
+            uint32_t num_params;
+            retrieve_be(num_params, inc, size);
+            if (num_params != pEffect->numParams)
+            {
+                return;
+            }
+            for (unsigned i = 0; i < num_params; ++i)
+            {
+                float parameter;
+                retrieve_be(parameter, inc, size);
+                pEffect->setParameter(pEffect, i, parameter);
+            }
+        }
+        else
+        {
+            uint32_t chunk_size;
+            retrieve_be(chunk_size, inc, size);
+            if (chunk_size > size)
+            {
+                return;
+            }
+            pEffect->dispatcher(pEffect, AEffectOpcodes::effSetChunk, 0, chunk_size, (void*)inc, 0);
+        }
+    }
+}
+
+struct MyDLGTEMPLATE : DLGTEMPLATE
+{
+    WORD ext[3];
+    MyDLGTEMPLATE()
+    {
+        memset(this, 0, sizeof(*this));
+    };
+};
+
+INT_PTR CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    AEffect* effect;
+    switch (uMsg)
+    {
+        case WM_INITDIALOG:
+        {
+            SetWindowLongPtr(hwnd, GWLP_USERDATA, lParam);
+            SetWindowText(hwnd, L"VST Host");
+            SetTimer(hwnd, 1, 20, 0);
+            effect = (AEffect*)lParam;
+            if (effect)
+            {
+                char product[VstStringConstants::kVstMaxProductStrLen] = { 0 };
+                effect->dispatcher(effect, AEffectXOpcodes::effGetProductString, 0, 0, &product, 0);
+
+                SetWindowTextA(hwnd, (LPCSTR)product);
+
+                effect->dispatcher(effect, AEffectOpcodes::effEditOpen, 0, 0, hwnd, 0);
+                ERect* eRect = 0;
+                effect->dispatcher(effect, AEffectOpcodes::effEditGetRect, 0, 0, &eRect, 0);
+                if (eRect)
+                {
+                    int width = eRect->right - eRect->left;
+                    int height = eRect->bottom - eRect->top;
+                    if (width < 50)
+                    {
+                        width = 50;
+                    }
+                    if (height < 50)
+                    {
+                        height = 50;
+                    }
+                    RECT wRect;
+                    SetRect(&wRect, 0, 0, width, height);
+                    AdjustWindowRectEx(&wRect, GetWindowLong(hwnd, GWL_STYLE), FALSE, GetWindowLong(hwnd, GWL_EXSTYLE));
+                    width = wRect.right - wRect.left;
+                    height = wRect.bottom - wRect.top;
+                    SetWindowPos(hwnd, HWND_TOP, 0, 0, width, height, SWP_SHOWWINDOW | SWP_NOMOVE);
+                }
+            }
+        }
+        break;
+
+        case WM_TIMER:
+            effect = (AEffect*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+            if (effect)
+            {
+                effect->dispatcher(effect, AEffectOpcodes::effEditIdle, 0, 0, 0, 0);
+            }
+            break;
+
+        case WM_CLOSE:
+        {
+            effect = (AEffect*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+            KillTimer(hwnd, 1);
+            if (effect)
+            {
+                effect->dispatcher(effect, AEffectOpcodes::effEditClose, 0, 0, 0, 0);
+            }
+
+            EndDialog(hwnd, IDOK);
+        }
+        break;
+    }
+
+    return 0;
+}
+
+struct audioMasterData
+{
+    VstIntPtr effect_number;
+};
+
+static VstIntPtr VSTCALLBACK audioMaster(AEffect* effect, VstInt32 opcode, VstInt32 index, VstIntPtr value, void* ptr, float opt)
+{
+    audioMasterData* data = NULL;
+    if (effect)
+    {
+        data = (audioMasterData*)effect->user;
+    }
+
+    switch (opcode)
+    {
+        case AudioMasterOpcodes::audioMasterAutomate:
+            /// The user changed a parameter in plug-ins editor, which is out of the Host's control.
+            /// This ensures that the Host is notified of the parameter change, which
+            /// allows it to record these changes for automation.
+            /// [index]: parameter index
+            /// [opt]: parameter value
+            /// @see AudioEffect::setParameterAutomated
+            break;
+
+        case AudioMasterOpcodes::audioMasterVersion:
+            /// Used to ask for the Host's version
+            /// [return value]: Host VST version (for example 2400 for VST 2.4)
+            /// @see AudioEffect::getMasterVersion
+            return kVstVersion;
+
+        case AudioMasterOpcodes::audioMasterCurrentId:
+            /// [return value]: current unique identifier on shell plug-in
+            /// @see AudioEffect::getCurrentUniqueId
+            if (data)
+            {
+                return data->effect_number;
+            }
+            break;
+
+        case AudioMasterOpcodes::audioMasterIdle:
+            /// Give idle time to Host application, e.g. if plug-in editor is doing mouse tracking in a modal loop.
+            /// no arguments
+            /// @see AudioEffect::masterIdle
+            break;
+
+        case AudioMasterOpcodes::audioMasterPinConnected:
+            /// [return value]: 0=true, 1=false
+            /// [index]: pin index
+            /// [value]: 0=input, 1=output
+            /// @see AudioEffect::isInputConnected
+            /// @see AudioEffect::isOutputConnected
+            break;
+
+        case AudioMasterOpcodesX::audioMasterGetVendorString:
+            /// [ptr]: char buffer for vendor string, limited to #kVstMaxVendorStrLen
+            /// @see AudioEffectX::getHostVendorString
+            strncpy((char*)ptr, "NoWork, Inc.", VstStringConstants::kVstMaxVendorStrLen);
+            //strncpy((char *)ptr, "YAMAHA", 64);
+            break;
+
+        case AudioMasterOpcodesX::audioMasterGetProductString:
+            /// [ptr]: char buffer for vendor string, limited to #kVstMaxProductStrLen
+            /// @see AudioEffectX::getHostProductString
+            strncpy((char*)ptr, "VSTi Host Bridge", VstStringConstants::kVstMaxProductStrLen);
+            //strncpy((char *)ptr, "SOL/SQ01", 64);
+            break;
+
+        case AudioMasterOpcodesX::audioMasterGetVendorVersion:
+            /// [return value]: vendor-specific version
+            /// @see AudioEffectX::getHostVendorVersion
+            return 1010;
+
+        case AudioMasterOpcodesX::audioMasterGetLanguage:
+            /// [return value]: language code
+            /// @see VstHostLanguage
+            return VstHostLanguage::kVstLangEnglish;
+
+        case AudioMasterOpcodesX::audioMasterVendorSpecific:
+            /// no definition, vendor specific handling
+            /// @see AudioEffectX::hostVendorSpecific
+            /* Steinberg HACK */
+            if (ptr)
+            {
+                uint32_t* blah = (uint32_t*)(((char*)ptr) - 4);
+                if (*blah == 0x0737bb68)
+                {
+                    *blah ^= 0x5CC8F349;
+                    blah[2] = 0x19E;
+                    return 0x1E7;
+                }
+            }
+            break;
+
+        case AudioMasterOpcodesX::audioMasterGetDirectory:
+            /// [return value]: FSSpec on 32 bit MAC, else char*
+            /// @see AudioEffectX::getDirectory
+            return (VstIntPtr)dll_dir;
+
+            /* More crap */
+        case DECLARE_VST_DEPRECATED(audioMasterNeedIdle):
+            need_idle = true;
+            return 0;
+    }
+
+    return 0;
+}
+
+LONG __stdcall myExceptFilterProc(LPEXCEPTION_POINTERS param)
+{
+    if (IsDebuggerPresent())
+    {
+        return UnhandledExceptionFilter(param);
+    }
+    else
+    {
+        //DumpCrashInfo( param );
+        TerminateProcess(GetCurrentProcess(), 0);
+        return 0;// never reached
+    }
+}
+
+#pragma comment(lib, "Winmm")
+
+LPTIMECALLBACK TimeProc(UINT uTimerID, UINT uMsg, DWORD_PTR dwUser, DWORD_PTR dw1, DWORD_PTR dw2)
+{
+    MyDLGTEMPLATE vstiEditor;
+    AEffect* pEffect = (AEffect*)dwUser;
+    vstiEditor.style = WS_POPUPWINDOW | WS_DLGFRAME | WS_MINIMIZEBOX | WS_SYSMENU | WS_CAPTION | DS_MODALFRAME | DS_CENTER;
+    DialogBoxIndirectParam(0, &vstiEditor, 0, (DLGPROC)WindowProc, (LPARAM)pEffect);
+    return 0;
+}
+
+static main_func pMain = NULL;
+static AEffect* pEffect = NULL;
+static audioMasterData effectData = { 0 };
+
+/// <summary>
+/// The processing state, it is set up by the first render request after the VSTi is (re)created
+/// </summary>
+static vector<uint8_t> blState;
+
+/// <summary>
+/// The block size passed to effSetBlockSize, the buffers are sized for it and processReplacing never renders more frames
+/// </summary>
+static uint32_t blockSize = BUFFER_SIZE;
+
+/// <summary>
+/// The input and output buffers of processReplacing, in blState
+/// </summary>
+static float** float_list_in;
+static float** float_list_out;
+static float* float_null;
+static float* float_out;
+
+/// <summary>
+/// The last settings set by the VST driver, they are restored when the VSTi is recreated
+/// </summary>
+static vector<uint8_t> chunk;
+
+/// <summary>
+/// Serializes the access to the VSTi between the render pipe and the control lane
+/// </summary>
+static CRITICAL_SECTION effectLock;
+
+class EffectLock
+{
+public:
+    EffectLock()
+    {
+        EnterCriticalSection(&effectLock);
+    }
+
+    ~EffectLock()
+    {
+        LeaveCriticalSection(&effectLock);
+    }
+};
+
+/// <summary>
+/// The control lane, chunk, editor and reset requests are served between render requests
+/// </summary>
+static PipeTransport controlTransport;
+static BufferedChannel controlChannel;
+static HANDLE hControlThread = NULL;
+
+/// <summary>
+/// Close the VSTi and create it again with the last settings
+/// </summary>
+/// <returns>Response::NoError on success</returns>
+uint32_t ResetEffect()
+{
+    if (blState.size())
+    {
+        pEffect->dispatcher(pEffect, AEffectXOpcodes::effStopProcess, 0, 0, 0, 0);
+    }
+    pEffect->dispatcher(pEffect, AEffectOpcodes::effClose, 0, 0, 0, 0);
+
+    blState.resize(0);
+
+    midiEventPool.Clear();
+
+    pEffect = pMain(&audioMaster);
+    if (!pEffect)
+    {
+        return Response::CannotReset;
+    }
+    pEffect->user = &effectData;
+    pEffect->dispatcher(pEffect, AEffectOpcodes::effOpen, 0, 0, 0, 0);
+    SetChunk(pEffect, chunk);
+
+    return Response::NoError;
+}
+
+/// <summary>
+/// Set up the processing state and start processing
+/// </summary>
+/// <param name="sampleRate">The sample rate</param>
+/// <param name="audioOutputs">The number of VSTi audio outputs which are used</param>
+void StartProcessing(uint32_t sampleRate, uint32_t audioOutputs)
+{
+    pEffect->dispatcher(pEffect, AEffectOpcodes::effSetSampleRate, 0, 0, 0, float(sampleRate));
+    pEffect->dispatcher(pEffect, AEffectOpcodes::effSetBlockSize, 0, blockSize, 0, 0);
+    pEffect->dispatcher(pEffect, AEffectOpcodes::effMainsChanged, 0, 1, 0, 0);
+    pEffect->dispatcher(pEffect, AEffectXOpcodes::effStartProcess, 0, 0, 0, 0);
+
+    size_t buffer_size = sizeof(float*) * (pEffect->numInputs + audioOutputs * 3);   // float lists (inputs + outputs)
+    buffer_size += sizeof(float) * blockSize;                                         // null input
+    buffer_size += sizeof(float) * blockSize * audioOutputs * 3;                      // outputs
+
+    blState.resize(buffer_size);
+
+    float_list_in = (float**)blState.data();
+    float_list_out = float_list_in + pEffect->numInputs;
+    float_null = (float*)(float_list_out + audioOutputs * 3);
+    float_out = float_null + blockSize;
+
+    for (unsigned i = 0; i < pEffect->numInputs; ++i)
+    {
+        float_list_in[i] = float_null;
+    }
+    for (unsigned i = 0; i < audioOutputs * 3; ++i)
+    {
+        float_list_out[i] = float_out + blockSize * i;
+    }
+
+    memset(float_null, 0, sizeof(float) * blockSize);
+}
+
+/// <summary>
+/// The idle thread warms up the VSTi before the first render request and idles it periodically afterwards.
+/// It runs at a low priority and takes the effect lock for every step, so it only runs between requests.
+/// </summary>
+static HANDLE hIdleThread = NULL;
+static HANDLE hIdleExit = NULL;
+
+static struct IdleSettings
+{
+    uint32_t sampleRate;
+    uint32_t audioOutputs;
+    /// <summary>
+    /// The time between two effIdle calls in milliseconds
+    /// </summary>
+    uint32_t interval;
+} idleSettings;
+
+DWORD WINAPI IdleThreadProc(LPVOID lpParameter)
+{
+    /// The warm-up renders into the void, it ends when the first render request arrives
+    unsigned idle_run = BUFFER_SIZE * 200;
+
+    while (idle_run && WaitForSingleObject(hIdleExit, 0) == WAIT_TIMEOUT)
+    {
+        EffectLock lock;
+
+        if (!pEffect || !need_idle || idle_started || renderRequests)
+        {
+            break;
+        }
+
+        if (!blState.size())
+        {
+            StartProcessing(idleSettings.sampleRate, idleSettings.audioOutputs);
+        }
+
+        unsigned sampleFrames = min(idle_run, blockSize);
+
+        pEffect->processReplacing(pEffect, float_list_in, float_list_out, sampleFrames);
+
+        pEffect->dispatcher(pEffect, DECLARE_VST_DEPRECATED(effIdle), 0, 0, 0, 0);
+
+        idle_run -= sampleFrames;
+        if (!idle_run)
+        {
+            idle_started = true;
+        }
+    }
+
+    while (WaitForSingleObject(hIdleExit, idleSettings.interval) == WAIT_TIMEOUT)
+    {
+        EffectLock lock;
+
+        if (need_idle && pEffect)
+        {
+            pEffect->dispatcher(pEffect, DECLARE_VST_DEPRECATED(effIdle), 0, 0, 0, 0);
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Stop the idle thread, the caller must not hold the effect lock
+/// </summary>
+void StopIdleThread()
+{
+    if (hIdleThread)
+    {
+        SetEvent(hIdleExit);
+        WaitForSingleObject(hIdleThread, INFINITE);
+        CloseHandle(hIdleThread);
+        hIdleThread = NULL;
+    }
+    if (hIdleExit)
+    {
+        CloseHandle(hIdleExit);
+        hIdleExit = NULL;
+    }
+}
+
+/// <summary>
+/// Execute a request received on the control lane
+/// </summary>
+/// <param name="command">The command</param>
+/// <param name="request">The payload of the request</param>
+/// <param name="reply">The payload of the reply</param>
+/// <returns>The status of the reply</returns>
+uint32_t ExecuteControlCommand(uint32_t command, vector<uint8_t> const& request, vector<uint8_t>& reply)
+{
+    EffectLock lock;
+
+    switch (command)
+    {
+        case Command::GetChunkData:
+            GetChunk(pEffect, reply);
+            return Response::NoError;
+
+        case Command::SetChunkData:
+            chunk = request;
+            SetChunk(pEffect, chunk);
+            return Response::NoError;
+
+        case Command::HasEditor:
+        {
+            uint32_t hasEditor = pEffect->flags & VstAEffectFlags::effFlagsHasEditor;
+            reply.resize(sizeof(hasEditor));
+            memcpy(reply.data(), &hasEditor, sizeof(hasEditor));
+        }
+        return Response::NoError;
+
+        case Command::DisplayEditorModal:
+            if (pEffect->flags & VstAEffectFlags::effFlagsHasEditor)
+            {
+                timeSetEvent(100, 10, (LPTIMECALLBACK)TimeProc, (DWORD)pEffect, TIME_ONESHOT);
+            }
+            return Response::NoError;
+
+        case Command::Reset:
+            return ResetEffect();
+    }
+
+    return Response::CommandUnknown;
+}
+
+/// <summary>
+/// Serve the control lane until the VST driver closes it
+/// </summary>
+DWORD WINAPI ControlThreadProc(LPVOID lpParameter)
+{
+    vector<uint8_t> request;
+    vector<uint8_t> reply;
+
+    for (;;)
+    {
+        /// Request: command, request id, payload size, payload
+        uint32_t header[3];
+        if (!controlChannel.Read(header, sizeof(header)))
+        {
+            break;
+        }
+
+        request.resize(header[2]);
+        if (header[2] && !controlChannel.Read(request.data(), header[2]))
+        {
+            break;
+        }
+
+        reply.clear();
+        uint32_t status = ExecuteControlCommand(header[0], request, reply);
+
+        /// Reply: request id, status, payload size, payload
+        uint32_t replyHeader[3] = { header[1], status, (uint32_t)reply.size() };
+        controlChannel.Write(replyHeader, sizeof(replyHeader));
+        if (reply.size())
+        {
+            controlChannel.Write(reply.data(), reply.size());
+        }
+
+        if (!controlChannel.Flush())
+        {
+            break;
+        }
+
+        /// Without a VSTi nothing can be rendered any more, the VST driver notices the broken pipe
+        if (status == Response::CannotReset)
+        {
+            TerminateProcess(GetCurrentProcess(), status);
+        }
+    }
+
+    return 0;
+}
+
+int CALLBACK _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdLine, int nCmdShow)
+{
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+
+    if (argv == NULL || argc < 3 || argc > 4)
+    {
+        return Error::InvalidCommandLineArguments;
+    }
+
+    /// vsthost /replay <capture file> [/max] plays a session captured by the VST driver, at the original or at maximum speed
+    bool replay = _wcsicmp(argv[1], L"/replay") == 0;
+    bool replayMaxSpeed = replay && argc == 4 && _wcsicmp(argv[3], L"/max") == 0;
+
+    /// The path of the VSTi
+    const wchar_t* pluginPath = argv[1];
+
+    if (replay)
+    {
+        if (!captureLog.Open(argv[2]))
+        {
+            return Error::CannotOpenCapture;
+        }
+
+        pluginPath = captureLog.GetHeader()->pluginPath;
+    }
+    else
+    {
+        if (argc != 3)
+        {
+            return Error::InvalidCommandLineArguments;
+        }
+
+        /// Get the checksum from the 3rd argument
+        wchar_t* end_char = 0;
+        unsigned inputChecksum = wcstoul(argv[2], &end_char, 16);
+        if (end_char == argv[2] || *end_char)
+        {
+            return Error::MalformedChecksum;
+        }
+
+        /// Calculate the checksum from the 2nd argument
+        unsigned checksum = 0;
+        end_char = argv[1];
+        while (*end_char)
+        {
+            checksum += (TCHAR)(*end_char++ * 820109);
+        }
+
+        if (inputChecksum != checksum)
+        {
+            return Error::ChecksumMismatch;
+        }
+    }
+
+    InitializeCriticalSection(&effectLock);
+    commandWait.Init(0);
+
+    uint32_t sampleRate = 44100;
+
+    vector<uint8_t> event_batch;
+    vector<float> sample_buffer;
+    //unsigned int samples_buffered = 0;
+
+    null_file = CreateFile(_T("NUL"), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+
+    pipe_in = GetStdHandle(STD_INPUT_HANDLE);
+    pipe_out = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    SetStdHandle(STD_INPUT_HANDLE, null_file);
+    SetStdHandle(STD_OUTPUT_HANDLE, null_file);
+
+    if (replay)
+    {
+        /// The replies go nowhere, shared audio and the control lane cannot be opened and fall back to the pipe
+        replayTransport.Open(&captureLog, !replayMaxSpeed);
+        channel.Attach(&replayTransport);
+    }
+    else
+    {
+        transport.Attach(pipe_in, pipe_out);
+        channel.Attach(&transport);
+    }
+
+    /// Carries information used to load common control classes from the dynamic-link library (DLL).
+    /// This structure is used with the InitCommonControlsEx function.
+    INITCOMMONCONTROLSEX icc{};
+    icc.dwSize = sizeof(icc);
+    icc.dwICC = ICC_WIN95_CLASSES | ICC_COOL_CLASSES | ICC_STANDARD_CLASSES;
+    /// Ensures that the common control DLL (Comctl32.dll) is loaded, and registers specific common control classes from the DLL.
+    /// An application must call this function before creating a common control.
+    if (!InitCommonControlsEx(&icc))
+    {
+        return Error::Comctl32LoadFailed;
+    }
+
+    /// Initializes the COM library on the current thread and identifies the concurrency model as single-thread apartment (STA).
+    if (FAILED(CoInitialize(NULL)))
+    {
+        return Error::ComStaInitializationFailed;
+    }
+
+#ifndef _DEBUG
+    SetUnhandledExceptionFilter(myExceptFilterProc);
+#endif
+
+    size_t dll_name_len = wcslen(pluginPath);
+    dll_dir = (char*)malloc(dll_name_len + 1);
+    wcstombs(dll_dir, pluginPath, dll_name_len);
+    dll_dir[dll_name_len] = '\0';
+    char* slash = strrchr(dll_dir, '\\');
+    *slash = '\0';
+
+    uint32_t code = 0;
+
+    /// Load the VSTi DLL which is passed as the first argument
+    /// "C:\Projects\New\VST\VSTDriver\output\vsthost32.exe" "C:\Program Files (x86)\yamaha_syxg50_vsti\syxg50.dll" 001AF06A (1765482)
+    HMODULE vstiDll = LoadLibraryW(pluginPath);
+    if (!vstiDll)
+    {
+        code = Response::CannotLoadVstiDll;
+        goto exit;
+    }
+
+    pMain = (main_func)GetProcAddress(vstiDll, "VSTPluginMain");
+    if (!pMain)
+    {
+        pMain = (main_func)GetProcAddress(vstiDll, "main");
+        if (!pMain)
+        {
+            pMain = (main_func)GetProcAddress(vstiDll, "MAIN");
+            if (!pMain)
+            {
+                code = Response::CannotGetProcAddress;
+                goto exit;
+            }
+        }
+    }
+
+#if 0
+    MessageBox(GetDesktopWindow(), argv[1], _T("HUUUURRRRRR"), 0);
+#endif
+
+    pEffect = pMain(&audioMaster);
+    if (!pEffect || pEffect->magic != kEffectMagic)
+    {
+        code = Response::NotAVsti;
+        goto exit;
+    }
+
+    pEffect->user = &effectData;
+    pEffect->dispatcher(pEffect, AEffectOpcodes::effOpen, 0, 0, 0, 0);
+
+    if (pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetPlugCategory, 0, 0, 0, 0) != kPlugCategSynth || pEffect->dispatcher(pEffect, AEffectXOpcodes::effCanDo, 0, 0, (void*)"receiveVstMidiEvent", 0) < 1)
+    {
+        code = Response::VstiIsNotAMidiSynth;
+        goto exit;
+    }
+
+    /// <summary>
+    /// The number of VSTi audio outputs
+    /// </summary>
+    uint32_t audioOutputs = min(pEffect->numOutputs, 2);
+
+    {
+        char effectName[VstStringConstants::kVstMaxEffectNameLen] = { 0 };
+        pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetEffectName, 0, 0, &effectName, 0);
+
+        char vendor[VstStringConstants::kVstMaxVendorStrLen] = { 0 };
+        pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetVendorString, 0, 0, &vendor, 0);
+
+        char product[VstStringConstants::kVstMaxProductStrLen] = { 0 };
+        pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetProductString, 0, 0, &product, 0);
+
+        uint32_t vendorVersion = pEffect->dispatcher(pEffect, AEffectXOpcodes::effGetVendorVersion, 0, 0, 0, 0);
+        uint32_t uniqueId = pEffect->uniqueID;
+
+        SendData(Response::NoError);
+        SendData(strlen(effectName));
+        SendData(strlen(vendor));
+        SendData(strlen(product));
+        SendData(vendorVersion);
+        SendData(uniqueId);
+        SendData(audioOutputs);
+
+        SendData(effectName);
+        SendData(vendor);
+        SendData(product);
+    }
+
+    for (;;)
+    {
+        /// Spin for the next render request before the read blocks in the kernel
+        if (sharedAudio.IsOpen() && (capabilities & Capability::SpinWait) && !channel.GetBuffered())
+        {
+            /// The reply has to be on its way before the driver waits for the next one
+            channel.Flush();
+            commandWait.Spin(sharedAudio.GetRequestCount(), renderRequests + 1);
+        }
+        else
+        {
+            commandWait.Spin(NULL, 0);
+        }
+
+        uint32_t command = ReceiveData();
+        commandWait.Finish();
+
+        if (!command)
+        {
+            break;
+        }
+
+        /// The control lane is served while the render pipe waits for the next command
+        EffectLock lock;
+
+        switch (command)
+        {
+            case Command::GetChunkData:
+            {
+                GetChunk(pEffect, chunk);
+
+                SendData(0u);
+                SendData(chunk.size());
+                SendData(chunk);
+            }
+            break;
+
+            case Command::SetChunkData:
+            {
+                uint32_t size = ReceiveData();
+                chunk.resize(size);
+                if (size)
+                {
+                    ReceiveData(chunk.data(), size);
+                }
+
+                SetChunk(pEffect, chunk);
+
+                SendData(0u);
+            }
+            break;
+
+            case Command::HasEditor:
+            {
+                uint32_t hasEditor = pEffect->flags & VstAEffectFlags::effFlagsHasEditor;
+
+                SendData(0u);
+                SendData(hasEditor);
+            }
+            break;
+
+            case Command::DisplayEditorModal:
+            {
+                if (pEffect->flags & VstAEffectFlags::effFlagsHasEditor)
+                {
+                    timeSetEvent(100, 10, (LPTIMECALLBACK)TimeProc, (DWORD)pEffect, TIME_ONESHOT);
+                }
+
+                SendData(0u);
+            }
+            break;
+
+            case Command::SetSampleRate:
+            {
+                uint32_t size = ReceiveData();
+                if (size != sizeof(sampleRate))
+                {
+                    code = Response::CannotSetSampleRate;
+                    goto exit;
+                }
+
+                sampleRate = ReceiveData();
+
+                SendData(0u);
+            }
+            break;
+
+            case Command::Reset:
+            {
+                code = ResetEffect();
+                if (code)
+                {
+                    goto exit;
+                }
+
+                SendData(0u);
+            }
+            break;
+
+            case Command::SendMidiEvent:
+            {
+                uint32_t b = ReceiveData();
+
+                AddMidiEvent((b & 0x7F000000) >> 24, b);
+
+                SendData(0u);
+            }
+            break;
+
+            case Command::SendMidiSystemExclusiveEvent:
+            {
+                uint32_t size = ReceiveData();
+                uint32_t port = size >> 24;
+                size &= 0xFFFFFF;
+
+                MidiEvent* ev = AddSysExEvent(port, size);
+
+                ReceiveData(ev->ev.sysexEvent.sysexDump, size);
+
+                SendData(0u);
+            }
+            break;
+
+            case Command::SetSubBlockSplit:
+            {
+                uint32_t size = ReceiveData();
+                if (size != sizeof(uint32_t))
+                {
+                    code = Response::CannotSetSubBlockSplit;
+                    goto exit;
+                }
+
+                subBlockSplitter.SetMinimumFrames(ReceiveData());
+
+                SendData(0u);
+            }
+            break;
+
+            case Command::StartBackgroundIdle:
+            {
+                uint32_t size = ReceiveData();
+                if (size != sizeof(uint32_t))
+                {
+                    code = Response::CannotStartBackgroundIdle;
+                    goto exit;
+                }
+
+                uint32_t interval = ReceiveData();
+
+                if (!hIdleThread)
+                {
+                    idleSettings.sampleRate = sampleRate;
+                    idleSettings.audioOutputs = audioOutputs;
+                    idleSettings.interval = interval ? interval : 1;
+
+                    hIdleExit = CreateEvent(NULL, TRUE, FALSE, NULL);
+                    hIdleThread = hIdleExit ? CreateThread(NULL, 0, IdleThreadProc, NULL, 0, NULL) : NULL;
+                    if (hIdleThread)
+                    {
+                        SetThreadPriority(hIdleThread, THREAD_PRIORITY_LOWEST);
+                    }
+                }
+
+                SendData(hIdleThread ? 0u : Response::CannotStartBackgroundIdle);
+            }
+            break;
+
+            case Command::SetBlockSize:
+            {
+                uint32_t size = ReceiveData();
+                if (size != sizeof(uint32_t))
+                {
+                    code = Response::CannotSetBlockSize;
+                    goto exit;
+                }
+
+                uint32_t requested = ReceiveData();
+                requested = requested < MIN_BUFFER_SIZE ? MIN_BUFFER_SIZE : requested > BUFFER_SIZE ? BUFFER_SIZE : requested;
+
+                if (requested != blockSize)
+                {
+                    /// Processing started with the previous block size, the next render request starts it again
+                    if (blState.size())
+                    {
+                        pEffect->dispatcher(pEffect, AEffectXOpcodes::effStopProcess, 0, 0, 0, 0);
+                        pEffect->dispatcher(pEffect, AEffectOpcodes::effMainsChanged, 0, 0, 0, 0);
+                        blState.resize(0);
+                    }
+
+                    blockSize = requested;
+                }
+
+                SendData(0u);
+                SendData(blockSize);
+            }
+            break;
+
+            case Command::Negotiate:
+            {
+                /// The protocol version of the VST driver, only the capabilities decide what is used
+                ReceiveData();
+                capabilities = ReceiveData() & SupportedCapabilities;
+
+                SendData(0u);
+                SendData(ProtocolVersion);
+                SendData(capabilities);
+            }
+            break;
+
+            case Command::OpenControlChannel:
+            {
+                std::wstring pipeNames[2];
+                for (std::wstring& pipeName : pipeNames)
+                {
+                    uint32_t size = ReceiveData();
+                    vector<wchar_t> name(size / sizeof(wchar_t) + 1);
+                    if (size)
+                    {
+                        ReceiveData(name.data(), size);
+                    }
+                    pipeName = name.data();
+                }
+
+                if (!hControlThread && controlTransport.Open(pipeNames[0], pipeNames[1]))
+                {
+                    controlChannel.Attach(&controlTransport);
+                    hControlThread = CreateThread(NULL, 0, ControlThreadProc, NULL, 0, NULL);
+                }
+
+                SendData(hControlThread ? 0u : Response::CannotOpenControlChannel);
+            }
+            break;
+
+            case Command::OpenSharedAudio:
+            {
+                uint32_t size = ReceiveData();
+                vector<wchar_t> mappingName(size / sizeof(wchar_t) + 1);
+                if (size)
+                {
+                    ReceiveData(mappingName.data(), size);
+                }
+
+                if (sharedAudio.Open(mappingName.data()) && sharedAudio.GetChannels() == audioOutputs)
+                {
+                    commandWait.Init(sharedAudio.GetHostSpinMicroseconds());
+                    SendData(0u);
+                }
+                else
+                {
+                    sharedAudio.Close();
+                    SendData(Response::CannotOpenSharedAudio);
+                }
+            }
+            break;
+
+            case Command::RenderAudioSamples:
+            {
+                ++renderRequests;
+
+                uint32_t count = ReceiveData();
+
+                /// The MIDI events queued by the driver since the previous render request
+                uint32_t event_batch_size = (capabilities & Capability::EventBatch) ? ReceiveData() : 0;
+                event_batch.resize(event_batch_size);
+                if (event_batch_size)
+                {
+                    ReceiveData(event_batch.data(), event_batch_size);
+                    AddMidiEventBatch(event_batch, count);
+                }
+
+                if (!blState.size())
+                {
+                    StartProcessing(sampleRate, audioOutputs);
+                }
+
+                /// Processing may have been started by the warm-up of the idle thread
+                sample_buffer.resize((blockSize << 1) * audioOutputs);
+
+                /// Without the idle thread the VSTi is warmed up and idled on the render path
+                if (need_idle && !hIdleThread)
+                {
+                    pEffect->dispatcher(pEffect, DECLARE_VST_DEPRECATED(effIdle), 0, 0, 0, 0);
+
+                    if (!idle_started)
+                    {
+                        unsigned idle_run = BUFFER_SIZE * 200;
+
+                        while (idle_run)
+                        {
+                            unsigned sampleFrames = min(idle_run, blockSize);
+
+                            pEffect->processReplacing(pEffect, float_list_in, float_list_out, sampleFrames);
+
+                            pEffect->dispatcher(pEffect, DECLARE_VST_DEPRECATED(effIdle), 0, 0, 0, 0);
+
+                            idle_run -= sampleFrames;
+                        }
+                    }
+                }
+
+                VstEvents* events = NULL;
+
+                if (subBlockSplitter.IsEnabled())
+                {
+                    subBlockSplitter.BeginBlock();
+                }
+                else if (!midiEventPool.IsEmpty())
+                {
+                    events = midiEventPool.GetVstEvents(0);
+                }
+
+                if (events)
+                {
+                    pEffect->dispatcher(pEffect, AEffectXOpcodes::effProcessEvents, 0, 0, events, 0);
+                }
+
+                if (need_idle && !hIdleThread)
+                {
+                    pEffect->dispatcher(pEffect, DECLARE_VST_DEPRECATED(effIdle), 0, 0, 0, 0);
+
+                    if (!idle_started)
+                    {
+                        if (events)
+                        {
+                            pEffect->dispatcher(pEffect, AEffectXOpcodes::effProcessEvents, 0, 0, events, 0);
+                        }
+
+                        idle_started = true;
+                    }
+                }
+
+                if (sharedAudio.IsOpen())
+                {
+                    /// Write the frames straight into the shared audio ring and only report back when they are ready
+                    while (count)
+                    {
+                        unsigned sampleFrames = min(count, blockSize);
+                        if (subBlockSplitter.IsEnabled())
+                        {
+                            sampleFrames = subBlockSplitter.Next(pEffect, sampleFrames);
+                        }
+
+                        pEffect->processReplacing(pEffect, float_list_in, float_list_out, sampleFrames);
+
+                        sharedAudio.Write(float_list_out, sampleFrames);
+
+                        count -= sampleFrames;
+                    }
+
+                    SendData(0u);
+
+                    if (capabilities & Capability::SpinWait)
+                    {
+                        /// The reply has to be on its way before the driver sees the counter
+                        channel.Flush();
+                        sharedAudio.PublishReply();
+                    }
+                }
+                else
+                {
+                    SendData(0u);
+
+                    while (count)
+                    {
+                        unsigned sampleFrames = min(count, blockSize);
+                        if (subBlockSplitter.IsEnabled())
+                        {
+                            sampleFrames = subBlockSplitter.Next(pEffect, sampleFrames);
+                        }
+
+                        pEffect->processReplacing(pEffect, float_list_in, float_list_out, sampleFrames);
+
+                        float* out = sample_buffer.data();
+
+                        if (audioOutputs == 2)
+                        {
+                            for (size_t i = 0; i < sampleFrames; ++i)
+                            {
+                                out[0] = float_out[i];
+                                out[1] = float_out[i + blockSize];
+                                out += 2;
+                            }
+                        }
+                        else
+                        {
+                            for (size_t i = 0; i < sampleFrames; ++i)
+                            {
+                                out[0] = float_out[i];
+                                ++out;
+                            }
+                        }
+
+                        SendData(sample_buffer.data(), sampleFrames * sizeof(float) * audioOutputs);
+
+                        count -= sampleFrames;
+                    }
+                }
+
+                if (subBlockSplitter.IsEnabled())
+                {
+                    subBlockSplitter.EndBlock();
+                }
+
+                midiEventPool.Clear();
+            }
+            break;
+
+            default:
+                code = Response::CommandUnknown;
+                goto exit;
+                break;
+        }
+    }
+
+exit:
+
+    StopIdleThread();
+
+    /// The control lane must not touch the VSTi any more
+    EnterCriticalSection(&effectLock);
+
+    if (pEffect)
+    {
+        if (blState.size())
+        {
+            pEffect->dispatcher(pEffect, AEffectXOpcodes::effStopProcess, 0, 0, 0, 0);
+        }
+
+        pEffect->dispatcher(pEffect, AEffectOpcodes::effClose, 0, 0, 0, 0);
+    }
+
+    midiEventPool.Clear();
+
+    sharedAudio.Close();
+
+    if (vstiDll)
+    {
+        FreeLibrary(vstiDll);
+    }
+
+    CoUninitialize();
+
+    if (dll_dir)
+    {
+        free(dll_dir);
+    }
+
+    if (argv)
+    {
+        LocalFree(argv);
+    }
+
+    SendData(code);
+    channel.Flush();
+
+#ifdef LOG_EXCHANGE
+    {
+        ChannelStatistics statistics;
+        channel.GetStatistics(statistics);
+
+        FILE* f = _tfopen(_T("C:\\temp\\log\\statistics.txt"), _T("w"));
+        _ftprintf(f, _T("WriteFile calls: %llu\nReadFile calls: %llu\nBytes sent: %llu\nBytes received: %llu\nMessages sent: %llu\n"),
+            statistics.sendCalls, statistics.receiveCalls, statistics.bytesSent, statistics.bytesReceived, statistics.messagesSent);
+
+        WaitHistogram histogram;
+        commandWait.GetHistogram(histogram);
+
+        _ftprintf(f, _T("\nCommand waits (spin %u us)\n< us\tspun\tblocked\n"), commandWait.GetSpinMicroseconds());
+        for (uint32_t i = 0; i < WaitHistogram::Buckets; ++i)
+        {
+            _ftprintf(f, _T("%llu\t%llu\t%llu\n"), 1ull << i, histogram.spun[i], histogram.blocked[i]);
+        }
+
+        SplitStatistics splitStatistics;
+        subBlockSplitter.GetStatistics(splitStatistics);
+
+        _ftprintf(f, _T("\nSub-block splits: %llu in %llu blocks\nsplits\tblocks\n"), splitStatistics.splits, splitStatistics.blocks);
+        for (uint32_t i = 0; i < SplitStatistics::Buckets; ++i)
+        {
+            _ftprintf(f, _T("%u\t%llu\n"), i, splitStatistics.splitsPerBlock[i]);
+        }
+        fclose(f);
+    }
+#endif
+
+    if (null_file)
+    {
+        CloseHandle(null_file);
+
+        SetStdHandle(STD_INPUT_HANDLE, pipe_in);
+        SetStdHandle(STD_OUTPUT_HANDLE, pipe_out);
+    }
+
+    return code;
 }
\ No newline at end of file